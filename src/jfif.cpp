@@ -39,16 +39,21 @@
 //     jpeg_extract_header()       -- Extracts jpeg header information (scan, frame, quantisation/huffman tables, DRI)
 //         jpeg_dht()              -- Constructs a Huffman decode structure from huffman table data
 //     jpeg_bitmap_init()          -- Creates space for appropriately sized bitmap and initialises header data
+//     jpeg_decode_scan<POLICY>()  -- Decodes scan data with the run time selected iDCT engine policy
+//         jpeg_dqt_prescale()     -- Applies the engine's prescaling to the quantisation tables
 //
-//   LOOP for each MCU:            -- jpeg_process_jfif() process an MCU at a time until EOI (or error)
+//   LOOP for each MCU:            -- jpeg_decode_scan() processes an MCU at a time until EOI (or error)
 //     jpeg_huff_decode()          -- Gets an adjusted Huffman/RLE decoded amplitude value and ZRLs, or marker or end-of-block
 //         jpeg_dht_lookup()       -- Does huffman lookup on code and extracts amplitude data, or flags a marker
 //             jpeg_get_bits()     -- Gets top bits from barrel shifter and (optionally) removes. Pulls in extra input if needed.
 //             jpeg_amp_adjust()   -- Adjusts decoded huffman decoded amplitude to +/- amplitude value
 //         <dequantise>            -- De-quantisation done in jpeg_huff_decode directly from selected table
-//     jpeg_idct()                 -- Inverse discrete cosine transform (define in jfif_idct base class)
-//     jpeg_ycc_to_rgb()           -- Converts YCbCr to RGB on an MCU
-//     jpeg_bitmap_update()        -- Updates bitmap data buffer with 8x8 RGB values
+//     jpeg_idct[_slow|_float]()   -- Inverse discrete cosine transform (define in jfif_idct base class)
+//     jpeg_band_store()           -- Stores the MCU's blocks in the current band (MCU row) buffer
+//     jpeg_band_complete()        -- At the end of a band (or the band after, when upsampling with vertical context)
+//         jpeg_ycc_to_rgb()       -- Upsamples chroma and converts YCbCr to RGB, for each pixel row of the band (if needed)
+//         jpeg_output_row()       -- Outputs each row to the selected targets, in the selected pixel format
+//             jpeg_bitmap_update() -- Updates bitmap data buffer with each converted row
 //   ENDLOOP
 //   return bitmap pointer
 //
@@ -59,18 +64,22 @@
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <vector>
+#include <algorithm>
 
 #include "jfif_class.h"
 #include "bitmap.h"
 
 // Set the constant values for the internal jfif class tables
-const int jfif::aanscales[DCTSIZE*DCTSIZE]  = JPEG_SCALING_INIT;
 const int jfif::jpeg_inv_zigzag[]           = JPEG_INV_ZIGZAG_MAP;
 const int jfif::jpeg_zigzag[]               = JPEG_ZIGZAG_MAP;
 
 const int jfif::jpeg_adj_neg[]              = JPEG_MAG_ADJUST_NEG;
 const int jfif::jpeg_adj_pos[]              = JPEG_MAG_ADJUST_POS;
 
+// AAN iDCT prescale values for the fast integer iDCT policy
+const int jfif_fast_int_idct_policy::aanscales[DCTSIZE2] = JPEG_SCALING_INIT;
+
 #ifdef JPEG_DEBUG_MODE
 
 //-------------------------------------------------------------
@@ -243,14 +252,14 @@ void jfif::print_DQT(const DQT_raw_t* qptr)
 //
 // Parameters:
 //    sptr:     A pointer to an array of MCU values arranged
-//              in an 8x8 array of integers
+//              in an 8x8 array of 16 bit integers
 //    N:        Number of components in MCU
 //
 // Return value:
 //    None
 //
 
-void jfif::print_MCU(int (*sptr)[JPEG_MCU_ELEMENTS], int N)
+void jfif::print_MCU(int16_t (*sptr)[JPEG_MCU_ELEMENTS], int N)
 {
     using std::cout;
     using std::endl;
@@ -293,1679 +302,4592 @@ void jfif::print_MCU(int (*sptr)[JPEG_MCU_ELEMENTS], int N)
 //
 // Description:
 //
-// Converts MCU with Y*n, Cb, Cr 8x8 data blocks to RGB
-// set of nxn data blocks.
+// Converts one pixel row of a band (MCU row) of Y, Cb, Cr
+// component data to planar RGB, in the band's rgb row buffers,
+// using the colour conversion of the iDCT engine POLICY.
+//
+// Sub-sampled chroma is upsampled in the same pass, just for
+// this row, with nearest neighbour replication or the triangle
+// filter, as selected by the band's upsample_mode. Sub-sampling
+// of up to 2 in each direction is supported (not 4). RGB coded
+// data is simply clipped, in a separate loop, and monochrome
+// data is clipped into the first colour row only.
 //
-// Non-subsampled data is just YCbCr, but can be YYCbCr
-// for vertical or horizontal sub-sampling, or YYYYCbCr if
-// sub-sampled in both directions. Sub-sampling of up to
-// 2 in each direction is supported (not 4). Returned RGB
-// data is 8x8, 16x8 or 16x16 triplet of red, green and blue
-// values, depending on sub-sampling.
+// 4 component data has its C, M and Y rows clipped (CMYK), or
+// colour converted from YCC (YCCK), and the K row then applied
+// to give RGB. For CMYK output, the C, M, Y and K rows are kept
+// in the band's cmyk rows.
 //
 // Parameters:
-//    ptr:      pointer to buffer with YCbCr 8x8 block triplet
-//    optr:     pointer to buffer space for RGB values
-//    Ns:       Number of components in scan
-//    Hi:       Horizontal sub sampling
-//    Vi:       Vertical sub sampling
-//    is_RGB:   3 component data is JPEG RGB data
+//    band:     pointer to band state and buffers
+//    set:      band buffer set to convert
+//    row:      pixel row within the band (0 to 8*Vi-1)
 //
 // Return Value:
 //    None
 //
 
-int jfif::jpeg_ycc_to_rgb(jpeg_nx8x8_block_t ptr, jpeg_rgb_block_t optr, int Ns, int Hi, int Vi, bool is_RGB)
+template <class POLICY>
+void jfif::jpeg_ycc_to_rgb(jpeg_band_t *band, int set, int row)
 {
-    using std::cerr;
-    using std::endl;
+    int      X  = band->X;
+    int16_t *y  = band->comp[set][0] + row*band->y_stride;
 
-    int ny = Hi * Vi;                   // Number of Y components to process
-
-    if (Ns != JPEG_NUM_COLOUR_SCANS)
+    if (band->Ns == 1)
     {
-        cerr << "ERROR: jpeg_ycc_to_rgb() called with no chroma data" << endl;
-        return JPEG_FORMAT_ERROR;
+        jpeg_clip_row(y, band->rgb[0], X);
+        return;
     }
 
-    // For each luminance (Y) value (sub-sampling)...
-    for (int lum_idx = 0; lum_idx < ny; lum_idx++)
+    const int16_t *c[JPEG_SOS_MAX_NS-1];
+
+    // Get a full resolution row of each chroma component
+    for (int cdx = 0; cdx < band->c_planes; cdx++)
     {
-        // Local calculations on lum_idx for optimisation
-        int lum_div_2 = lum_idx >> 1;
-        int lum_mod_2 = lum_idx & 0x1;
+        int16_t *cnear = band->comp[set][cdx+1] + (row / band->Vi)*band->c_stride;
+        int16_t *cup   = band->c_up[cdx];
+
+        // Not sub-sampled, or only vertically with nearest neighbour, so use the row in place
+        if (band->Hi == 1 && (band->Vi == 1 || band->upsample_mode == JPEG_UPSAMPLE_NEAREST))
+        {
+            c[cdx] = cnear;
+            continue;
+        }
 
-        for (int row = 0; row < JPEG_BLOCK_DIMENSION; row++)
+        if (band->upsample_mode == JPEG_UPSAMPLE_NEAREST)
+        {
+            jpeg_upsample_h2_row(cnear, cup, band->c_width);
+        }
+        else if (band->Vi == 1)
+        {
+            jpeg_upsample_h2_tri_row(cnear, cup, band->c_width);
+        }
+        else
         {
-            for (int col = 0; col < JPEG_BLOCK_DIMENSION; col++)
+            // Further chroma row is the one below for odd rows, else the one above
+            int16_t *cfar = cnear + ((row & 1) ? band->c_stride : -band->c_stride);
+
+            if (band->Hi == 2)
+            {
+                jpeg_upsample_h2v2_tri_row(cnear, cfar, cup, band->c_width);
+            }
+            else
             {
-                int r, g, b;
+                jpeg_upsample_v2_tri_row(cnear, cfar, cup, band->c_width, (row & 1) ? 2 : 1);
+            }
+        }
 
-                // Get Y value for this array
-                int Y = ptr[lum_idx][row][col];
+        c[cdx] = cup;
+    }
 
-                // Get chroma values (with sub-sampling indexing)
-                int Cb = ptr[ny]  [row/Vi + (lum_div_2<<2)][col/Hi + (lum_mod_2<<2)];
-                int Cr = ptr[ny+1][row/Vi + (lum_div_2<<2)][col/Hi + (lum_mod_2<<2)];
+    if (band->Ns == JPEG_NUM_CMYK_COLOURS)
+    {
+        const int16_t  *k    = band->k_luma ? band->comp[set][JPEG_NUM_CMYK_COLOURS-1] + row*band->y_stride : c[2];
+        bool            keep = band->cmyk[0] != NULL;
+        uint8_t *const *cmy  = keep ? band->cmyk : band->rgb;
 
-                // If data is already RGB, simply copy from array blocks normally used for YCC data
-                if (is_RGB)
-                {
-                    r = Y;
-                    g = Cb;
-                    b = Cr;
-                }
-                else
-                {
-#ifdef JPEG_DCT_INTEGER
-                    // Do conversion, and clip
-                    r = Y*JPEG_RGB_SCALE + JPEG_RGB_Kr1 * (Cr-128);
-                    g = Y*JPEG_RGB_SCALE - JPEG_RGB_Kg1 * (Cb-128) - JPEG_RGB_Kg2 * (Cr-128);
-                    b = Y*JPEG_RGB_SCALE + JPEG_RGB_Kb1 * (Cb-128);
-
-                    r = JPEG_CLIP((r >> JPEG_RGB_BITS) + ((r & JPEG_RGB_ROUND_MASK) ? 1 : 0));
-                    g = JPEG_CLIP((g >> JPEG_RGB_BITS) + ((g & JPEG_RGB_ROUND_MASK) ? 1 : 0));
-                    b = JPEG_CLIP((b >> JPEG_RGB_BITS) + ((b & JPEG_RGB_ROUND_MASK) ? 1 : 0));
-#else
-                    r = JPEG_CLIP(JPEG_ROUND((double)Y + JPEG_RGB_Kr1 * (double)(Cr-128)));
-                    g = JPEG_CLIP(JPEG_ROUND((double)Y - JPEG_RGB_Kg1 * (double)(Cb-128) - JPEG_RGB_Kg2 * (double)(Cr-128)));
-                    b = JPEG_CLIP(JPEG_ROUND((double)Y + JPEG_RGB_Kb1 * (double)(Cb-128)));
-#endif
-                }
+        jpeg_clip_row(k, band->cmyk[JPEG_NUM_CMYK_COLOURS-1], X);
 
-                // Calculate destination row and column indexes, with special case
-                // of Vertical, but no horizontal sub-sampling
-                int col_idx = (Vi == 2 && Hi == 1) ? col+(lum_div_2<<3) : col+(lum_mod_2<<3);
-                int row_idx = (Vi == 2 && Hi == 1) ? row+(lum_mod_2<<3) : row+(lum_div_2<<3);
+        if (band->is_RGB)
+        {
+            jpeg_clip_row(y,    cmy[0], X);
+            jpeg_clip_row(c[0], cmy[1], X);
+            jpeg_clip_row(c[1], cmy[2], X);
+        }
+        else
+        {
+            POLICY::ycc_to_rgb_row(y, c[0], c[1], cmy[0], cmy[1], cmy[2], X);
+        }
 
-                // Update buffer with RGB values
-                optr[0][row_idx][col_idx] = r;
-                optr[1][row_idx][col_idx] = g;
-                optr[2][row_idx][col_idx] = b;
+        // YCC converted rows are inverted to C, M and Y when kept, else inverted as K applied
+        for (int cdx = 0; cdx < JPEG_NUM_RGB_COLOURS; cdx++)
+        {
+            if (keep && !band->is_RGB)
+            {
+                jpeg_invert_row(cmy[cdx], X);
             }
+
+            jpeg_cmyk_to_rgb_row(cmy[cdx], band->cmyk[JPEG_NUM_CMYK_COLOURS-1], band->rgb[cdx], X, !keep && !band->is_RGB);
         }
     }
-
-    return JPEG_NO_ERROR;
+    // If data is already RGB, simply clip the components normally used for YCC data
+    else if (band->is_RGB)
+    {
+        jpeg_clip_row(y,    band->rgb[0], X);
+        jpeg_clip_row(c[0], band->rgb[1], X);
+        jpeg_clip_row(c[1], band->rgb[2], X);
+    }
+    else
+    {
+        POLICY::ycc_to_rgb_row(y, c[0], c[1], band->rgb[0], band->rgb[1], band->rgb[2], X);
+    }
 }
 
 //-------------------------------------------------------------
-// jpeg_amp_adjust()
+// jpeg_band_store()
 //
 // Description:
 //
-// Takes a Huffman decode amplitude value and returns the +/-
-// adjusted value (as per ITU.T81 Table F.1 and Table F.2)
+// Copies the iDCT output blocks of an MCU into the current band
+// buffer set, at the MCU's column position. Y blocks are in
+// raster order within the MCU, as are the K blocks of 4 component
+// data when K is sampled as luma.
+//
+// When resizing with a reduced block size (bs), each block's
+// bs by bs samples from the reduced iDCT (in the block's top left
+// corner) are stored, or for a block size of 1 the sample is taken
+// from the block's DC coefficient alone, with no iDCT.
 //
 // Parameters:
-//    value:    Unadjusted decoded amplitude value (0 - 2047)
-//    size:     Size of bit width for decoded value (0 - 11)
+//    band:     pointer to band state and buffers
+//    sptr:     pointer to MCU's 8x8 blocks (Y*n [Cb Cr [K*n]]), of
+//              de-quantised DC coefficients only, for a block size of 1
+//    mcu_col:  the MCU's column position
 //
 // Return value:
-//    Adjusted value (range -2047 to 2047)
+//    None
 //
 
-int jfif::jpeg_amp_adjust (int value, int size)
+void jfif::jpeg_band_store (jpeg_band_t *band, int16_t (*sptr)[JPEG_MCU_ELEMENTS], int mcu_col)
 {
+    int ny = band->Hi * band->Vi;
+    int nc = ny + band->c_planes;
+    int bs = band->bs;
 
-    if (size == 0)
+    for (int blk = 0; blk < nc + (band->k_luma ? ny : 0); blk++)
     {
-        return 0;
-    }
+        int16_t *dst;
+        int      stride;
 
-    // Top bit selects positive or negative table
-    int top_bit         = value & (1 << (size-1));
+        // Luma sampled blocks, of Y or K
+        if (blk < ny || blk >= nc)
+        {
+            int plane = (blk < ny) ? 0   : JPEG_NUM_CMYK_COLOURS-1;
+            int lblk  = (blk < ny) ? blk : blk - nc;
 
-    // Rest of bits are offset from table
-    int bottom_bit_mask = (1 << (size-1))-1;
+            stride = band->y_stride;
+            dst    = band->comp[band->set][plane] + (lblk / band->Hi)*bs*stride + (mcu_col*band->Hi + (lblk % band->Hi))*bs;
+        }
+        else
+        {
+            stride = band->c_stride;
+            dst    = band->comp[band->set][blk-ny+1] + mcu_col*bs;
+        }
 
-    // Return value
-    return (top_bit ? jpeg_adj_pos[size] : jpeg_adj_neg[size]) + (value & bottom_bit_mask);
+        if (bs == 1)
+        {
+            // The block's mean is its DC coefficient / 8, level shifted
+            *dst = JPEG_CLIP(JPEG_CHROMA_NEUTRAL + ((sptr[blk][0] + 4) >> 3));
+        }
+        else
+        {
+            for (int row = 0; row < bs; row++)
+            {
+                memcpy(&dst[row*stride], &sptr[blk][row*JPEG_BLOCK_DIMENSION], bs*sizeof(int16_t));
+            }
+        }
+    }
 }
 
 //-------------------------------------------------------------
-// jpeg_get_bits()
+// jpeg_band_clear()
 //
 // Description:
 //
-// Returns top 'n' bits from a barrel shifter. If insufficient
-// bits available, data is pulled from input buffer onto barrel
-// until enough available. The barrel state and barrel bit count
-// is maintained by function. In addition, it manages padded
-// special byte (0xFF00), stripping the 0x00 byte, and also
-// detects (but not decode) markers (0xFFnn - where nn is 1 to 255).
+// Sets the current band buffer set to black from an MCU column
+// position to the end of the band, for the MCUs of a band a
+// truncated scan ended before decoding, so none of the previous
+// band's samples are output in their place. Y (and any K, as
+// full ink for the inverted Adobe data) is set to 0, and chroma
+// to neutral, or to 0 for JPEG RGB and CMYK data.
 //
 // Parameters:
-//      n:              number of bits required from top of barrel
-//      buf:            pointer to input buffer
-//      idx:            pointer to current input byte in buf (updated)
-//      barrel:         pointer to barrel shifter (updated)
-//      bit_count:      Pointer to bit count of bits on barrel (updated)
-//      remove_bits:    Control to return bits without updating bit_count
-//                      for removal of n bits (still updated for any input
-//                      byte added).
+//    band:     pointer to band state and buffers
+//    mcu_col:  the first undecoded MCU's column position in the band
 //
 // Return value:
-//      0xFFFFmmmm      - if top bits set, bottom mmmm bits contain marker value.
-//      0x0000nnnn      - else returned n bits of barrel top
+//    None
 //
 
-int jfif::jpeg_get_bits(int n, uint8_t *buf, int *idx, uint32_t *barrel, int *bit_count, bool remove_bits)
+void jfif::jpeg_band_clear (jpeg_band_t *band, int mcu_col)
 {
-    int rtn_value;
+    // MCUs in the band, from the luma stride (less its padding)
+    int band_mcus = (band->y_stride - 2*JPEG_BAND_PAD_COLS) / (band->Hi*band->bs);
 
-    // Update barrel to have enough bits for requested width
-    while (*bit_count < n)
+    for (int cdx = 0; cdx < band->Ns; cdx++)
     {
-        // Hit a marker
-        if (buf[*idx] == JPEG_MARKER_BYTE && buf[*idx+1] != 0x00)
+        // Luma sampled planes (Y, and any luma sampled K), else chroma sampled
+        bool    luma   = cdx == 0 || (cdx == JPEG_NUM_CMYK_COLOURS-1 && band->k_luma);
+        int     stride = luma ? band->y_stride : band->c_stride;
+        int     width  = luma ? band->Hi*band->bs : band->bs;
+        int     rows   = luma ? band->Vi*band->bs : band->bs;
+        int16_t black  = (cdx == 0 || cdx == JPEG_NUM_CMYK_COLOURS-1 || band->is_RGB) ? 0 : JPEG_CHROMA_NEUTRAL;
+
+        for (int row = 0; row < rows; row++)
         {
-            // Flush the barrel shifter
-            *bit_count = 0;
-
-            // Return the marker in lieu of a codeword (tagged in upper bits to make negative)
-            rtn_value = (int)((buf[*idx] << 8) | buf[*idx+1] | JPEG_MARKER_FLAG);
+            int16_t *plane = band->comp[band->set][cdx] + row*stride;
 
-            // Skip over the marker
-            *idx += 2;
-
-            return rtn_value;
+            std::fill(plane + mcu_col*width, plane + band_mcus*width, black);
         }
+    }
+}
 
-        // Add a byte to bottom of the barrel
-        *barrel = (*barrel << 8) | (uint32_t)buf[*idx];
-        *bit_count += 8;
-
-        // Detect padded byte and remove
-        if (buf[*idx] == 0xff && buf[*idx+1] == 0x00)
-        {
-            *idx += 1;
-        }
+//-------------------------------------------------------------
+// jpeg_band_context()
+//
+// Description:
+//
+// Fills in the chroma edge context of a band for triangle filter
+// upsampling, replicating the samples at the right hand edge of
+// the image's chroma data into the column beyond, and the left
+// edge into column -1. If the band contains the last chroma row
+// of the image, that is replicated into the row below. A chroma
+// sampled K is treated as chroma.
+//
+// Parameters:
+//    band:     pointer to band state and buffers
+//    set:      band buffer set
+//    band_row: the band's MCU row position
+//
+// Return value:
+//    None
+//
 
-        // Update inout buffer index for added byte
-        *idx += 1;
+void jfif::jpeg_band_context (jpeg_band_t *band, int set, int band_row)
+{
+    if (band->Ns == 1 || band->upsample_mode != JPEG_UPSAMPLE_TRIANGLE)
+    {
+        return;
     }
 
-    // Get top n bits from barrel
-    rtn_value = (*barrel >> (*bit_count - n)) & ((1U << n) - 1U) ;
+    int cw   = band->c_width;
+    int cs   = band->c_stride;
+    int bs   = band->bs;
+    int last = band->c_height - 1 - band_row*bs;
 
-    // Only remove bits from barrel if enabled
-    if (remove_bits)
+    for (int cdx = 1; cdx <= band->c_planes; cdx++)
     {
-        *bit_count -= n;
-    }
+        int16_t *plane = band->comp[set][cdx];
 
-    return rtn_value;
+        for (int row = 0; row < bs; row++)
+        {
+            plane[row*cs - 1]  = plane[row*cs];
+            plane[row*cs + cw] = plane[row*cs + cw - 1];
+        }
+
+        if (last >= 0 && last < bs)
+        {
+            memcpy(&plane[(last+1)*cs - JPEG_BAND_PAD_COLS], &plane[last*cs - JPEG_BAND_PAD_COLS], cs*sizeof(int16_t));
+        }
+    }
 }
 
 //-------------------------------------------------------------
-// jpeg_dht()
+// jpeg_output_yuv_row()
 //
 // Description:
 //
-// Construct a Huffman data decode structure from JPEG DHT
-// segment on a buffer. Space is dynamically created for the
-// decode structure, and a pointer returned (or NULL on error)
+// Outputs a pixel row of a band in planar YUV (I420 or NV12),
+// straight from the band's decoded components, with no colour
+// conversion. The luma row is clipped to 8 bits, and on even rows
+// the row of chroma for the row pair is generated, from the
+// chroma planes at the JPEG's sub-sampling: copied for 4:2:0,
+// and averaged over 2 rows, 2 columns or both for 4:2:2, 4:4:0
+// and 4:4:4. Monochrome data has neutral (128) chroma.
 //
-// The information required for huffman decode is created here.
-// For each bit-width length Ln a, value (current_prefix, reset to 0)
-// is shifted right and Ln added. This number is then stored for
-// the bit-width. The stored numbers are then the upper bound (+1) for
-// that bit-width's values, and the previous value shited right 1
-// is the lower bound. To look up a value, the code is checked to be
-// less than the upper bound for the bit width, and the offset into
-// that widths values is the code minus lower bound. The offsets
-// into the Vmn data are stored with each bit width as well.
+// The row is written to the raw buffer's planes, unless a sink
+// is selected, when it is built contiguously (luma then chroma)
+// in the band's row buffer, passed to the sink, and any raw
+// buffer copied from it.
 //
 // Parameters:
-//    dht:              pointer to a byte buffer containing JPEG DHT segment
-//    decode_ptr:       pointer to a DHT table pointer, for returning decode table data
-//                      if NULL, or as preallocated space to use otherwise.
+//    band:     pointer to band state and buffers
+//    set:      band buffer set
+//    row:      pixel row within the band
+//    y_pos:    the row's position in the output (image or crop)
 //
 // Return value:
-//    DHT_offsets_t structure pointer containing decode data or
-//    NULL if an error occurred.
+//    None
 //
 
-DHT_offsets_t* jfif::jpeg_dht(uint8_t *dht, DHT_offsets_t* decode_ptr)
+void jfif::jpeg_output_yuv_row (jpeg_band_t *band, int set, int row, int y_pos)
 {
-    using std::cout;
-    using std::cerr;
-    using std::dec;
-    using std::hex;
-    using std::setw;
-    using std::setfill;
-    using std::endl;
+    int  X      = band->out_w;
+    int  cw     = (X + 1) / 2;
+    int  ch     = (band->raw_rows + 1) / 2;
+    bool chroma = !(y_pos & 1);
+    bool nv12   = band->pixel_format == JPEG_PIXFMT_NV12;
+
+    // Raw buffer plane positions for the row, with chroma rows at half the luma stride
+    long     stride  = band->raw_stride;
+    long     cstride = (stride + 1) / 2;
+    int      raw_row = y_pos - band->raw_y0;
+    uint8_t *raw_y   = NULL;
+    uint8_t *raw_c   = NULL;
+
+    if (band->raw != NULL)
+    {
+        raw_y = &band->raw[raw_row*stride];
+        raw_c = &band->raw[band->raw_rows*stride + (raw_row/2)*(nv12 ? 2*cstride : cstride)];
+    }
 
-    DHT_offsets_t* rtnptr;
-    DHT_offsets_t* ptr;
+    uint8_t *yptr = (band->sink != NULL) ? band->row     : raw_y;
+    uint8_t *cptr = (band->sink != NULL) ? band->row + X : raw_c;
 
-#ifdef JPEG_DEBUG_MODE
-    char strbuf[JPEG_DEFAULT_STR_SIZE];
-    int  map_array     [JPEG_DHT_MAX_TABLES][JPEG_DHT_MAX_VALUES], *map;
-    int  codelen_array [JPEG_DHT_MAX_TABLES][JPEG_DHT_MAX_VALUES], *codelen;
-#endif
+    jpeg_clip_row(band->comp[set][0] + row*band->y_stride + band->out_x, yptr, X);
 
+    if (chroma)
+    {
+        // Cb and Cr rows, straight to I420 planes, or via the (free) RGB row buffers for NV12
+        uint8_t *c[JPEG_NUM_COLOUR_SCANS-1];
 
-    // Allocate some initialised space for the DHT pointers, if none already
-    if (decode_ptr == NULL) {
+        c[0] = nv12 ? band->rgb[1] : cptr;
+        c[1] = nv12 ? band->rgb[2] : ((band->sink != NULL) ? cptr + cw : cptr + cstride*ch);
 
-        try
+        for (int cdx = 0; cdx < JPEG_NUM_COLOUR_SCANS-1; cdx++)
         {
-            rtnptr = new DHT_offsets_t[JPEG_DHT_MAX_TABLES]();
+            if (band->Ns == 1)
+            {
+                memset(c[cdx], JPEG_CHROMA_NEUTRAL, cw);
+            }
+            else
+            {
+                // Chroma rows covering this row and the next (output X offset is even)
+                const int16_t *plane = band->comp[set][cdx+1] + band->out_x/band->Hi;
+                const int16_t *r0    = plane + ((band->Vi == 1) ? row : row/2)*band->c_stride;
+                const int16_t *r1    = (band->Vi == 1) ? r0 + band->c_stride : r0;
+
+                jpeg_downsample_row(r0, r1, c[cdx], cw, (band->Hi == 1) ? 2 : 1);
+            }
         }
-        catch(std::bad_alloc &ba)
+
+        if (nv12)
         {
-            cerr << "ERROR: jpeg_dht(): memory allocation failed: " << ba.what() << endl;
-            return (DHT_offsets_t*) NULL;
+            jpeg_interleave2_row(c[0], c[1], cptr, cw);
         }
     }
-    else
+
+    if (band->sink != NULL)
     {
-        rtnptr = decode_ptr;
+        band->sink(band->sink_ctx, y_pos, band->row, X);
+
+        if (band->raw != NULL)
+        {
+            memcpy(raw_y, yptr, X);
+
+            if (chroma && nv12)
+            {
+                memcpy(raw_c, cptr, 2*cw);
+            }
+            else if (chroma)
+            {
+                memcpy(raw_c,              cptr,      cw);
+                memcpy(raw_c + cstride*ch, cptr + cw, cw);
+            }
+        }
     }
+}
 
-    // Extract DHT segment length
-    int length = (dht[0] << 8) | dht[1];
+//-------------------------------------------------------------
+// jpeg_output_cmyk_row()
+//
+// Description:
+//
+// Outputs a pixel row of 4 component data in planar CMYK, from
+// the band's cmyk rows (YCCK already converted to C, M and Y),
+// as coded, so inverted for Adobe CMYK. The row is written to the
+// raw buffer's C, M, Y and K planes, and when a sink is selected
+// is built contiguously (C, M, Y then K) in the band's row buffer,
+// and passed to the sink.
+//
+// Parameters:
+//    band:     pointer to band state and buffers
+//    y_pos:    the row's position in the output (image or crop)
+//
+// Return value:
+//    None
+//
 
-    // Point to start of DHT payload
-    int offset = JPEG_DHT_PAYLOAD_OFFSET;
+void jfif::jpeg_output_cmyk_row (jpeg_band_t *band, int y_pos)
+{
+    int      X     = band->out_w;
+    long     plane = (long)band->raw_rows * band->raw_stride;
+    uint8_t *raw   = (band->raw != NULL) ? &band->raw[(long)(y_pos - band->raw_y0)*band->raw_stride] : NULL;
 
-#ifdef JPEG_DEBUG_MODE
-    if (debug_enable & JPEG_DEBUG_DHT_EN)
+    for (int cdx = 0; cdx < JPEG_NUM_CMYK_COLOURS; cdx++)
     {
-        cout << "  length: " << length << endl;
+        const uint8_t *src = band->cmyk[cdx] + band->out_x;
+
+        if (raw != NULL)
+        {
+            memcpy(raw + cdx*plane, src, X);
+        }
+
+        if (band->sink != NULL)
+        {
+            memcpy(band->row + cdx*X, src, X);
+        }
     }
 
-    // Initialise maps to mark as invalid (not all may be present)
-    for (int idx = 0; idx < JPEG_DHT_MAX_TABLES; idx++)
+    if (band->sink != NULL)
     {
-        map_array[idx][0] = JPEG_INVALID;
+        band->sink(band->sink_ctx, y_pos, band->row, X);
     }
-#endif
+}
 
-    while (offset < length) {
+//-------------------------------------------------------------
+// jpeg_output_row()
+//
+// Description:
+//
+// Sends a pixel row to each of the selected output targets. The
+// bitmap, and the raw buffer and sink in RGB based formats, are
+// generated from the band's colour converted rgb row buffers,
+// whilst gray (of YCbCr data) and planar YUV formats take the
+// row straight from the band's decoded components, and planar
+// CMYK from the band's cmyk rows. When resizing, all the targets
+// are generated from the resampler's output row.
+//
+// Parameters:
+//    band:     pointer to band state and buffers
+//    set:      band buffer set
+//    row:      pixel row within the band
+//    y_pos:    the row's position in the output (image or crop)
+//
+// Return value:
+//    None
+//
 
-        int current_prefix = 0;
+void jfif::jpeg_output_row (jpeg_band_t *band, int set, int row, int y_pos)
+{
+    int X = band->out_w;
 
-        // Get combined Tc/Th index
-        int Tch = (((dht[offset] >> 4) & JPEG_NIBBLE_MASK) ? 2 : 0) | ((dht[offset] & 0xf) ? 1 : 0) ;
+    // RGB rows from the resampler when resizing. When monochrome, all colour values the same.
+    uint8_t *const *rgb = (band->rs != NULL) ? band->rs->out : band->rgb;
+    int             x0  = (band->rs != NULL) ? 0 : band->out_x;
 
-        // Point to the appropriate Tc/Th table
-        ptr = rtnptr + Tch;
+    const uint8_t *r = rgb[0] + x0;
+    const uint8_t *g = ((band->Ns == 1) ? rgb[0] : rgb[1]) + x0;
+    const uint8_t *b = ((band->Ns == 1) ? rgb[0] : rgb[2]) + x0;
 
-        ptr->Tc = (dht[offset] >> 4) & JPEG_NIBBLE_MASK;
-        ptr->Th = (dht[offset] >> 0) & JPEG_NIBBLE_MASK;
+    // Bitmap row, for a bitmap sink at the row's position in the band buffer (top-down)
+    if (band->bmp_data != NULL)
+    {
+        bool top_down = band->bmp_sink != NULL;
+        int  bmp_row  = top_down ? y_pos - band->bmp_y0 : y_pos;
 
-#ifdef JPEG_DEBUG_MODE
-        if (debug_enable & JPEG_DEBUG_DHT_EN)
+        if (band->bmp_bits == 8 && band->rs != NULL)
         {
-            cout << "  Tc    : " << (int)ptr->Tc << endl;
-            cout << "  Th    : " << (int)ptr->Th << endl;
+            jpeg_bitmap_gray_update(r, bmp_row, band->bmp_data, X, band->out_h, top_down);
         }
-#endif
+        else if (band->bmp_bits == 8)
+        {
+            jpeg_bitmap_gray_update(band->comp[set][0] + row*band->y_stride + band->out_x, bmp_row, band->bmp_data,
+                                    X, band->out_h, top_down);
+        }
+        else
+        {
+            jpeg_bitmap_update(r, g, b, bmp_row, band->bmp_data, X, band->out_h, top_down);
+        }
+    }
 
-        // Skip past Tc/Th byte
-        offset++;
+    // Tensor row, normalised from the RGB row
+    if (band->tensor != NULL)
+    {
+        long esize = (band->tensor_type == JPEG_TENSOR_FLOAT32) ? 4 : 2;
+        long plane = (long)X * band->out_h * esize;
+        bool nchw  = band->tensor_layout == JPEG_TENSOR_NCHW;
 
-        // Point to (Tc,Th) tables indicated
-        ptr->Ln = &dht[offset];
+        jpeg_tensor_row(r, g, b, &band->tensor[(long)y_pos * X * (nchw ? 1 : JPEG_NUM_RGB_COLOURS) * esize],
+                        nchw ? plane : 0, X, band->tensor_scale, band->tensor_offset, band->tensor_type);
+    }
 
-#ifdef JPEG_DEBUG_MODE
-        map     = map_array[Tch];
-        codelen = codelen_array[Tch];
-        for (int idx = 0; idx < JPEG_DHT_MAX_VALUES; idx++)
+    if (band->pixel_format == JPEG_PIXFMT_I420 || band->pixel_format == JPEG_PIXFMT_NV12)
+    {
+        if (band->raw != NULL || band->sink != NULL)
         {
-            codelen[idx] = map[idx] = 0;
+            jpeg_output_yuv_row(band, set, row, y_pos);
         }
-#endif
-
-#ifdef JPEG_DEBUG_MODE
-        // Print the length values for each bit length for this table
-        if (debug_enable & JPEG_DEBUG_DHT_EN)
+    }
+    else if (band->pixel_format == JPEG_PIXFMT_CMYK)
+    {
+        if (band->raw != NULL || band->sink != NULL)
         {
-            for (int bit_length = 1; bit_length <= JPEG_DHT_MAX_BITS; bit_length++)
-            {
-                cout << "  L" << setfill('0') << dec << setw(2) << bit_length << "  : " << (int)ptr->Ln[bit_length-1] << endl;
-            }
+            jpeg_output_cmyk_row(band, y_pos);
         }
-#endif
-
-        // Skip past lengths
-        offset += JPEG_DHT_MAX_BITS;
+    }
+    // Packed row, either directly in the raw buffer, or for the sink
+    else if (band->raw != NULL || band->sink != NULL)
+    {
+        uint8_t *rptr = (band->raw != NULL) ? &band->raw[(long)(y_pos - band->raw_y0)*band->raw_stride] : band->row;
 
-        // Construct the code/byte mapping table for each bit length
-        for (int bit_length = 1; bit_length <= JPEG_DHT_MAX_BITS; bit_length++)
+        switch (band->pixel_format)
         {
-            // Process any valid codes for this bit length
-            if (ptr->Ln[bit_length-1])
-            {
-                // Store locations of the Vmn codes for each bit length with values
-                // (this can't be zero---the initialised memory value)
-                ptr->vmn_offset[bit_length-1] = &dht[offset];
+        case JPEG_PIXFMT_RGBA32:
+            jpeg_interleave4_row(r, g, b, rptr, X);
+            break;
 
-#ifdef JPEG_DEBUG_MODE
-                // Print the Vm,n values
-                if (debug_enable & JPEG_DEBUG_DHT_EN)
-                {
-                    for (int jdx = 0; jdx < ptr->Ln[bit_length-1]; jdx++)
-                    {
-                        cout << "    V" << dec << bit_length << "," << jdx << " = " << hex << setw(2) << (int)dht[offset+jdx] << endl;
-                    }
-#endif
+        case JPEG_PIXFMT_BGRA32:
+            jpeg_interleave4_row(b, g, r, rptr, X);
+            break;
 
-                // Add code to map table
-#ifdef JPEG_DEBUG_MODE
-                for (int jdx = 0; jdx < ptr->Ln[bit_length-1]; jdx++)
-                {
-                    map[dht[offset+jdx]] = current_prefix;
-                    codelen[dht[offset+jdx]] = bit_length;
-                    current_prefix++;
-                }
-#else
-                current_prefix += ptr->Ln[bit_length-1];
-#endif
-                // Skip over values for this bit width
-                offset += ptr->Ln[bit_length-1];
-            }
+        case JPEG_PIXFMT_RGB565:
+            jpeg_pack_rgb565_row(r, g, b, rptr, X);
+            break;
 
-            // Remember the first unused code for this bit width
-            ptr->row_break_codes[bit_length-1] = current_prefix;
+        case JPEG_PIXFMT_GRAY8:
+            if (band->rs != NULL && band->Ns == 1)
+            {
+                memcpy(rptr, r, X);
+            }
+            else if (band->rs != NULL || (band->Ns != 1 && (band->is_RGB || band->Ns == JPEG_NUM_CMYK_COLOURS)))
+            {
+                jpeg_rgb_to_gray_row(r, g, b, rptr, X);
+            }
+            else
+            {
+                jpeg_clip_row(band->comp[set][0] + row*band->y_stride + band->out_x, rptr, X);
+            }
+            break;
 
-            // Tail code becomes current prefix shifted left for next bit width row
-            current_prefix <<= 1;
+        default:
+            jpeg_interleave_row(r, g, b, rptr, X);
+            break;
         }
 
-#ifdef JPEG_DEBUG_MODE
-        // Print out the mapping table
-        if (debug_enable & JPEG_DEBUG_DHT_EN)
+        if (band->sink != NULL)
         {
-            cout << "Table " << ((Tch >> 1) & 1) << "," << (Tch & 1) << endl;
-
-            for (int idx = 0; idx < JPEG_DHT_MAX_VALUES; idx++)
-            {
-                if (codelen[idx])
-                {
-                    setfill('0');
-                    cout << "  "  << dec << setw(3) << idx << " (0x" << hex << setw(2) << idx << ")";
-                    cout << " = (" << hex << setw(4) << (int)map[idx] << ") " << int2binstr(strbuf, map[idx], codelen[idx]) << endl;
-                }
-            }
+            band->sink(band->sink_ctx, y_pos, rptr, X);
         }
-#endif
-
     }
 
-    return rtnptr;
+    band->rows_out = y_pos + 1;
 }
 
 //-------------------------------------------------------------
-// jpeg_dht_lookup()
+// jpeg_resize_row()
 //
 // Description:
 //
-// Gets an adjusted Huffman/RLE decoded amplitude value from
-// the input buffer bit stream (via a barrel shifter) for
-// either DC or AC data. Flags encountering a marker, an EOB
-// or ZRL.
+// Passes a colour converted pixel row of a band through the
+// resampler, when resizing. The row is resampled horizontally,
+// and accumulated into each output row it covers, with the
+// fraction of the output row it covers as its weight. Each output
+// row completed is sent to the output targets.
 //
 // Parameters:
-//    dht_ptr:          pointer to Huffman decode data
-//    is_DC:            flags if required code is for DC (true) or not (false)
-//    T:                defines huffman table ID (0 or 1 for baseline DCT)
-//    buf:              input data buffer pointer
-//    idx:              pointer to current offset index into input buffer (updated)
-//    barrel:           pointer to barrel shifter (updated)
-//    bit_count:        Pointer to bit count of bits on barrel (updated)
+//    band:     pointer to band state and buffers
+//    set:      band buffer set
+//    row:      pixel row within the band
 //
 // Return value:
-//    Returns a structure with either a decoded amplitude value and
-//    zero run length, or flags for marker/boundary state. The structure
-//    has the following fields:
-//        marker:       Returning a marker if > 0 (is 0xmmmm, where mmmm is marker value)
-//        is_EOB:       Hit EOB (if marker 0)
-//        is_ZRL:       Hit ZRL (if marker 0)
-//        ZRL:          Zero run length (if marker == 0 and is_EOB false)
-//        amplitude:    amplitude value if ZRL < 16 and if marker == 0 and is_EOB is false
+//    None
 //
 
-rle_amplitude_t jfif::jpeg_dht_lookup(DHT_offsets_t* dht_ptr, bool is_DC, int T, uint8_t *buf, int *idx, uint32_t *barrel, int *bit_count)
+void jfif::jpeg_resize_row (jpeg_band_t *band, int set, int row)
 {
-    using std::cout;
-    using std::cerr;
-    using std::hex;
-    using std::setw;
-    using std::endl;
-
-    int             value;
-    rle_amplitude_t rval;
-    DHT_offsets_t*  dht;
+    jpeg_resize_t *rs   = band->rs;
+    int            nrgb = (band->Ns == 1) ? 1 : JPEG_NUM_RGB_COLOURS;
 
-    // Lookup which DHT table to use (don't assume any ordering)
-    for (int table = 0; table < JPEG_DHT_MAX_TABLES; table++)
+    for (int cdx = 0; cdx < nrgb; cdx++)
     {
-        dht = dht_ptr + table;
-
-        // Once the table is found, stop looking
-        if ((is_DC && dht->Tc == JPEG_DHT_DC_CLASS && T == dht->Th) ||
-           (!is_DC && dht->Tc == JPEG_DHT_AC_CLASS && T == dht->Th))
-        {
-            break;
-        }
+        jpeg_resample_h_row(band->rgb[cdx] + band->out_x, rs->h_row[cdx], rs->out_w, rs->x_start, rs->x_weight, rs->taps);
     }
 
-    // Check for smallest matching code.
-    // (In hardware, could match all available bit widths simultaneously, and
-    // use a priority encoder to match to the smallest width, in case of multi-match
-    // [is that possible?])
-    for (int bit_width = 1; bit_width <= JPEG_DHT_MAX_BITS; bit_width++)
+    // Source row's span, in units of 1/(in_h*out_h) of the image height
+    long in_start = (long)rs->in_row * rs->out_h;
+    long in_end   = in_start + rs->out_h;
+
+    while (rs->out_row < rs->out_h)
     {
-        int code;
+        long out_start = (long)rs->out_row * rs->in_h;
+        long out_end   = out_start + rs->in_h;
+        long seg_start = std::max(in_start, out_start);
+        long seg_end   = std::min(in_end,   out_end);
 
-        // Get next code of 'bit_width' width from input stream
-        if ((code = jpeg_get_bits(bit_width, buf, idx, barrel, bit_count, false)) < 0)
-        {
-            // Returned code was a marker, so strip top marker indicator bits and return
-            rval.marker = code & 0xffff;
-            return rval;
+        int weight = JPEG_RESIZE_WEIGHT(seg_end - out_start, rs->in_h) - JPEG_RESIZE_WEIGHT(seg_start - out_start, rs->in_h);
 
-        // Not a marker, so check if there is a match for this bit width.
-        // This is just code being less than row_break_code (and Ln not 0)
-        }
-        else if (dht->Ln[bit_width-1] && (code < dht->row_break_codes[bit_width-1]))
+        for (int cdx = 0; cdx < nrgb; cdx++)
         {
-            // Code to retrieve is "extracted code - previous width's break code<<1"
-            // from beginning of vmn bytes for this width
-            value = dht->vmn_offset[bit_width-1][code - ((bit_width == 1) ? 0 : (dht->row_break_codes[bit_width-2] << 1))];
-
-            // Remove these extracted bits from the barrel shifter and finish loop
-            *bit_count -= bit_width;
-
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_HUFF_DECODE)
-            {
-                cout << "code=0x" << hex << setw(4) << (int)code << " : value=0x" << hex << setw(4) << (int)value << endl;
-            }
-#endif
+            jpeg_resample_v_acc_row(rs->h_row[cdx], rs->acc[cdx], rs->out_w, weight);
+        }
 
+        // Output row needs more source rows
+        if (seg_end < out_end)
+        {
             break;
-        // Didn't get a match on maximum bits, so this is an error
         }
-        else if (bit_width == JPEG_DHT_MAX_BITS)
+
+        for (int cdx = 0; cdx < nrgb; cdx++)
         {
-            cerr << "ERROR: jpeg_dht_lookup(): lookup failure" << endl;
-            exit(JPEG_FORMAT_ERROR);
+            jpeg_resample_v_out_row(rs->acc[cdx], rs->out[cdx], rs->out_w);
         }
-    }
-
-    // Decode lookup value and get additional bits if applicable...
-
-    // By default, let's assume this isn't EOB, ZRL or a marker
-    rval.marker = 0;
-    rval.is_EOB = false;
-    rval.is_ZRL = false;
-
-    // Get the zeros run-length
-    rval.ZRL    = (value >> 4) & 0xf;
 
-    // Check for the special cases
-    if (value == JPEG_ZRL)
-    {
-        rval.is_ZRL = true;
+        jpeg_output_row(band, set, row, rs->out_row++);
 
-    }
-    else if (value == JPEG_EOB)
-    {
-        rval.is_EOB = true;
-    }
-    else
-    {
-        // For DC, value is just an additional bit length (no ZRL nibble)
-        if (is_DC)
+        // Source row used up
+        if (seg_end == in_end)
         {
-            rval.ZRL       = 0;
+            break;
         }
-
-        // Fetch additional bits (and remove from barrel)
-        rval.amplitude = jpeg_amp_adjust( jpeg_get_bits((value & 0xf), buf, idx, barrel, bit_count, true), (value & 0xf));
     }
 
-    return rval;
+    rs->in_row++;
 }
 
 //-------------------------------------------------------------
-// jpeg_bitmap_update()
+// jpeg_band_output()
 //
 // Description:
 //
-// Takes an RGB Ns x [8|16]x[8|16] block at JPEG position mcu_col,mcu_row
-// and positions its pixels within a bitmap buffer.
+// Colour converts each pixel row of a band within the output
+// (the image, or the crop), if the selected targets need RGB, and
+// outputs it to the targets, or to the resampler when resizing.
+// With band or bitmap sinks, the rows output are gathered in band
+// buffers, and passed to the sinks together.
 //
 // Parameters:
-//    ptr:      pointer to block of RGB data generated from an MCU
-//    mcu_row:  the block's MCU row position
-//    mcu_col:  the block's MCU column position
-//    Ns:       The number of components in the scan (1 or 3)
-//    Hi:       The number of horizontal Y components in data (sub-sampling)
-//    Vi:       The number of vertical Y components in data (sub-sampling)
-//    bmp_data_ptr: pointer to the start of the bitmap's data buffer
-//    X:        Size of the image's width
-//    Y:        Size of the image's height
+//    band:     pointer to band state and buffers
+//    set:      band buffer set to output
+//    band_row: the band's MCU row position
 //
 // Return value:
-//    NONE
+//    None
 //
 
-void jfif::jpeg_bitmap_update (jpeg_rgb_block_t ptr, int mcu_row, int mcu_col, int Ns, int Hi, int Vi, uint8_t *bmp_data_ptr, uint8_t *rawbuf, int X, int Y)
+template <class POLICY>
+void jfif::jpeg_band_output (jpeg_band_t *band, int set, int band_row)
 {
+    int rows = band->bs * band->Vi;
+    int top  = band->out_y;
+    int end  = band->out_y + band->in_h;
 
-    // Each row extended to align to 32 bits;
-    int ext_X = BMP_WIDTH_TO_PADDED_BYTES(X);
+    // Band's first output row, and the most rows it can output
+    int first = (band->rs != NULL) ? band->rows_out : std::max(band_row*rows, top) - top;
+    int last  = (band->rs != NULL) ? first + band->max_rows : std::min((band_row + 1)*rows, end) - top;
+
+    if (band->band_sink != NULL)
+    {
+        band->raw_y0   = first;
+        band->raw_rows = last - first;
+    }
 
-    for (int mrow = 0; mrow < (JPEG_BLOCK_DIMENSION*Vi); mrow++)
+    band->bmp_y0 = first;
+
+    for (int row = 0; row < rows && band_row*rows + row < end; row++)
     {
-        for (int mcol = 0; mcol < (JPEG_BLOCK_DIMENSION*Hi); mcol++)
+        if (band_row*rows + row < top)
         {
-            uint8_t r, g, b;
+            continue;
+        }
 
-            // Extract RGB values
-            if (Ns == 1)
-            {
-                // When monochrome, all values the same
-                r = g = b = ptr[0][mrow>>1][mcol+((mrow&1)<<3)];
+        if (band->need_rgb)
+        {
+            jpeg_ycc_to_rgb<POLICY>(band, set, row);
+        }
 
-            }
-            else
-            {
-                // Extract RGB values
-                r = ptr[0][mrow][mcol];
-                g = ptr[1][mrow][mcol];
-                b = ptr[2][mrow][mcol];
-            }
+        if (band->rs != NULL)
+        {
+            jpeg_resize_row(band, set, row);
+        }
+        else
+        {
+            jpeg_output_row(band, set, row, band_row*rows + row - top);
+        }
+    }
 
-            // Calculate picture position (not accounting for padding)
-            int x_pos = 8 * Hi * mcu_col + mcol;
-            int y_pos = 8 * Vi * mcu_row + mrow;
+    int count = band->rows_out - first;
 
-            // If x_pos and y_pos not off the scale, then not an MCU padding byte
-            if (x_pos < X && y_pos < Y)
-            {
-#ifndef JPEG_DISPLAY_BMP
-                // Store RGB data in raw data buffer
-                if (rawbuf != NULL)
-                {
-                    rawbuf[y_pos*X*3 + x_pos*3 + 0] = r;
-                    rawbuf[y_pos*X*3 + x_pos*3 + 1] = g;
-                    rawbuf[y_pos*X*3 + x_pos*3 + 2] = b;
-                }
-#endif
-                // Flip for bitmap (which starts at the bottom and is blue first)
-                y_pos = Y - y_pos - 1;
+    if (band->band_sink != NULL && count > 0)
+    {
+        band->band_sink(band->sink_ctx, first, count, band->raw, band->raw_stride, band->out_w);
+    }
 
-                // Write to bitmap buffer
-                bmp_data_ptr[y_pos*ext_X + x_pos*3 + 2] = r;
-                bmp_data_ptr[y_pos*ext_X + x_pos*3 + 1] = g;
-                bmp_data_ptr[y_pos*ext_X + x_pos*3 + 0] = b;
-            }
-        }
+    if (band->bmp_sink != NULL && count > 0)
+    {
+        band->bmp_sink(band->sink_ctx, first, count, band->bmp_data, band->bmp_stride, band->out_w);
     }
 }
 
 //-------------------------------------------------------------
-// jpeg_extract_header()
+// jpeg_band_complete()
 //
 // Description:
 //
-// Parses the JFIF/JPEG header, extracting the relevant header data
-// needed for processing the scan data correctly. Checks are done on
-// the header for format errors or unsupported configurations.
+// Called when all the MCUs of a band have been stored. Normally
+// the band is output straight away, but when triangle filtering
+// vertically the output of a band is delayed until the next band
+// has been decoded, to give the chroma row below as context. The
+// band buffer sets are then swapped, and the row above for the
+// new band taken from the previous band.
 //
 // Parameters:
-//    buf:      pointer to input buffer containing JFIF data
-//    sptr:     pointer to SOS header structure pointer, updated to point to
-//              allocated and updated scan data.
-//    fptr:     pointer to frame header pointer, updated to point to frame data in buffer
-//    qptr:     Pointer to quantisation table pointers
-//    hptr:     pointer to huffman decode data structure pointer, updated to point to
-//              allocated and update decode data.
-//    dri:      pointer to an integer where DRI value will be returned
-//    is_RGB:   pointer to flag to indicate RGB colour space
+//    band:     pointer to band state and buffers
+//    band_row: the band's MCU row position
+//    last:     flag last band to be decoded
 //
 // Return value:
-//    JPEG_NO_ERROR:          on successful completion
-//    JPEG_MEMORY_ERROR:      memory allocation failure
-//    JPEG_FORMAT_ERROR:      format violation (message on stderr)
-//    JPEG_UNSUPPORTED_ERROR: valid, but not-supported (message on stderr)
+//    None
 //
 
-int jfif::jpeg_extract_header(uint8_t *buf, scan_header_t **sptr, frame_header_t **fptr, DQT_t *qptr,
-                              DHT_offsets_t **hptr, int *dri, bool *is_RGB)
+template <class POLICY>
+void jfif::jpeg_band_complete (jpeg_band_t *band, int band_row, bool last)
 {
-    using std::cout;
-    using std::cerr;
-    using std::dec;
-    using std::hex;
-    using std::setw;
-    using std::setfill;
-    using std::endl;
+    int set = band->set;
 
-    int buf_idx        = 0;       // Index into input data buffer
-    int last_buf_idx   = 0;       // Index at end of last good marker/block (for error reporting location only)
+    jpeg_band_context(band, set, band_row);
 
-    int  marker        = 0;
-    int  length        = 0;
-    bool expecting_SOI = true;
-    bool is_JFIF       = false;
-    int  ptq;
+    if (!band->delayed)
+    {
+        jpeg_band_output<POLICY>(band, set, band_row);
+        return;
+    }
 
-    *is_RGB = false;
+    int    prev  = (set + 1) % JPEG_BAND_SETS;
+    int    cs    = band->c_stride;
+    size_t bytes = cs * sizeof(int16_t);
 
-    do
+    for (int cdx = 1; cdx <= band->c_planes; cdx++)
     {
-        // Remember starting buffer index
-        last_buf_idx = buf_idx;
-
-        // Construct the 16 bit marker
-        marker       = buf[buf_idx++];
-        marker       = (marker << 8) | buf[buf_idx++];
+        int16_t *cur_row0  = band->comp[set][cdx]  - JPEG_BAND_PAD_COLS;
+        int16_t *prev_row0 = band->comp[prev][cdx] - JPEG_BAND_PAD_COLS;
 
-        // Decode the marker
-        switch(marker)
+        if (band_row == band->mcu_y0)
         {
-        // -----------------------
-        // Start of Image
-        // -----------------------
+            // First band decoded (top of image, or crop context), so replicate the first row above
+            memcpy(cur_row0 - cs, cur_row0, bytes);
+        }
+        else
+        {
+            // Exchange context rows with the previous band
+            memcpy(cur_row0 - cs, prev_row0 + (band->bs-1)*cs, bytes);
+            memcpy(prev_row0 + band->bs*cs, cur_row0, bytes);
+        }
+    }
 
-        case JPEG_MKR_SOI:
+    // Previous band now has all its context, so output it
+    if (band_row > band->mcu_y0)
+    {
+        jpeg_band_output<POLICY>(band, prev, band_row-1);
+    }
 
-            expecting_SOI = false;
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cout << JPEG_STR_SOI;
-            }
-#endif
-            break;
+    if (last)
+    {
+        jpeg_band_output<POLICY>(band, set, band_row);
+    }
 
-        // -----------------------
-        // APP0 for JFIF
-        // -----------------------
+    band->set = prev;
+}
 
-        case JPEG_MKR_APP0:
+//-------------------------------------------------------------
+// jpeg_amp_adjust()
+//
+// Description:
+//
+// Takes a Huffman decode amplitude value and returns the +/-
+// adjusted value (as per ITU.T81 Table F.1 and Table F.2)
+//
+// Parameters:
+//    value:    Unadjusted decoded amplitude value (0 - 2047)
+//    size:     Size of bit width for decoded value (0 - 11)
+//
+// Return value:
+//    Adjusted value (range -2047 to 2047)
+//
 
-            length =  (buf[buf_idx] << 8) | buf[buf_idx+1];
+int jfif::jpeg_amp_adjust (int value, int size)
+{
 
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cout << JPEG_STR_APP0 << (int)marker-JPEG_MKR_APP0 << " : " << dec << length << " : \"" << &buf[buf_idx+2] << "\"";
-            }
-#endif
-            // Check the header is JFIF. First time ID should be "JFIF", but can then be followed by an
-            // extension segment "JFXX"
-            if ( (is_JFIF && strncmp((const char *)&buf[buf_idx+2], JPEG_JFXX_STR, 4)) ||
-                (!is_JFIF && strncmp((const char *)&buf[buf_idx+2], JPEG_JFIF_STR, 4)))
-            {
-                cerr << "ERROR: unrecognised APP0 encountered" << endl;
-                return JPEG_FORMAT_ERROR;
-            }
+    if (size == 0)
+    {
+        return 0;
+    }
 
-            // Flag that this is a JFIF format file
-            is_JFIF = true;
-            *is_RGB = false;
+    // Top bit selects positive or negative table
+    int top_bit         = value & (1 << (size-1));
 
-            buf_idx += length;
+    // Rest of bits are offset from table
+    int bottom_bit_mask = (1 << (size-1))-1;
 
-            break;
+    // Return value
+    return (top_bit ? jpeg_adj_pos[size] : jpeg_adj_neg[size]) + (value & bottom_bit_mask);
+}
 
-        // -----------------------
-        // APP14 for Adobe
-        // -----------------------
+//-------------------------------------------------------------
+// jpeg_get_bits()
+//
+// Description:
+//
+// Returns top 'n' bits from a barrel shifter. If insufficient
+// bits available, data is pulled from input buffer onto barrel
+// until enough available. The barrel state and barrel bit count
+// is maintained by function. In addition, it manages padded
+// special byte (0xFF00), stripping the 0x00 byte, and also
+// detects (but not decode) markers (0xFFnn - where nn is 1 to 255).
+//
+// Parameters:
+//      n:              number of bits required from top of barrel
+//      buf:            pointer to input buffer
+//      idx:            pointer to current input byte in buf (updated)
+//      barrel:         pointer to barrel shifter (updated)
+//      bit_count:      Pointer to bit count of bits on barrel (updated)
+//      remove_bits:    Control to return bits without updating bit_count
+//                      for removal of n bits (still updated for any input
+//                      byte added).
+//
+// Return value:
+//      0xFFFFmmmm      - if top bits set, bottom mmmm bits contain marker value.
+//      0x0000nnnn      - else returned n bits of barrel top
+//
 
-        case JPEG_MKR_APPe:
+int jfif::jpeg_get_bits(int n, uint8_t *buf, int *idx, uint32_t *barrel, int *bit_count, bool remove_bits)
+{
+    int rtn_value;
 
-            length =  (buf[buf_idx] << 8) | buf[buf_idx+1];
+    // Update barrel to have enough bits for requested width
+    while (*bit_count < n)
+    {
+        // Input ended without an EOI marker, so flag one
+        if (!jpeg_input_ready(&buf[*idx], 2))
+        {
+            *bit_count = 0;
 
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cerr << JPEG_STR_APP0 << (int)marker-JPEG_MKR_APP0 << " : " << length << " : \"" << &buf[buf_idx+2] << "\"";
-            }
-#endif
+            return (int)(JPEG_MKR_EOI | JPEG_MARKER_FLAG);
+        }
 
-            // Check the header
-            if (strncmp((const char *)&buf[buf_idx+2], JPEG_APP14_ADOBE_STR, JPEG_APP14_ADOBE_STR_LEN))
-            {
-                cerr << "ERROR: unrecognised APP14 encountered" << endl;
-                return JPEG_FORMAT_ERROR;
-            }
+        // Hit a marker
+        if (buf[*idx] == JPEG_MARKER_BYTE && buf[*idx+1] != 0x00)
+        {
+            // Flush the barrel shifter
+            *bit_count = 0;
 
-            // Extract colour space info if not a JFIF format (which is YCbCr)
-            if (!is_JFIF)
-            {
-                int colour_space;
+            // Return the marker in lieu of a codeword (tagged in upper bits to make negative)
+            rtn_value = (int)((buf[*idx] << 8) | buf[*idx+1] | JPEG_MARKER_FLAG);
 
-                if ((colour_space = buf[buf_idx+JPEG_APP14_COLOUR_SPACE_OFFSET]) > 1)
-                {
-                    cerr << "ERROR: unsupported APP14 colour space encountered" << endl;
-                    return JPEG_UNSUPPORTED_ERROR;
-                }
+            // Skip over the marker
+            *idx += 2;
 
-                // Extracted colour space byte is 0 for RGB and 1 for YCbCr
-                *is_RGB = colour_space == 0;
-            }
+            return rtn_value;
+        }
 
-            buf_idx += length;
+        // Add a byte to bottom of the barrel
+        *barrel = (*barrel << 8) | (uint32_t)buf[*idx];
+        *bit_count += 8;
 
-            break;
+        // Detect padded byte and remove
+        if (buf[*idx] == 0xff && buf[*idx+1] == 0x00)
+        {
+            *idx += 1;
+        }
 
-        // -----------------------
-        // Application Data marker
-        // -----------------------
+        // Update inout buffer index for added byte
+        *idx += 1;
+    }
 
-        case JPEG_MKR_APP1: case JPEG_MKR_APP2: case JPEG_MKR_APP3:
-        case JPEG_MKR_APP4: case JPEG_MKR_APP5: case JPEG_MKR_APP6: case JPEG_MKR_APP7:
-        case JPEG_MKR_APP8: case JPEG_MKR_APP9: case JPEG_MKR_APPa: case JPEG_MKR_APPb:
-        case JPEG_MKR_APPc: case JPEG_MKR_APPd: case JPEG_MKR_APPf:
+    // Get top n bits from barrel
+    rtn_value = (*barrel >> (*bit_count - n)) & ((1U << n) - 1U) ;
 
-            length =  (buf[buf_idx] << 8) | buf[buf_idx+1];
+    // Only remove bits from barrel if enabled
+    if (remove_bits)
+    {
+        *bit_count -= n;
+    }
 
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cout << JPEG_STR_APP0 << (int)(marker-JPEG_MKR_APP0) << " : " << dec << length << " : \"" << &buf[buf_idx+2] << "\"";
-            }
-#endif
+    return rtn_value;
+}
 
-            // Check that it's okay to receive this marker now
-            if (expecting_SOI)
-            {
-                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
-                return JPEG_FORMAT_ERROR;
-            }
+//-------------------------------------------------------------
+// jpeg_segment_length()
+//
+// Description:
+//
+// Gets the length of a header marker segment (from its first two
+// bytes, following the marker), checking the length is at least
+// a minimum for the segment type, and that the whole segment is
+// within the input (when of a known length, or still arriving).
+//
+// Parameters:
+//    seg:        pointer to the segment (its length bytes)
+//    min_length: smallest valid length for the segment type
+//
+// Return value:
+//    The segment length, or 0 if too short or overrunning the input
+//    (message on stderr)
+//
 
-            buf_idx += length;
-            break;
+int jfif::jpeg_segment_length (const uint8_t *seg, int min_length)
+{
+    int length = 0;
 
-        // -----------------------
-        // Comment marker
-        // -----------------------
+    if (jpeg_input_ready(seg, 2))
+    {
+        length = (seg[0] << 8) | seg[1];
+    }
 
-        case JPEG_MKR_COM:
+    if (length < min_length || !jpeg_input_ready(seg, length))
+    {
+        std::cerr << "ERROR: jpeg_segment_length(): marker segment too short (" << length
+                  << " bytes), or overruns the input" << std::endl;
+        return 0;
+    }
 
-            length =  (buf[buf_idx] << 8) | buf[buf_idx+1];
+    return length;
+}
 
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cout << JPEG_STR_COM << " : " << dec << length << " : \"" << &buf[buf_idx+2] << "\"";
-            }
-#endif
+//-------------------------------------------------------------
+// jpeg_dht_check()
+//
+// Description:
+//
+// Checks the tables of a DHT segment lie within the segment,
+// before the Huffman decode data is constructed from them by
+// jpeg_dht(), which keeps pointers into the tables' values.
+//
+// Parameters:
+//    dht:      pointer to a byte buffer containing JPEG DHT segment
+//    length:   segment length
+//
+// Return value:
+//    true if the tables are within the segment, else false (message
+//    on stderr)
+//
 
-            // Check that it's okay to receive this marker now
-            if (expecting_SOI)
-            {
-                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
-                return JPEG_FORMAT_ERROR;
-            }
+bool jfif::jpeg_dht_check (const uint8_t *dht, int length)
+{
+    int offset = JPEG_DHT_PAYLOAD_OFFSET;
 
-            buf_idx += length;
-            break;
+    while (offset < length)
+    {
+        // Tc/Th byte, and the code counts for each bit length
+        int values = 0;
 
-        // -----------------------
-        // Quantisation marker
-        // -----------------------
+        if (offset + 1 + JPEG_DHT_MAX_BITS > length)
+        {
+            break;
+        }
 
-        case JPEG_MKR_DQT:
+        for (int bit_length = 1; bit_length <= JPEG_DHT_MAX_BITS; bit_length++)
+        {
+            values += dht[offset + bit_length];
+        }
 
-            length =  (buf[buf_idx] << 8) | buf[buf_idx+1];
+        offset += 1 + JPEG_DHT_MAX_BITS + values;
+    }
 
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cout << JPEG_STR_DQT << " : " << dec << length;
-            }
-#endif
+    if (offset != length)
+    {
+        std::cerr << "ERROR: jpeg_dht_check(): Huffman tables overrun the DHT segment" << std::endl;
+        return false;
+    }
 
-            // Check that it's okay to receive this marker now
-            if (expecting_SOI)
-            {
-                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
-                return JPEG_FORMAT_ERROR;
-            }
+    return true;
+}
 
-            for (int idx = 0; idx < (length-2); idx++)
-            {
-                int zdx = (idx%JPEG_DQT_TABLE_SIZE) - 1;
+//-------------------------------------------------------------
+// jpeg_dht()
+//
+// Description:
+//
+// Construct a Huffman data decode structure from JPEG DHT
+// segment on a buffer. Space is dynamically created for the
+// decode structure, and a pointer returned (or NULL on error)
+//
+// The information required for huffman decode is created here.
+// For each bit-width length Ln a, value (current_prefix, reset to 0)
+// is shifted right and Ln added. This number is then stored for
+// the bit-width. The stored numbers are then the upper bound (+1) for
+// that bit-width's values, and the previous value shited right 1
+// is the lower bound. To look up a value, the code is checked to be
+// less than the upper bound for the bit width, and the offset into
+// that widths values is the code minus lower bound. The offsets
+// into the Vmn data are stored with each bit width as well.
+//
+// Parameters:
+//    dht:              pointer to a byte buffer containing JPEG DHT segment
+//    decode_ptr:       pointer to a DHT table pointer, for returning decode table data
+//                      if NULL, or as preallocated space to use otherwise.
+//
+// Return value:
+//    DHT_offsets_t structure pointer containing decode data or
+//    NULL if an error occurred.
+//
 
-                // First byte of table data is table ID
-                if ((idx%JPEG_DQT_TABLE_SIZE) == 0)
-                {
-                    ptq = buf[buf_idx+JPEG_DQT_OFFSET+idx] & 0xf;
-                    qptr[ptq].PTq     = ptq;
+DHT_offsets_t* jfif::jpeg_dht(uint8_t *dht, DHT_offsets_t* decode_ptr)
+{
+    using std::cout;
+    using std::cerr;
+    using std::dec;
+    using std::hex;
+    using std::setw;
+    using std::setfill;
+    using std::endl;
 
-                // Next 64 bytes are quantisation values. These are scaled with AAN prescale values now,
-                // to avoid extra multiplication during iDCT.
-                }
-                else
-                {
-#ifdef JPEG_FAST_INT_IDCT
-                    qptr[ptq].Qn[zdx] = jpeg_idescale(buf[buf_idx+JPEG_DQT_OFFSET+idx] * aanscales[zdx], PRE_DESCALE_BITS);
-#else
-                    qptr[ptq].Qn[zdx] = buf[buf_idx+JPEG_DQT_OFFSET+idx];
-#endif
-                }
+    DHT_offsets_t* rtnptr;
+    DHT_offsets_t* ptr;
 
 #ifdef JPEG_DEBUG_MODE
-                if ((debug_enable & JPEG_DEBUG_DQT_EN) && (idx%JPEG_DQT_TABLE_SIZE) == JPEG_DQT_TABLE_SIZE-1)
-                {
-                    cout << endl;
-                    print_DQT((DQT_raw_pt)&buf[buf_idx+JPEG_DQT_OFFSET+idx-(JPEG_DQT_TABLE_SIZE-1)]);
-                }
+    char strbuf[JPEG_DEFAULT_STR_SIZE];
+    int  map_array     [JPEG_DHT_MAX_TABLES][JPEG_DHT_MAX_VALUES], *map;
+    int  codelen_array [JPEG_DHT_MAX_TABLES][JPEG_DHT_MAX_VALUES], *codelen;
 #endif
-            }
 
-            buf_idx += length;
 
-            break;
+    // Allocate some initialised space for the DHT pointers, if none already
+    if (decode_ptr == NULL) {
 
-        // -----------------------
-        // Start of Frame
-        // -----------------------
+        try
+        {
+            rtnptr = new DHT_offsets_t[JPEG_DHT_MAX_TABLES]();
+        }
+        catch(std::bad_alloc &ba)
+        {
+            cerr << "ERROR: jpeg_dht(): memory allocation failed: " << ba.what() << endl;
+            return (DHT_offsets_t*) NULL;
+        }
+    }
+    else
+    {
+        rtnptr = decode_ptr;
+    }
 
-        // SOF0 (for baseline DCT)---other frame types are unsupported
+    // Extract DHT segment length
+    int length = (dht[0] << 8) | dht[1];
 
-        case JPEG_MKR_SOF0:
+    // Point to start of DHT payload
+    int offset = JPEG_DHT_PAYLOAD_OFFSET;
 
-            // Check that it's okay to receive this marker now
-            if (expecting_SOI)
-            {
-                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
-                return JPEG_FORMAT_ERROR;
-            }
+#ifdef JPEG_DEBUG_MODE
+    if (debug_enable & JPEG_DEBUG_DHT_EN)
+    {
+        cout << "  length: " << length << endl;
+    }
 
-            // Point to frame
-            *fptr = (frame_header_t*) &buf[buf_idx];
+    // Initialise maps to mark as invalid (not all may be present)
+    for (int idx = 0; idx < JPEG_DHT_MAX_TABLES; idx++)
+    {
+        map_array[idx][0] = JPEG_INVALID;
+    }
+#endif
 
-#ifdef JPEG_LIMITED_SUB_SAMPLING
-            // Check sub-sampling parameters
-            for (idx = 0; idx < (*fptr)->Nf; idx++)
-            {
-                if ((*fptr)->Ci[idx].HVi != JPEG_SUPPORTED_SUBSAMPLING)
-                {
-                    cerr << "ERROR: unsupported sub-sampling detected in file" < endl;
-                    return JPEG_UNSUPPORTED_ERROR;
-                }
-            }
-#else
-            // Check sub-sampling parameters
-            for (int idx = 0; idx < (*fptr)->Nf; idx++)
-            {
-                int Hi = (*fptr)->Ci[idx].HVi >> 4;
-                int Vi = (*fptr)->Ci[idx].HVi & 0xf;
+    while (offset < length) {
 
-                // Check for unsupported vertical sub-sampling
-                if ((idx && (Hi != JPEG_NO_SUBSAMPLING || Vi != JPEG_NO_SUBSAMPLING)) ||
-                    (!idx && (Hi > JPEG_SUBSAMPLING || Hi < JPEG_NO_SUBSAMPLING || Vi > JPEG_SUBSAMPLING || Vi < JPEG_NO_SUBSAMPLING)))
-                {
-                    cerr << "ERROR: unsupported sub-sampling detected in file" << endl;
-                    return JPEG_UNSUPPORTED_ERROR;
+        int current_prefix = 0;
 
-                }
-            }
-#endif
+        // Get combined Tc/Th index
+        int Tch = (((dht[offset] >> 4) & JPEG_NIBBLE_MASK) ? 2 : 0) | ((dht[offset] & 0xf) ? 1 : 0) ;
 
-            // Extract block length
-            length = JPEG_REORDER16((*fptr)->length);
+        // Point to the appropriate Tc/Th table
+        ptr = rtnptr + Tch;
 
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cerr << JPEG_STR_SOF0 << " : " << length;
-            }
+        ptr->Tc = (dht[offset] >> 4) & JPEG_NIBBLE_MASK;
+        ptr->Th = (dht[offset] >> 0) & JPEG_NIBBLE_MASK;
 
-            // Print out frame contents
-            if (debug_enable & JPEG_DEBUG_FRM_EN)
-            {
-                cout << endl;
-                print_frame_hdr(*fptr);
-            }
+#ifdef JPEG_DEBUG_MODE
+        if (debug_enable & JPEG_DEBUG_DHT_EN)
+        {
+            cout << "  Tc    : " << (int)ptr->Tc << endl;
+            cout << "  Th    : " << (int)ptr->Th << endl;
+        }
 #endif
-            // Skip passed frame
-            buf_idx += length;
-
-            break;
 
-        // -----------------------
-        // Huffman table marker
-        // -----------------------
-
-        case JPEG_MKR_DHT:
+        // Skip past Tc/Th byte
+        offset++;
 
-            length =  (buf[buf_idx] << 8) | buf[buf_idx+1];
+        // Point to (Tc,Th) tables indicated
+        ptr->Ln = &dht[offset];
 
 #ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cout << JPEG_STR_DHT << " : " << dec << length;
-            }
+        map     = map_array[Tch];
+        codelen = codelen_array[Tch];
+        for (int idx = 0; idx < JPEG_DHT_MAX_VALUES; idx++)
+        {
+            codelen[idx] = map[idx] = 0;
+        }
 #endif
 
-            // Check that it's okay to receive this marker now
-            if (expecting_SOI)
+#ifdef JPEG_DEBUG_MODE
+        // Print the length values for each bit length for this table
+        if (debug_enable & JPEG_DEBUG_DHT_EN)
+        {
+            for (int bit_length = 1; bit_length <= JPEG_DHT_MAX_BITS; bit_length++)
             {
-                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
-                return JPEG_FORMAT_ERROR;
+                cout << "  L" << setfill('0') << dec << setw(2) << bit_length << "  : " << (int)ptr->Ln[bit_length-1] << endl;
             }
+        }
+#endif
 
-            buf_idx += length;
+        // Skip past lengths
+        offset += JPEG_DHT_MAX_BITS;
 
-            // Construct the Huffman table from the bytes
-            if ((*hptr = jpeg_dht(&buf[buf_idx-length], *hptr)) == NULL)
+        // Construct the code/byte mapping table for each bit length
+        for (int bit_length = 1; bit_length <= JPEG_DHT_MAX_BITS; bit_length++)
+        {
+            // Process any valid codes for this bit length
+            if (ptr->Ln[bit_length-1])
             {
-                cerr << "ERROR: failed call to jpeg_dht()" << endl;
-                return(JPEG_MEMORY_ERROR);
-            }
-
-            break;
-
-        // -----------------------
-        // Define restart interval
-        // -----------------------
-
-        case JPEG_MKR_DRI:
-
-            length =  (buf[buf_idx] << 8) | buf[buf_idx+1];
-            *dri   =  (buf[buf_idx+JPEG_DRI_OFFSET] << 8) | buf[buf_idx+3];
+                // Store locations of the Vmn codes for each bit length with values
+                // (this can't be zero---the initialised memory value)
+                ptr->vmn_offset[bit_length-1] = &dht[offset];
 
 #ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cout << JPEG_STR_DRI << " : " << dec << length << " : " << (int)(*dri);
-            }
-#endif
-
-            // Check that it's okay to receive this marker now
-            if (expecting_SOI)
-            {
-                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
-                return JPEG_FORMAT_ERROR;
-            }
-
-            buf_idx += length;
-
-            break;
-
-        // -----------------------
-        // Start of scan marker
-        // -----------------------
-
-        case JPEG_MKR_SOS:
+                // Print the Vm,n values
+                if (debug_enable & JPEG_DEBUG_DHT_EN)
+                {
+                    for (int jdx = 0; jdx < ptr->Ln[bit_length-1]; jdx++)
+                    {
+                        cout << "    V" << dec << bit_length << "," << jdx << " = " << hex << setw(2) << (int)dht[offset+jdx] << endl;
+                    }
+#endif
 
+                // Add code to map table
 #ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cout << JPEG_STR_SOS << endl;
-            }
+                for (int jdx = 0; jdx < ptr->Ln[bit_length-1]; jdx++)
+                {
+                    map[dht[offset+jdx]] = current_prefix;
+                    codelen[dht[offset+jdx]] = bit_length;
+                    current_prefix++;
+                }
+#else
+                current_prefix += ptr->Ln[bit_length-1];
 #endif
-
-            // Check that it's okay to receive this marker now
-            if (expecting_SOI)
-            {
-                cout << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
-                return JPEG_FORMAT_ERROR;
-            }
-
-            // Create some space for the header (structure not overlayed on byte buffer,
-            // since component specific parameter is not of fixed size, pushing
-            // subsequent fields to non-predeterminate positions)
-            try
-            {
-                *sptr = new scan_header_t;
+                // Skip over values for this bit width
+                offset += ptr->Ln[bit_length-1];
             }
-            catch(std::bad_alloc& ba)
-            {
-                cerr << "ERROR: memory allocation error: " << ba.what() << endl;
-                return JPEG_MEMORY_ERROR;
-            };
 
-            // These fields extracted from byte buffer
-            (*sptr)->length = (buf[buf_idx] << 8) | buf[buf_idx+1];
-            (*sptr)->Ns     = buf[buf_idx+JPEG_SOS_NS_OFFSET];
+            // Remember the first unused code for this bit width
+            ptr->row_break_codes[bit_length-1] = current_prefix;
 
-            // Pointer to variable length parameters (determined by Ns)
-            (*sptr)->p_Ci   = (scan_params_t*) &buf[buf_idx+JPEG_SOS_CI_OFFSET];
+            // Tail code becomes current prefix shifted left for next bit width row
+            current_prefix <<= 1;
+        }
 
-            // Pointer to last few parameters (known constants for baseline DCT)
-            (*sptr)->p_tail = (scan_tail_t*)   &buf[buf_idx+JPEG_SOS_CI_OFFSET + ((*sptr)->Ns*2)];
+#ifdef JPEG_DEBUG_MODE
+        // Print out the mapping table
+        if (debug_enable & JPEG_DEBUG_DHT_EN)
+        {
+            cout << "Table " << ((Tch >> 1) & 1) << "," << (Tch & 1) << endl;
 
-#ifndef JPEG_IGNORE_SOS_TAIL_ERRORS
-            // Check the values
-            if ((*sptr)->p_tail->Ss != 0 || (*sptr)->p_tail->Se != JPEG_MCU_ELEMENTS-1 || (*sptr)->p_tail->Ahl != 0)
+            for (int idx = 0; idx < JPEG_DHT_MAX_VALUES; idx++)
             {
-                cerr << "ERROR: Unexpected values at end of SOS header" << endl;
-                return JPEG_FORMAT_ERROR;
+                if (codelen[idx])
+                {
+                    setfill('0');
+                    cout << "  "  << dec << setw(3) << idx << " (0x" << hex << setw(2) << idx << ")";
+                    cout << " = (" << hex << setw(4) << (int)map[idx] << ") " << int2binstr(strbuf, map[idx], codelen[idx]) << endl;
+                }
             }
+        }
 #endif
 
-            // Pointer to start of entropy coded data segment
-            (*sptr)->p_ECS  = &buf[buf_idx+JPEG_SOS_CI_OFFSET + ((*sptr)->Ns*2) + JPEG_SOS_TAIL_SIZE];
+    }
 
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_SCAN_EN) {
-                cout << endl;
-                print_scan_hdr(*sptr);
-            }
-#endif
-            // Return at start of scan, as all header data should now have been extracted
-            return JPEG_NO_ERROR;
+    return rtnptr;
+}
 
-            break;
+//-------------------------------------------------------------
+// jpeg_dht_lookup()
+//
+// Description:
+//
+// Gets an adjusted Huffman/RLE decoded amplitude value from
+// the input buffer bit stream (via a barrel shifter) for
+// either DC or AC data. Flags encountering a marker, an EOB
+// or ZRL.
+//
+// Parameters:
+//    dht_ptr:          pointer to Huffman decode data
+//    is_DC:            flags if required code is for DC (true) or not (false)
+//    T:                defines huffman table ID (0 or 1 for baseline DCT)
+//    buf:              input data buffer pointer
+//    idx:              pointer to current offset index into input buffer (updated)
+//    barrel:           pointer to barrel shifter (updated)
+//    bit_count:        Pointer to bit count of bits on barrel (updated)
+//
+// Return value:
+//    Returns a structure with either a decoded amplitude value and
+//    zero run length, or flags for marker/boundary state. The structure
+//    has the following fields:
+//        marker:       Returning a marker if > 0 (is 0xmmmm, where mmmm is marker value)
+//        is_EOB:       Hit EOB (if marker 0)
+//        is_ZRL:       Hit ZRL (if marker 0)
+//        ZRL:          Zero run length (if marker == 0 and is_EOB false)
+//        amplitude:    amplitude value if ZRL < 16 and if marker == 0 and is_EOB is false
+//
 
-        // -----------------------
-        // SOFx markers
-        // -----------------------
+rle_amplitude_t jfif::jpeg_dht_lookup(DHT_offsets_t* dht_ptr, bool is_DC, int T, uint8_t *buf, int *idx, uint32_t *barrel, int *bit_count)
+{
+    using std::cout;
+    using std::cerr;
+    using std::hex;
+    using std::setw;
+    using std::endl;
 
-        // Only baseline DCT supported, so whine if other SOF markers turn up
-        case JPEG_MKR_SOF1: case JPEG_MKR_SOF2: case JPEG_MKR_SOF3:
-        case JPEG_MKR_SOF5: case JPEG_MKR_SOF6: case JPEG_MKR_SOF7:
-        case JPEG_MKR_SOF9: case JPEG_MKR_SOFa: case JPEG_MKR_SOFb:
-        case JPEG_MKR_SOFd: case JPEG_MKR_SOFe: case JPEG_MKR_SOFf:
+    int             value;
+    rle_amplitude_t rval;
+    DHT_offsets_t*  dht;
+    int             table;
 
-            cerr << "ERROR: encountered an unsupported SOF marker (0x" << hex << setw(4) << marker << "). Only baseline (SOF0) allowed." << endl;
-            return JPEG_UNSUPPORTED_ERROR;
+    // Lookup which DHT table to use (don't assume any ordering)
+    for (table = 0; table < JPEG_DHT_MAX_TABLES; table++)
+    {
+        dht = dht_ptr + table;
 
+        // Once the table is found (of those defined), stop looking
+        if (dht->Ln != NULL && ((is_DC && dht->Tc == JPEG_DHT_DC_CLASS && T == dht->Th) ||
+                               (!is_DC && dht->Tc == JPEG_DHT_AC_CLASS && T == dht->Th)))
+        {
             break;
+        }
+    }
 
-        // Reset interval markers (not expected in header)
-        case JPEG_MKR_RST0: case JPEG_MKR_RST1: case JPEG_MKR_RST2: case JPEG_MKR_RST3:
-        case JPEG_MKR_RST4: case JPEG_MKR_RST5: case JPEG_MKR_RST6: case JPEG_MKR_RST7:
-
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
-            {
-                cout << JPEG_STR_RST0 << (int)(marker-JPEG_MKR_RST0);
-            }
-#endif
-
-            cerr << "ERROR: encountered unexpected RSTn marker (0x" << hex << setw(4) << marker << ") in parsing header" << endl;
-            return JPEG_FORMAT_ERROR;
-
-            break;
+    // The scan selected a table not defined, so an error (returned in lieu of a marker)
+    if (table == JPEG_DHT_MAX_TABLES)
+    {
+        cerr << "ERROR: jpeg_dht_lookup(): no " << (is_DC ? "DC" : "AC") << " Huffman table " << T << endl;
+        rval.marker = JPEG_FORMAT_ERROR;
+        return rval;
+    }
 
-        // -----------------------
-        // End of image marker
-        // -----------------------
+    // Check for smallest matching code.
+    // (In hardware, could match all available bit widths simultaneously, and
+    // use a priority encoder to match to the smallest width, in case of multi-match
+    // [is that possible?])
+    for (int bit_width = 1; bit_width <= JPEG_DHT_MAX_BITS; bit_width++)
+    {
+        int code;
 
-        // EOI not expected in header
+        // Get next code of 'bit_width' width from input stream
+        if ((code = jpeg_get_bits(bit_width, buf, idx, barrel, bit_count, false)) < 0)
+        {
+            // Returned code was a marker, so strip top marker indicator bits and return
+            rval.marker = code & 0xffff;
+            return rval;
 
-        case JPEG_MKR_EOI:
+        // Not a marker, so check if there is a match for this bit width.
+        // This is just code being less than row_break_code (and Ln not 0)
+        }
+        else if (dht->Ln[bit_width-1] && (code < dht->row_break_codes[bit_width-1]))
+        {
+            // Code to retrieve is "extracted code - previous width's break code<<1"
+            // from beginning of vmn bytes for this width
+            value = dht->vmn_offset[bit_width-1][code - ((bit_width == 1) ? 0 : (dht->row_break_codes[bit_width-2] << 1))];
 
-            length =  (buf[buf_idx] << 8) | buf[buf_idx+1];
+            // Remove these extracted bits from the barrel shifter and finish loop
+            *bit_count -= bit_width;
 
 #ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            if (debug_enable & JPEG_DEBUG_HUFF_DECODE)
             {
-                cout << JPEG_STR_EOI << " : " << dec << length;
+                cout << "code=0x" << hex << setw(4) << (int)code << " : value=0x" << hex << setw(4) << (int)value << endl;
             }
 #endif
-            cerr << "ERROR: encountered unexpected EOI marker (0x" << hex << setw(4) << marker << ") in parsing header" << endl;
-            return JPEG_FORMAT_ERROR;
 
             break;
+        // Didn't get a match on maximum bits, so this is an error (returned in lieu of a marker)
+        }
+        else if (bit_width == JPEG_DHT_MAX_BITS)
+        {
+            cerr << "ERROR: jpeg_dht_lookup(): lookup failure" << endl;
+            rval.marker = JPEG_FORMAT_ERROR;
+            return rval;
+        }
+    }
 
-        // -----------------------
-        // Unkown marker
-        // -----------------------
+    // Decode lookup value and get additional bits if applicable...
 
-        default:
+    // By default, let's assume this isn't EOB, ZRL or a marker
+    rval.marker = 0;
+    rval.is_EOB = false;
+    rval.is_ZRL = false;
 
-            if (expecting_SOI)
-            {
-                cerr << "ERROR: expected SOI marker not found. Input not a JFIF/JPEG file" << endl;
-            }
-            else
-            {
-                cerr << "ERROR: Unrecognised or unsupported marker (" << hex << setw(4) << marker << ") at " << hex << setw(8) << last_buf_idx << endl;
-            }
+    // Get the zeros run-length
+    rval.ZRL    = (value >> 4) & 0xf;
 
-            return JPEG_FORMAT_ERROR;
+    // Check for the special cases
+    if (value == JPEG_ZRL)
+    {
+        rval.is_ZRL = true;
+
+    }
+    else if (value == JPEG_EOB)
+    {
+        rval.is_EOB = true;
+    }
+    else
+    {
+        // For DC, value is just an additional bit length (no ZRL nibble)
+        if (is_DC)
+        {
+            rval.ZRL       = 0;
         }
 
-#ifdef JPEG_DEBUG_MODE
-        if (debug_enable & JPEG_DEBUG_MKR_EN)
+        // Corrupt tables may give a size beyond that of any amplitude
+        if ((value & 0xf) > JPEG_MAG_MAX_SIZE)
         {
-            cout << " at location 0x" << setfill('0') << hex << setw(8) << last_buf_idx << endl;
+            cerr << "ERROR: jpeg_dht_lookup(): invalid amplitude size (" << (value & 0xf) << ")" << endl;
+            rval.marker = JPEG_FORMAT_ERROR;
+            return rval;
         }
-#endif
 
+        // Fetch additional bits (and remove from barrel)
+        rval.amplitude = jpeg_amp_adjust( jpeg_get_bits((value & 0xf), buf, idx, barrel, bit_count, true), (value & 0xf));
+    }
+
+    return rval;
+}
+
+//-------------------------------------------------------------
+// jpeg_bitmap_update()
+//
+// Description:
+//
+// Takes a row of planar RGB pixels at image row y_pos and swizzles
+// them into the bitmap buffer's (flipped) BGR row, zeroing the row's
+// padding bytes. Image edges are dealt with once for the whole row.
+//
+// Parameters:
+//    r, g, b:  pointers to X bytes of each colour for the row
+//    y_pos:    the row's position in the image
+//    bmp_data_ptr: pointer to the start of the bitmap's data buffer
+//    X:        Size of the image's width
+//    Y:        Size of the image's height
+//    top_down: bitmap rows in top-down order (not flipped)
+//
+// Return value:
+//    NONE
+//
+
+void jfif::jpeg_bitmap_update (const uint8_t *r, const uint8_t *g, const uint8_t *b, int y_pos, uint8_t *bmp_data_ptr, int X, int Y,
+                               bool top_down)
+{
+
+    // Each row extended to align to 32 bits;
+    int ext_X = BMP_WIDTH_TO_PADDED_BYTES(X);
+
+    // Flip for bitmap (which starts at the bottom, unless top-down, and is blue first)
+    uint8_t *bptr = &bmp_data_ptr[(long)(top_down ? y_pos : Y - y_pos - 1)*ext_X];
+
+    jpeg_interleave_row(b, g, r, bptr, X);
+
+    // Zero the row's padding bytes
+    memset(&bptr[X*3], 0, ext_X - X*3);
+}
+
+//-------------------------------------------------------------
+// jpeg_bitmap_gray_update()
+//
+// Description:
+//
+// Takes a row of luma samples at image row y_pos, straight from the
+// iDCT output, and clips them into an 8 bit grayscale bitmap's
+// (flipped) row, zeroing the row's padding bytes.
+//
+// Parameters:
+//    y:        pointer to X luma samples for the row
+//    y_pos:    the row's position in the image
+//    bmp_data_ptr: pointer to the start of the bitmap's data buffer
+//    X:        Size of the image's width
+//    Y:        Size of the image's height
+//    top_down: bitmap rows in top-down order (not flipped)
+//
+// Return value:
+//    NONE
+//
+
+void jfif::jpeg_bitmap_gray_update (const int16_t *y, int y_pos, uint8_t *bmp_data_ptr, int X, int Y, bool top_down)
+{
+    // Each row extended to align to 32 bits;
+    int ext_X = JPEG_BMP_GRAY_PADDED_BYTES(X);
+
+    uint8_t *bptr = &bmp_data_ptr[(long)(top_down ? y_pos : Y - y_pos - 1)*ext_X];
+
+    jpeg_clip_row(y, bptr, X);
+
+    memset(&bptr[X], 0, ext_X - X);
+}
+
+//-------------------------------------------------------------
+// jpeg_bitmap_gray_update()
+//
+// Description:
+//
+// As above, but for a row of 8 bit luma samples (e.g. from the
+// resampler).
+//
+
+void jfif::jpeg_bitmap_gray_update (const uint8_t *y, int y_pos, uint8_t *bmp_data_ptr, int X, int Y, bool top_down)
+{
+    int ext_X = JPEG_BMP_GRAY_PADDED_BYTES(X);
+
+    uint8_t *bptr = &bmp_data_ptr[(long)(top_down ? y_pos : Y - y_pos - 1)*ext_X];
+
+    memcpy(bptr, y, X);
+
+    memset(&bptr[X], 0, ext_X - X);
+}
+
+//-------------------------------------------------------------
+// jpeg_extract_header()
+//
+// Description:
+//
+// Parses the JFIF/JPEG header, extracting the relevant header data
+// needed for processing the scan data correctly. Checks are done on
+// the header for format errors or unsupported configurations.
+//
+// Parameters:
+//    buf:      pointer to input buffer containing JFIF data
+//    sptr:     pointer to SOS header structure pointer, updated to point to
+//              allocated and updated scan data.
+//    fptr:     pointer to frame header pointer, updated to point to frame data in buffer
+//    qptr:     Pointer to quantisation table pointers
+//    hptr:     pointer to huffman decode data structure pointer, updated to point to
+//              allocated and update decode data.
+//    dri:      pointer to an integer where DRI value will be returned
+//    is_RGB:   pointer to flag to indicate RGB colour space (for 4
+//              components, CMYK rather than YCCK)
+//
+// Return value:
+//    JPEG_NO_ERROR:          on successful completion
+//    JPEG_MEMORY_ERROR:      memory allocation failure
+//    JPEG_FORMAT_ERROR:      format violation (message on stderr)
+//    JPEG_UNSUPPORTED_ERROR: valid, but not-supported (message on stderr)
+//
+
+int jfif::jpeg_extract_header(uint8_t *buf, scan_header_t **sptr, frame_header_t **fptr, DQT_t *qptr,
+                              DHT_offsets_t **hptr, int *dri, bool *is_RGB)
+{
+    using std::cout;
+    using std::cerr;
+    using std::dec;
+    using std::hex;
+    using std::setw;
+    using std::setfill;
+    using std::endl;
+
+    int buf_idx        = 0;       // Index into input data buffer
+    int last_buf_idx   = 0;       // Index at end of last good marker/block (for error reporting location only)
+
+    int  marker        = 0;
+    int  length        = 0;
+    bool expecting_SOI = true;
+    bool is_JFIF       = false;
+    int  transform     = JPEG_INVALID;    // Adobe APP14 colour transform, if any
+    int  ptq           = 0;
+
+    *is_RGB = false;
+
+    do
+    {
+        // Remember starting buffer index
+        last_buf_idx = buf_idx;
+
+        // Check there's a marker before the input ends
+        if (!jpeg_input_ready(&buf[buf_idx], 2))
+        {
+            cerr << "ERROR: input ended within the header" << endl;
+            return JPEG_FORMAT_ERROR;
+        }
+
+        // Construct the 16 bit marker
+        marker       = buf[buf_idx++];
+        marker       = (marker << 8) | buf[buf_idx++];
+
+        // Decode the marker
+        switch(marker)
+        {
+        // -----------------------
+        // Start of Image
+        // -----------------------
+
+        case JPEG_MKR_SOI:
+
+            expecting_SOI = false;
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_SOI;
+            }
+#endif
+            break;
+
+        // -----------------------
+        // APP0 for JFIF
+        // -----------------------
+
+        case JPEG_MKR_APP0:
+
+            // Room for the identifier
+            if ((length = jpeg_segment_length(&buf[buf_idx], JPEG_APP0_MIN_LENGTH)) == 0)
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_APP0 << (int)marker-JPEG_MKR_APP0 << " : " << dec << length << " : \"" << &buf[buf_idx+2] << "\"";
+            }
+#endif
+            // Check the header is JFIF. First time ID should be "JFIF", but can then be followed by an
+            // extension segment "JFXX"
+            if ( (is_JFIF && strncmp((const char *)&buf[buf_idx+2], JPEG_JFXX_STR, 4)) ||
+                (!is_JFIF && strncmp((const char *)&buf[buf_idx+2], JPEG_JFIF_STR, 4)))
+            {
+                cerr << "ERROR: unrecognised APP0 encountered" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // Flag that this is a JFIF format file
+            is_JFIF = true;
+            *is_RGB = false;
+
+            buf_idx += length;
+
+            break;
+
+        // -----------------------
+        // APP14 for Adobe
+        // -----------------------
+
+        case JPEG_MKR_APPe:
+
+            // Room for the identifier and colour space byte
+            if ((length = jpeg_segment_length(&buf[buf_idx], JPEG_APP14_COLOUR_SPACE_OFFSET+1)) == 0)
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cerr << JPEG_STR_APP0 << (int)marker-JPEG_MKR_APP0 << " : " << length << " : \"" << &buf[buf_idx+2] << "\"";
+            }
+#endif
+
+            // Check the header
+            if (strncmp((const char *)&buf[buf_idx+2], JPEG_APP14_ADOBE_STR, JPEG_APP14_ADOBE_STR_LEN))
+            {
+                cerr << "ERROR: unrecognised APP14 encountered" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // Extract colour space info if not a JFIF format (which is YCbCr)
+            if (!is_JFIF)
+            {
+                if ((transform = buf[buf_idx+JPEG_APP14_COLOUR_SPACE_OFFSET]) > JPEG_APP14_YCCK)
+                {
+                    cerr << "ERROR: unsupported APP14 colour space encountered" << endl;
+                    return JPEG_UNSUPPORTED_ERROR;
+                }
+
+                // Extracted colour space byte is 0 for RGB (or CMYK), 1 for YCbCr and 2 for YCCK
+                *is_RGB = transform == 0;
+            }
+
+            buf_idx += length;
+
+            break;
+
+        // -----------------------
+        // Application Data marker
+        // -----------------------
+
+        case JPEG_MKR_APP1: case JPEG_MKR_APP2: case JPEG_MKR_APP3:
+        case JPEG_MKR_APP4: case JPEG_MKR_APP5: case JPEG_MKR_APP6: case JPEG_MKR_APP7:
+        case JPEG_MKR_APP8: case JPEG_MKR_APP9: case JPEG_MKR_APPa: case JPEG_MKR_APPb:
+        case JPEG_MKR_APPc: case JPEG_MKR_APPd: case JPEG_MKR_APPf:
+
+            if ((length = jpeg_segment_length(&buf[buf_idx], 2)) == 0)
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_APP0 << (int)(marker-JPEG_MKR_APP0) << " : " << dec << length << " : \"" << &buf[buf_idx+2] << "\"";
+            }
+#endif
+
+            // Check that it's okay to receive this marker now
+            if (expecting_SOI)
+            {
+                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            buf_idx += length;
+            break;
+
+        // -----------------------
+        // Comment marker
+        // -----------------------
+
+        case JPEG_MKR_COM:
+
+            if ((length = jpeg_segment_length(&buf[buf_idx], 2)) == 0)
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_COM << " : " << dec << length << " : \"" << &buf[buf_idx+2] << "\"";
+            }
+#endif
+
+            // Check that it's okay to receive this marker now
+            if (expecting_SOI)
+            {
+                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            buf_idx += length;
+            break;
+
+        // -----------------------
+        // Quantisation marker
+        // -----------------------
+
+        case JPEG_MKR_DQT:
+
+            if ((length = jpeg_segment_length(&buf[buf_idx], 2)) == 0)
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_DQT << " : " << dec << length;
+            }
+#endif
+
+            // Check that it's okay to receive this marker now
+            if (expecting_SOI)
+            {
+                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            for (int idx = 0; idx < (length-2); idx++)
+            {
+                int zdx = (idx%JPEG_DQT_TABLE_SIZE) - 1;
+
+                // First byte of table data is table ID
+                if ((idx%JPEG_DQT_TABLE_SIZE) == 0)
+                {
+                    // Only 8 bit values (baseline) in the supported destinations
+                    if ((ptq = buf[buf_idx+JPEG_DQT_OFFSET+idx]) >= JPEG_MAX_QUANT_TABLES)
+                    {
+                        cerr << "ERROR: invalid or unsupported DQT table (0x" << hex << setw(2) << ptq << ")" << endl;
+                        return JPEG_FORMAT_ERROR;
+                    }
+
+                    qptr[ptq].PTq     = ptq;
+
+                // Next 64 bytes are quantisation values. These are stored raw, and any iDCT
+                // prescaling applied by jpeg_dqt_prescale() once the iDCT engine is known.
+                }
+                else
+                {
+                    qptr[ptq].Qn[zdx] = buf[buf_idx+JPEG_DQT_OFFSET+idx];
+                }
+
+#ifdef JPEG_DEBUG_MODE
+                if ((debug_enable & JPEG_DEBUG_DQT_EN) && (idx%JPEG_DQT_TABLE_SIZE) == JPEG_DQT_TABLE_SIZE-1)
+                {
+                    cout << endl;
+                    print_DQT((DQT_raw_pt)&buf[buf_idx+JPEG_DQT_OFFSET+idx-(JPEG_DQT_TABLE_SIZE-1)]);
+                }
+#endif
+            }
+
+            buf_idx += length;
+
+            break;
+
+        // -----------------------
+        // Start of Frame
+        // -----------------------
+
+        // SOF0 (for baseline DCT)---other frame types are unsupported
+
+        case JPEG_MKR_SOF0:
+
+            // Check that it's okay to receive this marker now
+            if (expecting_SOI)
+            {
+                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // Room for the fixed fields
+            if ((length = jpeg_segment_length(&buf[buf_idx], JPEG_SOF_CI_OFFSET)) == 0)
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // Point to frame
+            *fptr = (frame_header_t*) &buf[buf_idx];
+
+            // Monochrome, 3 component, and 4 component (CMYK or YCCK) data supported
+            if ((*fptr)->Nf != 1 && (*fptr)->Nf != JPEG_NUM_COLOUR_SCANS && (*fptr)->Nf != JPEG_NUM_CMYK_COLOURS)
+            {
+                cerr << "ERROR: unsupported number of frame components (" << dec << (int)(*fptr)->Nf << ")" << endl;
+                return JPEG_UNSUPPORTED_ERROR;
+            }
+
+            // A frame must have some width and height to decode
+            if (JPEG_REORDER16((*fptr)->X) == 0 || JPEG_REORDER16((*fptr)->Y) == 0)
+            {
+                cerr << "ERROR: invalid frame size (" << dec << JPEG_REORDER16((*fptr)->X) << "x"
+                     << JPEG_REORDER16((*fptr)->Y) << ")" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // Each component's parameters within the segment, and selecting a valid quantisation table
+            if (length < JPEG_SOF_CI_OFFSET + (*fptr)->Nf*(int)sizeof(frame_params_t))
+            {
+                cerr << "ERROR: frame header too short for " << dec << (int)(*fptr)->Nf << " components" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            for (int idx = 0; idx < (*fptr)->Nf; idx++)
+            {
+                if ((*fptr)->Ci[idx].Tq >= JPEG_MAX_QUANT_TABLES)
+                {
+                    cerr << "ERROR: invalid frame component quantisation table (" << dec << (int)(*fptr)->Ci[idx].Tq << ")" << endl;
+                    return JPEG_FORMAT_ERROR;
+                }
+            }
+
+#ifdef JPEG_LIMITED_SUB_SAMPLING
+            // Check sub-sampling parameters
+            for (int idx = 0; idx < (*fptr)->Nf; idx++)
+            {
+                if ((*fptr)->Ci[idx].HVi != JPEG_SUPPORTED_SUBSAMPLING)
+                {
+                    cerr << "ERROR: unsupported sub-sampling detected in file" << endl;
+                    return JPEG_UNSUPPORTED_ERROR;
+                }
+            }
+#else
+            // Check sub-sampling parameters. Luma sampling factors may be up to 2 in
+            // each direction (4:2:2, 4:4:0 and 4:2:0), with chroma at 1x1, and the K of
+            // 4 component data sampled as either
+            for (int idx = 0; idx < (*fptr)->Nf; idx++)
+            {
+                int Hi = (*fptr)->Ci[idx].HVi >> 4;
+                int Vi = (*fptr)->Ci[idx].HVi & 0xf;
+
+                // Check for unsupported sub-sampling
+                if ((idx && (Hi != JPEG_NO_SUBSAMPLING || Vi != JPEG_NO_SUBSAMPLING) &&
+                            (idx != JPEG_NUM_COLOUR_SCANS || (*fptr)->Ci[idx].HVi != (*fptr)->Ci[0].HVi)) ||
+                    (!idx && (Hi > JPEG_SUBSAMPLING || Hi < JPEG_NO_SUBSAMPLING || Vi > JPEG_SUBSAMPLING || Vi < JPEG_NO_SUBSAMPLING)))
+                {
+                    cerr << "ERROR: unsupported sub-sampling detected in file" << endl;
+                    return JPEG_UNSUPPORTED_ERROR;
+
+                }
+            }
+#endif
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cerr << JPEG_STR_SOF0 << " : " << length;
+            }
+
+            // Print out frame contents
+            if (debug_enable & JPEG_DEBUG_FRM_EN)
+            {
+                cout << endl;
+                print_frame_hdr(*fptr);
+            }
+#endif
+            // Skip passed frame
+            buf_idx += length;
+
+            break;
+
+        // -----------------------
+        // Huffman table marker
+        // -----------------------
+
+        case JPEG_MKR_DHT:
+
+            if ((length = jpeg_segment_length(&buf[buf_idx], 2)) == 0)
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_DHT << " : " << dec << length;
+            }
+#endif
+
+            // Check that it's okay to receive this marker now
+            if (expecting_SOI)
+            {
+                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // Check the tables are within the segment
+            if (!jpeg_dht_check(&buf[buf_idx], length))
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+            buf_idx += length;
+
+            // Construct the Huffman table from the bytes
+            if ((*hptr = jpeg_dht(&buf[buf_idx-length], *hptr)) == NULL)
+            {
+                cerr << "ERROR: failed call to jpeg_dht()" << endl;
+                return(JPEG_MEMORY_ERROR);
+            }
+
+            break;
+
+        // -----------------------
+        // Define restart interval
+        // -----------------------
+
+        case JPEG_MKR_DRI:
+
+            if ((length = jpeg_segment_length(&buf[buf_idx], JPEG_DRI_OFFSET+2)) == 0)
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+            *dri   =  (buf[buf_idx+JPEG_DRI_OFFSET] << 8) | buf[buf_idx+3];
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_DRI << " : " << dec << length << " : " << (int)(*dri);
+            }
+#endif
+
+            // Check that it's okay to receive this marker now
+            if (expecting_SOI)
+            {
+                cerr << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            buf_idx += length;
+
+            break;
+
+        // -----------------------
+        // Start of scan marker
+        // -----------------------
+
+        case JPEG_MKR_SOS:
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_SOS << endl;
+            }
+#endif
+
+            // Check that it's okay to receive this marker now
+            if (expecting_SOI)
+            {
+                cout << "ERROR: encountered unexpected marker when waiting for SOI" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // The scan needs a frame (and Huffman tables) to decode with
+            if (*fptr == NULL || *hptr == NULL)
+            {
+                cerr << "ERROR: encountered SOS marker before the frame header or Huffman tables" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // Room for the number of components, and then their parameters and the tail
+            if ((length = jpeg_segment_length(&buf[buf_idx], JPEG_SOS_CI_OFFSET)) == 0)
+            {
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // A single scan, interleaving all the frame's components, is supported
+            if (buf[buf_idx+JPEG_SOS_NS_OFFSET] != (*fptr)->Nf)
+            {
+                cerr << "ERROR: unsupported scan of " << dec << (int)buf[buf_idx+JPEG_SOS_NS_OFFSET]
+                     << " components (of " << (int)(*fptr)->Nf << ")" << endl;
+                return JPEG_UNSUPPORTED_ERROR;
+            }
+
+            if (length < JPEG_SOS_CI_OFFSET + (*fptr)->Nf*2 + JPEG_SOS_TAIL_SIZE)
+            {
+                cerr << "ERROR: scan header too short for " << dec << (int)(*fptr)->Nf << " components" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // Create some space for the header (structure not overlayed on byte buffer,
+            // since component specific parameter is not of fixed size, pushing
+            // subsequent fields to non-predeterminate positions)
+            try
+            {
+                *sptr = new scan_header_t;
+            }
+            catch(std::bad_alloc& ba)
+            {
+                cerr << "ERROR: memory allocation error: " << ba.what() << endl;
+                return JPEG_MEMORY_ERROR;
+            };
+
+            // These fields extracted from byte buffer
+            (*sptr)->length = length;
+            (*sptr)->Ns     = buf[buf_idx+JPEG_SOS_NS_OFFSET];
+
+            // Pointer to variable length parameters (determined by Ns)
+            (*sptr)->p_Ci   = (scan_params_t*) &buf[buf_idx+JPEG_SOS_CI_OFFSET];
+
+            // Pointer to last few parameters (known constants for baseline DCT)
+            (*sptr)->p_tail = (scan_tail_t*)   &buf[buf_idx+JPEG_SOS_CI_OFFSET + ((*sptr)->Ns*2)];
+
+#ifndef JPEG_IGNORE_SOS_TAIL_ERRORS
+            // Check the values
+            if ((*sptr)->p_tail->Ss != 0 || (*sptr)->p_tail->Se != JPEG_MCU_ELEMENTS-1 || (*sptr)->p_tail->Ahl != 0)
+            {
+                cerr << "ERROR: Unexpected values at end of SOS header" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+#endif
+
+            // Pointer to start of entropy coded data segment
+            (*sptr)->p_ECS  = &buf[buf_idx+JPEG_SOS_CI_OFFSET + ((*sptr)->Ns*2) + JPEG_SOS_TAIL_SIZE];
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_SCAN_EN) {
+                cout << endl;
+                print_scan_hdr(*sptr);
+            }
+#endif
+            // 4 component data is CMYK, unless flagged by APP14 as YCCK (which must be 4 component)
+            if (*fptr != NULL && (*fptr)->Nf == JPEG_NUM_CMYK_COLOURS)
+            {
+                *is_RGB = transform != JPEG_APP14_YCCK;
+            }
+            else if (transform == JPEG_APP14_YCCK)
+            {
+                cerr << "ERROR: APP14 YCCK colour space for a frame without 4 components" << endl;
+                return JPEG_FORMAT_ERROR;
+            }
+
+            // Return at start of scan, as all header data should now have been extracted
+            return JPEG_NO_ERROR;
+
+            break;
+
+        // -----------------------
+        // SOFx markers
+        // -----------------------
+
+        // Only baseline DCT supported, so whine if other SOF markers turn up
+        case JPEG_MKR_SOF1: case JPEG_MKR_SOF2: case JPEG_MKR_SOF3:
+        case JPEG_MKR_SOF5: case JPEG_MKR_SOF6: case JPEG_MKR_SOF7:
+        case JPEG_MKR_SOF9: case JPEG_MKR_SOFa: case JPEG_MKR_SOFb:
+        case JPEG_MKR_SOFd: case JPEG_MKR_SOFe: case JPEG_MKR_SOFf:
+
+            cerr << "ERROR: encountered an unsupported SOF marker (0x" << hex << setw(4) << marker << "). Only baseline (SOF0) allowed." << endl;
+            return JPEG_UNSUPPORTED_ERROR;
+
+            break;
+
+        // Reset interval markers (not expected in header)
+        case JPEG_MKR_RST0: case JPEG_MKR_RST1: case JPEG_MKR_RST2: case JPEG_MKR_RST3:
+        case JPEG_MKR_RST4: case JPEG_MKR_RST5: case JPEG_MKR_RST6: case JPEG_MKR_RST7:
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_RST0 << (int)(marker-JPEG_MKR_RST0);
+            }
+#endif
+
+            cerr << "ERROR: encountered unexpected RSTn marker (0x" << hex << setw(4) << marker << ") in parsing header" << endl;
+            return JPEG_FORMAT_ERROR;
+
+            break;
+
+        // -----------------------
+        // End of image marker
+        // -----------------------
+
+        // EOI not expected in header
+
+        case JPEG_MKR_EOI:
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MKR_EN)
+            {
+                cout << JPEG_STR_EOI;
+            }
+#endif
+            cerr << "ERROR: encountered unexpected EOI marker (0x" << hex << setw(4) << marker << ") in parsing header" << endl;
+            return JPEG_FORMAT_ERROR;
+
+            break;
+
+        // -----------------------
+        // Unkown marker
+        // -----------------------
+
+        default:
+
+            if (expecting_SOI)
+            {
+                cerr << "ERROR: expected SOI marker not found. Input not a JFIF/JPEG file" << endl;
+            }
+            else
+            {
+                cerr << "ERROR: Unrecognised or unsupported marker (" << hex << setw(4) << marker << ") at " << hex << setw(8) << last_buf_idx << endl;
+            }
+
+            return JPEG_FORMAT_ERROR;
+        }
+
+#ifdef JPEG_DEBUG_MODE
+        if (debug_enable & JPEG_DEBUG_MKR_EN)
+        {
+            cout << " at location 0x" << setfill('0') << hex << setw(8) << last_buf_idx << endl;
+        }
+#endif
+
+
+    } while (marker != JPEG_MKR_EOI);
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_huff_decode()
+//
+// Description:
+//
+// Uses the header information extracted by jpeg_extract_header()
+// to return successive 8x8 arrays of integers of Huffman/RLE
+// decoded data, that's been amplitude adjusted and dequantised (as
+// required by the iDCT engine POLICY) and
+// reverse-serpentine positioned. The data is ready for inverse DCT
+// conversion. Note the pointer points to Ns arrays---e.g if Ns == 3
+// Y, Cb and Cr arrays are consecutively located in memory.
+//
+// Parameters:
+//    sptr:     pointer to scan header data
+//    hptr:     pointer to huffman decode data
+//    qptr:     pointer to quantisation table pointers
+//    fptr:     pointer to frame header data
+//    ecs_ptr:  pointer to entropy coded segments pointer (updated)
+//              When *ecs_ptr == NULL, starts from beginning. Is updated after
+//              each returned MCU or marker to point to next data
+//              segment, for chaining.
+//    marker:   pointer to int that's updated with a marker or error code,
+//              if function returns NULL
+//    decode_only: flag to only entropy decode the MCU, tracking the DC
+//              values, for MCUs outside of a crop (or when only the DC
+//              values are needed). The returned array contents are
+//              then undefined, except for each block's de-quantised
+//              DC value.
+//
+// Return value:
+//    NULL:     Indicates a marker or error is returned (to *marker)
+//              If marker < JPEG_MARKER_MASK, then an error code else
+//              a marker, as defined in jfif_local.h
+//
+//    non-NULL: a pointer to 8x8 array of 16 bit ints with decoded data
+//
+
+template <class POLICY>
+int16_t (*jfif::jpeg_huff_decode(scan_header_t *sptr, DHT_offsets_t *hptr, DQT_t *qptr, frame_header_t *fptr,
+                             uint8_t *ecs_ptr[],    int *marker, bool decode_only)) [JPEG_MCU_ELEMENTS]
+{
+    using std::cout;
+    using std::cerr;
+    using std::setw;
+    using std::endl;
+
+    // Input stream (ECS) index
+    int idx = 0;
+
+    // Huffman/RLE  decode values
+    rle_amplitude_t rle;
+
+    // Default returned marker is 'none'
+    *marker = 0;
+
+    // If follow-on pointer null, point to beginning of ECS segment
+    if (*ecs_ptr == NULL)
+    {
+        *ecs_ptr = sptr->p_ECS;
+    }
+
+    // Extract sampling factors locally (ignore if no chroma components)
+    int horiz_sampling = (fptr->Nf == 1) ? 1 : (fptr->Ci[0].HVi >> 4) & 0xf;
+    int vert_sampling  = (fptr->Nf == 1) ? 1 : (fptr->Ci[0].HVi)      & 0xf;
+
+    int y_arrays       = horiz_sampling*vert_sampling;
+    // With 4 components, K is either sampled as luma (with as many arrays) or as chroma
+    int k_arrays       = (sptr->Ns == JPEG_NUM_CMYK_COLOURS && fptr->Ci[3].HVi == fptr->Ci[0].HVi) ? y_arrays : 1;
+    int total_arrays   = sptr->Ns + y_arrays + k_arrays - 2;
+
+    // Clear MCU data (for as many 8x8 blocks as needed)
+    for (int ydx = 0; ydx < total_arrays && !decode_only; ydx++)
+    {
+        for (int mdx = 0; mdx < JPEG_MCU_ELEMENTS; mdx++)
+        {
+            mcu[ydx][mdx] = 0;
+        }
+    }
+
+    // The MCU contains up to 10 elements (e.g. Y alone, or Y Cb Cr, or Y..Y Cb Cr [sub-sampled],
+    // or Y..Y Cb Cr K..K [4 component, with K sampled as luma])
+    for (int array = 0; array < total_arrays; array++)
+    {
+
+        // Pick the table for Y, then the chroma arrays, then any K arrays
+        int table = (array >= y_arrays) ? std::min(array - y_arrays + 1, sptr->Ns - 1) : 0;
+
+        // Get Td/Ta values for this table
+        int Td = ((sptr->p_Ci+table)->Tda >> 4) & 0xf;
+        int Ta = ((sptr->p_Ci+table)->Tda >> 0) & 0xf;
+
+        // Pick the quantisation table for this segment
+        int Tq = fptr->Ci[table].Tq;
+
+        // Fetch DC codeword (= length of additional bits to follow), or marker
+        rle = jpeg_dht_lookup (hptr, true, Td, *ecs_ptr, &idx, &jfif_barrel, &jfif_bit_count);
+
+        // Got a marker
+        if (rle.marker)
+        {
+            // Locally check for RSTn and reset DC diff value(s)
+            if ((rle.marker & 0xfff0) == JPEG_MKR_RST0)
+            {
+#ifdef JPEG_DEBUG_MODE
+                if (debug_enable & JPEG_DEBUG_MKR_EN)
+                {
+                    cout << "jpeg_huff_decode: reset DC" << endl;
+                }
+#endif
+                // Reset all the DC values
+                for (int jdx = 0; jdx < JPEG_SOS_MAX_NS; jdx++)
+                {
+                    current_dc_value[jdx] = 0;
+                }
+            }
+
+            *ecs_ptr += idx;
+            *marker   = rle.marker;
+
+            return NULL;
+
+        // If not EOB then get DC value
+        }
+        else
+        {
+            // Extract raw DC value and de-quantise
+            if (!rle.is_EOB && rle.amplitude && qptr[Tq].Qn[0])
+            {
+                current_dc_value[table] += rle.amplitude;
+            }
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_AMP_EN)
+            {
+                cout << "AMP(dc):  " << 0 << ": " << current_dc_value[table] << " (" << rle.amplitude << ")" << endl;
+            }
+#endif
+
+
+            // De-quantise the DC value (descaled by the fast integer policy, as the Qn values
+            // also include AAN iDCT prescaling, only partially descaled already)
+            mcu[array][0] = JPEG_CLIP16(POLICY::dequantise(current_dc_value[table], qptr[Tq].Qn[0]));
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_QNT_EN)
+            {
+                cout << setw(2) << 0 << ": " << setw(6) <<  current_dc_value[table] << " " << setw(6) << qptr[Tq].Qn[0] << " " << mcu[array][0] << endl;
+            }
+#endif
+
+        }
+
+        // Fetch AC codewords
+        for (int mdx = 1; mdx < JPEG_MCU_ELEMENTS; mdx++)
+        {
+            // Lookup the code in the Huffman table, or get marker
+            rle = jpeg_dht_lookup (hptr, false, Ta, *ecs_ptr, &idx, &jfif_barrel, &jfif_bit_count);
+
+            // Shouldn't get a marker in the middle of AC data except EOI near
+            // beginning (flushed to byte boundary)
+            if (rle.marker)
+            {
+                if (rle.marker == JPEG_MKR_EOI)
+                {
+                    *ecs_ptr += idx;
+                    *marker   = rle.marker;
+
+                }
+                else if (rle.marker & JPEG_MARKER_MASK)
+                {
+                    cerr << "ERROR: jpeg_huff_decode: got a marker in the middle of AC data" << endl;
+                    *marker = JPEG_FORMAT_ERROR;
+                }
+                else
+                {
+                    // Lookup error
+                    *marker = rle.marker;
+                }
+
+                return NULL;
+
+            }
+            else if (rle.is_EOB)
+            {
+                mdx = JPEG_MCU_ELEMENTS;
+
+            }
+            else
+            {
+                // If there are zero run length elements simply skip index
+                if (rle.ZRL)
+                {
+                    mdx += rle.ZRL;
+                }
+
+                // If not a ZRL (0xF0) code update mcu (ZRL implies a 0 value at mdx)
+                if (!rle.is_ZRL)
+                {
+                    // Corrupt data may run past the block's last coefficient
+                    if (mdx >= JPEG_MCU_ELEMENTS)
+                    {
+                        cerr << "ERROR: jpeg_huff_decode: coefficient beyond the end of the block" << endl;
+                        *marker = JPEG_FORMAT_ERROR;
+                        return NULL;
+                    }
+
+                    // Update MCU matrix
+                    if (!rle.is_EOB && rle.amplitude && qptr[Tq].Qn[mdx] && !decode_only)
+                    {
+                        // Inverse zigzag MCU index and store dequantised amplitude value
+                        mcu[array][jpeg_inv_zigzag[mdx]] = JPEG_CLIP16(POLICY::dequantise(rle.amplitude, qptr[Tq].Qn[mdx]));
+
+#ifdef JPEG_DEBUG_MODE
+                       if (debug_enable & JPEG_DEBUG_AMP_EN)
+                       {
+                           cout << "AMP(ac): " << setw(2) << mdx << ": " << rle.amplitude << endl;
+                       }
+
+                       if (debug_enable & JPEG_DEBUG_QNT_EN)
+                       {
+                           cout << setw(2) << jpeg_inv_zigzag[mdx] << ": ";
+                           cout << setw(6) << rle.amplitude << " ";
+                           cout << setw(6) << qptr[Tq].Qn[mdx] << " ";
+                           cout << mcu[array][jpeg_inv_zigzag[mdx]] << endl;
+                       }
+#endif
+                    }
+                }
+#ifdef DEBUG_MODE
+                else {
+                    if (debug_enable & JPEG_DEBUG_MKR_EN)
+                    {
+                        cout << "ZRL" << endl;
+                    }
+                }
+#endif
+            }
+        }
+    }
+
+    // Update data pointer to next segment
+    *ecs_ptr += idx;
+
+    // Return the array data
+    return mcu;
+}
+
+//-------------------------------------------------------------
+// jpeg_bitmap_init()
+//
+// Description:
+//
+// Initialises the header of a 24 bit bitmap for the image being
+// processed, at the start of a space of jpeg_bitmap_size_c()
+// bytes (no more than JPEG_BITMAP_MAX_SIZE). The pixel data is
+// not initialised, as every row is written by
+// jpeg_bitmap_update(). A top-down bitmap is flagged
+// with a negative height. An 8 bit bitmap has a grayscale palette,
+// following the header.
+//
+// Parameters:
+//    bmp_ptr:  pointer to the bitmap space
+//    X:        Image width in pixels
+//    Y:        Image height in pixels
+//    bits:     bits per pixel (24, or 8 for grayscale)
+//    top_down: rows stored top-down
+//
+// Return value:
+//    Size of the header (including any palette) in bytes
+//
+
+int jfif::jpeg_bitmap_init(uint8_t *bmp_ptr, int X, int Y, int bits, bool top_down)
+{
+    // Size of the bitmap (including header)
+    uint32_t bmp_size          = (uint32_t)jpeg_bitmap_bits_size_c(X, Y, bits);
+
+    // Size of the header, and any palette
+    int      hdr_size          = BMP_HDRSIZE + ((bits == 8) ? JPEG_BMP_GRAY_PALETTE_SIZE : 0);
+
+    // Cast the bitmap start to a bitmap header
+    bmhdr_t* bmp_hdr           = (bmhdr_t *)bmp_ptr;
+
+    memset(bmp_ptr, 0, BMP_HDRSIZE);
+
+    // Initialise bitmap file fields
+    bmp_hdr->f.bfType[0]       = 'B';
+    bmp_hdr->f.bfType[1]       = 'M';
+    bmp_hdr->f.bfSize          = bmp_size;
+    bmp_hdr->f.bfOffBits       = hdr_size;
+
+    // Initialise bitmap info (unspecified fields are left as 0)
+    bmp_hdr->i.biSize          = BMP_INFOHDRSIZE;
+    bmp_hdr->i.biWidth         = X;
+    bmp_hdr->i.biHeight        = top_down ? (uint32_t)-Y : Y;
+    bmp_hdr->i.biPlanes        = 1;
+    bmp_hdr->i.biBitCount      = bits;
+    bmp_hdr->i.biClrUsed       = (bits == 8) ? JPEG_BMP_GRAY_LEVELS : 0;
+
+    // Do endian swap if needed
+    BMP_HDRENDIAN(bmp_hdr);
+
+    // Grayscale palette, with each index its own level
+    if (bits == 8)
+    {
+        rgbquad_t *palette = (rgbquad_t *)&bmp_ptr[BMP_HDRSIZE];
+
+        for (int idx = 0; idx < JPEG_BMP_GRAY_LEVELS; idx++)
+        {
+            palette[idx].Blue        = idx;
+            palette[idx].Green       = idx;
+            palette[idx].Red         = idx;
+            palette[idx].rgbReserved = 0;
+        }
+    }
+
+    return hdr_size;
+}
+
+//-------------------------------------------------------------
+// jpeg_dqt_prescale()
+//
+// Description:
+//
+// Applies the iDCT engine POLICY's prescaling to the raw
+// quantisation tables extracted by jpeg_extract_header().
+//
+// Parameters:
+//    qptr:     Pointer to quantisation tables (updated)
+//
+// Return value:
+//    None
+//
+
+template <class POLICY>
+void jfif::jpeg_dqt_prescale(DQT_t *qptr)
+{
+    for (int tdx = 0; tdx < JPEG_MAX_QUANT_TABLES; tdx++)
+    {
+        for (int zdx = 0; zdx < JPEG_DQT_ELEMENTS; zdx++)
+        {
+            qptr[tdx].Qn[zdx] = POLICY::dqt_prescale(qptr[tdx].Qn[zdx], zdx);
+        }
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_output_size()
+//
+// Description:
+//
+// Gives the size of the outputs for an image: that of the crop,
+// if selected, or the image, unless a resize is selected. Given
+// only one of the resize width and height, the other keeps the
+// aspect ratio of the crop (or image).
+//
+// Parameters:
+//    X_img:    image width in pixels
+//    Y_img:    image height in pixels
+//    X:        pointer to the returned output width
+//    Y:        pointer to the returned output height
+//
+// Return value:
+//    None
+//
+
+void jfif::jpeg_output_size (int X_img, int Y_img, int *X, int *Y)
+{
+    int cw = crop_width  ? crop_width  : X_img;
+    int ch = crop_height ? crop_height : Y_img;
+
+    *X = resize_width  ? resize_width  : cw;
+    *Y = resize_height ? resize_height : ch;
+
+    if (resize_width && !resize_height)
+    {
+        *Y = std::max((int)(((long)ch*resize_width + cw/2) / cw), 1);
+    }
+    else if (resize_height && !resize_width)
+    {
+        *X = std::max((int)(((long)cw*resize_height + ch/2) / ch), 1);
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_mcu_needed()
+//
+// Description:
+//
+// Checks whether an MCU is within the range decoded for output
+//
+// Parameters:
+//    band:     pointer to band state
+//    mcu:      MCU count position in the scan
+//    X_mcus:   image width in MCUs
+//
+// Return value:
+//    true if needed, else false
+//
+
+bool jfif::jpeg_mcu_needed (const jpeg_band_t *band, int mcu, int X_mcus)
+{
+    int mcu_col = mcu % X_mcus;
+    int mcu_row = mcu / X_mcus;
+
+    return mcu_col >= band->mcu_x0 && mcu_col <= band->mcu_x1 && mcu_row >= band->mcu_y0 && mcu_row <= band->mcu_y1;
+}
+
+//-------------------------------------------------------------
+// jpeg_skip_to_marker()
+//
+// Description:
+//
+// Skips over entropy coded data, without decoding it, to the
+// next marker, passing over stuffed zero bytes and fill bytes.
+//
+// Parameters:
+//    buf:      pointer to entropy coded data
+//    marker:   pointer to int, updated with the marker found
+//
+// Return value:
+//    Pointer to the data following the marker
+//
+
+uint8_t* jfif::jpeg_skip_to_marker (uint8_t *buf, int *marker)
+{
+    while (jpeg_input_ready(buf, 2) && (buf[0] != JPEG_MARKER_BYTE || buf[1] == 0x00 || buf[1] == JPEG_MARKER_BYTE))
+    {
+        buf++;
+    }
+
+    // Input ended without an EOI marker, so flag one
+    if (!jpeg_input_ready(buf, 2))
+    {
+        *marker = JPEG_MKR_EOI;
+
+        return buf;
+    }
+
+    *marker = (buf[0] << 8) | buf[1];
+
+    return buf + 2;
+}
+
+//-------------------------------------------------------------
+// jpeg_decode_scan()
+//
+// Description:
+//
+// Decodes the scan data, MCU at a time, until the end-of-image
+// marker, using the iDCT engine POLICY. Each MCU is Huffman
+// decoded, inverse DCT'd, colour converted and placed into the
+// bitmap (and raw) buffers.
+//
+// When cropping, only the MCUs covering the crop (plus any needed
+// for upsampling context) are de-quantised, inverse DCT'd and
+// output. Others are just entropy decoded, to track the DC values,
+// or skipped altogether, if a whole restart interval lies outside
+// the crop, and decoding stops after the crop's last MCU.
+//
+// Parameters:
+//    sptr:         pointer to scan header data
+//    hptr:         pointer to huffman decode data
+//    qptr:         pointer to (raw) quantisation tables
+//    fptr:         pointer to frame header data
+//    dri:          restart interval (0 if none)
+//    is_RGB:       3 component data is JPEG RGB data
+//    bmp_data_ptr: pointer to the start of the bitmap's data buffer
+//    rawbuf:       pointer to the raw buffer
+//    raw_stride:   bytes between raw buffer rows
+//    tensor:       pointer to the tensor
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers.
+//
+
+template <class POLICY>
+int jfif::jpeg_decode_scan(scan_header_t *sptr, DHT_offsets_t *hptr, DQT_t *qptr, frame_header_t *fptr,
+                           int dri, bool is_RGB, uint8_t *bmp_data_ptr, uint8_t *rawbuf, int raw_stride,
+                           uint8_t *tensor)
+{
+    using std::cout;
+    using std::cerr;
+    using std::hex;
+    using std::setw;
+    using std::endl;
+
+    // Band (MCU row) state, and its buffers
+    jpeg_band_t          band;
+    std::vector<int16_t> band_buf;
+    std::vector<uint8_t> rgb_buf;
+    std::vector<uint8_t> sink_buf;
+    std::vector<uint8_t> bmp_buf;
+
+    // Resampler state, and its buffers, when resizing
+    jpeg_resize_t         rs;
+    std::vector<int>      rs_start;
+    std::vector<int16_t>  rs_weight;
+    std::vector<uint16_t> rs_h_buf;
+    std::vector<uint32_t> rs_acc_buf;
+    std::vector<uint8_t>  rs_out_buf;
+
+    // Pointer for decoded scan data with Y [Cb Cr] data
+    int16_t (*scan_data_ptr)[JPEG_MCU_ELEMENTS];
+
+    // Pointer to buffer of next data for processing (used in chaining)
+    uint8_t *ecs_ptr = NULL;
+
+    // Local state for marker and RSTn checking
+    int  marker = 0, exp_rst_marker = JPEG_MKR_RST0;
+    bool expecting_rstn = false;
+
+    // Counter for tracking number of MCU's processed
+    int mcu_count = 0;
+
+    // Start with cleared bit reader and DC predictors, as a decoder may be
+    // reused, with state left over from the end of a previous image
+    for (int jdx = 0; jdx < JPEG_SOS_MAX_NS; jdx++)
+    {
+        current_dc_value[jdx] = 0;
+    }
+
+    jfif_barrel     = 0;
+    jfif_bit_count  = 0;
+
+    // Prescale the quantisation tables for the selected iDCT engine
+    jpeg_dqt_prescale<POLICY>(qptr);
+
+    // Extract the H and V subsampling parameters locally, from the frame header
+    // (ignore if no chroma components)
+    int Hi = (fptr->Nf == 1) ? 1 : fptr->Ci[0].HVi >> 4;
+    int Vi = (fptr->Nf == 1) ? 1 : fptr->Ci[0].HVi & 0xf;
+
+    // Extract the image dimensions (with any necessary byte swapping)
+    int Y = JPEG_REORDER16(fptr->Y);
+    int X = JPEG_REORDER16(fptr->X);
+
+    // 4 component data may have K sampled as luma, rather than as chroma
+    bool k_luma    = sptr->Ns == JPEG_NUM_CMYK_COLOURS && fptr->Ci[JPEG_NUM_CMYK_COLOURS-1].HVi == fptr->Ci[0].HVi;
+
+    // The number of arrays n MCU to process is number of scan components plus extra sub-samples
+    int mcu_arrays = sptr->Ns + Hi*Vi - 1 + (k_luma ? Hi*Vi - 1 : 0);
+
+    // MCU width in pixels is 8 x horizontal sub-sampling
+    int mcu_width   = 8 * Hi;
+
+    // MCU height in pixels is 8 x vertical sub-sampling
+    int mcu_height  = 8 * Vi;
+
+    // Calculate width in whole mcus
+    int X_mcus = X/mcu_width + ((X%mcu_width) ? 1 : 0);
+
+    // Calculate height in whole mcus
+    int Y_mcus = Y/mcu_height + ((Y%mcu_height) ? 1 : 0);
+
+    // Calculate total number of MCU to cover image
+    int total_mcus =  X_mcus * Y_mcus;
+
+    // Output rectangle (the crop, or the whole image)
+    bool cropped = crop_width != 0;
+    int  out_x   = cropped ? crop_x      : 0;
+    int  out_y   = cropped ? crop_y      : 0;
+    int  out_w   = cropped ? crop_width  : X;
+    int  out_h   = cropped ? crop_height : Y;
+
+    // Size of the output, if resized
+    int  rs_w, rs_h;
+
+    jpeg_output_size(X, Y, &rs_w, &rs_h);
+
+    bool resized = rs_w != out_w || rs_h != out_h;
+
+    // When resizing, decode with the smallest block size (8, 4, 2 or 1) that keeps
+    // the output rectangle at least the size it's resized to, to resample from
+    int  bs      = JPEG_BLOCK_DIMENSION;
+
+    while (resized && bs > 1 && JPEG_SCALED_DIM(out_w, bs/2) >= rs_w && JPEG_SCALED_DIM(out_h, bs/2) >= rs_h)
+    {
+        bs /= 2;
+    }
+
+    // Output rectangle at the decoded scale
+    int  in_x    = out_x * bs / JPEG_BLOCK_DIMENSION;
+    int  in_y    = out_y * bs / JPEG_BLOCK_DIMENSION;
+    int  in_w    = JPEG_SCALED_DIM(out_x + out_w, bs) - in_x;
+    int  in_h    = JPEG_SCALED_DIM(out_y + out_h, bs) - in_y;
+
+    // Resampling only needed if the decoded scale isn't already the resized size
+    bool resample = in_w != rs_w || in_h != rs_h;
+
+    // MCU size at the decoded scale
+    int  smcu_width  = bs * Hi;
+    int  smcu_height = bs * Vi;
+
+    // Range of MCUs covering the output, plus an MCU either side for triangle filter
+    // context in the sub-sampled direction(s)
+    bool context = sptr->Ns != 1 && upsample_mode == JPEG_UPSAMPLE_TRIANGLE;
+    int  ctx_x   = (context && Hi == JPEG_SUBSAMPLING) ? 1 : 0;
+    int  ctx_y   = (context && Vi == JPEG_SUBSAMPLING) ? 1 : 0;
+
+    band.mcu_x0        = std::max(out_x / mcu_width - ctx_x, 0);
+    band.mcu_x1        = std::min((out_x + out_w - 1) / mcu_width + ctx_x, X_mcus - 1);
+    band.mcu_y0        = std::max(out_y / mcu_height - ctx_y, 0);
+    band.mcu_y1        = std::min((out_y + out_h - 1) / mcu_height + ctx_y, Y_mcus - 1);
+
+    int  band_mcus     = band.mcu_x1 - band.mcu_x0 + 1;
+
+    // MCU count once the last MCU needed has been decoded
+    int  last_mcu      = band.mcu_y1 * X_mcus + band.mcu_x1 + 1;
+
+    // Set up the band buffers, with padding for upsampling context
+    band.Hi            = Hi;
+    band.Vi            = Vi;
+    band.bs            = bs;
+    band.Ns            = sptr->Ns;
+    band.is_RGB        = is_RGB;
+    band.k_luma        = k_luma;
+    band.c_planes      = sptr->Ns - 1 - (k_luma ? 1 : 0);
+    band.upsample_mode = upsample_mode;
+    band.delayed       = (sptr->Ns != 1 && Vi == JPEG_SUBSAMPLING && upsample_mode == JPEG_UPSAMPLE_TRIANGLE);
+    band.X             = std::min(JPEG_SCALED_DIM(X, bs) - band.mcu_x0*smcu_width, band_mcus*smcu_width);
+    band.Y             = JPEG_SCALED_DIM(Y, bs);
+    band.c_width       = (band.X + Hi - 1) / Hi;
+    band.c_height      = (band.Y + Vi - 1) / Vi;
+    band.y_stride      = band_mcus*smcu_width + 2*JPEG_BAND_PAD_COLS;
+    band.c_stride      = band_mcus*bs         + 2*JPEG_BAND_PAD_COLS;
+    band.set           = 0;
+    band.rows_out      = 0;
+    band.out_x         = in_x - band.mcu_x0*smcu_width;
+    band.out_y         = in_y;
+    band.in_w          = in_w;
+    band.in_h          = in_h;
+    band.out_w         = rs_w;
+    band.out_h         = rs_h;
+    band.rs            = resample ? &rs : NULL;
+    band.bmp_data      = bmp_data_ptr;
+    band.raw           = rawbuf;
+    band.sink          = (output_flags & JPEG_OUTPUT_SINK) ? sink      : NULL;
+    band.band_sink     = (output_flags & JPEG_OUTPUT_BAND) ? band_sink : NULL;
+    band.bmp_sink      = (output_flags & JPEG_OUTPUT_BMP_BAND) ? bmp_sink : NULL;
+    band.sink_ctx      = (output_flags & (JPEG_OUTPUT_SINK | JPEG_OUTPUT_BAND | JPEG_OUTPUT_BMP_BAND)) ? sink_ctx : NULL;
+    band.pixel_format  = pixel_format;
+    band.raw_stride    = raw_stride;
+    band.raw_y0        = 0;
+    band.raw_rows      = rs_h;
+
+    // A band outputs at most a band's rows, or when resizing the output rows its rows
+    // cover (plus one, for partial coverage)
+    band.max_rows      = resample ? std::min((int)(((long)smcu_height*rs_h + in_h - 1) / in_h) + 1, rs_h) : smcu_height;
+
+    // Set up the resampler, with each output sample's horizontal weights for the source
+    // samples it covers (as for rows, in jpeg_resize_row()), padded to a multiple of
+    // 8 taps with zero weights
+    if (resample)
+    {
+        int taps = 0;
+
+        for (int x = 0; x < rs_w; x++)
+        {
+            taps = std::max(taps, (int)((((long)x + 1)*in_w - 1) / rs_w - ((long)x*in_w) / rs_w + 1));
+        }
+
+        rs.in_w    = in_w;
+        rs.in_h    = in_h;
+        rs.out_w   = rs_w;
+        rs.out_h   = rs_h;
+        rs.taps    = (taps + 7) & ~7;
+        rs.in_row  = 0;
+        rs.out_row = 0;
+
+        rs_start.resize(rs_w);
+        rs_weight.assign((long)rs_w*rs.taps, 0);
+        rs_h_buf.resize(JPEG_NUM_RGB_COLOURS*rs_w);
+        rs_acc_buf.assign(JPEG_NUM_RGB_COLOURS*rs_w, 0);
+        rs_out_buf.resize(JPEG_NUM_RGB_COLOURS*rs_w);
+
+        for (int x = 0; x < rs_w; x++)
+        {
+            long x_start = (long)x * in_w;
+            long x_end   = x_start + in_w;
+            int  p0      = (int)(x_start / rs_w);
+            int  p1      = (int)((x_end - 1) / rs_w);
+
+            // First tap kept within the source rectangle
+            rs_start[x] = std::min(p0, in_w - taps);
+
+            for (int p = p0; p <= p1; p++)
+            {
+                long seg_start = std::max((long)p * rs_w, x_start);
+                long seg_end   = std::min((long)(p + 1) * rs_w, x_end);
+
+                rs_weight[(long)x*rs.taps + p - rs_start[x]] = JPEG_RESIZE_WEIGHT(seg_end - x_start, in_w) -
+                                                                JPEG_RESIZE_WEIGHT(seg_start - x_start, in_w);
+            }
+        }
+
+        rs.x_start  = &rs_start[0];
+        rs.x_weight = &rs_weight[0];
+
+        for (int cdx = 0; cdx < JPEG_NUM_RGB_COLOURS; cdx++)
+        {
+            rs.h_row[cdx] = &rs_h_buf[cdx*rs_w];
+            rs.acc[cdx]   = &rs_acc_buf[cdx*rs_w];
+            rs.out[cdx]   = &rs_out_buf[cdx*rs_w];
+        }
+    }
+
+    // For a band sink, the raw buffer is a band (MCU row) buffer, reused for each band
+    if (band.band_sink != NULL)
+    {
+        band.raw_stride = jpeg_raw_stride_c(pixel_format, rs_w, 0);
+        sink_buf.resize(jpeg_raw_stride_size_c(pixel_format, rs_w, band.max_rows, band.raw_stride));
+        band.raw        = &sink_buf[0];
+    }
+
+    // Likewise, for a bitmap sink the bitmap is a band of top-down rows. Monochrome
+    // images have an 8 bit bitmap, if selected.
+    band.bmp_y0        = 0;
+    band.bmp_bits      = (bitmap_gray && sptr->Ns == 1) ? 8 : 24;
+    band.bmp_stride    = (band.bmp_bits == 8) ? JPEG_BMP_GRAY_PADDED_BYTES(rs_w) : BMP_WIDTH_TO_PADDED_BYTES(rs_w);
+
+    if (band.bmp_sink != NULL)
+    {
+        bmp_buf.resize((long)band.bmp_stride * band.max_rows);
+        band.bmp_data   = &bmp_buf[0];
+    }
+
+    band.tensor        = tensor;
+    band.tensor_type   = tensor_type;
+    band.tensor_layout = tensor_layout;
+    band.tensor_scale  = tensor_scale;
+    band.tensor_offset = tensor_offset;
+
+    // Colour conversion only needed for the 24 bit bitmap, the tensor and RGB based
+    // formats, or for resampling
+    // (CMYK output being converted to C, M and Y, for 4 component data)
+    band.need_rgb      = resample || (band.bmp_data != NULL && band.bmp_bits == 24) || band.tensor != NULL ||
+                         ((band.raw != NULL || band.sink != NULL) &&
+                          (pixel_format != JPEG_PIXFMT_GRAY8 || (sptr->Ns != 1 && (is_RGB || sptr->Ns == JPEG_NUM_CMYK_COLOURS))) &&
+                          pixel_format != JPEG_PIXFMT_I420 && pixel_format != JPEG_PIXFMT_NV12);
+
+    // 4 component data has C, M, Y and K rows after the RGB rows (C, M and Y used for CMYK output only)
+    bool cmyk_out = pixel_format == JPEG_PIXFMT_CMYK && (band.raw != NULL || band.sink != NULL);
+    int  n_rows   = JPEG_NUM_RGB_COLOURS + ((sptr->Ns == JPEG_NUM_CMYK_COLOURS) ? JPEG_NUM_CMYK_COLOURS : 0);
+
+    int y_size = band.y_stride * (smcu_height + 2*JPEG_BAND_PAD_ROWS);
+    int c_size = band.c_stride * (bs          + 2*JPEG_BAND_PAD_ROWS);
+
+    band_buf.resize(JPEG_BAND_SETS*((k_luma ? 2 : 1)*y_size + band.c_planes*c_size) + band.c_planes*band.y_stride);
+    rgb_buf.resize(n_rows*band.y_stride + ((band.sink != NULL) ? rs_w*JPEG_MAX_PIXEL_BYTES : 0));
+
+    int16_t *bptr = &band_buf[0];
+
+    for (int set = 0; set < JPEG_BAND_SETS; set++)
+    {
+        for (int cdx = 0; cdx < JPEG_SOS_MAX_NS; cdx++)
+        {
+            if (cdx < sptr->Ns)
+            {
+                // Luma sampled planes (Y, and any luma sampled K), else chroma sampled
+                bool luma   = cdx == 0 || (cdx == JPEG_NUM_CMYK_COLOURS-1 && k_luma);
+                int  stride = luma ? band.y_stride : band.c_stride;
+
+                band.comp[set][cdx] = bptr + JPEG_BAND_PAD_ROWS*stride + JPEG_BAND_PAD_COLS;
+                bptr               += luma ? y_size : c_size;
+            }
+            else
+            {
+                band.comp[set][cdx] = NULL;
+            }
+        }
+    }
+
+    for (int cdx = 0; cdx < JPEG_SOS_MAX_NS-1; cdx++)
+    {
+        band.c_up[cdx] = (cdx < band.c_planes) ? bptr + cdx*band.y_stride : NULL;
+    }
+
+    for (int cdx = 0; cdx < JPEG_NUM_RGB_COLOURS; cdx++)
+    {
+        band.rgb[cdx] = &rgb_buf[cdx*band.y_stride];
+    }
+
+    for (int cdx = 0; cdx < JPEG_NUM_CMYK_COLOURS; cdx++)
+    {
+        bool used = (cdx == JPEG_NUM_CMYK_COLOURS-1) ? sptr->Ns == JPEG_NUM_CMYK_COLOURS : cmyk_out;
+
+        band.cmyk[cdx] = used ? &rgb_buf[(JPEG_NUM_RGB_COLOURS + cdx)*band.y_stride] : NULL;
+    }
+
+    band.row = &rgb_buf[n_rows*band.y_stride];
+
+    // When cropping with restart intervals, flags the start of an interval (which might be skipped)
+    bool interval_start = cropped && dri;
+
+    // Process scan data until end-of-image marker
+    while (marker != JPEG_MKR_EOI)
+    {
+        // At the start of a restart interval with none of its MCUs needed, skip
+        // straight to the interval's RSTn marker, without decoding
+        if (interval_start)
+        {
+            bool needed = false;
+
+            for (int mcu = mcu_count; mcu < std::min(mcu_count + dri, total_mcus) && !needed; mcu++)
+            {
+                needed = jpeg_mcu_needed(&band, mcu, X_mcus);
+            }
+
+            interval_start = false;
+
+            if (!needed)
+            {
+                ecs_ptr = jpeg_skip_to_marker((ecs_ptr == NULL) ? sptr->p_ECS : ecs_ptr, &marker);
+
+                if (marker == exp_rst_marker)
+                {
+                    // Restart, as for a decoded interval
+                    for (int jdx = 0; jdx < JPEG_SOS_MAX_NS; jdx++)
+                    {
+                        current_dc_value[jdx] = 0;
+                    }
+
+                    jfif_bit_count  = 0;
+                    exp_rst_marker  = (exp_rst_marker & 0xfff0) + (exp_rst_marker+1)%8;
+                    marker          = 0;
+                    mcu_count      += dri;
+                    interval_start  = true;
+                }
+                else if (marker != JPEG_MKR_EOI)
+                {
+                    cerr << "ERROR: encountered unexpected marker (0x" << hex << setw(4) << marker << ") skipping scan data" << endl;
+                    return JPEG_FORMAT_ERROR;
+                }
+
+                continue;
+            }
+        }
+
+        // Decode entropy data (only, for MCUs outside of a crop, and only the DC
+        // coefficients for a block size of 1)
+        scan_data_ptr = jpeg_huff_decode<POLICY>(sptr, hptr, qptr, fptr, &ecs_ptr, &marker,
+                                                 !jpeg_mcu_needed(&band, mcu_count, X_mcus) || bs == 1);
+
+        // NULL returned on encountering a marker or error
+        if (scan_data_ptr == NULL)
+        {
+            // Encountered a marker
+            if (marker & JPEG_MARKER_MASK)
+            {
+                // Only expecting RSTn or EOI
+                if (marker >= JPEG_MKR_RST0 && marker <= JPEG_MKR_RST7)
+                {
+                    if (marker != exp_rst_marker)
+                    {
+                        cerr << "ERROR: unexpected RSTn marker sequence (got " << hex << setw(4) << marker;
+                        cerr << ", expected " << hex << setw(4) << exp_rst_marker << endl;
+                        return JPEG_FORMAT_ERROR;
+                    }
+
+#ifdef JPEG_DEBUG_MODE
+                    if (debug_enable & JPEG_DEBUG_MKR_EN)
+                    {
+                         cout << "RST" << (marker - JPEG_MKR_RST0) << endl;
+                    }
+#endif
+                    exp_rst_marker = (exp_rst_marker & 0xfff0) + (exp_rst_marker+1)%8;
+                    marker = 0;
+                    expecting_rstn = false;
+                    interval_start = cropped && dri;
+
+                }
+                else if (marker == JPEG_MKR_EOI)
+                {
+#ifdef JPEG_DEBUG_MODE
+                    if (debug_enable & JPEG_DEBUG_MKR_EN)
+                    {
+                        cout << "EOI" << endl;
+                    }
+#endif
+                }
+                else
+                {
+                    cerr << "ERROR: encountered unexpected marker (0x" << hex << setw(4) << marker << ") in scan data" << endl;
+                    return JPEG_FORMAT_ERROR;
+                }
+            // An error occured, return error code (in marker)
+            }
+            else
+            {
+                return marker;
+            }
+
+        // Received a valid MCU
+        } else {
+
+            // Should have finished by now, but make this a warning only that EOI is missing
+            if (mcu_count >= total_mcus)
+            {
+#ifndef JPEG_NO_WARNINGS
+                cerr << "WARNING: receiving more data when EOI expected" << endl;
+#endif
+                // Break out of the while loop, as if EOI, as no more data needs processing
+                break;
+            }
+
+#ifdef JPEG_DEBUG_MODE
+            if (debug_enable & JPEG_DEBUG_MCU_EN)
+            {
+                cout << "MCU " << (mcu_count % X_mcus) << "," << (mcu_count / X_mcus) << endl;
+                print_MCU(scan_data_ptr, mcu_arrays);
+            }
+#endif
+
+            if (jpeg_mcu_needed(&band, mcu_count, X_mcus))
+            {
+                // Perform inverse DCT for each 8x8 element and return into same buffer,
+                // with a reduced size iDCT when resizing to 1/2 or 1/4 scale (and none
+                // when only the DC coefficients are needed)
+                for (int scans = 0; scans < mcu_arrays && bs != 1; scans++)
+                {
+                    if (bs == JPEG_BLOCK_DIMENSION)
+                    {
+                        POLICY::idct(*this, (jpeg_8x8_block_t)scan_data_ptr[scans]);
+                    }
+                    else
+                    {
+                        POLICY::idct_reduced(*this, (jpeg_8x8_block_t)scan_data_ptr[scans], bs);
+                    }
+                }
+
+                // Store the blocks in the band, and convert and output the band when complete
+                jpeg_band_store(&band, scan_data_ptr, mcu_count % X_mcus - band.mcu_x0);
+
+                if ((mcu_count % X_mcus) == band.mcu_x1)
+                {
+                    jpeg_band_complete<POLICY>(&band, mcu_count / X_mcus, mcu_count == last_mcu-1);
+                }
+            }
+
+            // Keep count of MCUs processed
+            mcu_count++;
+
+            // Nothing more to do once the last MCU needed is processed
+            if (mcu_count == last_mcu)
+            {
+                break;
+            }
+
+            // Flag if DRI says next data should be an RSTn marker
+            if (mcu_count && dri && !(mcu_count%dri))
+            {
+                expecting_rstn = true;
+            }
+        }
+    }
+
+    // If the scan ended early, output any partial band, and any band whose output was delayed
+    if (mcu_count < last_mcu)
+    {
+        int mcu_row = mcu_count / X_mcus;
+        int mcu_col = mcu_count % X_mcus;
+
+        // Last band completed (the current one, if all its MCUs needed were decoded)
+        int done_row = (mcu_col > band.mcu_x1) ? mcu_row : mcu_row - 1;
+
+        if (mcu_row >= band.mcu_y0 && mcu_col > band.mcu_x0 && mcu_col <= band.mcu_x1)
+        {
+            // The band's undecoded MCUs are output as black
+            jpeg_band_clear(&band, mcu_col - band.mcu_x0);
+            jpeg_band_complete<POLICY>(&band, mcu_row, true);
+        }
+        else if (band.delayed && done_row >= band.mcu_y0)
+        {
+            jpeg_band_output<POLICY>(&band, (band.set + 1) % JPEG_BAND_SETS, done_row);
+        }
+
+        // The rows after the last band output are black too, with the first two rows of the
+        // band's components set to black for the formats taken from these
+        for (int cdx = 0; cdx < JPEG_NUM_RGB_COLOURS; cdx++)
+        {
+            memset(band.rgb[cdx], 0, band.y_stride);
+
+            if (band.rs != NULL)
+            {
+                memset(rs.out[cdx], 0, rs_w);
+            }
+        }
+
+        // (Black as full ink, for the inverted C, M, Y and K of 4 component data)
+        for (int cdx = 0; cdx < JPEG_NUM_CMYK_COLOURS; cdx++)
+        {
+            if (band.cmyk[cdx] != NULL)
+            {
+                memset(band.cmyk[cdx], 0, band.y_stride);
+            }
+        }
+
+        for (int cdx = 0; cdx < sptr->Ns; cdx++)
+        {
+            int      stride = cdx ? band.c_stride : band.y_stride;
+            int16_t *plane  = band.comp[band.set][cdx];
+
+            std::fill(plane, plane + stride + band.X, (int16_t)(cdx ? JPEG_CHROMA_NEUTRAL : 0));
+        }
+
+        int first_black = band.rows_out;
+
+        for (int y_pos = first_black; y_pos < rs_h; y_pos++)
+        {
+            // Band and bitmap sinks given the rows a band's worth at a time
+            if (y_pos == first_black || y_pos - band.bmp_y0 == band.max_rows)
+            {
+                band.bmp_y0 = y_pos;
+
+                if (band.band_sink != NULL)
+                {
+                    band.raw_y0   = y_pos;
+                    band.raw_rows = std::min(band.max_rows, rs_h - y_pos);
+                }
+            }
+
+            jpeg_output_row(&band, band.set, y_pos & 1, y_pos);
+
+            if (y_pos == rs_h-1 || y_pos - band.bmp_y0 == band.max_rows-1)
+            {
+                int rows = y_pos - band.bmp_y0 + 1;
+
+                if (band.band_sink != NULL)
+                {
+                    band.band_sink(band.sink_ctx, band.bmp_y0, rows, band.raw, band.raw_stride, rs_w);
+                }
+
+                if (band.bmp_sink != NULL)
+                {
+                    band.bmp_sink(band.sink_ctx, band.bmp_y0, rows, band.bmp_data, band.bmp_stride, rs_w);
+                }
+            }
+        }
+    }
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_idct_mode()
+//
+// Description:
+//
+// Selects the iDCT engine used for subsequent decodes.
+//
+// Parameters:
+//    mode:     One of JPEG_IDCT_FAST_INT, JPEG_IDCT_SLOW_INT or
+//              JPEG_IDCT_FLOAT
+//
+// Return value:
+//    JPEG_NO_ERROR, or JPEG_USER_INPUT_ERROR if mode invalid
+//
+
+int jfif::jpeg_set_idct_mode(int mode)
+{
+    if (mode != JPEG_IDCT_FAST_INT && mode != JPEG_IDCT_SLOW_INT && mode != JPEG_IDCT_FLOAT)
+    {
+        std::cerr << "ERROR: jpeg_set_idct_mode(): invalid iDCT mode (" << mode << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    idct_mode = mode;
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_upsample_mode()
+//
+// Description:
+//
+// Selects the chroma upsampling used for subsequent decodes of
+// sub-sampled images.
+//
+// Parameters:
+//    mode:     One of JPEG_UPSAMPLE_NEAREST or JPEG_UPSAMPLE_TRIANGLE
+//
+// Return value:
+//    JPEG_NO_ERROR, or JPEG_USER_INPUT_ERROR if mode invalid
+//
+
+int jfif::jpeg_set_upsample_mode(int mode)
+{
+    if (mode != JPEG_UPSAMPLE_NEAREST && mode != JPEG_UPSAMPLE_TRIANGLE)
+    {
+        std::cerr << "ERROR: jpeg_set_upsample_mode(): invalid upsampling mode (" << mode << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    upsample_mode = mode;
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_output()
+//
+// Description:
+//
+// Selects the output targets for subsequent decodes, so that only
+// the buffers needed are allocated and written.
+//
+// Parameters:
+//    flags:        JPEG_OUTPUT_BMP (or JPEG_OUTPUT_BMP_BAND), JPEG_OUTPUT_RAW
+//                  (or JPEG_OUTPUT_BAND), and/or JPEG_OUTPUT_SINK
+//    sink_in:      row sink function (required for JPEG_OUTPUT_SINK)
+//    sink_ctx_in:  caller context passed to the row, band and bitmap sinks
+//    band_sink_in: band sink function (required for JPEG_OUTPUT_BAND)
+//    bmp_sink_in:  bitmap sink function (required for JPEG_OUTPUT_BMP_BAND)
+//
+// Return value:
+//    JPEG_NO_ERROR, or JPEG_USER_INPUT_ERROR if flags invalid
+//
+
+int jfif::jpeg_set_output(int flags, jpeg_row_sink_t sink_in, void *sink_ctx_in, jpeg_band_sink_t band_sink_in,
+                          jpeg_band_sink_t bmp_sink_in)
+{
+    if (flags == 0 || (flags & ~JPEG_OUTPUT_ALL) || ((flags & JPEG_OUTPUT_SINK) && sink_in == NULL) ||
+        ((flags & JPEG_OUTPUT_BAND)     && (band_sink_in == NULL || (flags & JPEG_OUTPUT_RAW))) ||
+        ((flags & JPEG_OUTPUT_BMP_BAND) && (bmp_sink_in  == NULL || (flags & JPEG_OUTPUT_BMP))))
+    {
+        std::cerr << "ERROR: jpeg_set_output(): invalid output selection (0x" << std::hex << flags << std::dec << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    output_flags = flags;
+    sink         = sink_in;
+    sink_ctx     = sink_ctx_in;
+    band_sink    = band_sink_in;
+    bmp_sink     = bmp_sink_in;
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_pixel_format()
+//
+// Description:
+//
+// Selects the pixel format of the raw buffer and row sink output
+// for subsequent decodes. The bitmap is unaffected.
+//
+// Parameters:
+//    format:   JPEG_PIXFMT_xxx
+//
+// Return value:
+//    JPEG_NO_ERROR, or JPEG_USER_INPUT_ERROR if format invalid
+//
+
+int jfif::jpeg_set_pixel_format(int format)
+{
+    if (format < JPEG_PIXFMT_RGB24 || format > JPEG_PIXFMT_CMYK)
+    {
+        std::cerr << "ERROR: jpeg_set_pixel_format(): invalid pixel format (" << format << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    pixel_format = format;
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_decode_image()
+//
+// Description:
+//
+// Parses the JFIF header of an image and decodes it, using the
+// selected iDCT engine, to the selected output targets. The
+// output buffers are either allocated here, or supplied by the
+// caller and checked against the image's size. Buffers of
+// targets not selected are returned as NULL.
+//
+// Parameters:
+//    ibuf:     pointer to the input buffer containing the JFIF data
+//    len:      length of the input in bytes, with all reads checked
+//              against it, or 0 for input terminated by an EOI marker
+//    bufs:     pointer to the output buffers, updated when allocating
+//    use_raw:  flag raw buffer wanted, when selected
+//    allocate: flag buffers to be allocated
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers. JPEG_UNSUPPORTED_ERROR returned for a
+//    planar YUV pixel format with RGB coded data, or when resizing,
+//    JPEG_USER_INPUT_ERROR for missing or too small caller buffers, and
+//    JPEG_MEMORY_ERROR if the output buffers can't be allocated.
+//
+
+int jfif::jpeg_decode_image(uint8_t *ibuf, long len, jpeg_output_bufs_t *bufs, bool use_raw, bool allocate)
+{
+    // Pointers to JPEG segments and data
+    scan_header_t*  scan_header  = NULL;
+    frame_header_t* frame_header = NULL;
+    DHT_offsets_t*  dht_table    = NULL;
+    DQT_t           dqt_table[JPEG_MAX_QUANT_TABLES] = {};
+
+    // Local state for DRI
+    int  dri = 0;
+
+    // Local status holders
+    int status;
+    bool is_RGB;
+
+    // Bound all reads of the input to its length, if known
+    jpeg_input_bound(ibuf, len);
+
+    // Parse JFIF header
+    if ((status = jpeg_extract_header(ibuf, &scan_header, &frame_header, dqt_table, &dht_table, &dri, &is_RGB)) == JPEG_NO_ERROR)
+    {
+        // Extract the image dimensions (with any necessary byte swapping)
+        int  Y_img      = JPEG_REORDER16(frame_header->Y);
+        int  X_img      = JPEG_REORDER16(frame_header->X);
+
+        // Output dimensions, of the crop if selected, or the resize (none for an empty frame)
+        int  X = 0, Y = 0;
+
+        if (X_img != 0 && Y_img != 0)
+        {
+            jpeg_output_size(X_img, Y_img, &X, &Y);
+        }
+
+        bool use_bmp    = (output_flags & JPEG_OUTPUT_BMP) != 0;
+        bool use_tensor = (output_flags & JPEG_OUTPUT_TENSOR) != 0;
+        int  bmp_bits   = (bitmap_gray && scan_header->Ns == 1) ? 8 : 24;
+        long bmp_size   = jpeg_bitmap_bits_size_c(X, Y, bmp_bits);
+        int  min_stride = jpeg_raw_stride_c(pixel_format, X, 0);
+
+        use_raw = use_raw && (output_flags & JPEG_OUTPUT_RAW);
+
+        // An empty frame has no MCUs to decode (or crop, or resize)
+        if (X_img == 0 || Y_img == 0)
+        {
+            std::cerr << "ERROR: jpeg_decode_image(): invalid image size (" << X_img << "x" << Y_img << ")" << std::endl;
+            status = JPEG_FORMAT_ERROR;
+        }
+        // Check the crop fits the image (and is at an even position for planar YUV)
+        else if (crop_width && (crop_x + crop_width > X_img || crop_y + crop_height > Y_img ||
+                                ((pixel_format == JPEG_PIXFMT_I420 || pixel_format == JPEG_PIXFMT_NV12) && ((crop_x | crop_y) & 1))))
+        {
+            std::cerr << "ERROR: jpeg_decode_image(): crop (" << crop_x << "," << crop_y << " " << crop_width << "x" << crop_height
+                      << ") invalid for " << X_img << "x" << Y_img << " image" << std::endl;
+            status = JPEG_USER_INPUT_ERROR;
+        }
+        // Planar YUV is taken from the components, so must be YCbCr (or monochrome) data
+        else if ((pixel_format == JPEG_PIXFMT_I420 || pixel_format == JPEG_PIXFMT_NV12) && frame_header->Nf != 1 &&
+                 (is_RGB || frame_header->Nf == JPEG_NUM_CMYK_COLOURS) && (output_flags & (JPEG_OUTPUT_RAW | JPEG_OUTPUT_SINK | JPEG_OUTPUT_BAND)))
+        {
+            std::cerr << "ERROR: jpeg_decode_image(): planar YUV output not supported for RGB, CMYK or YCCK coded data" << std::endl;
+            status = JPEG_UNSUPPORTED_ERROR;
+        }
+        // Planar CMYK is only of 4 component data
+        else if (pixel_format == JPEG_PIXFMT_CMYK && frame_header->Nf != JPEG_NUM_CMYK_COLOURS &&
+                 (output_flags & (JPEG_OUTPUT_RAW | JPEG_OUTPUT_SINK | JPEG_OUTPUT_BAND)))
+        {
+            std::cerr << "ERROR: jpeg_decode_image(): planar CMYK output not supported for " << (int)frame_header->Nf
+                      << " component data" << std::endl;
+            status = JPEG_UNSUPPORTED_ERROR;
+        }
+        // Resizing resamples RGB rows, so the planar formats are not available
+        else if ((resize_width || resize_height) &&
+                 (pixel_format == JPEG_PIXFMT_I420 || pixel_format == JPEG_PIXFMT_NV12 || pixel_format == JPEG_PIXFMT_CMYK) &&
+                 (output_flags & (JPEG_OUTPUT_RAW | JPEG_OUTPUT_SINK | JPEG_OUTPUT_BAND)))
+        {
+            std::cerr << "ERROR: jpeg_decode_image(): planar YUV or CMYK output not supported when resizing" << std::endl;
+            status = JPEG_UNSUPPORTED_ERROR;
+        }
+        // A bitmap's size must fit its header's 32 bit field
+        else if ((output_flags & (JPEG_OUTPUT_BMP | JPEG_OUTPUT_BMP_BAND)) && bmp_size > JPEG_BITMAP_MAX_SIZE)
+        {
+            std::cerr << "ERROR: jpeg_decode_image(): bitmap output not supported for " << std::dec << X << "x" << Y
+                      << " image (over " << JPEG_BITMAP_MAX_SIZE << " bytes)" << std::endl;
+            status = JPEG_UNSUPPORTED_ERROR;
+        }
+        // A tensor is always written to the caller's slot
+        else if (allocate && use_tensor)
+        {
+            std::cerr << "ERROR: jpeg_decode_image(): tensor output needs a caller supplied buffer" << std::endl;
+            status = JPEG_USER_INPUT_ERROR;
+        }
+        // Create space for only the selected output targets (every pixel is
+        // written, so no initialisation needed), or check the caller's buffers
+        else if (allocate)
+        {
+            bufs->bmp        = NULL;
+            bufs->raw        = NULL;
+            bufs->bmp_size   = use_bmp ? bmp_size : 0;
+            bufs->raw_stride = min_stride;
+            bufs->raw_size   = use_raw ? jpeg_raw_stride_size_c(pixel_format, X, Y, min_stride) : 0;
+
+            try
+            {
+                bufs->bmp    = use_bmp ? new uint8_t[bufs->bmp_size] : NULL;
+                bufs->raw    = use_raw ? new uint8_t[bufs->raw_size] : NULL;
+            }
+            catch(std::bad_alloc& ba)
+            {
+                std::cerr << "ERROR: jpeg_decode_image(): memory allocation failed for " << X << "x" << Y
+                          << " image: " << ba.what() << std::endl;
+
+                // Any bitmap allocated before the raw buffer failed is freed
+                delete [] bufs->bmp;
+                bufs->bmp    = NULL;
+                status       = JPEG_MEMORY_ERROR;
+            }
+        }
+        else
+        {
+            bufs->raw_stride = bufs->raw_stride ? bufs->raw_stride : min_stride;
+
+            if ((use_bmp    && (bufs->bmp == NULL || bufs->bmp_size < bmp_size)) ||
+                (use_raw    && (bufs->raw == NULL || bufs->raw_stride < min_stride ||
+                                bufs->raw_size < jpeg_raw_stride_size_c(pixel_format, X, Y, bufs->raw_stride))) ||
+                (use_tensor && (bufs->tensor == NULL || bufs->tensor_size < jpeg_tensor_size_c(tensor_type, X, Y))))
+            {
+                std::cerr << "ERROR: jpeg_decode_image(): output buffer missing or too small for "
+                          << X << "x" << Y << " image" << std::endl;
+                status = JPEG_USER_INPUT_ERROR;
+            }
+
+            bufs->bmp = use_bmp ? bufs->bmp : NULL;
+            bufs->raw    = use_raw    ? bufs->raw    : NULL;
+            bufs->tensor = use_tensor ? bufs->tensor : NULL;
+        }
+
+        if (status == JPEG_NO_ERROR)
+        {
+            uint8_t* bmp_data_ptr = NULL;
+
+            if (bufs->bmp != NULL)
+            {
+                bmp_data_ptr = bufs->bmp + jpeg_bitmap_init(bufs->bmp, X, Y, bmp_bits);
+            }
+
+            // Decode the scan data with the selected iDCT engine
+            switch (idct_mode)
+            {
+            case JPEG_IDCT_SLOW_INT:
+                status = jpeg_decode_scan<jfif_slow_int_idct_policy>(scan_header, dht_table, dqt_table, frame_header, dri, is_RGB,
+                                                                     bmp_data_ptr, bufs->raw, bufs->raw_stride,
+                                                                     (uint8_t *)bufs->tensor);
+                break;
+
+            case JPEG_IDCT_FLOAT:
+                status = jpeg_decode_scan<jfif_float_idct_policy>   (scan_header, dht_table, dqt_table, frame_header, dri, is_RGB,
+                                                                     bmp_data_ptr, bufs->raw, bufs->raw_stride,
+                                                                     (uint8_t *)bufs->tensor);
+                break;
+
+            default:
+#ifdef JPEG_HW_MODEL
+                // Fast integer engine, instrumented with the hardware pipeline model
+                status = jpeg_decode_scan<jfif_hwmodel_idct_policy> (scan_header, dht_table, dqt_table, frame_header, dri, is_RGB,
+                                                                     bmp_data_ptr, bufs->raw, bufs->raw_stride,
+                                                                     (uint8_t *)bufs->tensor);
+#else
+                status = jpeg_decode_scan<jfif_fast_int_idct_policy>(scan_header, dht_table, dqt_table, frame_header, dri, is_RGB,
+                                                                     bmp_data_ptr, bufs->raw, bufs->raw_stride,
+                                                                     (uint8_t *)bufs->tensor);
+#endif
+                break;
+            }
+        }
+    }
+
+    delete scan_header;
+    delete [] dht_table;
+
+    return status;
+}
+
+//-------------------------------------------------------------
+// jpeg_process_jfif()
+//
+// Description:
+//
+// Takes a buffer containing JFIF data and decodes it, using the
+// selected iDCT engine, to the selected output targets, which are
+// allocated here (free with jpeg_free_c()). Targets not selected
+// are returned as NULL.
+//
+// Parameters:
+//    ibuf:     pointer to the input buffer containing the JFIF data
+//    obuf:     pointer to a buffer pointer, updated to point to bitmap output
+//    rawbuf:   pointer to a buffer pointer, updated to point to raw output,
+//              in the selected pixel format (may be NULL)
+//    len:      length of the input in bytes, or 0 for input terminated
+//              by an EOI marker
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers. JPEG_UNSUPPORTED_ERROR returned for a
+//    planar YUV pixel format with RGB coded data. Any buffers allocated
+//    are returned, even on error.
+//
+
+int jfif::jpeg_process_jfif(uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf, long len)
+{
+    jpeg_output_bufs_t bufs = {};
+
+    int status = jpeg_decode_image(ibuf, len, &bufs, rawbuf != NULL, true);
+
+    // Return bitmap and raw data
+    if (obuf != NULL)
+    {
+        *obuf = bufs.bmp;
+    }
+
+    if (rawbuf != NULL)
+    {
+        *rawbuf = bufs.raw;
+    }
+
+    return status;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_crop()
+//
+// Description:
+//
+// Selects a crop rectangle for subsequent decodes, or none when
+// width and height are 0. The crop is checked against each
+// image's size when decoded.
+//
+// Parameters:
+//    x, y:     crop's top left position in the image
+//    width:    crop width in pixels
+//    height:   crop height in pixels
+//
+// Return value:
+//    JPEG_NO_ERROR, or JPEG_USER_INPUT_ERROR if crop invalid
+//
+
+int jfif::jpeg_set_crop(int x, int y, int width, int height)
+{
+    if (x < 0 || y < 0 || width < 0 || height < 0 || ((width == 0) != (height == 0)) ||
+        (width == 0 && (x != 0 || y != 0)))
+    {
+        std::cerr << "ERROR: jpeg_set_crop(): invalid crop (" << x << "," << y << " " << width << "x" << height << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    crop_x      = x;
+    crop_y      = y;
+    crop_width  = width;
+    crop_height = height;
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_bitmap_gray()
+//
+// Description:
+//
+// Selects whether monochrome images have an 8 bit grayscale
+// (palettised) bitmap, written straight from the iDCT output, in
+// place of a 24 bit bitmap, for subsequent decodes.
+//
+// Parameters:
+//    enable:   true for an 8 bit bitmap
+//
+// Return value:
+//    None
+//
+
+void jfif::jpeg_set_bitmap_gray(bool enable)
+{
+    bitmap_gray = enable;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_input_wait()
+//
+// Description:
+//
+// Selects a function to wait for more input, for decoding input
+// as it arrives, before it is all present. Whenever the entropy
+// coded data runs out, the decode waits on the function, and
+// resumes with its state (bit reader, DC values and MCU position)
+// intact. The header must be present before decoding starts.
+//
+// Parameters:
+//    wait:     input wait function (NULL when all the input is present)
+//    ctx:      caller context passed to the wait function
+//
+// Return value:
+//    None
+//
+
+void jfif::jpeg_set_input_wait(jpeg_input_wait_t wait, void *ctx)
+{
+    input_wait = wait;
+    input_ctx  = ctx;
+    input_end  = NULL;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_resize()
+//
+// Description:
+//
+// Selects a size to resize the outputs to, for subsequent
+// decodes, or none when width and height are 0. Given only one of
+// the width and height, the other keeps the aspect ratio of the
+// crop (or image). The image is decoded at the smallest scale
+// (1/1, 1/2, 1/4 or 1/8) at least the selected size, with a 4x4
+// or 2x2 iDCT of each block's lowest frequencies at 1/2 or 1/4,
+// or just its DC value at 1/8, and area resampled to the selected
+// size (if not already that size) as each row is converted.
+//
+// Parameters:
+//    width:    output width in pixels (0 to keep the aspect ratio)
+//    height:   output height in pixels (0 to keep the aspect ratio)
+//
+// Return value:
+//    JPEG_NO_ERROR, or JPEG_USER_INPUT_ERROR if size invalid
+//
+
+int jfif::jpeg_set_resize(int width, int height)
+{
+    if (width < 0 || height < 0 || width > JPEG_MAX_DIMENSION || height > JPEG_MAX_DIMENSION)
+    {
+        std::cerr << "ERROR: jpeg_set_resize(): invalid size (" << width << "x" << height << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    resize_width  = width;
+    resize_height = height;
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_tensor()
+//
+// Description:
+//
+// Selects the tensor element type and layout, and the per channel
+// normalisation, for subsequent decodes. The normalisation,
+// (v/255 - mean)/std, is held as a scale and offset of the 8 bit
+// values, for applying as each row is colour converted.
+//
+// Parameters:
+//    type:     JPEG_TENSOR_FLOAT32, JPEG_TENSOR_FLOAT16 or JPEG_TENSOR_BFLOAT16
+//    layout:   JPEG_TENSOR_NHWC or JPEG_TENSOR_NCHW
+//    mean:     per channel (R, G, B) mean (NULL for 0)
+//    std:      per channel standard deviation (NULL for 1)
+//
+// Return value:
+//    JPEG_NO_ERROR, or JPEG_USER_INPUT_ERROR if a parameter invalid
+//
+
+int jfif::jpeg_set_tensor(int type, int layout, const float *mean, const float *std)
+{
+    if ((type != JPEG_TENSOR_FLOAT32 && type != JPEG_TENSOR_FLOAT16 && type != JPEG_TENSOR_BFLOAT16) ||
+        (layout != JPEG_TENSOR_NHWC && layout != JPEG_TENSOR_NCHW) ||
+        (std != NULL && (std[0] == 0.0f || std[1] == 0.0f || std[2] == 0.0f)))
+    {
+        std::cerr << "ERROR: jpeg_set_tensor(): invalid tensor type (" << type << "), layout (" << layout
+                  << ") or zero std" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    tensor_type   = type;
+    tensor_layout = layout;
+
+    for (int cdx = 0; cdx < JPEG_NUM_RGB_COLOURS; cdx++)
+    {
+        float m = (mean != NULL) ? mean[cdx] : 0.0f;
+        float d = (std  != NULL) ? std[cdx]  : 1.0f;
+
+        tensor_scale[cdx]  = 1.0f / (255.0f * d);
+        tensor_offset[cdx] = -m / d;
+    }
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_set_opts()
+//
+// Description:
+//
+// Selects the iDCT engine, chroma upsampling, output targets,
+// pixel format, crop, tensor, resize and bitmap options for
+// subsequent decodes, from a decode options structure.
+//
+// Parameters:
+//    opts:     pointer to decode options
+//
+// Return value:
+//    JPEG_NO_ERROR, or JPEG_USER_INPUT_ERROR if an option invalid
+//
+
+int jfif::jpeg_set_opts(const jpeg_decode_opts_t *opts)
+{
+    int status;
+
+    if ((status = jpeg_set_idct_mode(opts->idct_mode))                               ||
+        (status = jpeg_set_upsample_mode(opts->upsample_mode))                       ||
+        (status = jpeg_set_output(opts->output_flags, opts->sink, opts->sink_ctx,
+                                  opts->band_sink, opts->bmp_sink))                  ||
+        (status = jpeg_set_pixel_format(opts->pixel_format))                         ||
+        (status = jpeg_set_crop(opts->crop_x, opts->crop_y, opts->crop_width, opts->crop_height)))
+    {
+        return status;
+    }
+
+    if ((status = jpeg_set_tensor(opts->tensor_type, opts->tensor_layout, opts->tensor_mean, opts->tensor_std)))
+    {
+        return status;
+    }
+
+    if ((status = jpeg_set_resize(opts->resize_width, opts->resize_height)))
+    {
+        return status;
+    }
+
+    jpeg_set_bitmap_gray(opts->bitmap_gray != 0);
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_process_jfif_into()
+//
+// Description:
+//
+// Takes a buffer containing JFIF data and decodes it, using the
+// selected iDCT engine, into caller supplied buffers for the
+// selected output targets, with no output allocation.
+//
+// Parameters:
+//    ibuf:     pointer to the input buffer containing the JFIF data
+//    bufs:     pointer to the output buffers (see jpeg_output_bufs_t)
+//    len:      length of the input in bytes, or 0 for input terminated
+//              by an EOI marker
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers. JPEG_USER_INPUT_ERROR returned for missing
+//    or too small buffers.
+//
+
+int jfif::jpeg_process_jfif_into(uint8_t *ibuf, const jpeg_output_bufs_t *bufs, long len)
+{
+    jpeg_output_bufs_t local_bufs = *bufs;
+
+    return jpeg_decode_image(ibuf, len, &local_bufs, true, false);
+}
+
+//-------------------------------------------------------------
+// jpeg_get_size()
+//
+// Description:
+//
+// Parses the header of a buffer containing JFIF data, to get the
+// image's dimensions without decoding it (e.g. for sizing buffers
+// for jpeg_process_jfif_into()).
+//
+// Parameters:
+//    ibuf:       pointer to the input buffer containing the JFIF data
+//    X:          pointer to the returned image width
+//    Y:          pointer to the returned image height
+//    components: pointer to the returned number of components (may be NULL)
+//    len:        length of the input in bytes, or 0 for input terminated
+//                by an EOI marker
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers.
+//
+
+int jfif::jpeg_get_size(uint8_t *ibuf, int *X, int *Y, int *components, long len)
+{
+    scan_header_t*  scan_header  = NULL;
+    frame_header_t* frame_header = NULL;
+    DHT_offsets_t*  dht_table    = NULL;
+    DQT_t           dqt_table[JPEG_MAX_QUANT_TABLES] = {};
+    int             dri = 0;
+    bool            is_RGB;
+
+    jpeg_input_bound(ibuf, len);
+
+    int status = jpeg_extract_header(ibuf, &scan_header, &frame_header, dqt_table, &dht_table, &dri, &is_RGB);
+
+    if (status == JPEG_NO_ERROR)
+    {
+        *X = JPEG_REORDER16(frame_header->X);
+        *Y = JPEG_REORDER16(frame_header->Y);
+
+        if (components != NULL)
+        {
+            *components = scan_header->Ns;
+        }
+    }
+
+    delete scan_header;
+    delete [] dht_table;
+
+    return status;
+}
+
+//-------------------------------------------------------------
+// jpeg_get_output_size()
+//
+// Description:
+//
+// Parses the header of a buffer containing JFIF data, to get the
+// dimensions of the outputs it would be decoded to, after any
+// selected crop and resize, without decoding it.
+//
+// Parameters:
+//    ibuf:       pointer to the input buffer containing the JFIF data
+//    X:          pointer to the returned output width
+//    Y:          pointer to the returned output height
+//    len:        length of the input in bytes, or 0 for input terminated
+//                by an EOI marker
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers, or an empty (zero width or height) frame.
+//
+
+int jfif::jpeg_get_output_size(uint8_t *ibuf, int *X, int *Y, long len)
+{
+    int X_img, Y_img;
+
+    int status = jpeg_get_size(ibuf, &X_img, &Y_img, NULL, len);
+
+    if (status == JPEG_NO_ERROR && (X_img == 0 || Y_img == 0))
+    {
+        std::cerr << "ERROR: jpeg_get_output_size(): invalid image size (" << X_img << "x" << Y_img << ")" << std::endl;
+        status = JPEG_FORMAT_ERROR;
+    }
+    else if (status == JPEG_NO_ERROR)
+    {
+        jpeg_output_size(X_img, Y_img, X, Y);
+    }
+
+    return status;
+}
+
+//-------------------------------------------------------------
+// jpeg_process_jfif_c()
+//
+// Description:
+//
+// C linkage for jpeg_process_jfif() member of jfif class
+//
+// Parameters:
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    obuf:         pointer to a buffer pointer, updated to point to bitmap output
+//    debug_enable: Debug control (whencompiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers.
+//
+
+extern "C" int jpeg_process_jfif_c (uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf, int debug_enable)
+{
+    return jpeg_process_jfif_opts_c(ibuf, obuf, rawbuf, NULL, debug_enable);
+}
+
+//-------------------------------------------------------------
+// jpeg_default_opts_c()
+//
+// Description:
+//
+// Initialises a decode options structure with default values
+//
+// Parameters:
+//    opts:         pointer to options structure to initialise
+//
+// Return value:
+//    None
+//
+
+extern "C" void jpeg_default_opts_c (jpeg_decode_opts_t *opts)
+{
+    opts->idct_mode     = JPEG_IDCT_DEFAULT;
+    opts->upsample_mode = JPEG_UPSAMPLE_DEFAULT;
+    opts->output_flags  = JPEG_OUTPUT_DEFAULT;
+    opts->pixel_format  = JPEG_PIXFMT_DEFAULT;
+    opts->sink          = NULL;
+    opts->sink_ctx      = NULL;
+    opts->band_sink     = NULL;
+    opts->bmp_sink      = NULL;
+    opts->crop_x        = 0;
+    opts->crop_y        = 0;
+    opts->crop_width    = 0;
+    opts->crop_height   = 0;
+    opts->bitmap_gray   = false;
+    opts->tensor_type   = JPEG_TENSOR_FLOAT32;
+    opts->tensor_layout = JPEG_TENSOR_NHWC;
+
+    for (int cdx = 0; cdx < JPEG_NUM_RGB_COLOURS; cdx++)
+    {
+        opts->tensor_mean[cdx] = 0.0f;
+        opts->tensor_std[cdx]  = 1.0f;
+    }
+
+    opts->resize_width  = 0;
+    opts->resize_height = 0;
+}
+
+//-------------------------------------------------------------
+// jpeg_process_jfif_opts_c()
+//
+// Description:
+//
+// C linkage for jpeg_process_jfif() member of jfif class, with
+// decode options
+//
+// Parameters:
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    obuf:         pointer to a buffer pointer, updated to point to bitmap output
+//    rawbuf:       pointer to a buffer pointer, updated to point to raw RGB output
+//    opts:         pointer to decode options (NULL for defaults)
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers. JPEG_USER_INPUT_ERROR returned for
+//    invalid options.
+//
+
+extern "C" int jpeg_process_jfif_opts_c (uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf, const jpeg_decode_opts_t *opts,
+                                         int debug_enable)
+{
+    int status;
+
+    // JPEG decoder object
+    jfif decoder(debug_enable);
+
+    // Select the iDCT engine, chroma upsampling, output targets and pixel format
+    if (opts != NULL && (status = decoder.jpeg_set_opts(opts)))
+    {
+        return status;
+    }
+
+    // Call decode method and return pointer to the bitmap and/or status
+    return decoder.jpeg_process_jfif(ibuf, obuf, rawbuf);
+}
+
+//-------------------------------------------------------------
+// jpeg_process_jfif_len_c()
+//
+// Description:
+//
+// As jpeg_process_jfif_opts_c(), but for an input of a given
+// length, with every read of it (in the header and the scan
+// data) checked against the length, rather than relying on a
+// terminating EOI marker. The input may then be a slice of a
+// larger buffer, such as an image packed in a mapped file,
+// decoded in place without copying. An input ending before its
+// EOI marker is decoded as if truncated.
+//
+// Parameters:
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    len:          length of the input, in bytes
+//    obuf:         pointer to a buffer pointer, updated to point to bitmap output
+//    rawbuf:       pointer to a buffer pointer, updated to point to raw RGB output
+//    opts:         pointer to decode options (NULL for defaults)
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers, or a header overrunning the input.
+//    JPEG_USER_INPUT_ERROR returned for invalid options or length.
+//
+
+extern "C" int jpeg_process_jfif_len_c (uint8_t *ibuf, long len, uint8_t **obuf, uint8_t **rawbuf, const jpeg_decode_opts_t *opts,
+                                        int debug_enable)
+{
+    int status;
+
+    if (len <= 0)
+    {
+        std::cerr << "ERROR: jpeg_process_jfif_len_c(): invalid input length (" << len << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    jfif decoder(debug_enable);
+
+    if (opts != NULL && (status = decoder.jpeg_set_opts(opts)))
+    {
+        return status;
+    }
+
+    return decoder.jpeg_process_jfif(ibuf, obuf, rawbuf, len);
+}
+
+//-------------------------------------------------------------
+// jpeg_process_jfif_into_c()
+//
+// Description:
+//
+// C linkage for jpeg_process_jfif_into() member of jfif class,
+// with decode options
+//
+// Parameters:
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    bufs:         pointer to caller's output buffers
+//    opts:         pointer to decode options (NULL for defaults)
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers. JPEG_USER_INPUT_ERROR returned for
+//    invalid options, or missing or too small buffers.
+//
+
+extern "C" int jpeg_process_jfif_into_c (uint8_t *ibuf, const jpeg_output_bufs_t *bufs, const jpeg_decode_opts_t *opts,
+                                         int debug_enable)
+{
+    int status;
+
+    jfif decoder(debug_enable);
+
+    if (opts != NULL && (status = decoder.jpeg_set_opts(opts)))
+    {
+        return status;
+    }
+
+    return decoder.jpeg_process_jfif_into(ibuf, bufs);
+}
+
+//-------------------------------------------------------------
+// jpeg_process_jfif_into_len_c()
+//
+// Description:
+//
+// As jpeg_process_jfif_into_c(), but for an input of a given
+// length, with every read of it checked against the length (see
+// jpeg_process_jfif_len_c())
+//
+// Parameters:
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    len:          length of the input, in bytes
+//    bufs:         pointer to caller's output buffers
+//    opts:         pointer to decode options (NULL for defaults)
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers, or a header overrunning the input.
+//    JPEG_USER_INPUT_ERROR returned for invalid options or length, or
+//    missing or too small buffers.
+//
+
+extern "C" int jpeg_process_jfif_into_len_c (uint8_t *ibuf, long len, const jpeg_output_bufs_t *bufs,
+                                             const jpeg_decode_opts_t *opts, int debug_enable)
+{
+    int status;
+
+    if (len <= 0)
+    {
+        std::cerr << "ERROR: jpeg_process_jfif_into_len_c(): invalid input length (" << len << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    jfif decoder(debug_enable);
+
+    if (opts != NULL && (status = decoder.jpeg_set_opts(opts)))
+    {
+        return status;
+    }
+
+    return decoder.jpeg_process_jfif_into(ibuf, bufs, len);
+}
+
+//-------------------------------------------------------------
+// jpeg_get_size_c()
+//
+// Description:
+//
+// C linkage for jpeg_get_size() member of jfif class
+//
+// Parameters:
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    X:            pointer to the returned image width
+//    Y:            pointer to the returned image height
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers.
+//
+
+extern "C" int jpeg_get_size_c (uint8_t *ibuf, int *X, int *Y, int debug_enable)
+{
+    jfif decoder(debug_enable);
+
+    return decoder.jpeg_get_size(ibuf, X, Y);
+}
+
+//-------------------------------------------------------------
+// jpeg_get_info_c()
+//
+// Description:
+//
+// C linkage for jpeg_get_size() member of jfif class, including
+// the number of components
+//
+// Parameters:
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    X:            pointer to the returned image width
+//    Y:            pointer to the returned image height
+//    components:   pointer to the returned number of components
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers.
+//
+
+extern "C" int jpeg_get_info_c (uint8_t *ibuf, int *X, int *Y, int *components, int debug_enable)
+{
+    jfif decoder(debug_enable);
+
+    return decoder.jpeg_get_size(ibuf, X, Y, components);
+}
+
+//-------------------------------------------------------------
+// jpeg_get_info_len_c()
+//
+// Description:
+//
+// As jpeg_get_info_c(), but for an input of a given length, with
+// every read of the header checked against the length (see
+// jpeg_process_jfif_len_c())
+//
+// Parameters:
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    len:          length of the input, in bytes
+//    X:            pointer to the returned image width
+//    Y:            pointer to the returned image height
+//    components:   pointer to the returned number of components
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers, or a header overrunning the input.
+//    JPEG_USER_INPUT_ERROR returned for an invalid length.
+//
+
+extern "C" int jpeg_get_info_len_c (uint8_t *ibuf, long len, int *X, int *Y, int *components, int debug_enable)
+{
+    if (len <= 0)
+    {
+        std::cerr << "ERROR: jpeg_get_info_len_c(): invalid input length (" << len << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
 
-    } while (marker != JPEG_MKR_EOI);
+    jfif decoder(debug_enable);
 
-    return JPEG_NO_ERROR;
+    return decoder.jpeg_get_size(ibuf, X, Y, components, len);
 }
 
 //-------------------------------------------------------------
-// jpeg_huff_decode()
+// jpeg_get_output_size_c()
 //
 // Description:
 //
-// Uses the header information extracted by jpeg_extract_header()
-// to return successive 8x8 arrays of integers of Huffman/RLE
-// decoded data, that's been amplitude adjusted and dequantised and
-// reverse-serpentine positioned. The data is ready for inverse DCT
-// conversion. Note the pointer points to Ns arrays---e.g if Ns == 3
-// Y, Cb and Cr arrays are consecutively located in memory.
+// C linkage for jpeg_get_output_size() member of jfif class, with
+// decode options
 //
 // Parameters:
-//    sptr:     pointer to scan header data
-//    hptr:     pointer to huffman decode data
-//    qptr:     pointer to quantisation table pointers
-//    fptr:     pointer to frame header data
-//    ecs_ptr:  pointer to entropy coded segments pointer (updated)
-//              When *ecs_ptr == NULL, starts from beginning. Is updated after
-//              each returned MCU or marker to point to next data
-//              segment, for chaining.
-//    marker:   pointer to int that's updated with a marker or error code,
-//              if function returns NULL
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    opts:         pointer to decode options (NULL for defaults)
+//    X:            pointer to the returned output width
+//    Y:            pointer to the returned output height
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
 //
 // Return value:
-//    NULL:     Indicates a marker or error is returned (to *marker)
-//              If marker < JPEG_MARKER_MASK, then an error code else
-//              a marker, as defined in jfif_local.h
-//
-//    non-NULL: a pointer to 8x8 array of ints with decoded data
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers. JPEG_USER_INPUT_ERROR returned for
+//    invalid options.
 //
 
-int (*jfif::jpeg_huff_decode(scan_header_t *sptr, DHT_offsets_t *hptr, DQT_t *qptr, frame_header_t *fptr,
-                             uint8_t *ecs_ptr[],    int *marker)) [JPEG_MCU_ELEMENTS]
+extern "C" int jpeg_get_output_size_c (uint8_t *ibuf, const jpeg_decode_opts_t *opts, int *X, int *Y, int debug_enable)
 {
-    using std::cout;
-    using std::cerr;
-    using std::setw;
-    using std::endl;
-
-    // Input stream (ECS) index
-    int idx = 0;
-
-    // Huffman/RLE  decode values
-    rle_amplitude_t rle;
+    int status;
 
-    // Default returned marker is 'none'
-    *marker = 0;
+    jfif decoder(debug_enable);
 
-    // If follow-on pointer null, point to beginning of ECS segment
-    if (*ecs_ptr == NULL)
+    if (opts != NULL && (status = decoder.jpeg_set_opts(opts)))
     {
-        *ecs_ptr = sptr->p_ECS;
+        return status;
     }
 
-    // Extract sampling factors locally (ignore if no chroma components)
-    int horiz_sampling = (fptr->Nf == 1) ? 1 : (fptr->Ci[0].HVi >> 4) & 0xf;
-    int vert_sampling  = (fptr->Nf == 1) ? 1 : (fptr->Ci[0].HVi)      & 0xf;
+    return decoder.jpeg_get_output_size(ibuf, X, Y);
+}
 
-    int y_arrays       = horiz_sampling*vert_sampling;
-    int total_arrays   = sptr->Ns + y_arrays - 1;
+//-------------------------------------------------------------
+// jpeg_get_output_size_len_c()
+//
+// Description:
+//
+// As jpeg_get_output_size_c(), but for an input of a given
+// length, with every read of the header checked against the
+// length (see jpeg_process_jfif_len_c())
+//
+// Parameters:
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    len:          length of the input, in bytes
+//    opts:         pointer to decode options (NULL for defaults)
+//    X:            pointer to the returned output width
+//    Y:            pointer to the returned output height
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers, or a header overrunning the input.
+//    JPEG_USER_INPUT_ERROR returned for invalid options or length.
+//
 
-    // Clear MCU data (for as many 8x8 blocks as needed)
-    for (int ydx = 0; ydx < total_arrays; ydx++)
-    {
-        for (int mdx = 0; mdx < JPEG_MCU_ELEMENTS; mdx++)
-        {
-            mcu[ydx][mdx] = 0;
-        }
-    }
+extern "C" int jpeg_get_output_size_len_c (uint8_t *ibuf, long len, const jpeg_decode_opts_t *opts, int *X, int *Y,
+                                           int debug_enable)
+{
+    int status;
 
-    // The MCU contains up to 6 elements (e.g. Y alone, or Y Cb Cr, or Y..Y Cb Cr [sub-sampled])
-    for (int array = 0; array < total_arrays; array++)
+    if (len <= 0)
     {
+        std::cerr << "ERROR: jpeg_get_output_size_len_c(): invalid input length (" << len << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
 
-        // Pick the table for Y until the last two arrays which are the chroma arrays
-        int table = (array >= y_arrays) ? array - y_arrays + 1 : 0;
-
-        // Get Td/Ta values for this table
-        int Td = ((sptr->p_Ci+table)->Tda >> 4) & 0xf;
-        int Ta = ((sptr->p_Ci+table)->Tda >> 0) & 0xf;
-
-        // Pick the quantisation table for this segment
-        int Tq = fptr->Ci[table].Tq;
-
-        // Fetch DC codeword (= length of additional bits to follow), or marker
-        rle = jpeg_dht_lookup (hptr, true, Td, *ecs_ptr, &idx, &jfif_barrel, &jfif_bit_count);
-
-        // Got a marker
-        if (rle.marker)
-        {
-            // Locally check for RSTn and reset DC diff value(s)
-            if ((rle.marker & 0xfff0) == JPEG_MKR_RST0)
-            {
-#ifdef JPEG_DEBUG_MODE
-                if (debug_enable & JPEG_DEBUG_MKR_EN)
-                {
-                    cout << "jpeg_huff_decode: reset DC" << endl;
-                }
-#endif
-                // Reset all the DC values
-                for (int jdx = 0; jdx < JPEG_SOS_MAX_NS; jdx++)
-                {
-                    current_dc_value[jdx] = 0;
-                }
-            }
-
-            *ecs_ptr += idx;
-            *marker   = rle.marker;
-
-            return NULL;
-
-        // If not EOB then get DC value
-        }
-        else
-        {
-            // Extract raw DC value and de-quantise
-            if (!rle.is_EOB && rle.amplitude && qptr[Tq].Qn[0])
-            {
-                current_dc_value[table] += rle.amplitude;
-            }
-
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_AMP_EN)
-            {
-                cout << "AMP(dc):  " << 0 << ": " << current_dc_value[table] << " (" << rle.amplitude << ")" << endl;
-            }
-#endif
+    jfif decoder(debug_enable);
 
+    if (opts != NULL && (status = decoder.jpeg_set_opts(opts)))
+    {
+        return status;
+    }
 
-#ifdef JPEG_FAST_INT_IDCT
-            // The dequantised value is also descaled as Qn value also includes AAN iDCT prescaling,
-            // only partially descaled already.
-            mcu[array][0] = jpeg_idescale(current_dc_value[table] * qptr[Tq].Qn[0], SCALE_BITS-PRE_DESCALE_BITS);
-#else
-            mcu[array][0] = current_dc_value[table] * qptr[Tq].Qn[0];
-#endif
+    return decoder.jpeg_get_output_size(ibuf, X, Y, len);
+}
 
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_QNT_EN)
-            {
-                cout << setw(2) << 0 << ": " << setw(6) <<  current_dc_value[table] << " " << setw(6) << qptr[Tq].Qn[0] << " " << mcu[array][0] << endl;
-            }
-#endif
+//-------------------------------------------------------------
+// Reusable decoder, for the C linkage. A jfif decoder object,
+// set up once with its decode options, to decode a series of
+// images without the cost of constructing a decoder for each.
+//
 
-        }
+struct jpeg_decoder : public jfif
+{
+    jpeg_decoder(int debug_enable) : jfif(debug_enable) {}
+};
 
-        // Fetch AC codewords
-        for (int mdx = 1; mdx < JPEG_MCU_ELEMENTS; mdx++)
-        {
-            // Lookup the code in the Huffman table, or get marker
-            rle = jpeg_dht_lookup (hptr, false, Ta, *ecs_ptr, &idx, &jfif_barrel, &jfif_bit_count);
+//-------------------------------------------------------------
+// jpeg_decoder_create_c()
+//
+// Description:
+//
+// Creates a reusable decoder, with the given decode options,
+// for use with jpeg_decoder_process_c(). The decoder is used by
+// one thread at a time, and freed with jpeg_decoder_free_c().
+//
+// Parameters:
+//    decoder:      pointer to the returned decoder (NULL on an error)
+//    opts:         pointer to decode options (NULL for defaults)
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, JPEG_USER_INPUT_ERROR
+//    for invalid options, or JPEG_MEMORY_ERROR.
+//
 
-            // Shouldn't get a marker in the middle of AC data except EOI near
-            // beginning (flushed to byte boundary)
-            if (rle.marker)
-            {
-                if (rle.marker == JPEG_MKR_EOI)
-                {
-                    *ecs_ptr += idx;
-                    *marker   = rle.marker;
+extern "C" int jpeg_decoder_create_c (jpeg_decoder_t **decoder, const jpeg_decode_opts_t *opts, int debug_enable)
+{
+    int status = JPEG_NO_ERROR;
 
-                }
-                else
-                {
-                    cerr << "ERROR: jpeg_huff_decode: got a marker in the middle of AC data" << endl;
-                    *marker = JPEG_FORMAT_ERROR;
-                }
+    try
+    {
+        *decoder = new jpeg_decoder(debug_enable);
+    }
+    catch(std::bad_alloc& ba)
+    {
+        std::cerr << "ERROR: jpeg_decoder_create_c(): memory allocation error: " << ba.what() << std::endl;
+        *decoder = NULL;
+        return JPEG_MEMORY_ERROR;
+    }
 
-                return NULL;
+    if (opts != NULL && (status = (*decoder)->jpeg_set_opts(opts)))
+    {
+        delete *decoder;
+        *decoder = NULL;
+    }
 
-            }
-            else if (rle.is_EOB)
-            {
-                mdx = JPEG_MCU_ELEMENTS;
+    return status;
+}
 
-            }
-            else
-            {
-                // If there are zero run length elements simply skip index
-                if (rle.ZRL)
-                {
-                    mdx += rle.ZRL;
-                }
+//-------------------------------------------------------------
+// jpeg_decoder_process_c()
+//
+// Description:
+//
+// As jpeg_process_jfif_opts_c(), but with a reusable decoder
+// from jpeg_decoder_create_c(), and its decode options. With the
+// input's length given, every read of it is checked against the
+// length (see jpeg_process_jfif_len_c()).
+//
+// Parameters:
+//    decoder:      decoder, from jpeg_decoder_create_c()
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    len:          length of the input, in bytes (0 for input terminated
+//                  by an EOI marker)
+//    obuf:         pointer to a buffer pointer, updated to point to bitmap output
+//    rawbuf:       pointer to a buffer pointer, updated to point to raw RGB output
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers.
+//
 
-                // If not a ZRL (0xF0) code update mcu (ZRL implies a 0 value at mdx)
-                if (!rle.is_ZRL)
-                {
-                    // Update MCU matrix
-                    if (!rle.is_EOB && rle.amplitude && qptr[Tq].Qn[mdx])
-                    {
-#ifdef JPEG_FAST_INT_IDCT
-                        // Inverse zigzag MCU index and store dequantised amplitude value. The value is also descaled
-                        // as Qn values also include AAN iDCT prescaling, only partially descaled already.
-                        mcu[array][jpeg_inv_zigzag[mdx]] = jpeg_idescale(rle.amplitude * qptr[Tq].Qn[mdx], SCALE_BITS-PRE_DESCALE_BITS);
-#else
-                        mcu[array][jpeg_inv_zigzag[mdx]] = rle.amplitude * qptr[Tq].Qn[mdx];
-#endif
+extern "C" int jpeg_decoder_process_c (jpeg_decoder_t *decoder, uint8_t *ibuf, long len, uint8_t **obuf, uint8_t **rawbuf)
+{
+    return decoder->jpeg_process_jfif(ibuf, obuf, rawbuf, len);
+}
 
-#ifdef JPEG_DEBUG_MODE
-                       if (debug_enable & JPEG_DEBUG_AMP_EN)
-                       {
-                           cout << "AMP(ac): " << setw(2) << mdx << ": " << rle.amplitude << endl;
-                       }
+//-------------------------------------------------------------
+// jpeg_decoder_output_size_c()
+//
+// Description:
+//
+// Output dimensions of an image, after any crop and resize in the
+// decoder's options, and its number of components, from the header
+//
+// Parameters:
+//    decoder:      decoder, from jpeg_decoder_create_c()
+//    ibuf:         pointer to the input buffer containing the JFIF data
+//    len:          length of the input, in bytes (0 for input terminated
+//                  by an EOI marker)
+//    X:            pointer to the returned output width
+//    Y:            pointer to the returned output height
+//    components:   pointer to the returned number of components
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, JPEG_FORMAT_ERROR on
+//    unexpected data or markers, or JPEG_USER_INPUT_ERROR for a crop
+//    outside of the image.
+//
 
-                       if (debug_enable & JPEG_DEBUG_QNT_EN)
-                       {
-                           cout << setw(2) << jpeg_inv_zigzag[mdx] << ": ";
-                           cout << setw(6) << rle.amplitude << " ";
-                           cout << setw(6) << qptr[Tq].Qn[mdx] << " ";
-                           cout << mcu[array][jpeg_inv_zigzag[mdx]] << endl;
-                       }
-#endif
-                    }
-                }
-#ifdef DEBUG_MODE
-                else {
-                    if (debug_enable & JPEG_DEBUG_MKR_EN)
-                    {
-                        cout << "ZRL" << endl;
-                    }
-                }
-#endif
-            }
-        }
-    }
+extern "C" int jpeg_decoder_output_size_c (jpeg_decoder_t *decoder, uint8_t *ibuf, long len, int *X, int *Y, int *components)
+{
+    int status;
 
-    // Update data pointer to next segment
-    *ecs_ptr += idx;
+    if ((status = decoder->jpeg_get_size(ibuf, X, Y, components, len)))
+    {
+        return status;
+    }
 
-    // Return the array data
-    return mcu;
+    return decoder->jpeg_get_output_size(ibuf, X, Y, len);
 }
 
 //-------------------------------------------------------------
-// jpeg_bitmap_init()
+// jpeg_decoder_free_c()
 //
 // Description:
 //
-// Creates a space big enough for the image being processed and
-// a bitmap header, for a 24 bit bitmap, and initialises the
-// header. A pointer to this space is returned.
+// Frees a decoder created by jpeg_decoder_create_c()
 //
 // Parameters:
-//    X:        Image width in pixels
-//    Y:        Image height in pixels
+//    decoder:      decoder to free (may be NULL)
 //
 // Return value:
-//    a pointer to the bitmap space.
+//    None
 //
 
-uint8_t* jfif::jpeg_bitmap_init(int X, int Y)
+extern "C" void jpeg_decoder_free_c (jpeg_decoder_t *decoder)
 {
-    // Create some space for a bitmap
-
-    // Byte width flushed to 32 bit boundary
-    int      bmp_width         = BMP_WIDTH_TO_PADDED_BYTES(X);
-    int      bmp_height        = Y;
-
-    // Allocate some space for a 24 bit bitmap (including header)
-    int      bmp_size          = (bmp_width * bmp_height) + BMP_HDRSIZE;
-    uint8_t* bmp_ptr           = new uint8_t[bmp_size]();
-
-    // Cast the bitmap start to a bitmap header
-    bmhdr_t* bmp_hdr           = (bmhdr_t *)bmp_ptr;
-
-    // Initialise bitmap file fields
-    bmp_hdr->f.bfType[0]       = 'B';
-    bmp_hdr->f.bfType[1]       = 'M';
-    bmp_hdr->f.bfSize          = bmp_size;
-    bmp_hdr->f.bfOffBits       = BMP_HDRSIZE;
-
-    // Initialise bitmap info (unspecified fields are left as 0)
-    bmp_hdr->i.biSize          = BMP_INFOHDRSIZE;
-    bmp_hdr->i.biWidth         = X;
-    bmp_hdr->i.biHeight        = Y;
-    bmp_hdr->i.biPlanes        = 1;
-    bmp_hdr->i.biBitCount      = 24;
-
-    // Do endian swap if needed
-    BMP_HDRENDIAN(bmp_hdr);
-
-    return bmp_ptr;
-
+    delete decoder;
 }
 
 //-------------------------------------------------------------
-// jpeg_process_jfif()
+// jpeg_free_c()
 //
 // Description:
 //
-// Takes a buffer containing JFIF data and decodes to a series
-// of 8x8 RGB triplets
+// Frees an output buffer allocated by jpeg_process_jfif_c() or
+// jpeg_process_jfif_opts_c()
 //
 // Parameters:
-//    ibuf:     pointer to the input buffer containing the JFIF data
-//    obuf:     pointer to a buffer pointer, updated to point to bitmap output
+//    buf:          buffer to free (may be NULL)
 //
 // Return value:
-//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
-//    unexpected data or markers.
+//    None
 //
-int jfif::jpeg_process_jfif(uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf)
-{
-    using std::cout;
-    using std::cerr;
-    using std::hex;
-    using std::setw;
-    using std::endl;
-
-    // Pointers to JPEG segments and data
-    scan_header_t*  scan_header  = NULL;
-    frame_header_t* frame_header = NULL;
-    DHT_offsets_t*  dht_table    = NULL;
-    DQT_t           dqt_table[JPEG_MAX_QUANT_TABLES];
-
-    // Data space for DCT data and RGB data
-    int rgb_data[JPEG_NUM_RGB_COLOURS][JPEG_BLOCK_DIMENSION*2][JPEG_BLOCK_DIMENSION*2];
-
-    // Pointer for decoded scan data with Y [Cb Cr] data
-    int (*scan_data_ptr)[JPEG_MCU_ELEMENTS];
 
-    // Pointer to buffer of next data for processing (used in chaining)
-    uint8_t *ecs_ptr = NULL;
-
-    // Local state for marker and RSTn checking
-    int  dri = 0, marker = 0, exp_rst_marker = JPEG_MKR_RST0;
-    bool expecting_rstn = false;
+extern "C" void jpeg_free_c (uint8_t *buf)
+{
+    delete [] buf;
+}
 
-    // Counter for tracking number of MCU's processed
-    int mcu_count = 0;
+//-------------------------------------------------------------
+// jpeg_raw_size_c()
+//
+// Description:
+//
+// Returns the size of a raw buffer for an image in a given
+// pixel format
+//
+// Parameters:
+//    pixel_format: JPEG_PIXFMT_xxx
+//    X:            image width in pixels
+//    Y:            image height in pixels
+//
+// Return value:
+//    Size in bytes, or 0 if pixel_format invalid
+//
 
-    // Local status holders
-    int status;
-    bool is_RGB;
+extern "C" long jpeg_raw_size_c (int pixel_format, int X, int Y)
+{
+    long pixels = (long)X * Y;
 
-    // Parse JFIF header
-    if (status = jpeg_extract_header(ibuf, &scan_header, &frame_header, dqt_table, &dht_table, &dri, &is_RGB))
+    switch (pixel_format)
     {
-        return status;
+    case JPEG_PIXFMT_RGB24:  return pixels * 3;
+    case JPEG_PIXFMT_RGBA32:
+    case JPEG_PIXFMT_BGRA32:
+    case JPEG_PIXFMT_CMYK:   return pixels * 4;
+    case JPEG_PIXFMT_RGB565: return pixels * 2;
+    case JPEG_PIXFMT_GRAY8:  return pixels;
+    case JPEG_PIXFMT_I420:
+    case JPEG_PIXFMT_NV12:   return pixels + 2 * (long)((X + 1) / 2) * ((Y + 1) / 2);
+    default:                 return 0;
     }
+}
 
-    // Extract the H and V subsampling parameters locally, from the frame header
-    // (ignore if no chroma components)
-    int Hi = (frame_header->Nf == 1) ? 1 : frame_header->Ci[0].HVi >> 4;
-    int Vi = (frame_header->Nf == 1) ? 1 : frame_header->Ci[0].HVi & 0xf;
-
-    // Extract the image dimensions (with any necessary byte swapping)
-    int Y = JPEG_REORDER16(frame_header->Y);
-    int X = JPEG_REORDER16(frame_header->X);
-
-    // The number of arrays n MCU to process is number of scan components plus extra sub-samples
-    int mcu_arrays = scan_header->Ns + Hi*Vi - 1 ;
-
-    // MCU width in pixels is 8 x horizontal sub-sampling
-    int mcu_width   = 8 * Hi;
-
-    // MCU height in pixels is 8 x vertical sub-sampling
-    int mcu_height  = 8 * Vi;
-
-    // Calculate width in whole mcus
-    int X_mcus = X/mcu_width + ((X%mcu_width) ? 1 : 0);
-
-    // Calculate total number of MCU to cover image
-    int total_mcus =  X_mcus * (Y/mcu_height + ((Y%mcu_height) ? 1 : 0));
+//-------------------------------------------------------------
+// jpeg_bitmap_size_c()
+//
+// Description:
+//
+// Returns the size of a 24 bit bitmap, including its header, for
+// an image
+//
+// Parameters:
+//    X:            image width in pixels
+//    Y:            image height in pixels
+//
+// Return value:
+//    Size in bytes
+//
 
-    // Create some space for bitmap, and initialise header
-    uint8_t* bmp_ptr = jpeg_bitmap_init(X, Y);
-    uint8_t* bmp_data_ptr = bmp_ptr + BMP_HDRSIZE;
+extern "C" long jpeg_bitmap_size_c (int X, int Y)
+{
+    return jpeg_bitmap_bits_size_c(X, Y, 24);
+}
 
-    *rawbuf = new uint8_t[Y * X*3]();
+//-------------------------------------------------------------
+// jpeg_bitmap_bits_size_c()
+//
+// Description:
+//
+// Returns the size of a 24 or 8 bit (grayscale) bitmap, including
+// its header, and palette for 8 bit, for an image
+//
+// Parameters:
+//    X:            image width in pixels
+//    Y:            image height in pixels
+//    bits:         bits per pixel (24 or 8)
+//
+// Return value:
+//    Size in bytes
+//
 
-    // Process scan data until end-of-image marker
-    while (marker != JPEG_MKR_EOI)
+extern "C" long jpeg_bitmap_bits_size_c (int X, int Y, int bits)
+{
+    // Byte width flushed to 32 bit boundary
+    if (bits == 8)
     {
-        // Decode entropy data
-        scan_data_ptr = jpeg_huff_decode(scan_header, dht_table, dqt_table, frame_header, &ecs_ptr, &marker);
-
-        // NULL returned on encountering a marker or error
-        if (scan_data_ptr == NULL)
-        {
-            // Encountered a marker
-            if (marker & JPEG_MARKER_MASK)
-            {
-                // Only expecting RSTn or EOI
-                if (marker >= JPEG_MKR_RST0 && marker <= JPEG_MKR_RST7)
-                {
-                    if (marker != exp_rst_marker)
-                    {
-                        cerr << "ERROR: unexpected RSTn marker sequence (got " << hex << setw(4) << marker;
-                        cerr << ", expected " << hex << setw(4) << exp_rst_marker << endl;
-                        return JPEG_FORMAT_ERROR;
-                    }
+        return (long)JPEG_BMP_GRAY_PADDED_BYTES(X) * Y + BMP_HDRSIZE + JPEG_BMP_GRAY_PALETTE_SIZE;
+    }
 
-#ifdef JPEG_DEBUG_MODE
-                    if (debug_enable & JPEG_DEBUG_MKR_EN)
-                    {
-                         cout << "RST" << (marker - JPEG_MKR_RST0) << endl;
-                    }
-#endif
-                    exp_rst_marker = (exp_rst_marker & 0xfff0) + (exp_rst_marker+1)%8;
-                    marker = 0;
-                    expecting_rstn = false;
+    return (long)BMP_WIDTH_TO_PADDED_BYTES(X) * Y + BMP_HDRSIZE;
+}
 
-                }
-                else if (marker == JPEG_MKR_EOI)
-                {
-#ifdef JPEG_DEBUG_MODE
-                    if (debug_enable & JPEG_DEBUG_MKR_EN)
-                    {
-                        cout << "EOI" << endl;
-                    }
-#endif
-                }
-                else
-                {
-                    cerr << "ERROR: encountered unexpected marker (0x" << hex << setw(4) << marker << ") in scan data" << endl;
-                    return JPEG_FORMAT_ERROR;
-                }
-            // An error occured, return error code (in marker)
-            }
-            else
-            {
-                return marker;
-            }
+//-------------------------------------------------------------
+// jpeg_bitmap_header_c()
+//
+// Description:
+//
+// Initialises a 24 or 8 bit bitmap header (with palette for 8 bit),
+// for writing ahead of the rows given to a bitmap sink (which are
+// top-down)
+//
+// Parameters:
+//    hdr:          header space of JPEG_BITMAP_MAX_HDR_SIZE bytes
+//    X:            image width in pixels
+//    Y:            image height in pixels
+//    bits:         bits per pixel (24 or 8)
+//    top_down:     rows stored top-down (negative height)
+//
+// Return value:
+//    Size of the header in bytes, or 0 if the bitmap is over
+//    JPEG_BITMAP_MAX_SIZE bytes
+//
 
-        // Received a valid MCU
-        } else {
+extern "C" long jpeg_bitmap_header_c (uint8_t *hdr, int X, int Y, int bits, int top_down)
+{
+    jfif decoder(0);
 
-            // Should have finished by now, but make this a warning only that EOI is missing
-            if (mcu_count >= total_mcus)
-            {
-#ifndef JPEG_NO_WARNINGS
-                cerr << "WARNING: receiving more data when EOI expected" << endl;
-#endif
-                // Break out of the while loop, as if EOI, as no more data needs processing
-                break;
-            }
+    if (jpeg_bitmap_bits_size_c(X, Y, bits) > JPEG_BITMAP_MAX_SIZE)
+    {
+        std::cerr << "ERROR: jpeg_bitmap_header_c(): " << std::dec << X << "x" << Y
+                  << " bitmap over " << JPEG_BITMAP_MAX_SIZE << " bytes" << std::endl;
+        return 0;
+    }
 
-#ifdef JPEG_DEBUG_MODE
-            if (debug_enable & JPEG_DEBUG_MCU_EN)
-            {
-                cout << "MCU " << (mcu_count % X_mcus) << "," << (mcu_count / X_mcus) << endl;
-                print_MCU(scan_data_ptr, mcu_arrays);
-            }
-#endif
+    return decoder.jpeg_bitmap_init(hdr, X, Y, bits, top_down != 0);
+}
 
-            // Perform inverse DCT for each 8x8 element and return into same buffer
-            for (int scans = 0; scans < mcu_arrays; scans++)
-            {
-#ifdef JPEG_FAST_INT_IDCT
-                jpeg_idct((jpeg_8x8_block_t)scan_data_ptr[scans]);
-#else
-                jpeg_idct_slow((jpeg_8x8_block_t)scan_data_ptr[scans]);
-#endif
-            }
+//-------------------------------------------------------------
+// jpeg_raw_stride_c()
+//
+// Description:
+//
+// Returns the smallest raw buffer row stride for an image width
+// in a given pixel format (the Y plane's, for planar YUV, and each
+// plane's for planar CMYK), rounded up to a multiple of an alignment.
+//
+// Parameters:
+//    pixel_format: JPEG_PIXFMT_xxx
+//    X:            image width in pixels
+//    align:        alignment in bytes (a power of 2, or 0 for none)
+//
+// Return value:
+//    Stride in bytes
+//
 
-            // Convert from scan data to RGB
-            if (scan_header->Ns != 1)
-            {
-                if (status = jpeg_ycc_to_rgb((jpeg_nx8x8_block_t)scan_data_ptr, rgb_data, scan_header->Ns, Hi, Vi, is_RGB))
-                {
-                    return status;
-                }
-            }
+extern "C" int jpeg_raw_stride_c (int pixel_format, int X, int align)
+{
+    bool planar = pixel_format == JPEG_PIXFMT_I420 || pixel_format == JPEG_PIXFMT_NV12 || pixel_format == JPEG_PIXFMT_CMYK;
+    int  stride = (int)jpeg_raw_size_c(planar ? JPEG_PIXFMT_GRAY8 : pixel_format, X, 1);
 
-            // Update bitmap data buffer with converted block
-            jpeg_bitmap_update (scan_header->Ns != 1 ? rgb_data : (jpeg_rgb_block_t)scan_data_ptr,
-                                mcu_count / X_mcus,
-                                mcu_count % X_mcus,
-                                scan_header->Ns,
-                                Hi,
-                                Vi,
-                                bmp_data_ptr,
-                                *rawbuf,
-                                X,
-                                Y);
+    return (align > 1) ? (stride + align - 1) & ~(align - 1) : stride;
+}
 
-            // Keep count of MCUs processed
-            mcu_count++;
+//-------------------------------------------------------------
+// jpeg_raw_stride_size_c()
+//
+// Description:
+//
+// Returns the size of a raw buffer for an image in a given pixel
+// format, with a given row stride. For planar YUV, the chroma
+// rows (of each plane, for I420) are half the stride, rounded up,
+// and planar CMYK has four planes of the stride.
+//
+// Parameters:
+//    pixel_format: JPEG_PIXFMT_xxx
+//    X:            image width in pixels
+//    Y:            image height in pixels
+//    stride:       row stride in bytes (0 for unpadded rows)
+//
+// Return value:
+//    Size in bytes
+//
 
-            // Flag if DRI says next data should be an RSTn marker
-            if (mcu_count && dri && !(mcu_count%dri))
-            {
-                expecting_rstn = true;
-            }
-        }
+extern "C" long jpeg_raw_stride_size_c (int pixel_format, int X, int Y, int stride)
+{
+    if (stride == 0)
+    {
+        return jpeg_raw_size_c(pixel_format, X, Y);
     }
 
-    free(scan_header);
-    free(dht_table);
+    if (pixel_format == JPEG_PIXFMT_I420 || pixel_format == JPEG_PIXFMT_NV12)
+    {
+        return (long)stride * Y + 2 * (long)((stride + 1) / 2) * ((Y + 1) / 2);
+    }
 
-    // Return bitmap data
-    *obuf = bmp_ptr;
+    if (pixel_format == JPEG_PIXFMT_CMYK)
+    {
+        return (long)stride * Y * JPEG_NUM_CMYK_COLOURS;
+    }
 
-    return JPEG_NO_ERROR;
+    return (long)stride * Y;
 }
 
 //-------------------------------------------------------------
-// jpeg_process_jfif_c()
+// jpeg_tensor_size_c()
 //
 // Description:
 //
-// C linkage for jpeg_process_jfif() member of jfif class
+// Returns the size of a 3 channel tensor for an image, with a
+// given element type
 //
 // Parameters:
-//    ibuf:         pointer to the input buffer containing the JFIF data
-//    obuf:         pointer to a buffer pointer, updated to point to bitmap output
-//    debug_enable: Debug control (whencompiled with JPEG_DEBUG_MODE)
+//    tensor_type:  JPEG_TENSOR_xxx
+//    X:            image width in pixels
+//    Y:            image height in pixels
 //
 // Return value:
-//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
-//    unexpected data or markers.
+//    Size in bytes, or 0 if tensor_type invalid
 //
 
-extern "C" int jpeg_process_jfif_c (uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf, int debug_enable)
+extern "C" long jpeg_tensor_size_c (int tensor_type, int X, int Y)
 {
-    // JPEG decoder object
-    jfif decoder(debug_enable);
+    long elements = (long)X * Y * JPEG_NUM_RGB_COLOURS;
 
-    // Call decode method and return pointer to the bitmap and/or status
-    return decoder.jpeg_process_jfif(ibuf, obuf, rawbuf);
+    switch (tensor_type)
+    {
+    case JPEG_TENSOR_FLOAT32:  return elements * 4;
+    case JPEG_TENSOR_FLOAT16:
+    case JPEG_TENSOR_BFLOAT16: return elements * 2;
+    default:                   return 0;
+    }
 }
-
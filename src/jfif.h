@@ -57,19 +57,262 @@
 #define bool                         int
 #endif
 
+// iDCT engine selection (made at run time, per decode)
+
+#define JPEG_IDCT_FAST_INT           0
+#define JPEG_IDCT_SLOW_INT           1
+#define JPEG_IDCT_FLOAT              2
+
+#define JPEG_IDCT_DEFAULT            JPEG_IDCT_FAST_INT
+
+// Chroma upsampling selection for sub-sampled (4:2:0, 4:2:2 and 4:4:0) images
+
+#define JPEG_UPSAMPLE_NEAREST        0
+#define JPEG_UPSAMPLE_TRIANGLE       1
+
+#define JPEG_UPSAMPLE_DEFAULT        JPEG_UPSAMPLE_NEAREST
+
+// Output target selection flags (ORed together)
+
+#define JPEG_OUTPUT_BMP              0x1    // 24 bit bitmap, returned in obuf
+#define JPEG_OUTPUT_RAW              0x2    // Raw buffer (in the selected pixel format), returned in rawbuf
+#define JPEG_OUTPUT_SINK             0x4    // Caller's row sink function
+#define JPEG_OUTPUT_BAND             0x8    // Caller's band sink function (not with JPEG_OUTPUT_RAW)
+#define JPEG_OUTPUT_BMP_BAND         0x10   // Top-down bitmap rows to caller's bitmap sink (not with JPEG_OUTPUT_BMP)
+#define JPEG_OUTPUT_TENSOR           0x20   // Normalised float tensor, in caller's buffer (jpeg_process_jfif_into_c())
+
+#define JPEG_OUTPUT_ALL              (JPEG_OUTPUT_BMP  | JPEG_OUTPUT_RAW | JPEG_OUTPUT_SINK | JPEG_OUTPUT_BAND | \
+                                      JPEG_OUTPUT_BMP_BAND | JPEG_OUTPUT_TENSOR)
+#define JPEG_OUTPUT_DEFAULT          (JPEG_OUTPUT_BMP | JPEG_OUTPUT_RAW)
+
+// Pixel formats of the raw buffer and row sink output. The bitmap is always
+// 24 bit. Packed formats are in byte order (RGB565 is a little endian 16 bit
+// word). The planar YUV formats are the JPEG's full range YCbCr, with chroma
+// sub-sampled 2x2 (rounded up), and are taken from the decoded components
+// without colour conversion: a Y plane (X by Y), followed by Cb then Cr
+// planes (I420), or by a single interleaved CbCr plane (NV12). Planar
+// CMYK, of 4 component (Adobe CMYK or YCCK) images only, is C, M, Y and
+// K planes (X by Y), with YCCK converted to CMYK, but as coded otherwise
+// (Adobe CMYK is inverted, with 255 for no ink)
+
+#define JPEG_PIXFMT_RGB24            0
+#define JPEG_PIXFMT_RGBA32           1      // Alpha 255
+#define JPEG_PIXFMT_BGRA32           2      // Alpha 255
+#define JPEG_PIXFMT_RGB565           3
+#define JPEG_PIXFMT_GRAY8            4      // Luma (Y), without colour conversion
+#define JPEG_PIXFMT_I420             5
+#define JPEG_PIXFMT_NV12             6
+#define JPEG_PIXFMT_CMYK             7
+
+#define JPEG_PIXFMT_DEFAULT          JPEG_PIXFMT_RGB24
+
+// Tensor element types and layouts. A tensor has 3 channels (R, G, B),
+// with monochrome images replicated to all three. Each value v is
+// normalised as (v/255 - mean)/std, with the channel's mean and std.
+
+#define JPEG_TENSOR_FLOAT32          0
+#define JPEG_TENSOR_FLOAT16          1      // IEEE 754 half precision
+#define JPEG_TENSOR_BFLOAT16         2
+
+#define JPEG_TENSOR_NHWC             0      // Channels interleaved (H x W x C)
+#define JPEG_TENSOR_NCHW             1      // Channel planes (C x H x W)
+
+// Largest bitmap header, of an 8 bit bitmap with its 256 entry palette
+
+#define JPEG_BITMAP_MAX_HDR_SIZE     (54 + 256*4)
+
+// Largest bitmap (including header), as its size is a 32 bit header field
+
+#define JPEG_BITMAP_MAX_SIZE         0xffffffffL
+
+// Row sink, called with each decoded image row (y, from the top) of X
+// pixels in the selected pixel format, in order, when JPEG_OUTPUT_SINK
+// selected. For the planar YUV formats, the row is the row's X luma
+// samples, followed on even rows by the row of chroma samples for the
+// row pair (Cb then Cr for I420, or interleaved CbCr for NV12)
+
+typedef void (*jpeg_row_sink_t)(void *sink_ctx, int y, const uint8_t *row, int X);
+
+// Band sink, called with each band (MCU row) of decoded rows in turn, when
+// JPEG_OUTPUT_BAND selected. The band's rows, from row y, are laid out as a
+// raw buffer (in the selected pixel format) of the given number of rows, with
+// a row stride in bytes. Only a band's worth of output is ever buffered, so
+// memory use depends on the image width, and not its area. The same sink
+// type is used for the bitmap sink (JPEG_OUTPUT_BMP_BAND), which is given
+// bands of bitmap rows (padded to 32 bits), in top-down order, for
+// writing after a top-down bitmap header (jpeg_bitmap_header_c()).
+
+typedef void (*jpeg_band_sink_t)(void *sink_ctx, int y, int rows, const uint8_t *data, int stride, int X);
+
+//-------------------------------------------------------------
+// Decode options. Initialise with jpeg_default_opts_c() before
+// setting individual fields. When a crop is given, only the MCUs
+// covering it are decoded, and all the outputs are of the crop's
+// size. When a resize is given, the outputs are of that size
+// instead, the crop (or image) being scaled to it as decoded.
+
+typedef struct {
+    int idct_mode;                   // iDCT engine (JPEG_IDCT_xxx)
+    int upsample_mode;               // Chroma upsampling (JPEG_UPSAMPLE_xxx)
+    int output_flags;                // Output targets (JPEG_OUTPUT_xxx)
+    int pixel_format;                // Raw buffer and row sink pixel format (JPEG_PIXFMT_xxx)
+    jpeg_row_sink_t sink;            // Row sink function (JPEG_OUTPUT_SINK)
+    void *sink_ctx;                  // Caller context passed to sinks
+    jpeg_band_sink_t band_sink;      // Band sink function (JPEG_OUTPUT_BAND)
+    jpeg_band_sink_t bmp_sink;       // Bitmap sink function (JPEG_OUTPUT_BMP_BAND)
+    int crop_x;                      // Crop rectangle's top left position in the image,
+    int crop_y;                      // (even for planar YUV formats)
+    int crop_width;                  // and its size (0 for no crop)
+    int crop_height;
+    int bitmap_gray;                 // 8 bit grayscale (palettised) bitmap for monochrome images
+    int tensor_type;                 // Tensor element type (JPEG_TENSOR_FLOAT32/FLOAT16/BFLOAT16)
+    int tensor_layout;               // Tensor layout (JPEG_TENSOR_NHWC or NCHW)
+    float tensor_mean[3];            // Per channel (R, G, B) normalisation mean
+    float tensor_std[3];             // and standard deviation (non-zero)
+    int resize_width;                // Output size to resize to (0 for none, or either
+    int resize_height;               // 0 to keep the aspect ratio)
+} jpeg_decode_opts_t;
+
+//-------------------------------------------------------------
+// Caller supplied output buffers, for decoding with no allocation
+// (jpeg_process_jfif_into_c()). Buffers need only be given for the
+// selected targets, and have no alignment requirement, but a raw
+// row stride can be given to align each row. For the planar YUV
+// formats the stride is that of the Y plane, with chroma rows
+// (per plane for I420) of half the stride, rounded up.
+
+typedef struct {
+    uint8_t *bmp;                    // Bitmap, including header (JPEG_OUTPUT_BMP)
+    long     bmp_size;               // Size of bmp in bytes (at least jpeg_bitmap_size_c())
+    uint8_t *raw;                    // Raw buffer, in the selected pixel format (JPEG_OUTPUT_RAW)
+    long     raw_size;               // Size of raw in bytes (at least jpeg_raw_stride_size_c())
+    int      raw_stride;             // Bytes from one raw row to the next (0 for unpadded rows)
+    void    *tensor;                 // Tensor slot, of the image's size (JPEG_OUTPUT_TENSOR)
+    long     tensor_size;            // Size of tensor in bytes (at least jpeg_tensor_size_c())
+} jpeg_output_bufs_t;
+
 //-------------------------------------------------------------
 // Exported function prototype(s) (see function main comments
 // for detailed description)
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Takes a byte buffer (ibuf) containing a JFIF/JPEG image, and
 // updates a pointer (obuf) to point to a 24 bit window bitmap.
 // Return value is one of the six values defined above. If other
-// than JPEG_NO_ERROR, the obuf pointer is undefined.
+// than JPEG_NO_ERROR, the obuf pointer is undefined. Output
+// targets not selected in the options are returned as NULL.
+
+extern int  jpeg_process_jfif_c      (uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf, int debug_enable);
+
+// As jpeg_process_jfif_c(), but with decode options (opts may be NULL for defaults)
+extern int  jpeg_process_jfif_opts_c (uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf, const jpeg_decode_opts_t *opts,
+                                      int debug_enable);
+
+// As jpeg_process_jfif_opts_c(), but for an input of len bytes, with every read of
+// it bounds checked, rather than relying on a terminating EOI marker. The input may
+// be a slice of a larger buffer (e.g. an image packed in a mapped file), decoded in
+// place. Input ending before the EOI marker is decoded as if truncated, and a header
+// overrunning it returns JPEG_FORMAT_ERROR. The _len_c variants below are the same.
+extern int  jpeg_process_jfif_len_c  (uint8_t *ibuf, long len, uint8_t **obuf, uint8_t **rawbuf,
+                                      const jpeg_decode_opts_t *opts, int debug_enable);
+
+// Initialise a decode options structure with default values
+extern void jpeg_default_opts_c      (jpeg_decode_opts_t *opts);
+
+// Size in bytes of a raw buffer for an X by Y image in a given pixel format
+extern long jpeg_raw_size_c          (int pixel_format, int X, int Y);
+
+// Image dimensions from a JFIF/JPEG image's header, without decoding it
+extern int  jpeg_get_size_c          (uint8_t *ibuf, int *X, int *Y, int debug_enable);
+
+// As jpeg_get_size_c(), also returning the number of components (1 for monochrome)
+extern int  jpeg_get_info_c          (uint8_t *ibuf, int *X, int *Y, int *components, int debug_enable);
+extern int  jpeg_get_info_len_c      (uint8_t *ibuf, long len, int *X, int *Y, int *components, int debug_enable);
+
+// Output dimensions of a JFIF/JPEG image, after any crop and resize in opts (may be NULL)
+extern int  jpeg_get_output_size_c   (uint8_t *ibuf, const jpeg_decode_opts_t *opts, int *X, int *Y, int debug_enable);
+extern int  jpeg_get_output_size_len_c (uint8_t *ibuf, long len, const jpeg_decode_opts_t *opts, int *X, int *Y,
+                                        int debug_enable);
+
+// Size in bytes of a 24 bit bitmap (including header) for an X by Y image
+extern long jpeg_bitmap_size_c       (int X, int Y);
+
+// Size in bytes of a 24 or 8 bit (grayscale) bitmap, including header and palette
+extern long jpeg_bitmap_bits_size_c  (int X, int Y, int bits);
+
+// Initialise a 24 or 8 bit bitmap header (and palette) for an X by Y image,
+// with top-down row order (negative height) if top_down set. hdr must have
+// space for JPEG_BITMAP_MAX_HDR_SIZE bytes, and the header size is returned
+// (or 0, with nothing written, if the bitmap is over JPEG_BITMAP_MAX_SIZE bytes).
+extern long jpeg_bitmap_header_c     (uint8_t *hdr, int X, int Y, int bits, int top_down);
+
+// Smallest raw row stride for an X pixel wide image in a given pixel format,
+// rounded up to a multiple of align bytes (a power of 2, or 0 for none)
+extern int  jpeg_raw_stride_c        (int pixel_format, int X, int align);
+
+// Size in bytes of a raw buffer with a given row stride (0 for unpadded rows)
+extern long jpeg_raw_stride_size_c   (int pixel_format, int X, int Y, int stride);
+
+// Size in bytes of a 3 channel tensor of a given element type (JPEG_TENSOR_xxx) for an X by Y image
+extern long jpeg_tensor_size_c       (int tensor_type, int X, int Y);
+
+// As jpeg_process_jfif_opts_c(), but decoding into caller supplied buffers,
+// with no allocation. JPEG_USER_INPUT_ERROR returned if a selected target's
+// buffer is missing or too small.
+extern int  jpeg_process_jfif_into_c (uint8_t *ibuf, const jpeg_output_bufs_t *bufs, const jpeg_decode_opts_t *opts,
+                                      int debug_enable);
+extern int  jpeg_process_jfif_into_len_c (uint8_t *ibuf, long len, const jpeg_output_bufs_t *bufs,
+                                          const jpeg_decode_opts_t *opts, int debug_enable);
+
+// Decodes a batch of n images, across threads worker threads (0 for one per core),
+// each into its slot of a caller supplied arena (image i at arena + i*slot_size),
+// with no allocation. The slot holds the raw buffer (unpadded rows) or tensor, as
+// selected by opts->output_flags being JPEG_OUTPUT_RAW or JPEG_OUTPUT_TENSOR (NULL
+// opts for defaults, with raw output). Each image's status is returned in status,
+// and the first failing image's status (or JPEG_NO_ERROR) returned.
+extern int  jpeg_process_batch_c     (uint8_t *const *ibufs, int n, uint8_t *arena, long slot_size,
+                                      const jpeg_decode_opts_t *opts, int threads, int *status, int debug_enable);
+
+// As jpeg_process_batch_c(), with each input's length (lens NULL for EOI terminated inputs)
+extern int  jpeg_process_batch_len_c (uint8_t *const *ibufs, const long *lens, int n, uint8_t *arena, long slot_size,
+                                      const jpeg_decode_opts_t *opts, int threads, int *status, int debug_enable);
+
+// Reusable decoder, created once with a set of decode options (NULL for defaults),
+// to decode a series of images, by one thread at a time, without constructing a
+// decoder for each. Processing is as for jpeg_process_jfif_opts_c(), or, given the
+// input's length (len, else 0), jpeg_process_jfif_len_c(). The output size is after
+// any crop and resize in the options.
+typedef struct jpeg_decoder jpeg_decoder_t;
+
+extern int  jpeg_decoder_create_c      (jpeg_decoder_t **decoder, const jpeg_decode_opts_t *opts, int debug_enable);
+extern int  jpeg_decoder_process_c     (jpeg_decoder_t *decoder, uint8_t *ibuf, long len, uint8_t **obuf, uint8_t **rawbuf);
+extern int  jpeg_decoder_output_size_c (jpeg_decoder_t *decoder, uint8_t *ibuf, long len, int *X, int *Y, int *components);
+extern void jpeg_decoder_free_c        (jpeg_decoder_t *decoder);
+
+// Incremental decode of an image as its data arrives, in chunks pushed (from one
+// thread) as they are received, up to max_size bytes in all. The decode runs on its
+// own thread, suspending when it runs out of data, and resuming when more is pushed,
+// with any row, band and bitmap sinks called (from the decode thread) as rows are
+// completed. The output size waits for the header to arrive. Finishing ends the
+// input (decoding a truncated image with black rows), waits for the decode, and
+// returns its status and outputs, as for jpeg_process_jfif_opts_c().
+typedef struct jpeg_stream jpeg_stream_t;
+
+extern int  jpeg_stream_create_c      (jpeg_stream_t **stream, const jpeg_decode_opts_t *opts, long max_size,
+                                       int debug_enable);
+extern int  jpeg_stream_push_c        (jpeg_stream_t *stream, const uint8_t *data, long len);
+extern int  jpeg_stream_output_size_c (jpeg_stream_t *stream, int *X, int *Y, int *components);
+extern int  jpeg_stream_finish_c      (jpeg_stream_t *stream, uint8_t **obuf, uint8_t **rawbuf);
+extern void jpeg_stream_free_c        (jpeg_stream_t *stream);
+
+// Frees a buffer returned by jpeg_process_jfif_c() or jpeg_process_jfif_opts_c()
+extern void jpeg_free_c              (uint8_t *buf);
 
 #ifdef __cplusplus
-extern "C" int jpeg_process_jfif_c (uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf, int debug_enable);
-#else
-extern     int jpeg_process_jfif_c (uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf, int debug_enable);
+}
 #endif
 
 #endif
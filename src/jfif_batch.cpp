@@ -0,0 +1,279 @@
+//=============================================================
+//
+// Copyright (c) 2026 Simon Southwell
+// All rights reserved.
+//
+// Date: 18th October 2026
+//
+// This file is part of JFIF.
+//
+// JFIF is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// JFIF is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JFIF. If not, see <http://www.gnu.org/licenses/>.
+//
+//=============================================================
+//
+// Batch decoding of many images into the slots of a single
+// caller supplied arena (e.g. a batch of training images into
+// one contiguous array). The images are shared out between a
+// pool of worker threads, each with its own decoder, which take
+// the next image not yet started until none are left. Each image
+// is decoded straight into its slot, with no allocation of
+// output buffers, and no copying.
+//
+//=============================================================
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "jfif_class.h"
+
+// Batch state shared by the worker threads
+typedef struct {
+    uint8_t *const           *ibufs;            // Input buffers, their lengths (NULL for EOI terminated), and their number
+    const long               *lens;
+    int                       n;
+    uint8_t                  *arena;            // Output arena, and the size of each image's slot
+    long                      slot_size;
+    const jpeg_decode_opts_t *opts;             // Decode options (for every image)
+    int                      *status;           // Returned status of each image
+    int                       debug_enable;
+    std::atomic<int>          next;             // Next image to be taken by a worker
+} jpeg_batch_t;
+
+//-------------------------------------------------------------
+// jpeg_batch_worker()
+//
+// Description:
+//
+// Decodes images of a batch, each into its slot of the arena,
+// taking the next image not yet started until none are left.
+// The worker's decoder is set up once, and reused for each image.
+//
+// Parameters:
+//    batch:    pointer to the shared batch state
+//
+// Return value:
+//    None
+//
+
+static void jpeg_batch_worker (jpeg_batch_t *batch)
+{
+    jfif decoder(batch->debug_enable);
+
+    int  opts_status = decoder.jpeg_set_opts(batch->opts);
+    bool tensor      = (batch->opts->output_flags & JPEG_OUTPUT_TENSOR) != 0;
+
+    for (int idx = batch->next++; idx < batch->n; idx = batch->next++)
+    {
+        jpeg_output_bufs_t bufs = {};
+        uint8_t           *slot = batch->arena + (long)idx * batch->slot_size;
+
+        if (tensor)
+        {
+            bufs.tensor      = slot;
+            bufs.tensor_size = batch->slot_size;
+        }
+        else
+        {
+            bufs.raw         = slot;
+            bufs.raw_size    = batch->slot_size;
+        }
+
+        long len = (batch->lens != NULL) ? batch->lens[idx] : 0;
+
+        if (opts_status != JPEG_NO_ERROR || batch->ibufs[idx] == NULL || (batch->lens != NULL && len <= 0))
+        {
+            batch->status[idx] = (opts_status != JPEG_NO_ERROR) ? opts_status : JPEG_USER_INPUT_ERROR;
+        }
+        else
+        {
+            batch->status[idx] = decoder.jpeg_process_jfif_into(batch->ibufs[idx], &bufs, len);
+        }
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_process_batch_c()
+//
+// Description:
+//
+// Decodes a batch of n images, across a pool of worker threads,
+// each into its slot of a caller supplied arena (image i at
+// arena + i*slot_size). The slot holds the raw buffer (with
+// unpadded rows) or tensor, whichever of JPEG_OUTPUT_RAW and
+// JPEG_OUTPUT_TENSOR is selected in the options. With a resize
+// selected, images of different sizes fill same sized slots.
+//
+// Parameters:
+//    ibufs:        array of n pointers to input buffers of JFIF data,
+//                  each terminated by an EOI marker
+//    n:            number of images
+//    arena:        output arena, of at least n*slot_size bytes
+//    slot_size:    size of each image's slot, in bytes
+//    opts:         pointer to decode options (NULL for defaults, with
+//                  raw output)
+//    threads:      number of worker threads (0 for one per core)
+//    status:       array of n ints, updated with each image's status
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    JPEG_NO_ERROR if all the images decoded, else the status of the
+//    first image that failed. JPEG_USER_INPUT_ERROR returned (for all
+//    images) for invalid parameters or options.
+//
+
+extern "C" int jpeg_process_batch_c (uint8_t *const *ibufs, int n, uint8_t *arena, long slot_size,
+                                     const jpeg_decode_opts_t *opts, int threads, int *status, int debug_enable)
+{
+    return jpeg_process_batch_len_c(ibufs, NULL, n, arena, slot_size, opts, threads, status, debug_enable);
+}
+
+//-------------------------------------------------------------
+// jpeg_process_batch_len_c()
+//
+// Description:
+//
+// As jpeg_process_batch_c(), but with the length of each input,
+// with every read of it bounds checked, so the inputs may be
+// slices of a larger buffer (e.g. images packed into a mapped
+// file), decoded in place. An input ending before its EOI marker
+// is decoded as if truncated.
+//
+// Parameters:
+//    ibufs:        array of n pointers to input buffers of JFIF data
+//    lens:         array of n input lengths, in bytes (NULL for inputs
+//                  terminated by an EOI marker)
+//    n:            number of images
+//    arena:        output arena, of at least n*slot_size bytes
+//    slot_size:    size of each image's slot, in bytes
+//    opts:         pointer to decode options (NULL for defaults, with
+//                  raw output)
+//    threads:      number of worker threads (0 for one per core)
+//    status:       array of n ints, updated with each image's status
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    As for jpeg_process_batch_c(), with JPEG_USER_INPUT_ERROR returned
+//    for an image with a length not greater than 0.
+//
+
+extern "C" int jpeg_process_batch_len_c (uint8_t *const *ibufs, const long *lens, int n, uint8_t *arena, long slot_size,
+                                         const jpeg_decode_opts_t *opts, int threads, int *status, int debug_enable)
+{
+    jpeg_decode_opts_t batch_opts;
+
+    if (opts != NULL)
+    {
+        batch_opts = *opts;
+    }
+    else
+    {
+        jpeg_default_opts_c(&batch_opts);
+        batch_opts.output_flags = JPEG_OUTPUT_RAW;
+    }
+
+    if (status == NULL || n < 0)
+    {
+        std::cerr << "ERROR: jpeg_process_batch_len_c(): no status array, or invalid number of images (" << n << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    // Each slot holds one output only, with no sinks
+    jfif decoder(debug_enable);
+
+    int  flags  = batch_opts.output_flags;
+    int  result = decoder.jpeg_set_opts(&batch_opts);
+
+    if (result == JPEG_NO_ERROR && (ibufs == NULL || arena == NULL || slot_size <= 0 ||
+                                    (flags != JPEG_OUTPUT_RAW && flags != JPEG_OUTPUT_TENSOR)))
+    {
+        std::cerr << "ERROR: jpeg_process_batch_len_c(): invalid batch, or output selection (0x" << std::hex << flags << std::dec
+                  << ") not JPEG_OUTPUT_RAW or JPEG_OUTPUT_TENSOR alone" << std::endl;
+        result = JPEG_USER_INPUT_ERROR;
+    }
+
+    if (result != JPEG_NO_ERROR)
+    {
+        for (int idx = 0; idx < n; idx++)
+        {
+            status[idx] = result;
+        }
+
+        return result;
+    }
+
+    jpeg_batch_t batch;
+
+    batch.ibufs        = ibufs;
+    batch.lens         = lens;
+    batch.n            = n;
+    batch.arena        = arena;
+    batch.slot_size    = slot_size;
+    batch.opts         = &batch_opts;
+    batch.status       = status;
+    batch.debug_enable = debug_enable;
+    batch.next         = 0;
+
+    // One worker per core by default, but no more than there are images. The
+    // calling thread is one of the workers.
+    if (threads <= 0)
+    {
+        threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    }
+
+    threads = std::max(std::min(threads, n), 1);
+
+    std::vector<std::thread> pool;
+
+    // Carry on with the workers already started if a thread can't be (with
+    // room reserved first, so no started thread is lost to a failed push)
+    try
+    {
+        pool.reserve(threads - 1);
+
+        for (int tdx = 1; tdx < threads; tdx++)
+        {
+            pool.emplace_back(jpeg_batch_worker, &batch);
+        }
+    }
+    catch(std::system_error& se)
+    {
+        // Threads unavailable (the calling thread always works)
+    }
+    catch(std::bad_alloc& ba)
+    {
+        // No room for the pool, so no workers started
+    }
+
+    jpeg_batch_worker(&batch);
+
+    for (size_t tdx = 0; tdx < pool.size(); tdx++)
+    {
+        pool[tdx].join();
+    }
+
+    for (int idx = 0; idx < n; idx++)
+    {
+        if (status[idx] != JPEG_NO_ERROR)
+        {
+            return status[idx];
+        }
+    }
+
+    return JPEG_NO_ERROR;
+}
@@ -24,38 +24,101 @@
 
 #include "jfif_local.h"
 #include "jfif_idct.h"
+#include "jfif_idct_policy.h"
+
+#ifdef JPEG_HW_MODEL
+#include "jfif_hwmodel.h"
+#endif
 
 #ifndef _JFIF_CLASS_H_
 #define _JFIF_CLASS_H_
 
+// Input wait function, for decoding input as it arrives (see jfif_stream.cpp).
+// Called when fewer than n bytes of input are available from ptr, it returns the
+// end of the available input, once there are n bytes, or the input has ended.
+typedef const uint8_t *(*jpeg_input_wait_t)(void *ctx, const uint8_t *ptr, int n);
+
 class jfif : public jfif_idct
 {
 
 public:
 
     // Constructor. Initialise local state and base class
-    jfif(int debug_enable_in = 0) : jfif_bit_count(0), jfif_barrel(0), debug_enable(debug_enable_in), jfif_idct(debug_enable_in)
+    jfif(int debug_enable_in = 0, int idct_mode_in = JPEG_IDCT_DEFAULT) :
+         jfif_idct(debug_enable_in), jfif_bit_count(0), jfif_barrel(0), idct_mode(idct_mode_in),
+         upsample_mode(JPEG_UPSAMPLE_DEFAULT), output_flags(JPEG_OUTPUT_DEFAULT), sink(NULL), sink_ctx(NULL),
+         band_sink(NULL), bmp_sink(NULL), bitmap_gray(false),
+         pixel_format(JPEG_PIXFMT_DEFAULT), crop_x(0), crop_y(0), crop_width(0), crop_height(0),
+         tensor_type(JPEG_TENSOR_FLOAT32), tensor_layout(JPEG_TENSOR_NHWC), resize_width(0), resize_height(0),
+         input_wait(NULL), input_ctx(NULL), input_end(NULL), debug_enable(debug_enable_in)
     {
+        for (int cdx = 0; cdx < JPEG_NUM_RGB_COLOURS; cdx++)
+        {
+            tensor_scale[cdx]  = 1.0f / 255;
+            tensor_offset[cdx] = 0.0f;
+        }
 
         for (int idx = 0; idx < JPEG_SOS_MAX_NS; idx++)
             current_dc_value[idx] = 0;
     };
 
-    // Top level method, for external access
-    int              jpeg_process_jfif   (uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf = NULL) ;
+    // Top level method, for external access. Input of len bytes, with all reads bounds
+    // checked, or, with len 0, terminated by an EOI marker (as for the methods below).
+    int              jpeg_process_jfif   (uint8_t *ibuf, uint8_t **obuf, uint8_t **rawbuf = NULL, long len = 0) ;
+
+    // Decode into caller supplied output buffers, with no allocation
+    int              jpeg_process_jfif_into (uint8_t *ibuf, const jpeg_output_bufs_t *bufs, long len = 0);
+
+    // Image dimensions from the header, without decoding
+    int              jpeg_get_size       (uint8_t *ibuf, int *X, int *Y, int *components = NULL, long len = 0);
+
+    // Output dimensions, after any selected crop and resize, from the header
+    int              jpeg_get_output_size (uint8_t *ibuf, int *X, int *Y, long len = 0);
+
+    // Select the iDCT engine (JPEG_IDCT_xxx) for subsequent decodes
+    int              jpeg_set_idct_mode  (int mode);
+
+    // Select the chroma upsampling (JPEG_UPSAMPLE_xxx) for subsequent decodes
+    int              jpeg_set_upsample_mode (int mode);
+
+    // Select the output targets (JPEG_OUTPUT_xxx), and any row, band and bitmap sinks, for subsequent decodes
+    int              jpeg_set_output     (int flags, jpeg_row_sink_t sink_in = NULL, void *sink_ctx_in = NULL,
+                                          jpeg_band_sink_t band_sink_in = NULL, jpeg_band_sink_t bmp_sink_in = NULL);
+
+    // Select the raw buffer and row sink pixel format (JPEG_PIXFMT_xxx) for subsequent decodes
+    int              jpeg_set_pixel_format (int format);
+
+    // Select a crop rectangle (width and height of 0 for none) for subsequent decodes
+    int              jpeg_set_crop       (int x, int y, int width, int height);
+
+    // Select the tensor element type, layout and normalisation (NULL mean and std for none), for subsequent decodes
+    int              jpeg_set_tensor     (int type, int layout, const float *mean = NULL, const float *std = NULL);
+
+    // Select a size to resize the output to (0 for none, or either 0 to keep the aspect ratio)
+    int              jpeg_set_resize     (int width, int height);
+
+    // Select an 8 bit grayscale bitmap for monochrome images, for subsequent decodes
+    void             jpeg_set_bitmap_gray (bool enable);
+
+    // Select all of the above from a decode options structure
+    int              jpeg_set_opts       (const jpeg_decode_opts_t *opts);
+
+    // Select a wait function, called when the input data runs out, for decoding input as it arrives
+    void             jpeg_set_input_wait (jpeg_input_wait_t wait, void *ctx);
 
     // Conversion functions for generating a 24bit bitmap
-    uint8_t*           jpeg_bitmap_init    (int X, int Y);
-    int              jpeg_ycc_to_rgb     (jpeg_nx8x8_block_t ptr, jpeg_rgb_block_t optr, int Ns, int Hi, int Vi,
-                                          bool is_RGB);
-    void             jpeg_bitmap_update  (jpeg_rgb_block_t ptr, int mcu_row, int mcu_col, int Ns, int Hi, int Vi,
-                                          uint8_t *bmp_data_ptr, uint8_t *rawbuf, int X, int Y);
+    int              jpeg_bitmap_init    (uint8_t *bmp_ptr, int X, int Y, int bits = 24, bool top_down = false);
+    void             jpeg_bitmap_update  (const uint8_t *r, const uint8_t *g, const uint8_t *b, int y_pos,
+                                          uint8_t *bmp_data_ptr, int X, int Y, bool top_down = false);
+    void             jpeg_bitmap_gray_update (const int16_t *y, int y_pos, uint8_t *bmp_data_ptr, int X, int Y,
+                                          bool top_down = false);
+    void             jpeg_bitmap_gray_update (const uint8_t *y, int y_pos, uint8_t *bmp_data_ptr, int X, int Y,
+                                          bool top_down = false);
 
 // Private state
 private:
 
     // Constant tables
-    static const int aanscales[DCTSIZE*DCTSIZE];
     static const int jpeg_inv_zigzag[];
     static const int jpeg_zigzag[];
     static const int jpeg_adj_neg[];
@@ -68,8 +131,50 @@ private:
     // Running DC value state
     int              current_dc_value[JPEG_SOS_MAX_NS];
 
-    // MCU buffer
-    int              mcu[JPEG_MAX_MCU_BLOCKS][JPEG_MCU_ELEMENTS];
+    // MCU buffer (16 bit de-quantised coefficients)
+    int16_t          mcu[JPEG_MAX_MCU_BLOCKS][JPEG_MCU_ELEMENTS];
+
+    // Selected iDCT engine (JPEG_IDCT_xxx)
+    int              idct_mode;
+
+    // Selected chroma upsampling (JPEG_UPSAMPLE_xxx)
+    int              upsample_mode;
+
+    // Selected output targets (JPEG_OUTPUT_xxx), and row, band and bitmap sinks
+    int              output_flags;
+    jpeg_row_sink_t  sink;
+    void            *sink_ctx;
+    jpeg_band_sink_t band_sink;
+    jpeg_band_sink_t bmp_sink;
+
+    // 8 bit grayscale bitmap selected for monochrome images
+    bool             bitmap_gray;
+
+    // Selected raw buffer and row sink pixel format (JPEG_PIXFMT_xxx)
+    int              pixel_format;
+
+    // Selected crop rectangle (0 width for none)
+    int              crop_x;
+    int              crop_y;
+    int              crop_width;
+    int              crop_height;
+
+    // Selected tensor element type and layout, and per channel normalisation
+    // (as a scale and offset of 8 bit values)
+    int              tensor_type;
+    int              tensor_layout;
+    float            tensor_scale[JPEG_NUM_RGB_COLOURS];
+    float            tensor_offset[JPEG_NUM_RGB_COLOURS];
+
+    // Selected output size to resize to (0 width and height for none)
+    int              resize_width;
+    int              resize_height;
+
+    // Input wait function (NULL when all the input is present), and the end
+    // of the input known to be available (NULL when terminated by an EOI marker)
+    jpeg_input_wait_t input_wait;
+    void            *input_ctx;
+    const uint8_t   *input_end;
 
     // Debug control
     int              debug_enable;
@@ -84,12 +189,34 @@ private:
     void             print_frame_hdr     (const frame_header_t* fptr);
     void             print_scan_hdr      (const scan_header_t* sptr);
     void             print_DQT           (const DQT_raw_t* qptr);
-    void             print_MCU           (int (*sptr)[JPEG_MCU_ELEMENTS], int N);
+    void             print_MCU           (int16_t (*sptr)[JPEG_MCU_ELEMENTS], int N);
 #endif
 
     // Low level support methods
     int              jpeg_amp_adjust     (int value, int size);
+
+    // Check n bytes of input are available from ptr, waiting for them when the input is still arriving
+    bool             jpeg_input_ready    (const uint8_t *ptr, int n)
+    {
+        return (input_wait == NULL && input_end == NULL) || (input_end != NULL && ptr + n <= input_end) ||
+               (input_wait != NULL && ptr + n <= (input_end = input_wait(input_ctx, ptr, n)));
+    }
+
+    // Bound the input to len bytes from ibuf (0 for input terminated by an EOI marker),
+    // unless it is still arriving
+    void             jpeg_input_bound    (const uint8_t *ibuf, long len)
+    {
+        if (input_wait == NULL)
+        {
+            input_end = (len > 0) ? ibuf + len : NULL;
+        }
+    }
+
+    // Length of the marker segment at seg, checked to be at least min_length and within the input (or 0)
+    int              jpeg_segment_length (const uint8_t *seg, int min_length);
+
     int              jpeg_get_bits       (int n, uint8_t *buf, int *idx, uint32_t *barrel, int *bit_count, bool remove_bits);
+    bool             jpeg_dht_check      (const uint8_t *dht, int length);
     DHT_offsets_t*   jpeg_dht            (uint8_t *dht, DHT_offsets_t* decode_ptr);
     rle_amplitude_t  jpeg_dht_lookup     (DHT_offsets_t* dht_ptr, bool is_DC, int T, uint8_t *buf, int *idx,
                                          uint32_t *barrel, int *bit_count);
@@ -98,8 +225,48 @@ private:
     int              jpeg_extract_header (uint8_t *buf, scan_header_t **sptr, frame_header_t **fptr, DQT_t *qptr,
                                          DHT_offsets_t **hptr, int *dri, bool *is_RGB);
 
-    int            (*jpeg_huff_decode    (scan_header_t *sptr, DHT_offsets_t *hptr, DQT_t *qptr, frame_header_t *fptr,
-                                          uint8_t *ecs_ptr[],    int *marker)) [JPEG_MCU_ELEMENTS];
+    // Output size of an image, after any crop and resize
+    void             jpeg_output_size    (int X_img, int Y_img, int *X, int *Y);
+
+    // Check if an MCU is needed for the output (i.e. within any crop)
+    bool             jpeg_mcu_needed     (const jpeg_band_t *band, int mcu, int X_mcus);
+
+    // Skip over entropy coded data to the next marker
+    uint8_t*         jpeg_skip_to_marker (uint8_t *buf, int *marker);
+
+    // Common decode for allocated and caller supplied output buffers
+    int              jpeg_decode_image   (uint8_t *ibuf, long len, jpeg_output_bufs_t *bufs, bool use_raw, bool allocate);
+
+    // Methods templated on the iDCT engine policy (see jfif_idct_policy.h)
+    template <class POLICY>
+    void             jpeg_dqt_prescale   (DQT_t *qptr);
+
+    template <class POLICY>
+    int16_t        (*jpeg_huff_decode    (scan_header_t *sptr, DHT_offsets_t *hptr, DQT_t *qptr, frame_header_t *fptr,
+                                          uint8_t *ecs_ptr[],    int *marker, bool decode_only)) [JPEG_MCU_ELEMENTS];
+
+    // MCU row (band) buffering, with upsampling context
+    void             jpeg_band_store     (jpeg_band_t *band, int16_t (*sptr)[JPEG_MCU_ELEMENTS], int mcu_col);
+    void             jpeg_band_clear     (jpeg_band_t *band, int mcu_col);
+    void             jpeg_band_context   (jpeg_band_t *band, int set, int band_row);
+    void             jpeg_output_row     (jpeg_band_t *band, int set, int row, int y_pos);
+    void             jpeg_output_yuv_row (jpeg_band_t *band, int set, int row, int y_pos);
+    void             jpeg_output_cmyk_row(jpeg_band_t *band, int y_pos);
+    void             jpeg_resize_row     (jpeg_band_t *band, int set, int row);
+
+    template <class POLICY>
+    void             jpeg_ycc_to_rgb     (jpeg_band_t *band, int set, int row);
+
+    template <class POLICY>
+    void             jpeg_band_output    (jpeg_band_t *band, int set, int band_row);
+
+    template <class POLICY>
+    void             jpeg_band_complete  (jpeg_band_t *band, int band_row, bool last);
+
+    template <class POLICY>
+    int              jpeg_decode_scan    (scan_header_t *sptr, DHT_offsets_t *hptr, DQT_t *qptr, frame_header_t *fptr,
+                                          int dri, bool is_RGB, uint8_t *bmp_data_ptr, uint8_t *rawbuf, int raw_stride,
+                                          uint8_t *tensor);
 };
 
 #endif
@@ -0,0 +1,1155 @@
+//=============================================================
+//
+// Copyright (c) 2026 Simon Southwell
+// All rights reserved.
+//
+// Date: 18th October 2026
+//
+// This file is part of JFIF.
+//
+// JFIF is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// JFIF is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JFIF. If not, see <http://www.gnu.org/licenses/>.
+//
+//=============================================================
+//
+// The fixed point conversion is, for each of r, g and b:
+//
+//   x = (Y << JPEG_RGB_BITS) + Kcb*(Cb-128) + Kcr*(Cr-128)
+//   x = CLIP((x + JPEG_RGB_ROUND) >> JPEG_RGB_BITS)
+//
+// which is bit exact with truncating and then adding 1 when
+// bit JPEG_RGB_BITS-1 is set, without the branch. The chroma
+// terms are calculated with a 16 bit multiply-add on
+// interleaved (Cb-128, Cr-128) pairs, and clipping done by
+// saturating packs down to 8 bits.
+//
+//=============================================================
+
+#include <string.h>
+
+#include "jfif_colour.h"
+
+//-------------------------------------------------------------
+// Scalar conversion of a single pixel
+
+static inline void jpeg_ycc_to_rgb_pixel (int Y, int Cb, int Cr, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    int y  = (Y << JPEG_RGB_BITS) + JPEG_RGB_ROUND;
+    int cb = Cb - 128;
+    int cr = Cr - 128;
+
+    *r = JPEG_CLIP((y + JPEG_RGB_Kr1 * cr)                      >> JPEG_RGB_BITS);
+    *g = JPEG_CLIP((y - JPEG_RGB_Kg1 * cb - JPEG_RGB_Kg2 * cr)  >> JPEG_RGB_BITS);
+    *b = JPEG_CLIP((y + JPEG_RGB_Kb1 * cb)                      >> JPEG_RGB_BITS);
+}
+
+#if defined(JPEG_SIMD_SSE2)
+
+// 32 bit lanes of interleaved 16 bit (Cb, Cr) multipliers, for _mm_madd_epi16
+#define JPEG_RGB_KPAIR(_kcb, _kcr)  ((int)(((uint32_t)(uint16_t)(_kcr) << 16) | (uint16_t)(_kcb)))
+
+//-------------------------------------------------------------
+// SSE2 conversion of 8 pixels
+
+static inline void jpeg_ycc_to_rgb_8 (const int16_t *Y, const int16_t *Cb, const int16_t *Cr,
+                                      uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i c128  = _mm_set1_epi16(128);
+    const __m128i round = _mm_set1_epi32(JPEG_RGB_ROUND);
+    const __m128i kr    = _mm_set1_epi32(JPEG_RGB_KPAIR(0,              JPEG_RGB_Kr1));
+    const __m128i kg    = _mm_set1_epi32(JPEG_RGB_KPAIR(-JPEG_RGB_Kg1,  -JPEG_RGB_Kg2));
+    const __m128i kb    = _mm_set1_epi32(JPEG_RGB_KPAIR(JPEG_RGB_Kb1,   0));
+
+    __m128i y   = _mm_loadu_si128((const __m128i *)Y);
+    __m128i cb  = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)Cb), c128);
+    __m128i cr  = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)Cr), c128);
+
+    // Interleaved chroma pairs, and scaled and rounded Y (iDCT output is 0 to 255)
+    __m128i clo = _mm_unpacklo_epi16(cb, cr);
+    __m128i chi = _mm_unpackhi_epi16(cb, cr);
+    __m128i ylo = _mm_add_epi32(_mm_slli_epi32(_mm_unpacklo_epi16(y, zero), JPEG_RGB_BITS), round);
+    __m128i yhi = _mm_add_epi32(_mm_slli_epi32(_mm_unpackhi_epi16(y, zero), JPEG_RGB_BITS), round);
+
+    __m128i rlo = _mm_srai_epi32(_mm_add_epi32(ylo, _mm_madd_epi16(clo, kr)), JPEG_RGB_BITS);
+    __m128i rhi = _mm_srai_epi32(_mm_add_epi32(yhi, _mm_madd_epi16(chi, kr)), JPEG_RGB_BITS);
+    __m128i glo = _mm_srai_epi32(_mm_add_epi32(ylo, _mm_madd_epi16(clo, kg)), JPEG_RGB_BITS);
+    __m128i ghi = _mm_srai_epi32(_mm_add_epi32(yhi, _mm_madd_epi16(chi, kg)), JPEG_RGB_BITS);
+    __m128i blo = _mm_srai_epi32(_mm_add_epi32(ylo, _mm_madd_epi16(clo, kb)), JPEG_RGB_BITS);
+    __m128i bhi = _mm_srai_epi32(_mm_add_epi32(yhi, _mm_madd_epi16(chi, kb)), JPEG_RGB_BITS);
+
+    // Saturating packs clip to 0 to 255
+    __m128i r16 = _mm_packs_epi32(rlo, rhi);
+    __m128i g16 = _mm_packs_epi32(glo, ghi);
+    __m128i b16 = _mm_packs_epi32(blo, bhi);
+
+    _mm_storel_epi64((__m128i *)r, _mm_packus_epi16(r16, r16));
+    _mm_storel_epi64((__m128i *)g, _mm_packus_epi16(g16, g16));
+    _mm_storel_epi64((__m128i *)b, _mm_packus_epi16(b16, b16));
+}
+
+#endif
+
+#if defined(JPEG_SIMD_AVX2)
+
+//-------------------------------------------------------------
+// AVX2 conversion of 16 pixels. The unpacks and packs operate
+// within each 128 bit lane, so the results are in order, apart
+// from the final pack to bytes, which is fixed with a permute.
+
+static inline __m128i jpeg_pack_u8_16 (__m256i lo, __m256i hi)
+{
+    __m256i v16 = _mm256_packs_epi32(lo, hi);
+    __m256i v8  = _mm256_packus_epi16(v16, v16);
+
+    return _mm256_castsi256_si128(_mm256_permute4x64_epi64(v8, 0x08));
+}
+
+static inline void jpeg_ycc_to_rgb_16 (const int16_t *Y, const int16_t *Cb, const int16_t *Cr,
+                                       uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i c128  = _mm256_set1_epi16(128);
+    const __m256i round = _mm256_set1_epi32(JPEG_RGB_ROUND);
+    const __m256i kr    = _mm256_set1_epi32(JPEG_RGB_KPAIR(0,              JPEG_RGB_Kr1));
+    const __m256i kg    = _mm256_set1_epi32(JPEG_RGB_KPAIR(-JPEG_RGB_Kg1,  -JPEG_RGB_Kg2));
+    const __m256i kb    = _mm256_set1_epi32(JPEG_RGB_KPAIR(JPEG_RGB_Kb1,   0));
+
+    __m256i y   = _mm256_loadu_si256((const __m256i *)Y);
+    __m256i cb  = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)Cb), c128);
+    __m256i cr  = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)Cr), c128);
+
+    __m256i clo = _mm256_unpacklo_epi16(cb, cr);
+    __m256i chi = _mm256_unpackhi_epi16(cb, cr);
+    __m256i ylo = _mm256_add_epi32(_mm256_slli_epi32(_mm256_unpacklo_epi16(y, zero), JPEG_RGB_BITS), round);
+    __m256i yhi = _mm256_add_epi32(_mm256_slli_epi32(_mm256_unpackhi_epi16(y, zero), JPEG_RGB_BITS), round);
+
+    _mm_storeu_si128((__m128i *)r, jpeg_pack_u8_16(_mm256_srai_epi32(_mm256_add_epi32(ylo, _mm256_madd_epi16(clo, kr)), JPEG_RGB_BITS),
+                                                   _mm256_srai_epi32(_mm256_add_epi32(yhi, _mm256_madd_epi16(chi, kr)), JPEG_RGB_BITS)));
+    _mm_storeu_si128((__m128i *)g, jpeg_pack_u8_16(_mm256_srai_epi32(_mm256_add_epi32(ylo, _mm256_madd_epi16(clo, kg)), JPEG_RGB_BITS),
+                                                   _mm256_srai_epi32(_mm256_add_epi32(yhi, _mm256_madd_epi16(chi, kg)), JPEG_RGB_BITS)));
+    _mm_storeu_si128((__m128i *)b, jpeg_pack_u8_16(_mm256_srai_epi32(_mm256_add_epi32(ylo, _mm256_madd_epi16(clo, kb)), JPEG_RGB_BITS),
+                                                   _mm256_srai_epi32(_mm256_add_epi32(yhi, _mm256_madd_epi16(chi, kb)), JPEG_RGB_BITS)));
+}
+
+#endif
+
+//-------------------------------------------------------------
+// jpeg_ycc_to_rgb_row()
+//
+// Description:
+//
+// Converts n pixels of YCbCr to planar RGB, 16 pixels at a time
+// with AVX2, then 8 at a time with SSE2, and any remainder with
+// scalar code.
+//
+// Parameters:
+//    Y, Cb, Cr:    pointers to n 16 bit samples (0 to 255) of each component
+//    r, g, b:      pointers to n bytes of each output colour
+//    n:            number of pixels
+//
+// Return value:
+//    None.
+//
+
+void jpeg_ycc_to_rgb_row (const int16_t *Y, const int16_t *Cb, const int16_t *Cr,
+                          uint8_t *r, uint8_t *g, uint8_t *b, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_AVX2)
+    for (; idx + 16 <= n; idx += 16)
+    {
+        jpeg_ycc_to_rgb_16(&Y[idx], &Cb[idx], &Cr[idx], &r[idx], &g[idx], &b[idx]);
+    }
+#endif
+
+#if defined(JPEG_SIMD_SSE2)
+    for (; idx + 8 <= n; idx += 8)
+    {
+        jpeg_ycc_to_rgb_8(&Y[idx], &Cb[idx], &Cr[idx], &r[idx], &g[idx], &b[idx]);
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        jpeg_ycc_to_rgb_pixel(Y[idx], Cb[idx], Cr[idx], &r[idx], &g[idx], &b[idx]);
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_clip_row()
+//
+// Description:
+//
+// Clips n 16 bit samples to 0 to 255, and stores as bytes
+//
+// Parameters:
+//    in:       pointer to n 16 bit samples
+//    out:      pointer to n output bytes
+//    n:        number of samples
+//
+// Return value:
+//    None.
+//
+
+void jpeg_clip_row (const int16_t *in, uint8_t *out, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    for (; idx + 16 <= n; idx += 16)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i *)&in[idx]);
+        __m128i hi = _mm_loadu_si128((const __m128i *)&in[idx+8]);
+
+        _mm_storeu_si128((__m128i *)&out[idx], _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        out[idx] = JPEG_CLIP(in[idx]);
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_interleave_row()
+//
+// Description:
+//
+// Interleaves n pixels from three 8 bit colour planes into
+// packed 3 byte pixels. With SSSE3, 16 pixels are done at a time,
+// each of the three 16 byte output vectors being assembled from
+// a byte shuffle of each plane.
+//
+// Parameters:
+//    c0, c1, c2: pointers to n bytes of each plane, in output byte order
+//    out:        pointer to 3n output bytes
+//    n:          number of pixels
+//
+// Return value:
+//    None.
+//
+
+void jpeg_interleave_row (const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, uint8_t *out, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSSE3)
+    // Shuffle masks for output vector k, plane c (-1 gives a zero byte)
+    const __m128i m00 = _mm_setr_epi8( 0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5);
+    const __m128i m01 = _mm_setr_epi8(-1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1);
+    const __m128i m02 = _mm_setr_epi8(-1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1);
+    const __m128i m10 = _mm_setr_epi8(-1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1);
+    const __m128i m11 = _mm_setr_epi8( 5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10);
+    const __m128i m12 = _mm_setr_epi8(-1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1);
+    const __m128i m20 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i m21 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i m22 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+    for (; idx + 16 <= n; idx += 16)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)&c0[idx]);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)&c1[idx]);
+        __m128i v2 = _mm_loadu_si128((const __m128i *)&c2[idx]);
+
+        __m128i o0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, m00), _mm_shuffle_epi8(v1, m01)), _mm_shuffle_epi8(v2, m02));
+        __m128i o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, m10), _mm_shuffle_epi8(v1, m11)), _mm_shuffle_epi8(v2, m12));
+        __m128i o2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, m20), _mm_shuffle_epi8(v1, m21)), _mm_shuffle_epi8(v2, m22));
+
+        _mm_storeu_si128((__m128i *)&out[3*idx],    o0);
+        _mm_storeu_si128((__m128i *)&out[3*idx+16], o1);
+        _mm_storeu_si128((__m128i *)&out[3*idx+32], o2);
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        out[3*idx + 0] = c0[idx];
+        out[3*idx + 1] = c1[idx];
+        out[3*idx + 2] = c2[idx];
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_interleave4_row()
+//
+// Description:
+//
+// Interleaves n pixels from three 8 bit colour planes into packed
+// 4 byte pixels, with the fourth (alpha) byte set to 255.
+//
+// Parameters:
+//    c0, c1, c2: pointers to n bytes of each plane, in output byte order
+//    out:        pointer to 4n output bytes
+//    n:          number of pixels
+//
+// Return value:
+//    None.
+//
+
+void jpeg_interleave4_row (const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, uint8_t *out, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    for (; idx + 16 <= n; idx += 16)
+    {
+        __m128i v0   = _mm_loadu_si128((const __m128i *)&c0[idx]);
+        __m128i v1   = _mm_loadu_si128((const __m128i *)&c1[idx]);
+        __m128i v2   = _mm_loadu_si128((const __m128i *)&c2[idx]);
+
+        __m128i v01l = _mm_unpacklo_epi8(v0, v1);
+        __m128i v01h = _mm_unpackhi_epi8(v0, v1);
+        __m128i v2al = _mm_unpacklo_epi8(v2, alpha);
+        __m128i v2ah = _mm_unpackhi_epi8(v2, alpha);
+
+        _mm_storeu_si128((__m128i *)&out[4*idx],    _mm_unpacklo_epi16(v01l, v2al));
+        _mm_storeu_si128((__m128i *)&out[4*idx+16], _mm_unpackhi_epi16(v01l, v2al));
+        _mm_storeu_si128((__m128i *)&out[4*idx+32], _mm_unpacklo_epi16(v01h, v2ah));
+        _mm_storeu_si128((__m128i *)&out[4*idx+48], _mm_unpackhi_epi16(v01h, v2ah));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        out[4*idx + 0] = c0[idx];
+        out[4*idx + 1] = c1[idx];
+        out[4*idx + 2] = c2[idx];
+        out[4*idx + 3] = 0xff;
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_interleave2_row()
+//
+// Description:
+//
+// Interleaves n samples from two 8 bit planes into pairs
+//
+// Parameters:
+//    c0, c1:   pointers to n bytes of each plane, in output byte order
+//    out:      pointer to 2n output bytes
+//    n:        number of samples
+//
+// Return value:
+//    None.
+//
+
+void jpeg_interleave2_row (const uint8_t *c0, const uint8_t *c1, uint8_t *out, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    for (; idx + 16 <= n; idx += 16)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)&c0[idx]);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)&c1[idx]);
+
+        _mm_storeu_si128((__m128i *)&out[2*idx],    _mm_unpacklo_epi8(v0, v1));
+        _mm_storeu_si128((__m128i *)&out[2*idx+16], _mm_unpackhi_epi8(v0, v1));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        out[2*idx + 0] = c0[idx];
+        out[2*idx + 1] = c1[idx];
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_pack_rgb565_row()
+//
+// Description:
+//
+// Packs n pixels from RGB planes into 16 bit RGB565 values,
+// stored little endian, truncating each colour.
+//
+// Parameters:
+//    r, g, b:  pointers to n bytes of each colour
+//    out:      pointer to 2n output bytes
+//    n:        number of pixels
+//
+// Return value:
+//    None.
+//
+
+void jpeg_pack_rgb565_row (const uint8_t *r, const uint8_t *g, const uint8_t *b, uint8_t *out, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i rmask = _mm_set1_epi16((short)0xf800);
+    const __m128i gmask = _mm_set1_epi16(0x07e0);
+
+    for (; idx + 8 <= n; idx += 8)
+    {
+        __m128i vr = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&r[idx]), zero);
+        __m128i vg = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&g[idx]), zero);
+        __m128i vb = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&b[idx]), zero);
+
+        __m128i v  = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_slli_epi16(vr, 8), rmask),
+                                               _mm_and_si128(_mm_slli_epi16(vg, 3), gmask)),
+                                  _mm_srli_epi16(vb, 3));
+
+        _mm_storeu_si128((__m128i *)&out[2*idx], v);
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        int v = ((r[idx] & 0xf8) << 8) | ((g[idx] & 0xfc) << 3) | (b[idx] >> 3);
+
+        out[2*idx + 0] = v & 0xff;
+        out[2*idx + 1] = v >> 8;
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_rgb_to_gray_row()
+//
+// Description:
+//
+// Calculates the luma of n pixels from RGB planes, for RGB
+// coded data (YCbCr data uses the Y component directly).
+//
+// Parameters:
+//    r, g, b:  pointers to n bytes of each colour
+//    out:      pointer to n output bytes
+//    n:        number of pixels
+//
+// Return value:
+//    None.
+//
+
+void jpeg_rgb_to_gray_row (const uint8_t *r, const uint8_t *g, const uint8_t *b, uint8_t *out, int n)
+{
+    for (int idx = 0; idx < n; idx++)
+    {
+        out[idx] = (JPEG_GRAY_Kr*r[idx] + JPEG_GRAY_Kg*g[idx] + JPEG_GRAY_Kb*b[idx] + JPEG_RGB_ROUND) >> JPEG_RGB_BITS;
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_cmyk_to_rgb_row()
+//
+// Description:
+//
+// Generates n samples of an R, G or B row from the C, M or Y row
+// and the K row of 4 component data, as c*k/255, with the product
+// rounded exactly with the (t + (t >> 8)) >> 8 division. Adobe
+// CMYK is stored inverted (255 for no ink), so this is the ink
+// remaining after the black. YCCK's colour converted rows are
+// the uninverted C, M and Y, so are inverted first.
+//
+// Parameters:
+//    in:       pointer to n bytes of C, M or Y (or YCCK's R, G or B)
+//    k:        pointer to n bytes of K
+//    out:      pointer to n output bytes (may be in)
+//    n:        number of samples
+//    inverted: invert the input (for YCCK)
+//
+// Return value:
+//    None.
+//
+
+void jpeg_cmyk_to_rgb_row (const uint8_t *in, const uint8_t *k, uint8_t *out, int n, bool inverted)
+{
+    int idx  = 0;
+    int flip = inverted ? 0xff : 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i vflip = _mm_set1_epi8((char)flip);
+
+    for (; idx + 16 <= n; idx += 16)
+    {
+        __m128i c  = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&in[idx]), vflip);
+        __m128i vk = _mm_loadu_si128((const __m128i *)&k[idx]);
+
+        // Products of up to 255*255 + 128, so fit unsigned 16 bits
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(vk, zero)), round);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(vk, zero)), round);
+
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128((__m128i *)&out[idx], _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        int t = (in[idx] ^ flip) * k[idx] + 128;
+
+        out[idx] = (t + (t >> 8)) >> 8;
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_invert_row()
+//
+// Description:
+//
+// Inverts n bytes in place (as 255 - v), for YCCK's colour
+// converted rows output as C, M and Y.
+//
+// Parameters:
+//    row:      pointer to n bytes
+//    n:        number of samples
+//
+// Return value:
+//    None.
+//
+
+void jpeg_invert_row (uint8_t *row, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    const __m128i ones = _mm_set1_epi8((char)0xff);
+
+    for (; idx + 16 <= n; idx += 16)
+    {
+        _mm_storeu_si128((__m128i *)&row[idx], _mm_xor_si128(_mm_loadu_si128((const __m128i *)&row[idx]), ones));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        row[idx] ^= 0xff;
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_downsample_row()
+//
+// Description:
+//
+// Downsamples a chroma row, for planar YUV output, averaging
+// rows r0 and r1 (the same row when not downsampling vertically),
+// and h adjacent samples horizontally.
+//
+// Parameters:
+//    r0, r1:   pointers to the input rows (h*n samples)
+//    out:      pointer to n output bytes
+//    n:        number of output samples
+//    h:        horizontal downsampling (1 or 2)
+//
+// Return value:
+//    None.
+//
+
+void jpeg_downsample_row (const int16_t *r0, const int16_t *r1, uint8_t *out, int n, int h)
+{
+    int idx = 0;
+
+    if (h == 1)
+    {
+#if defined(JPEG_SIMD_SSE2)
+        for (; idx + 8 <= n; idx += 8)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)&r0[idx]);
+            __m128i b = _mm_loadu_si128((const __m128i *)&r1[idx]);
+            __m128i v = _mm_avg_epu16(a, b);
+
+            _mm_storel_epi64((__m128i *)&out[idx], _mm_packus_epi16(v, v));
+        }
+#endif
+        for (; idx < n; idx++)
+        {
+            out[idx] = (r0[idx] + r1[idx] + 1) >> 1;
+        }
+    }
+    else
+    {
+#if defined(JPEG_SIMD_SSE2)
+        const __m128i ones = _mm_set1_epi16(1);
+        const __m128i two  = _mm_set1_epi32(2);
+
+        for (; idx + 8 <= n; idx += 8)
+        {
+            __m128i lo = _mm_add_epi16(_mm_loadu_si128((const __m128i *)&r0[2*idx]),   _mm_loadu_si128((const __m128i *)&r1[2*idx]));
+            __m128i hi = _mm_add_epi16(_mm_loadu_si128((const __m128i *)&r0[2*idx+8]), _mm_loadu_si128((const __m128i *)&r1[2*idx+8]));
+
+            // Sum adjacent pairs to 32 bits, and round
+            lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lo, ones), two), 2);
+            hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(hi, ones), two), 2);
+
+            __m128i v = _mm_packs_epi32(lo, hi);
+
+            _mm_storel_epi64((__m128i *)&out[idx], _mm_packus_epi16(v, v));
+        }
+#endif
+        for (; idx < n; idx++)
+        {
+            out[idx] = (r0[2*idx] + r0[2*idx+1] + r1[2*idx] + r1[2*idx+1] + 2) >> 2;
+        }
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_upsample_h2_row()
+//
+// Description:
+//
+// Nearest neighbour (replication) upsampling of a chroma row,
+// horizontally by 2
+//
+// Parameters:
+//    in:       pointer to n input samples
+//    out:      pointer to 2n output samples
+//    n:        number of input samples
+//
+// Return value:
+//    None.
+//
+
+void jpeg_upsample_h2_row (const int16_t *in, int16_t *out, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    for (; idx + 8 <= n; idx += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&in[idx]);
+
+        _mm_storeu_si128((__m128i *)&out[2*idx],   _mm_unpacklo_epi16(v, v));
+        _mm_storeu_si128((__m128i *)&out[2*idx+8], _mm_unpackhi_epi16(v, v));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        out[2*idx] = out[2*idx+1] = in[idx];
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_upsample_h2_tri_row()
+//
+// Description:
+//
+// Triangle filter upsampling of a chroma row, horizontally by 2.
+// Each output is 3/4 of the nearer and 1/4 of the further input
+// sample, with in[-1] and in[n] required as edge context.
+//
+// Parameters:
+//    in:       pointer to n input samples
+//    out:      pointer to 2n output samples
+//    n:        number of input samples
+//
+// Return value:
+//    None.
+//
+
+void jpeg_upsample_h2_tri_row (const int16_t *in, int16_t *out, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi16(2);
+
+    for (; idx + 8 <= n; idx += 8)
+    {
+        __m128i c  = _mm_loadu_si128((const __m128i *)&in[idx]);
+        __m128i cl = _mm_loadu_si128((const __m128i *)&in[idx-1]);
+        __m128i cr = _mm_loadu_si128((const __m128i *)&in[idx+1]);
+        __m128i c3 = _mm_add_epi16(c, _mm_add_epi16(c, c));
+
+        __m128i e  = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(c3, cl), one), 2);
+        __m128i o  = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(c3, cr), two), 2);
+
+        _mm_storeu_si128((__m128i *)&out[2*idx],   _mm_unpacklo_epi16(e, o));
+        _mm_storeu_si128((__m128i *)&out[2*idx+8], _mm_unpackhi_epi16(e, o));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        int c3 = 3 * in[idx];
+
+        out[2*idx]   = (c3 + in[idx-1] + 1) >> 2;
+        out[2*idx+1] = (c3 + in[idx+1] + 2) >> 2;
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_upsample_v2_tri_row()
+//
+// Description:
+//
+// Triangle filter upsampling of a chroma row, vertically by 2.
+// The output is 3/4 of the nearer row and 1/4 of the further.
+//
+// Parameters:
+//    near:     pointer to n samples of the nearer input row
+//    far:      pointer to n samples of the further input row
+//    out:      pointer to n output samples
+//    n:        number of samples
+//    bias:     rounding bias (1 for the upper, 2 for the lower output row)
+//
+// Return value:
+//    None.
+//
+
+void jpeg_upsample_v2_tri_row (const int16_t *near, const int16_t *far, int16_t *out, int n, int bias)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    const __m128i vbias = _mm_set1_epi16(bias);
+
+    for (; idx + 8 <= n; idx += 8)
+    {
+        __m128i cn = _mm_loadu_si128((const __m128i *)&near[idx]);
+        __m128i cf = _mm_loadu_si128((const __m128i *)&far[idx]);
+        __m128i t  = _mm_add_epi16(_mm_add_epi16(cn, _mm_add_epi16(cn, cn)), _mm_add_epi16(cf, vbias));
+
+        _mm_storeu_si128((__m128i *)&out[idx], _mm_srli_epi16(t, 2));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        out[idx] = (3 * near[idx] + far[idx] + bias) >> 2;
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_upsample_h2v2_tri_row()
+//
+// Description:
+//
+// Triangle filter upsampling of a chroma row by 2 in both
+// directions. The two input rows are first combined vertically
+// (3/4 nearer, 1/4 further), unscaled, and the results then
+// filtered horizontally, with a single rounding at the end.
+// near[-1], near[n], far[-1] and far[n] are required as edge
+// context.
+//
+// Parameters:
+//    near:     pointer to n samples of the nearer input row
+//    far:      pointer to n samples of the further input row
+//    out:      pointer to 2n output samples
+//    n:        number of input samples
+//
+// Return value:
+//    None.
+//
+
+void jpeg_upsample_h2v2_tri_row (const int16_t *near, const int16_t *far, int16_t *out, int n)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    const __m128i seven = _mm_set1_epi16(7);
+    const __m128i eight = _mm_set1_epi16(8);
+
+    for (; idx + 8 <= n; idx += 8)
+    {
+        __m128i n0 = _mm_loadu_si128((const __m128i *)&near[idx]);
+        __m128i nl = _mm_loadu_si128((const __m128i *)&near[idx-1]);
+        __m128i nr = _mm_loadu_si128((const __m128i *)&near[idx+1]);
+        __m128i f0 = _mm_loadu_si128((const __m128i *)&far[idx]);
+        __m128i fl = _mm_loadu_si128((const __m128i *)&far[idx-1]);
+        __m128i fr = _mm_loadu_si128((const __m128i *)&far[idx+1]);
+
+        // Vertical sums (4x scale)
+        __m128i t  = _mm_add_epi16(_mm_add_epi16(n0, _mm_add_epi16(n0, n0)), f0);
+        __m128i tl = _mm_add_epi16(_mm_add_epi16(nl, _mm_add_epi16(nl, nl)), fl);
+        __m128i tr = _mm_add_epi16(_mm_add_epi16(nr, _mm_add_epi16(nr, nr)), fr);
+        __m128i t3 = _mm_add_epi16(t, _mm_add_epi16(t, t));
+
+        __m128i e  = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t3, tl), eight), 4);
+        __m128i o  = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t3, tr), seven), 4);
+
+        _mm_storeu_si128((__m128i *)&out[2*idx],   _mm_unpacklo_epi16(e, o));
+        _mm_storeu_si128((__m128i *)&out[2*idx+8], _mm_unpackhi_epi16(e, o));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        int t  = 3 * near[idx]   + far[idx];
+        int tl = 3 * near[idx-1] + far[idx-1];
+        int tr = 3 * near[idx+1] + far[idx+1];
+
+        out[2*idx]   = (3 * t + tl + 8) >> 4;
+        out[2*idx+1] = (3 * t + tr + 7) >> 4;
+    }
+}
+
+//-------------------------------------------------------------
+// Scalar conversions of a float to half (IEEE 754 binary16) and
+// bfloat16 precision, rounding to nearest even
+
+static inline uint16_t jpeg_float_to_half (float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int      exp  = (int)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t man  = bits & 0x7fffff;
+
+    // Overflow to infinity (no NaNs from normalised pixel values)
+    if (exp >= 0x1f)
+    {
+        return sign | 0x7c00;
+    }
+
+    // Subnormal (or zero), with the implicit leading 1 shifted into the mantissa
+    if (exp <= 0)
+    {
+        if (exp < -10)
+        {
+            return sign;
+        }
+
+        man      |= 0x800000;
+        int shift = 14 - exp;
+        uint32_t h = man >> shift;
+        uint32_t rem = man & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+
+        h += (rem > half || (rem == half && (h & 1))) ? 1 : 0;
+
+        return sign | h;
+    }
+
+    // Normal, where a mantissa carry from rounding correctly increments the exponent
+    uint32_t h = ((uint32_t)exp << 10) | (man >> 13);
+    uint32_t rem = man & 0x1fff;
+
+    h += (rem > 0x1000 || (rem == 0x1000 && (h & 1))) ? 1 : 0;
+
+    return sign | h;
+}
+
+static inline uint16_t jpeg_float_to_bf16 (float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    return (uint16_t)((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+static inline void jpeg_tensor_store (uint8_t *out, float v, int type)
+{
+    uint16_t h;
+
+    switch (type)
+    {
+    case JPEG_TENSOR_FLOAT16:  h = jpeg_float_to_half(v); memcpy(out, &h, sizeof(h)); break;
+    case JPEG_TENSOR_BFLOAT16: h = jpeg_float_to_bf16(v); memcpy(out, &h, sizeof(h)); break;
+    default:                   memcpy(out, &v, sizeof(v));                           break;
+    }
+}
+
+#if defined(JPEG_SIMD_SSE2)
+
+//-------------------------------------------------------------
+// SSE2 store of 4 float elements to a tensor, converted to 16
+// bit types where selected (half precision only with F16C)
+
+static inline void jpeg_tensor_store4 (uint8_t *out, __m128 v, int type)
+{
+    if (type == JPEG_TENSOR_FLOAT32)
+    {
+        _mm_storeu_ps((float *)out, v);
+    }
+    else if (type == JPEG_TENSOR_BFLOAT16)
+    {
+        // Round to nearest even on the upper 16 bits, which an arithmetic shift
+        // keeps in signed range for the saturating pack
+        __m128i bits = _mm_castps_si128(v);
+        __m128i lsb  = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+
+        bits = _mm_srai_epi32(_mm_add_epi32(bits, _mm_add_epi32(lsb, _mm_set1_epi32(0x7fff))), 16);
+
+        _mm_storel_epi64((__m128i *)out, _mm_packs_epi32(bits, bits));
+    }
+#if defined(JPEG_SIMD_F16C)
+    else
+    {
+        _mm_storel_epi64((__m128i *)out, _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+}
+
+#endif
+
+//-------------------------------------------------------------
+// jpeg_tensor_row()
+//
+// Description:
+//
+// Normalises n pixels of RGB planes into a row of a float32,
+// float16 or bfloat16 tensor, as v*scale + offset for each
+// channel. For NCHW, the channels are written to planes of the
+// given size, and for NHWC (a plane size of 0) interleaved.
+//
+// Parameters:
+//    r, g, b:  pointers to n bytes of each colour
+//    out:      pointer to the tensor row (in channel 0's plane for NCHW)
+//    plane:    bytes between channel planes (0 for interleaved)
+//    n:        number of pixels
+//    scale:    per channel scale (3 values)
+//    offset:   per channel offset (3 values)
+//    type:     element type (JPEG_TENSOR_xxx)
+//
+// Return value:
+//    None.
+//
+
+void jpeg_tensor_row (const uint8_t *r, const uint8_t *g, const uint8_t *b, uint8_t *out, long plane, int n,
+                      const float *scale, const float *offset, int type)
+{
+    int            idx   = 0;
+    int            esize = (type == JPEG_TENSOR_FLOAT32) ? 4 : 2;
+    const uint8_t *c[3]  = {r, g, b};
+
+#if defined(JPEG_SIMD_SSE2)
+# if !defined(JPEG_SIMD_F16C)
+    if (type != JPEG_TENSOR_FLOAT16)
+# endif
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; idx + 4 <= n; idx += 4)
+        {
+            __m128 v[3];
+
+            for (int cdx = 0; cdx < 3; cdx++)
+            {
+                int w;
+                memcpy(&w, &c[cdx][idx], sizeof(w));
+
+                __m128i vi = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(w), zero), zero);
+
+                v[cdx] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(vi), _mm_set1_ps(scale[cdx])), _mm_set1_ps(offset[cdx]));
+            }
+
+            if (plane)
+            {
+                for (int cdx = 0; cdx < 3; cdx++)
+                {
+                    jpeg_tensor_store4(&out[cdx*plane + idx*esize], v[cdx], type);
+                }
+            }
+            else
+            {
+                // Transpose 4 (r, g, b) pixels to (r0 g0 b0 r1), (g1 b1 r2 g2) and (b2 r3 g3 b3)
+                __m128 rg_lo = _mm_unpacklo_ps(v[0], v[1]);
+                __m128 rg_hi = _mm_unpackhi_ps(v[0], v[1]);
+                __m128 t0    = _mm_shuffle_ps(v[2],  rg_lo, _MM_SHUFFLE(2, 2, 0, 0));
+                __m128 t1    = _mm_shuffle_ps(rg_lo, v[2],  _MM_SHUFFLE(1, 1, 3, 3));
+                __m128 t2    = _mm_shuffle_ps(v[2],  rg_hi, _MM_SHUFFLE(2, 2, 2, 2));
+                __m128 t3    = _mm_shuffle_ps(rg_hi, v[2],  _MM_SHUFFLE(3, 3, 3, 3));
+
+                uint8_t *optr = &out[3*idx*esize];
+
+                jpeg_tensor_store4(optr,           _mm_shuffle_ps(rg_lo, t0, _MM_SHUFFLE(2, 0, 1, 0)), type);
+                jpeg_tensor_store4(optr + 4*esize, _mm_shuffle_ps(t1, rg_hi, _MM_SHUFFLE(1, 0, 2, 0)), type);
+                jpeg_tensor_store4(optr + 8*esize, _mm_shuffle_ps(t2, t3,    _MM_SHUFFLE(2, 0, 2, 0)), type);
+            }
+        }
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        for (int cdx = 0; cdx < 3; cdx++)
+        {
+            uint8_t *optr = plane ? &out[cdx*plane + idx*esize] : &out[(3*idx + cdx)*esize];
+
+            jpeg_tensor_store(optr, c[cdx][idx]*scale[cdx] + offset[cdx], type);
+        }
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_resample_h_row()
+//
+// Description:
+//
+// Resamples a row horizontally, each output sample being the
+// weighted sum of taps source samples, from its first source
+// sample. The weights (summing to JPEG_RESIZE_ONE) are kept to
+// 8 fractional bits in the 16 bit output, for vertical
+// resampling. With 8 taps (padded with zero weights), four output
+// samples at a time are summed with SSE2, from 8 source samples
+// each.
+//
+// Parameters:
+//    in:       pointer to the source row (readable to 8 samples
+//              beyond the last tap)
+//    out:      pointer to n output samples (8.8 fixed point)
+//    n:        number of output samples
+//    start:    first source sample of each output sample
+//    weight:   taps weights of each output sample
+//    taps:     number of taps
+//
+// Return value:
+//    None.
+//
+
+void jpeg_resample_h_row (const uint8_t *in, uint16_t *out, int n, const int *start, const int16_t *weight, int taps)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    if (taps == 8)
+    {
+        const __m128i zero  = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(1 << (JPEG_RESIZE_BITS-8-1));
+        const __m128i bias  = _mm_set1_epi32(0x8000);
+        const __m128i sign  = _mm_set1_epi16((short)0x8000);
+
+        for (; idx + 4 <= n; idx += 4)
+        {
+            __m128i s[4];
+
+            for (int jdx = 0; jdx < 4; jdx++)
+            {
+                __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&in[start[idx+jdx]]), zero);
+
+                s[jdx] = _mm_madd_epi16(px, _mm_loadu_si128((const __m128i *)&weight[(idx+jdx)*8]));
+            }
+
+            // Transpose and add, for the four sums
+            __m128i t0  = _mm_add_epi32(_mm_unpacklo_epi32(s[0], s[1]), _mm_unpackhi_epi32(s[0], s[1]));
+            __m128i t1  = _mm_add_epi32(_mm_unpacklo_epi32(s[2], s[3]), _mm_unpackhi_epi32(s[2], s[3]));
+            __m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1));
+
+            // Round and descale, packing the unsigned 16 bit results via a signed bias
+            sum = _mm_sub_epi32(_mm_srai_epi32(_mm_add_epi32(sum, round), JPEG_RESIZE_BITS-8), bias);
+            sum = _mm_xor_si128(_mm_packs_epi32(sum, sum), sign);
+
+            _mm_storel_epi64((__m128i *)&out[idx], sum);
+        }
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        const uint8_t *src = &in[start[idx]];
+        const int16_t *w   = &weight[idx*taps];
+        int            sum = 0;
+
+        for (int tdx = 0; tdx < taps; tdx++)
+        {
+            sum += src[tdx] * w[tdx];
+        }
+
+        out[idx] = (sum + (1 << (JPEG_RESIZE_BITS-8-1))) >> (JPEG_RESIZE_BITS-8);
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_resample_v_acc_row()
+//
+// Description:
+//
+// Accumulates a horizontally resampled row, with its weight, into
+// the vertical accumulators of an output row.
+//
+// Parameters:
+//    in:       pointer to n horizontally resampled samples
+//    acc:      pointer to n accumulators
+//    n:        number of samples
+//    weight:   the row's weight (up to JPEG_RESIZE_ONE)
+//
+// Return value:
+//    None.
+//
+
+void jpeg_resample_v_acc_row (const uint16_t *in, uint32_t *acc, int n, int weight)
+{
+    int idx = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    const __m128i w = _mm_set1_epi16((short)weight);
+
+    for (; idx + 8 <= n; idx += 8)
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i *)&in[idx]);
+        __m128i lo = _mm_mullo_epi16(v, w);
+        __m128i hi = _mm_mulhi_epu16(v, w);
+
+        __m128i a0 = _mm_loadu_si128((const __m128i *)&acc[idx]);
+        __m128i a1 = _mm_loadu_si128((const __m128i *)&acc[idx+4]);
+
+        _mm_storeu_si128((__m128i *)&acc[idx],   _mm_add_epi32(a0, _mm_unpacklo_epi16(lo, hi)));
+        _mm_storeu_si128((__m128i *)&acc[idx+4], _mm_add_epi32(a1, _mm_unpackhi_epi16(lo, hi)));
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        acc[idx] += (uint32_t)in[idx] * weight;
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_resample_v_out_row()
+//
+// Description:
+//
+// Completes an output row from its vertical accumulators, which
+// are cleared for the next row.
+//
+// Parameters:
+//    acc:      pointer to n accumulators
+//    out:      pointer to n output bytes
+//    n:        number of samples
+//
+// Return value:
+//    None.
+//
+
+void jpeg_resample_v_out_row (uint32_t *acc, uint8_t *out, int n)
+{
+    const int shift = JPEG_RESIZE_BITS + 8;
+    int       idx   = 0;
+
+#if defined(JPEG_SIMD_SSE2)
+    const __m128i round = _mm_set1_epi32(1 << (shift-1));
+    const __m128i zero  = _mm_setzero_si128();
+
+    for (; idx + 8 <= n; idx += 8)
+    {
+        __m128i a0 = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i *)&acc[idx]),   round), shift);
+        __m128i a1 = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i *)&acc[idx+4]), round), shift);
+        __m128i v  = _mm_packs_epi32(a0, a1);
+
+        _mm_storel_epi64((__m128i *)&out[idx], _mm_packus_epi16(v, v));
+        _mm_storeu_si128((__m128i *)&acc[idx],   zero);
+        _mm_storeu_si128((__m128i *)&acc[idx+4], zero);
+    }
+#endif
+
+    for (; idx < n; idx++)
+    {
+        out[idx] = (acc[idx] + (1U << (shift-1))) >> shift;
+        acc[idx] = 0;
+    }
+}
@@ -0,0 +1,105 @@
+//=============================================================
+//
+// Copyright (c) 2026 Simon Southwell
+// All rights reserved.
+//
+// Date: 18th October 2026
+//
+// This file is part of JFIF.
+//
+// JFIF is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// JFIF is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JFIF. If not, see <http://www.gnu.org/licenses/>.
+//
+//=============================================================
+//
+// Colour conversion and chroma upsampling kernels. These operate
+// on rows of 16 bit iDCT output samples, producing planar 8 bit
+// output (or upsampled 16 bit rows), and are vectorised with SSE2
+// or AVX2 when available (see jfif_local.h).
+//
+// The triangle filter upsamplers are those of the IJG library's
+// "fancy" upsampling, and so give the same results. These expect
+// a replicated context sample either side of the input row
+// (in[-1] and in[n]).
+//
+//=============================================================
+
+#include "jfif_local.h"
+
+#ifndef _JFIF_COLOUR_H_
+#define _JFIF_COLOUR_H_
+
+// Fixed point YCbCr to RGB conversion of n pixels, using the JPEG_RGB_Kxx constants
+void jpeg_ycc_to_rgb_row (const int16_t *Y, const int16_t *Cb, const int16_t *Cr,
+                          uint8_t *r, uint8_t *g, uint8_t *b, int n);
+
+// Clip n 16 bit samples to 8 bits (for RGB coded and monochrome data)
+void jpeg_clip_row       (const int16_t *in, uint8_t *out, int n);
+
+// Interleave n pixels of three 8 bit planes into packed triplets (c0, c1, c2).
+// Called with (r, g, b) for raw RGB, or (b, g, r) for bitmap BGR
+void jpeg_interleave_row (const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, uint8_t *out, int n);
+
+// As jpeg_interleave_row(), but to 4 byte pixels with a fourth (alpha) byte of 255
+void jpeg_interleave4_row (const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, uint8_t *out, int n);
+
+// Interleave n samples of two 8 bit planes into pairs (c0, c1)
+void jpeg_interleave2_row (const uint8_t *c0, const uint8_t *c1, uint8_t *out, int n);
+
+// Pack n pixels of RGB planes into little endian 16 bit RGB565
+void jpeg_pack_rgb565_row (const uint8_t *r, const uint8_t *g, const uint8_t *b, uint8_t *out, int n);
+
+// Luma of n pixels of RGB planes (for RGB coded data)
+void jpeg_rgb_to_gray_row (const uint8_t *r, const uint8_t *g, const uint8_t *b, uint8_t *out, int n);
+
+// R, G or B of n pixels of 4 component data, from the C, M or Y row and K row, as
+// c*k/255 (Adobe CMYK being inverted), or as (255-c)*k/255 if inverted (for YCCK)
+void jpeg_cmyk_to_rgb_row (const uint8_t *in, const uint8_t *k, uint8_t *out, int n, bool inverted);
+
+// Invert n bytes in place, as 255 - v
+void jpeg_invert_row      (uint8_t *row, int n);
+
+// Average n output samples from rows r0 and r1 (which may be the same), and
+// from h (1 or 2) adjacent samples horizontally, for chroma downsampling
+void jpeg_downsample_row  (const int16_t *r0, const int16_t *r1, uint8_t *out, int n, int h);
+
+// Normalise n pixels of RGB planes to a tensor row of JPEG_TENSOR_xxx elements,
+// as v*scale[c] + offset[c] for each channel c. With a plane size (in bytes)
+// the channels are written to separate planes (NCHW), else interleaved (NHWC)
+void jpeg_tensor_row      (const uint8_t *r, const uint8_t *g, const uint8_t *b, uint8_t *out, long plane, int n,
+                           const float *scale, const float *offset, int type);
+
+// Horizontal resampling of a row to n output samples (8.8 fixed point), each the
+// sum of taps source samples from start[] with weights of JPEG_RESIZE_ONE in total
+void jpeg_resample_h_row      (const uint8_t *in, uint16_t *out, int n, const int *start, const int16_t *weight, int taps);
+
+// Accumulate n horizontally resampled samples, with a row weight, for vertical resampling
+void jpeg_resample_v_acc_row  (const uint16_t *in, uint32_t *acc, int n, int weight);
+
+// Complete n samples of an output row from its accumulators, clearing them
+void jpeg_resample_v_out_row  (uint32_t *acc, uint8_t *out, int n);
+
+// Chroma upsampling, horizontally by 2 (n input samples, 2n output)
+void jpeg_upsample_h2_row     (const int16_t *in, int16_t *out, int n);
+
+// Triangle filter upsampling horizontally by 2 (n input samples, 2n output)
+void jpeg_upsample_h2_tri_row (const int16_t *in, int16_t *out, int n);
+
+// Triangle filter upsampling vertically by 2, for an output row with nearest
+// input row near and the next nearest far (bias 1 for upper, 2 for lower row)
+void jpeg_upsample_v2_tri_row (const int16_t *near, const int16_t *far, int16_t *out, int n, int bias);
+
+// Triangle filter upsampling by 2 in both directions (n input samples, 2n output)
+void jpeg_upsample_h2v2_tri_row (const int16_t *near, const int16_t *far, int16_t *out, int n);
+
+#endif
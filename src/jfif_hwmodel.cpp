@@ -0,0 +1,400 @@
+//=============================================================
+//
+// Copyright (c) 2026 Simon Southwell
+// All rights reserved.
+//
+// Date: 18th October 2026
+//
+// This file is part of JFIF.
+//
+// JFIF is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// JFIF is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JFIF. If not, see <http://www.gnu.org/licenses/>.
+//
+//=============================================================
+//
+// Hardware iDCT pipeline model, and the jfif_hwmodel program
+// (make hwmodel) that runs real images through it. See
+// jfif_hwmodel.h for a description of the modelled hardware.
+//
+// Each block's timing is resolved, in decode order, from the
+// cycles at which the entropy decoder, FIFO, 1D pipeline(s)
+// and transpose buffers become free. As the modelled hardware
+// is strictly in order, this gives the same cycle counts as
+// stepping the pipeline a cycle at a time.
+//
+// The entropy decoder's time for a block is estimated from
+// the number of coded symbols (the DC difference, each non-zero
+// AC coefficient, ZRL codes for zero runs of 16 or more, and
+// EOB), as the block's de-quantised coefficients are seen.
+//
+//=============================================================
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "jfif_class.h"
+#include "jfif_hwmodel.h"
+#include "bitmap.h"
+
+#ifdef WIN32
+// MSVC doesn't have getopt, so declare hooks to bundled in version
+extern "C" int getopt(int nargc, char** nargv, char *ostr);
+extern "C" char *optarg;
+#else
+#include <getopt.h>
+#endif
+
+#define JPEG_HWMODEL_MAX(_a, _b)    (((_a) > (_b)) ? (_a) : (_b))
+
+static const int jpeg_hwmodel_inv_zigzag[DCTSIZE2] = JPEG_INV_ZIGZAG_MAP;
+
+jfif_hwmodel *jfif_hwmodel_idct_policy::model = NULL;
+
+//-------------------------------------------------------------
+// jfif_hwmodel()
+//
+// Description:
+//
+// Constructor. Takes a copy of the configuration (limited to
+// the supported ranges) and resets the pipeline state.
+//
+// Parameters:
+//    cfg_in:   model configuration
+//
+
+jfif_hwmodel::jfif_hwmodel (const jpeg_hwmodel_cfg_t &cfg_in) : cfg(cfg_in)
+{
+    cfg.pipeline_depth    = JPEG_HWMODEL_MAX(cfg.pipeline_depth, 1);
+    cfg.transpose_latency = JPEG_HWMODEL_MAX(cfg.transpose_latency, 0);
+    cfg.symbols_per_cycle = JPEG_HWMODEL_MAX(cfg.symbols_per_cycle, 1);
+    cfg.transpose_buffers = (cfg.transpose_buffers >= JPEG_HWMODEL_MAX_TBUFS) ? JPEG_HWMODEL_MAX_TBUFS : 1;
+    cfg.num_1d_units      = (cfg.num_1d_units >= 2) ? 2 : 1;
+    cfg.fifo_depth        = (cfg.fifo_depth < 1) ? 1 : (cfg.fifo_depth > JPEG_HWMODEL_MAX_FIFO) ? JPEG_HWMODEL_MAX_FIFO : cfg.fifo_depth;
+
+    memset(&stat, 0, sizeof(stat));
+
+    entropy_free  = 0;
+    row_unit_free = 0;
+    col_unit_free = 0;
+
+    memset(tbuf_free, 0, sizeof(tbuf_free));
+    memset(fifo_pop,  0, sizeof(fifo_pop));
+}
+
+//-------------------------------------------------------------
+// jpeg_hwmodel_default_cfg()
+//
+// Description:
+//
+// Initialises a configuration with the default values
+//
+// Parameters:
+//    cfg:      configuration to update
+//
+// Return value:
+//    None.
+//
+
+void jfif_hwmodel::jpeg_hwmodel_default_cfg (jpeg_hwmodel_cfg_t &cfg)
+{
+    cfg.pipeline_depth    = JPEG_HWMODEL_DEF_DEPTH;
+    cfg.transpose_latency = JPEG_HWMODEL_DEF_TLATENCY;
+    cfg.transpose_buffers = JPEG_HWMODEL_DEF_TBUFS;
+    cfg.num_1d_units      = JPEG_HWMODEL_DEF_UNITS;
+    cfg.symbols_per_cycle = JPEG_HWMODEL_DEF_SYMBOLS;
+    cfg.fifo_depth        = JPEG_HWMODEL_DEF_FIFO;
+    cfg.clock_mhz         = JPEG_HWMODEL_DEF_CLOCK;
+}
+
+//-------------------------------------------------------------
+// jpeg_hwmodel_block()
+//
+// Description:
+//
+// Accounts the timing for the next coefficient block through
+// the modelled hardware. A 1D pass issues one row (or column)
+// per cycle for 8 cycles, with the result of an issue at cycle
+// t written at cycle t + pipeline_depth. The column pass may
+// start transpose_latency cycles after the last row is written.
+//
+// Parameters:
+//    data:     de-quantised coefficient block, in natural order
+//
+// Return value:
+//    None.
+//
+
+void jfif_hwmodel::jpeg_hwmodel_block (jpeg_8x8_block_t data)
+{
+    long k = stat.blocks;
+    int  D = cfg.pipeline_depth;
+
+    // Estimate coded symbols: DC, plus each non-zero AC (with any ZRLs), plus EOB
+    int symbols = 1;
+    int run     = 0;
+
+    for (int zdx = 1; zdx < DCTSIZE2; zdx++)
+    {
+        int ndx = jpeg_hwmodel_inv_zigzag[zdx];
+
+        if (data[ndx / DCTSIZE][ndx % DCTSIZE])
+        {
+            symbols += run/16 + 1;
+            run      = 0;
+        }
+        else
+        {
+            run++;
+        }
+    }
+
+    if (run)
+    {
+        symbols++;
+    }
+
+    long ent_cycles = (symbols + cfg.symbols_per_cycle - 1) / cfg.symbols_per_cycle;
+
+    // Entropy decoder waits for a FIFO slot (i.e. block k-fifo_depth popped by the iDCT)
+    long fifo_slot = (k >= cfg.fifo_depth) ? fifo_pop[k % cfg.fifo_depth] : 0;
+    long ent_start = JPEG_HWMODEL_MAX(entropy_free, fifo_slot);
+    long ent_done  = ent_start + ent_cycles;
+
+    stat.backpressure_cycles += ent_start - entropy_free;
+    entropy_free              = ent_done;
+
+    // Row pass needs the block, the row pipeline, and a free transpose buffer
+    // by the time the first row result is written (D cycles after issue)
+    long tbuf      = tbuf_free[k % cfg.transpose_buffers] - D;
+    long resources = JPEG_HWMODEL_MAX(row_unit_free, tbuf);
+    long row_start = JPEG_HWMODEL_MAX(ent_done, resources);
+
+    if (ent_done > resources)
+    {
+        stat.starve_cycles += ent_done - resources;
+    }
+
+    if (tbuf > JPEG_HWMODEL_MAX(row_unit_free, ent_done))
+    {
+        stat.tbuf_full_cycles += tbuf - JPEG_HWMODEL_MAX(row_unit_free, ent_done);
+    }
+
+    fifo_pop[k % cfg.fifo_depth] = row_start;
+    row_unit_free                = row_start + DCTSIZE;
+
+    // Column pass, after the transpose, on the shared or dedicated column pipeline
+    long col_ready = row_start + (DCTSIZE-1) + D + cfg.transpose_latency;
+    long col_unit  = (cfg.num_1d_units == 1) ? row_unit_free : col_unit_free;
+    long col_start = JPEG_HWMODEL_MAX(col_ready, col_unit);
+    long col_idle  = JPEG_HWMODEL_MAX(col_unit, row_start + DCTSIZE);
+
+    if (col_ready > col_idle)
+    {
+        stat.transpose_cycles += col_ready - col_idle;
+    }
+
+    if (cfg.num_1d_units == 1)
+    {
+        row_unit_free = col_start + DCTSIZE;
+    }
+    else
+    {
+        col_unit_free = col_start + DCTSIZE;
+    }
+
+    tbuf_free[k % cfg.transpose_buffers] = col_start + DCTSIZE;
+
+    // Last column result written at the end of the pipeline
+    stat.total_cycles = JPEG_HWMODEL_MAX(stat.total_cycles, col_start + (DCTSIZE-1) + D + 1);
+    stat.symbols     += symbols;
+    stat.blocks++;
+}
+
+//-------------------------------------------------------------
+// jpeg_hwmodel_report()
+//
+// Description:
+//
+// Outputs the configuration and results of the model
+//
+// Parameters:
+//    fp:         output file pointer
+//    name:       image name
+//    X, Y:       image dimensions in pixels
+//    target_fps: target frame rate for required clock calculation (0 for none)
+//
+// Return value:
+//    None.
+//
+
+void jfif_hwmodel::jpeg_hwmodel_report (FILE *fp, const char *name, int X, int Y, double target_fps)
+{
+    double cycles     = (double)JPEG_HWMODEL_MAX(stat.total_cycles, 1);
+    long   blocks     = JPEG_HWMODEL_MAX(stat.blocks, 1);
+    double pixel_rate = (double)X * Y * cfg.clock_mhz / cycles;
+    double util       = 100.0 * 2 * DCTSIZE * stat.blocks / (cycles * cfg.num_1d_units);
+
+    fprintf(fp, "%s: %d x %d pixels, %ld blocks\n\n", name, X, Y, stat.blocks);
+
+    fprintf(fp, "  Configuration\n");
+    fprintf(fp, "    1D pipeline depth          : %d cycles\n",         cfg.pipeline_depth);
+    fprintf(fp, "    1D pipelines               : %d (%s)\n",           cfg.num_1d_units, (cfg.num_1d_units == 1) ? "shared rows/columns" : "row and column");
+    fprintf(fp, "    transpose buffers          : %d\n",                cfg.transpose_buffers);
+    fprintf(fp, "    transpose latency          : %d cycles\n",         cfg.transpose_latency);
+    fprintf(fp, "    entropy decoder rate       : %d symbols/cycle\n",  cfg.symbols_per_cycle);
+    fprintf(fp, "    coefficient FIFO depth     : %d blocks\n",         cfg.fifo_depth);
+    fprintf(fp, "    clock                      : %.1f MHz\n\n",        cfg.clock_mhz);
+
+    fprintf(fp, "  Results\n");
+    fprintf(fp, "    total cycles               : %ld\n",               stat.total_cycles);
+    fprintf(fp, "    cycles per block           : %.2f\n",              cycles / blocks);
+    fprintf(fp, "    symbols per block (est.)   : %.2f\n",              (double)stat.symbols / blocks);
+    fprintf(fp, "    1D pipeline utilisation    : %.1f%%\n",            util);
+    fprintf(fp, "    stall cycles\n");
+    fprintf(fp, "      iDCT starved of data     : %ld\n",               stat.starve_cycles);
+    fprintf(fp, "      transpose buffer full    : %ld\n",               stat.tbuf_full_cycles);
+    fprintf(fp, "      transpose latency        : %ld\n",               stat.transpose_cycles);
+    fprintf(fp, "      entropy FIFO full        : %ld\n",               stat.backpressure_cycles);
+    fprintf(fp, "    pixel rate                 : %.2f Mpixels/s (%.2f frames/s)\n", pixel_rate, pixel_rate * 1.0e6 / ((double)X * Y));
+
+    if (target_fps > 0.0)
+    {
+        fprintf(fp, "    clock for %.1f frames/s    : %.1f MHz\n", target_fps, cycles * target_fps / 1.0e6);
+    }
+}
+
+//-------------------------------------------------------------
+// main()
+//
+// Decodes an image with the fast integer iDCT engine,
+// instrumented with the hardware model, and reports the
+// model results. The decoded bitmap can optionally be saved.
+//
+
+int main (int argc, char **argv)
+{
+    jpeg_hwmodel_cfg_t cfg;
+
+    const char* ifname     = INPUT_FILENAME;
+    const char* ofname     = NULL;
+    double      target_fps = 0.0;
+    int         option;
+
+    jfif_hwmodel::jpeg_hwmodel_default_cfg(cfg);
+
+    while ((option = getopt(argc, argv, (char *)"hi:o:p:t:b:u:s:f:c:r:")) != EOF)
+    {
+        switch(option)
+        {
+        case 'i': ifname                = optarg;                     break;
+        case 'o': ofname                = optarg;                     break;
+        case 'p': cfg.pipeline_depth    = (int)strtol(optarg, NULL, 0); break;
+        case 't': cfg.transpose_latency = (int)strtol(optarg, NULL, 0); break;
+        case 'b': cfg.transpose_buffers = (int)strtol(optarg, NULL, 0); break;
+        case 'u': cfg.num_1d_units      = (int)strtol(optarg, NULL, 0); break;
+        case 's': cfg.symbols_per_cycle = (int)strtol(optarg, NULL, 0); break;
+        case 'f': cfg.fifo_depth        = (int)strtol(optarg, NULL, 0); break;
+        case 'c': cfg.clock_mhz         = strtod(optarg, NULL);         break;
+        case 'r': target_fps            = strtod(optarg, NULL);         break;
+
+        case 'h':
+        case '?':
+            fprintf(stderr, "Usage: jfif_hwmodel [-h] [-i <filename>] [-o <filename>] [-p <depth>] [-t <latency>]\n"
+                            "                    [-b 1|2] [-u 1|2] [-s <symbols>] [-f <depth>] [-c <MHz>] [-r <fps>]\n"
+                            "    -h display help message\n"
+                            "    -i define input filename (default %s)\n"
+                            "    -o save decoded bitmap to file (default none)\n"
+                            "    -p 1D iDCT pipeline depth in cycles (default %d)\n"
+                            "    -t transpose buffer latency in cycles (default %d)\n"
+                            "    -b number of transpose buffers (default %d)\n"
+                            "    -u number of 1D pipelines, 1 shared or 2 (default %d)\n"
+                            "    -s entropy decoder symbols per cycle (default %d)\n"
+                            "    -f coefficient FIFO depth in blocks (default %d)\n"
+                            "    -c clock frequency in MHz (default %.1f)\n"
+                            "    -r target frame rate, to report required clock (default none)\n",
+                            INPUT_FILENAME, JPEG_HWMODEL_DEF_DEPTH, JPEG_HWMODEL_DEF_TLATENCY, JPEG_HWMODEL_DEF_TBUFS,
+                            JPEG_HWMODEL_DEF_UNITS, JPEG_HWMODEL_DEF_SYMBOLS, JPEG_HWMODEL_DEF_FIFO, JPEG_HWMODEL_DEF_CLOCK);
+            return JPEG_USER_INPUT_ERROR;
+        }
+    }
+
+    // Read the input file into a buffer
+    FILE *ifp;
+    long  fsize;
+
+    if ((ifp = fopen(ifname, "rb")) == NULL)
+    {
+        fprintf(stderr, "ERROR: could not open %s for reading\n", ifname);
+        return JPEG_FILE_ERROR;
+    }
+
+    fseek(ifp, 0, SEEK_END);
+    fsize = ftell(ifp);
+    fseek(ifp, 0, SEEK_SET);
+
+    uint8_t *ibuf = (uint8_t *)malloc(fsize > 0 ? fsize : 1);
+
+    if (ibuf == NULL)
+    {
+        fprintf(stderr, "ERROR: memory allocation failed\n");
+        return JPEG_MEMORY_ERROR;
+    }
+
+    if (fread(ibuf, 1, fsize, ifp) != (size_t)fsize)
+    {
+        fprintf(stderr, "ERROR: failed to read %s\n", ifname);
+        return JPEG_FILE_ERROR;
+    }
+
+    fclose(ifp);
+
+    // Decode with the model attached to the (fast integer) iDCT
+    jfif_hwmodel model(cfg);
+    jfif         decoder(0, JPEG_IDCT_FAST_INT);
+    uint8_t*     obuf;
+    uint8_t*     rawbuf;
+    int          status;
+
+    jfif_hwmodel_idct_policy::model = &model;
+
+    if ((status = decoder.jpeg_process_jfif(ibuf, &obuf, &rawbuf)))
+    {
+        return status;
+    }
+
+    jfif_hwmodel_idct_policy::model = NULL;
+
+    bmhdr_t *bmp_hdr = (bmhdr_t *)obuf;
+    int      X       = BMP_SWPEND32(bmp_hdr->i.biWidth);
+    int      Y       = BMP_SWPEND32(bmp_hdr->i.biHeight);
+
+    model.jpeg_hwmodel_report(stdout, ifname, X, Y, target_fps);
+
+    // Optionally save the decoded image
+    if (ofname != NULL)
+    {
+        FILE *ofp;
+
+        if ((ofp = fopen(ofname, "wb")) == NULL)
+        {
+            fprintf(stderr, "ERROR: could not open %s for writing\n", ofname);
+            return JPEG_FILE_ERROR;
+        }
+
+        fwrite(obuf, 1, BMP_SWPEND32(bmp_hdr->f.bfSize), ofp);
+        fclose(ofp);
+    }
+
+    return JPEG_NO_ERROR;
+}
@@ -0,0 +1,144 @@
+//=============================================================
+//
+// Copyright (c) 2026 Simon Southwell
+// All rights reserved.
+//
+// Date: 18th October 2026
+//
+// This file is part of JFIF.
+//
+// JFIF is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// JFIF is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JFIF. If not, see <http://www.gnu.org/licenses/>.
+//
+//=============================================================
+//
+// Cycle level throughput model of a hardware iDCT pipeline,
+// as reflected in the PHASEn structure of jpeg_idct_1d().
+//
+// The modelled hardware is an entropy (Huffman/RLE) decoder,
+// feeding de-quantised coefficient blocks through a FIFO to a
+// 1D iDCT pipeline that accepts one 8 element row (or column)
+// per cycle. Row results are written to a transpose buffer, and
+// read back as columns for the second pass, either through the
+// same 1D pipeline, or a second dedicated column pipeline.
+//
+// The model is driven from real image data: the decoder is
+// compiled with JPEG_HW_MODEL defined, when the fast integer
+// engine's policy is replaced with jfif_hwmodel_idct_policy,
+// which accounts each block's timing before doing the iDCT.
+//
+//=============================================================
+
+#include <cstdio>
+
+#include "jfif_local.h"
+#include "jfif_idct.h"
+#include "jfif_idct_policy.h"
+
+#ifndef _JFIF_HWMODEL_H_
+#define _JFIF_HWMODEL_H_
+
+#define JPEG_HWMODEL_MAX_FIFO       64
+#define JPEG_HWMODEL_MAX_TBUFS      2
+
+// Default configuration
+#define JPEG_HWMODEL_DEF_DEPTH      6           // PHASE1 to PHASE6 of jpeg_idct_1d()
+#define JPEG_HWMODEL_DEF_TLATENCY   1
+#define JPEG_HWMODEL_DEF_TBUFS      2
+#define JPEG_HWMODEL_DEF_UNITS      2
+#define JPEG_HWMODEL_DEF_SYMBOLS    1
+#define JPEG_HWMODEL_DEF_FIFO       2
+#define JPEG_HWMODEL_DEF_CLOCK      200.0
+
+//-------------------------------------------------------------
+// Model configuration
+
+typedef struct {
+    int    pipeline_depth;              // 1D iDCT pipeline stages, input to output
+    int    transpose_latency;           // Cycles from last row written to first column read
+    int    transpose_buffers;           // Transpose buffers (1, or 2 for ping-pong)
+    int    num_1d_units;                // 1D pipelines (1 shared for rows and columns, or 2)
+    int    symbols_per_cycle;           // Entropy decoder rate, in coded symbols per cycle
+    int    fifo_depth;                  // Coefficient block FIFO depth (entropy decoder to iDCT)
+    double clock_mhz;                   // Clock frequency for pixel rate calculations
+} jpeg_hwmodel_cfg_t;
+
+//-------------------------------------------------------------
+// Model statistics
+
+typedef struct {
+    long   blocks;                      // Blocks processed
+    long   symbols;                     // Estimated coded symbols (DC, non-zero AC and EOB)
+    long   total_cycles;                // Cycle of last iDCT output
+    long   starve_cycles;               // Row pass idle, waiting for entropy decoded data
+    long   tbuf_full_cycles;            // Row pass stalled, waiting for a free transpose buffer
+    long   transpose_cycles;            // Column pass stalled, waiting on transpose latency
+    long   backpressure_cycles;         // Entropy decoder stalled on a full FIFO
+} jpeg_hwmodel_stats_t;
+
+//-------------------------------------------------------------
+// Pipeline model
+
+class jfif_hwmodel {
+
+public:
+
+    jfif_hwmodel (const jpeg_hwmodel_cfg_t &cfg_in);
+
+    // Initialise a configuration with default values
+    static void jpeg_hwmodel_default_cfg (jpeg_hwmodel_cfg_t &cfg);
+
+    // Account the timing for the next block, in decode order
+    void        jpeg_hwmodel_block       (jpeg_8x8_block_t data);
+
+    // Output report for an image of X by Y pixels, with optional frame rate target
+    void        jpeg_hwmodel_report      (FILE *fp, const char *name, int X, int Y, double target_fps);
+
+    const jpeg_hwmodel_stats_t &stats() const { return stat; };
+
+private:
+
+    jpeg_hwmodel_cfg_t   cfg;
+    jpeg_hwmodel_stats_t stat;
+
+    // Pipeline state (cycle numbers at which resources become free)
+    long entropy_free;
+    long row_unit_free;
+    long col_unit_free;
+    long tbuf_free[JPEG_HWMODEL_MAX_TBUFS];
+    long fifo_pop[JPEG_HWMODEL_MAX_FIFO];
+};
+
+//-------------------------------------------------------------
+// Fast integer iDCT engine policy, instrumented with the
+// hardware model (set jfif_hwmodel_idct_policy::model before
+// decoding)
+
+class jfif_hwmodel_idct_policy : public jfif_fast_int_idct_policy {
+
+public:
+
+    static jfif_hwmodel *model;
+
+    static inline void idct (jfif_idct &engine, jpeg_8x8_block_t data)
+    {
+        if (model != NULL)
+        {
+            model->jpeg_hwmodel_block(data);
+        }
+
+        engine.jpeg_idct(data);
+    };
+};
+
+#endif
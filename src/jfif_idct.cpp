@@ -24,10 +24,14 @@
 
 #include <iostream>
 #include <iomanip>
+#include <cmath>
 
 #include "jfif_idct.h"
 
-const jpeg_dct_t jfif_idct::C[JPEG_BLOCK_DIMENSION][JPEG_BLOCK_DIMENSION] = JPEG_DCT_C_INIT;
+const int    jfif_idct::C_int  [JPEG_BLOCK_DIMENSION][JPEG_BLOCK_DIMENSION] = JPEG_DCT_C_INT_INIT;
+const float  jfif_idct::aan_float_scales[DCTSIZE2]                       = JPEG_FLOAT_SCALING_INIT;
+const int    jfif_idct::idct_4x4_mult[2][5]                              = {JPEG_IDCT_4X4_INIT, JPEG_IDCT_4X4_AAN_INIT};
+const int    jfif_idct::idct_2x2_mult[2]                                 = {JPEG_IDCT_2X2_MULT, JPEG_IDCT_2X2_AAN_MULT};
 
 //-------------------------------------------------------------
 // jpeg_idct_1d()
@@ -49,8 +53,8 @@ const jpeg_dct_t jfif_idct::C[JPEG_BLOCK_DIMENSION][JPEG_BLOCK_DIMENSION] = JPEG
 //    None.
 //
 
-void jfif_idct::jpeg_idct_1d(int *data0, int *data1, int *data2, int *data3,
-                             int *data4, int *data5, int *data6, int *data7)
+inline void jfif_idct::jpeg_idct_1d(int *data0, int *data1, int *data2, int *data3,
+                                    int *data4, int *data5, int *data6, int *data7)
 
 {
     using std::cout;
@@ -235,10 +239,11 @@ void jfif_idct::jpeg_idct_1d(int *data0, int *data1, int *data2, int *data3,
 // fast algorithm in the independent JPEG group's library,
 // after Arai, Agui and Nakajima (Trans. IEICE E-71(11):1095),
 // but pipelined for RTL implementation. See jpeg_idct_ifast2()
-// below for pre-pipelined code.
+// below for pre-pipelined code. The 16 bit coefficients are
+// widened to 32 bits for the row and column passes.
 //
 // Parameters:
-//      data:  pointer to 8x8 block of ints for transformation
+//      data:  pointer to 8x8 block of 16 bit coefficients for transformation
 //
 // Return value:
 //    None.
@@ -255,41 +260,49 @@ void jfif_idct::jpeg_idct (jpeg_8x8_block_t data) {
 
     int row, col;
 
+    // 32 bit workspace, as intermediate row results exceed 16 bits
+    int ws[DCTSIZE][DCTSIZE];
+
     // Eight 1d iDCTs across row
     for (row = 0; row < DCTSIZE; row++) {
 
+        for (col = 0; col < DCTSIZE; col++)
+        {
+            ws[row][col] = data[row][col];
+        }
+
 #ifdef JPEG_DEBUG_MODE
         if (debug_enable & JPEG_DEBUG_IDCT_EN_11)
         {
             cout << "jpeg_idct_ifast: IN :" << setfill ('0');
-            cout << " " << hex << setw(4) << (data[row][0] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][1] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][2] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][3] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][4] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][5] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][6] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][7] & 0xffff) << endl;
+            cout << " " << hex << setw(4) << (ws[row][0] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][1] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][2] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][3] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][4] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][5] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][6] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][7] & 0xffff) << endl;
         }
 #endif
 
         // iDCT on row
-        jpeg_idct_1d(&data[row][0], &data[row][1], &data[row][2], &data[row][3],
-                     &data[row][4], &data[row][5], &data[row][6], &data[row][7]);
+        jpeg_idct_1d(&ws[row][0], &ws[row][1], &ws[row][2], &ws[row][3],
+                     &ws[row][4], &ws[row][5], &ws[row][6], &ws[row][7]);
 
 
 #ifdef JPEG_DEBUG_MODE
         if (debug_enable & JPEG_DEBUG_IDCT_EN_12)
         {
             cout << "jpeg_idct_ifast: MID :" << setfill ('0');
-            cout << " " << hex << setw(4) << (data[row][0] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][1] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][2] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][3] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][4] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][5] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][6] & 0xffff);
-            cout << " " << hex << setw(4) << (data[row][7] & 0xffff) << endl;
+            cout << " " << hex << setw(4) << (ws[row][0] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][1] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][2] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][3] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][4] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][5] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][6] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[row][7] & 0xffff) << endl;
         }
 #endif
 
@@ -301,33 +314,33 @@ void jfif_idct::jpeg_idct (jpeg_8x8_block_t data) {
 #ifdef JPEG_DEBUG_MODE
         if (debug_enable & JPEG_DEBUG_IDCT_EN_13) {
             cout << "jpeg_idct_ifast: ROT :" << setfill ('0');
-            cout << " " << hex << setw(4) << (data[0][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[1][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[2][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[3][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[4][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[5][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[6][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[7][col] & 0xffff) << endl;
+            cout << " " << hex << setw(4) << (ws[0][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[1][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[2][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[3][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[4][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[5][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[6][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[7][col] & 0xffff) << endl;
         }
 #endif
 
         // iDCT on columns
-        jpeg_idct_1d(&data[0][col], &data[1][col], &data[2][col], &data[3][col],
-                     &data[4][col], &data[5][col], &data[6][col], &data[7][col]);
+        jpeg_idct_1d(&ws[0][col], &ws[1][col], &ws[2][col], &ws[3][col],
+                     &ws[4][col], &ws[5][col], &ws[6][col], &ws[7][col]);
 
 #ifdef JPEG_DEBUG_MODE
         if (debug_enable & JPEG_DEBUG_IDCT_EN_14)
         {
             cout << "jpeg_idct_ifast: OUT :" << setfill ('0');
-            cout << " " << hex << setw(4) << (data[0][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[1][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[2][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[3][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[4][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[5][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[6][col] & 0xffff);
-            cout << " " << hex << setw(4) << (data[7][col] & 0xffff) << endl;
+            cout << " " << hex << setw(4) << (ws[0][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[1][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[2][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[3][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[4][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[5][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[6][col] & 0xffff);
+            cout << " " << hex << setw(4) << (ws[7][col] & 0xffff) << endl;
         }
 #endif
 
@@ -335,25 +348,25 @@ void jfif_idct::jpeg_idct (jpeg_8x8_block_t data) {
         if (debug_enable & JPEG_DEBUG_IDCT_EN_2)
         {
             cout << setfill ('0');
-            cout << hex << setw(4) << (data[7][col] & 0xffff);
-            cout << hex << setw(4) << (data[6][col] & 0xffff);
-            cout << hex << setw(4) << (data[5][col] & 0xffff);
-            cout << hex << setw(4) << (data[4][col] & 0xffff);
-            cout << hex << setw(4) << (data[3][col] & 0xffff);
-            cout << hex << setw(4) << (data[2][col] & 0xffff);
-            cout << hex << setw(4) << (data[1][col] & 0xffff);
-            cout << hex << setw(4) << (data[0][col] & 0xffff) << endl;
+            cout << hex << setw(4) << (ws[7][col] & 0xffff);
+            cout << hex << setw(4) << (ws[6][col] & 0xffff);
+            cout << hex << setw(4) << (ws[5][col] & 0xffff);
+            cout << hex << setw(4) << (ws[4][col] & 0xffff);
+            cout << hex << setw(4) << (ws[3][col] & 0xffff);
+            cout << hex << setw(4) << (ws[2][col] & 0xffff);
+            cout << hex << setw(4) << (ws[1][col] & 0xffff);
+            cout << hex << setw(4) << (ws[0][col] & 0xffff) << endl;
         }
 #endif
         // Final output stage: scale down by a factor of 8 and range-limit
-        data[0][col] = JPEG_CLIP(128+jpeg_idescale(data[0][col], FINAL_SCALE_BITS));
-        data[1][col] = JPEG_CLIP(128+jpeg_idescale(data[1][col], FINAL_SCALE_BITS));
-        data[2][col] = JPEG_CLIP(128+jpeg_idescale(data[2][col], FINAL_SCALE_BITS));
-        data[3][col] = JPEG_CLIP(128+jpeg_idescale(data[3][col], FINAL_SCALE_BITS));
-        data[4][col] = JPEG_CLIP(128+jpeg_idescale(data[4][col], FINAL_SCALE_BITS));
-        data[5][col] = JPEG_CLIP(128+jpeg_idescale(data[5][col], FINAL_SCALE_BITS));
-        data[6][col] = JPEG_CLIP(128+jpeg_idescale(data[6][col], FINAL_SCALE_BITS));
-        data[7][col] = JPEG_CLIP(128+jpeg_idescale(data[7][col], FINAL_SCALE_BITS));
+        data[0][col] = JPEG_CLIP(128+jpeg_idescale(ws[0][col], FINAL_SCALE_BITS));
+        data[1][col] = JPEG_CLIP(128+jpeg_idescale(ws[1][col], FINAL_SCALE_BITS));
+        data[2][col] = JPEG_CLIP(128+jpeg_idescale(ws[2][col], FINAL_SCALE_BITS));
+        data[3][col] = JPEG_CLIP(128+jpeg_idescale(ws[3][col], FINAL_SCALE_BITS));
+        data[4][col] = JPEG_CLIP(128+jpeg_idescale(ws[4][col], FINAL_SCALE_BITS));
+        data[5][col] = JPEG_CLIP(128+jpeg_idescale(ws[5][col], FINAL_SCALE_BITS));
+        data[6][col] = JPEG_CLIP(128+jpeg_idescale(ws[6][col], FINAL_SCALE_BITS));
+        data[7][col] = JPEG_CLIP(128+jpeg_idescale(ws[7][col], FINAL_SCALE_BITS));
 
 
 #ifdef JPEG_DEBUG_MODE
@@ -379,11 +392,12 @@ void jfif_idct::jpeg_idct (jpeg_8x8_block_t data) {
 //
 // Description:
 //
-// Inverse discrete cosine transform for an 8x8 block.
+// Inverse discrete cosine transform for an 8x8 block, using
+// u0.9 fixed point cosine values.
 // Adapted from "The Data Compression Book", 2nd ed., Nelson et al., 1995
 //
 // Parameters:
-//      data:  pointer to 8x8 block of ints for transformation
+//      data:  pointer to 8x8 block of 16 bit coefficients for transformation
 //
 // Return value:
 //    None.
@@ -391,11 +405,8 @@ void jfif_idct::jpeg_idct (jpeg_8x8_block_t data) {
 
 void jfif_idct::jpeg_idct_slow(jpeg_8x8_block_t data)
 {
-
-#ifndef JPEG_FAST_INT_IDCT
-
-    jpeg_dct_t temp[JPEG_BLOCK_DIMENSION][JPEG_BLOCK_DIMENSION];
-    jpeg_dct_t temp1;
+    int temp[JPEG_BLOCK_DIMENSION][JPEG_BLOCK_DIMENSION];
+    int temp1;
 
     int idx, jdx, kdx;
 
@@ -404,21 +415,19 @@ void jfif_idct::jpeg_idct_slow(jpeg_8x8_block_t data)
     {
         for (jdx = 0; jdx < JPEG_BLOCK_DIMENSION; jdx++ )
         {
-            temp[idx][jdx] = 0.0;
+            temp[idx][jdx] = 0;
 
             for (kdx = 0; kdx < JPEG_BLOCK_DIMENSION; kdx++)
             {
                 // Save a multiply and add if possible. Many coeff should be 0.
                 if (data[idx][kdx])
                 {
-                    temp[idx][jdx] += data[idx][kdx] * C[kdx][jdx];
+                    temp[idx][jdx] += data[idx][kdx] * C_int[kdx][jdx];
                 }
             }
 
-#ifdef JPEG_DCT_INTEGER
             // Renormalise scaled integer values
             temp[idx][jdx] = temp[idx][jdx] >> JPEG_DCT_INT_SCALE;
-#endif
         }
     }
 
@@ -427,29 +436,434 @@ void jfif_idct::jpeg_idct_slow(jpeg_8x8_block_t data)
     {
         for (jdx = 0; jdx < JPEG_BLOCK_DIMENSION; jdx++)
         {
-            temp1 = 0.0;
+            temp1 = 0;
 
             for (kdx = 0; kdx < JPEG_BLOCK_DIMENSION; kdx++ )
             {
                 // Save a multiply and add if possible
                 if (temp[kdx][jdx])
                 {
-                    temp1 += C[kdx][idx] * temp[kdx][jdx];
+                    temp1 += C_int[kdx][idx] * temp[kdx][jdx];
                 }
             }
 
-#ifdef JPEG_DCT_INTEGER
             // Renormalise scaled integer values
             temp1 = (temp1 >> JPEG_DCT_INT_SCALE);
-#endif
 
             // Renormalise to 0 to 255
-            temp1 += 128.0;
+            temp1 += 128;
 
             // Perform clipping and store in output buffer
             data[idx][jdx] = (uint8_t)JPEG_CLIP(temp1);
         }
     }
+}
+
+//-------------------------------------------------------------
+// jpeg_idct_4x4()
+//
+// Description:
+//
+// Reduced size inverse DCT, for decoding at 1/2 scale. The lowest
+// 4x4 frequencies of a block are transformed with a 4 point iDCT
+// on each row and column, to a 4x4 block of samples, each the
+// equivalent of a 2x2 area of the full size block, and the higher
+// frequencies ignored. Rows are kept with RED_PASS_BITS of
+// fraction between the passes.
+//
+// Parameters:
+//      data:       pointer to 8x8 block of 16 bit coefficients, with the
+//                  4x4 samples returned in its top left corner
+//      aan_scaled: coefficients are AAN prescaled (fast integer engine)
+//
+// Return value:
+//    None.
+//
+
+void jfif_idct::jpeg_idct_4x4 (jpeg_8x8_block_t data, bool aan_scaled)
+{
+    const int *k = idct_4x4_mult[aan_scaled ? 1 : 0];
+    int        ws[4][4];
+
+    // Rows, descaled to RED_PASS_BITS of fraction
+    for (int row = 0; row < 4; row++)
+    {
+        const int16_t *in = data[row];
+
+        int e2 = (in[2]*k[0]) >> (RED_CONST_BITS-RED_PASS_BITS);
+        int e0 = in[0]*(1 << RED_PASS_BITS) + e2;
+        int e1 = in[0]*(1 << RED_PASS_BITS) - e2;
+        int o0 = (in[1]*k[1] + in[3]*k[2]) >> (RED_CONST_BITS-RED_PASS_BITS);
+        int o1 = (in[1]*k[3] - in[3]*k[4]) >> (RED_CONST_BITS-RED_PASS_BITS);
+
+        ws[row][0] = e0 + o0;
+        ws[row][1] = e1 + o1;
+        ws[row][2] = e1 - o1;
+        ws[row][3] = e0 - o0;
+    }
+
+    // Columns, with the final descale (rounded), level shift and clipping
+    for (int col = 0; col < 4; col++)
+    {
+        int e2 = (ws[2][col]*k[0]) >> RED_CONST_BITS;
+        int e0 = ws[0][col] + e2 + (1 << (RED_PASS_BITS+FINAL_SCALE_BITS-1));
+        int e1 = ws[0][col] - e2 + (1 << (RED_PASS_BITS+FINAL_SCALE_BITS-1));
+        int o0 = (ws[1][col]*k[1] + ws[3][col]*k[2]) >> RED_CONST_BITS;
+        int o1 = (ws[1][col]*k[3] - ws[3][col]*k[4]) >> RED_CONST_BITS;
+
+        data[0][col] = JPEG_CLIP(128 + ((e0 + o0) >> (RED_PASS_BITS+FINAL_SCALE_BITS)));
+        data[1][col] = JPEG_CLIP(128 + ((e1 + o1) >> (RED_PASS_BITS+FINAL_SCALE_BITS)));
+        data[2][col] = JPEG_CLIP(128 + ((e1 - o1) >> (RED_PASS_BITS+FINAL_SCALE_BITS)));
+        data[3][col] = JPEG_CLIP(128 + ((e0 - o0) >> (RED_PASS_BITS+FINAL_SCALE_BITS)));
+    }
+}
+
+//-------------------------------------------------------------
+// jpeg_idct_2x2()
+//
+// Description:
+//
+// Reduced size inverse DCT, for decoding at 1/4 scale. As for
+// jpeg_idct_4x4(), but transforming the lowest 2x2 frequencies
+// to a 2x2 block of samples, each the equivalent of a 4x4 area
+// of the full size block.
+//
+// Parameters:
+//      data:       pointer to 8x8 block of 16 bit coefficients, with the
+//                  2x2 samples returned in its top left corner
+//      aan_scaled: coefficients are AAN prescaled (fast integer engine)
+//
+// Return value:
+//    None.
+//
+
+void jfif_idct::jpeg_idct_2x2 (jpeg_8x8_block_t data, bool aan_scaled)
+{
+    int k = idct_2x2_mult[aan_scaled ? 1 : 0];
+    int ws[2][2];
+
+    for (int row = 0; row < 2; row++)
+    {
+        int o = (data[row][1]*k) >> (RED_CONST_BITS-RED_PASS_BITS);
+
+        ws[row][0] = data[row][0]*(1 << RED_PASS_BITS) + o;
+        ws[row][1] = data[row][0]*(1 << RED_PASS_BITS) - o;
+    }
+
+    for (int col = 0; col < 2; col++)
+    {
+        int e = ws[0][col] + (1 << (RED_PASS_BITS+FINAL_SCALE_BITS-1));
+        int o = (ws[1][col]*k) >> RED_CONST_BITS;
+
+        data[0][col] = JPEG_CLIP(128 + ((e + o) >> (RED_PASS_BITS+FINAL_SCALE_BITS)));
+        data[1][col] = JPEG_CLIP(128 + ((e - o) >> (RED_PASS_BITS+FINAL_SCALE_BITS)));
+    }
+}
+
+//-------------------------------------------------------------
+// Single precision floating point vector support for the
+// separable AAN iDCT. A vector (jpeg_vf_t) holds JPEG_VF_LANES
+// floats: 8 for AVX, 4 for SSE, or a single float when compiled
+// without SIMD support. The 1D iDCT is written once in terms of
+// the jpeg_vf_xxx() operations, and operates on JPEG_VF_LANES
+// columns in parallel.
+
+#if defined(JPEG_SIMD_AVX)
+
+typedef __m256 jpeg_vf_t;
+#define JPEG_VF_LANES 8
+
+static inline jpeg_vf_t jpeg_vf_add (jpeg_vf_t a, jpeg_vf_t b) { return _mm256_add_ps(a, b); }
+static inline jpeg_vf_t jpeg_vf_sub (jpeg_vf_t a, jpeg_vf_t b) { return _mm256_sub_ps(a, b); }
+static inline jpeg_vf_t jpeg_vf_mul (jpeg_vf_t a, jpeg_vf_t b) { return _mm256_mul_ps(a, b); }
+static inline jpeg_vf_t jpeg_vf_set (float a)                  { return _mm256_set1_ps(a);    }
+
+// Load JPEG_VF_LANES 16 bit coefficients and convert to float
+static inline jpeg_vf_t jpeg_vf_load (const int16_t *p)
+{
+    __m128i v  = _mm_loadu_si128((const __m128i *)p);
+    __m128i lo = _mm_cvtepi16_epi32(v);
+    __m128i hi = _mm_cvtepi16_epi32(_mm_srli_si128(v, 8));
+
+    return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+}
+
+// Load JPEG_VF_LANES floats
+static inline jpeg_vf_t jpeg_vf_load_scale (const float *p)
+{
+    return _mm256_loadu_ps(p);
+}
+
+// Round to nearest, level shift by 128, clip to 0 to 255 and store as 16 bit values
+static inline void jpeg_vf_store (int16_t *p, jpeg_vf_t a)
+{
+    a = _mm256_add_ps(a, _mm256_set1_ps(128.0f));
+    a = _mm256_min_ps(_mm256_max_ps(a, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+
+    __m256i v = _mm256_cvtps_epi32(a);
+
+    _mm_storeu_si128((__m128i *)p, _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extractf128_si256(v, 1)));
+}
+
+// Transpose an 8x8 block held as 8 vectors of 8
+static inline void jpeg_vf_transpose (jpeg_vf_t ws[DCTSIZE][DCTSIZE/JPEG_VF_LANES])
+{
+    __m256 t0 = _mm256_unpacklo_ps(ws[0][0], ws[1][0]);
+    __m256 t1 = _mm256_unpackhi_ps(ws[0][0], ws[1][0]);
+    __m256 t2 = _mm256_unpacklo_ps(ws[2][0], ws[3][0]);
+    __m256 t3 = _mm256_unpackhi_ps(ws[2][0], ws[3][0]);
+    __m256 t4 = _mm256_unpacklo_ps(ws[4][0], ws[5][0]);
+    __m256 t5 = _mm256_unpackhi_ps(ws[4][0], ws[5][0]);
+    __m256 t6 = _mm256_unpacklo_ps(ws[6][0], ws[7][0]);
+    __m256 t7 = _mm256_unpackhi_ps(ws[6][0], ws[7][0]);
+
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1,0,1,0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3,2,3,2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1,0,1,0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3,2,3,2));
+
+    ws[0][0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    ws[1][0] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    ws[2][0] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    ws[3][0] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    ws[4][0] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    ws[5][0] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    ws[6][0] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    ws[7][0] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+#elif defined(JPEG_SIMD_SSE2)
+
+typedef __m128 jpeg_vf_t;
+#define JPEG_VF_LANES 4
+
+static inline jpeg_vf_t jpeg_vf_add (jpeg_vf_t a, jpeg_vf_t b) { return _mm_add_ps(a, b); }
+static inline jpeg_vf_t jpeg_vf_sub (jpeg_vf_t a, jpeg_vf_t b) { return _mm_sub_ps(a, b); }
+static inline jpeg_vf_t jpeg_vf_mul (jpeg_vf_t a, jpeg_vf_t b) { return _mm_mul_ps(a, b); }
+static inline jpeg_vf_t jpeg_vf_set (float a)                  { return _mm_set1_ps(a);    }
+
+// Load 4 16 bit coefficients, sign extending to 32 bits
+static inline jpeg_vf_t jpeg_vf_load (const int16_t *p)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i *)p);
+
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+static inline jpeg_vf_t jpeg_vf_load_scale (const float *p)
+{
+    return _mm_loadu_ps(p);
+}
+
+static inline void jpeg_vf_store (int16_t *p, jpeg_vf_t a)
+{
+    a = _mm_add_ps(a, _mm_set1_ps(128.0f));
+    a = _mm_min_ps(_mm_max_ps(a, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+
+    __m128i v = _mm_cvtps_epi32(a);
+
+    _mm_storel_epi64((__m128i *)p, _mm_packs_epi32(v, v));
+}
+
+// Transpose an 8x8 block held as 8 rows of 2 vectors, as four
+// 4x4 transposes, swapping the off-diagonal quadrants
+static inline void jpeg_vf_transpose (jpeg_vf_t ws[DCTSIZE][DCTSIZE/JPEG_VF_LANES])
+{
+    _MM_TRANSPOSE4_PS(ws[0][0], ws[1][0], ws[2][0], ws[3][0]);
+    _MM_TRANSPOSE4_PS(ws[0][1], ws[1][1], ws[2][1], ws[3][1]);
+    _MM_TRANSPOSE4_PS(ws[4][0], ws[5][0], ws[6][0], ws[7][0]);
+    _MM_TRANSPOSE4_PS(ws[4][1], ws[5][1], ws[6][1], ws[7][1]);
+
+    for (int idx = 0; idx < 4; idx++)
+    {
+        __m128 tmp    = ws[idx][1];
+        ws[idx][1]    = ws[idx+4][0];
+        ws[idx+4][0]  = tmp;
+    }
+}
+
+#else
+
+typedef float jpeg_vf_t;
+#define JPEG_VF_LANES 1
+
+static inline jpeg_vf_t jpeg_vf_add (jpeg_vf_t a, jpeg_vf_t b) { return a + b; }
+static inline jpeg_vf_t jpeg_vf_sub (jpeg_vf_t a, jpeg_vf_t b) { return a - b; }
+static inline jpeg_vf_t jpeg_vf_mul (jpeg_vf_t a, jpeg_vf_t b) { return a * b; }
+static inline jpeg_vf_t jpeg_vf_set (float a)                  { return a;     }
+
+static inline jpeg_vf_t jpeg_vf_load (const int16_t *p)
+{
+    return (float)*p;
+}
+
+static inline jpeg_vf_t jpeg_vf_load_scale (const float *p)
+{
+    return *p;
+}
+
+static inline void jpeg_vf_store (int16_t *p, jpeg_vf_t a)
+{
+    a += 128.0f;
+    *p = (int16_t)floorf(JPEG_CLIP(a) + 0.5f);
+}
+
+static inline void jpeg_vf_transpose (jpeg_vf_t ws[DCTSIZE][DCTSIZE/JPEG_VF_LANES])
+{
+    for (int idx = 0; idx < DCTSIZE; idx++)
+    {
+        for (int jdx = idx+1; jdx < DCTSIZE; jdx++)
+        {
+            float tmp    = ws[idx][jdx];
+            ws[idx][jdx] = ws[jdx][idx];
+            ws[jdx][idx] = tmp;
+        }
+    }
+}
+
 #endif
+
+//-------------------------------------------------------------
+// jpeg_idct_float_1d()
+//
+// Description:
+//
+// One dimensional AAN iDCT, in single precision floating point,
+// operating down the 8 rows of a workspace for JPEG_VF_LANES
+// columns at a time. The structure follows the fast integer
+// iDCT (see jpeg_idct_1d()), but without intermediate descaling.
+//
+// Parameters:
+//      ws:   pointer to 8 rows of workspace vectors
+//      vdx:  vector column index into the rows
+//
+// Return value:
+//    None.
+//
+
+static inline void jpeg_idct_float_1d (jpeg_vf_t ws[DCTSIZE][DCTSIZE/JPEG_VF_LANES], int vdx)
+{
+    // Even part
+    jpeg_vf_t tmp10 = jpeg_vf_add(ws[0][vdx], ws[4][vdx]);
+    jpeg_vf_t tmp11 = jpeg_vf_sub(ws[0][vdx], ws[4][vdx]);
+    jpeg_vf_t tmp13 = jpeg_vf_add(ws[2][vdx], ws[6][vdx]);
+    jpeg_vf_t tmp12 = jpeg_vf_sub(jpeg_vf_mul(jpeg_vf_sub(ws[2][vdx], ws[6][vdx]), jpeg_vf_set(1.414213562f)), tmp13);
+
+    jpeg_vf_t tmp0  = jpeg_vf_add(tmp10, tmp13);
+    jpeg_vf_t tmp3  = jpeg_vf_sub(tmp10, tmp13);
+    jpeg_vf_t tmp1  = jpeg_vf_add(tmp11, tmp12);
+    jpeg_vf_t tmp2  = jpeg_vf_sub(tmp11, tmp12);
+
+    // Odd part
+    jpeg_vf_t z13   = jpeg_vf_add(ws[5][vdx], ws[3][vdx]);
+    jpeg_vf_t z10   = jpeg_vf_sub(ws[5][vdx], ws[3][vdx]);
+    jpeg_vf_t z11   = jpeg_vf_add(ws[1][vdx], ws[7][vdx]);
+    jpeg_vf_t z12   = jpeg_vf_sub(ws[1][vdx], ws[7][vdx]);
+
+    jpeg_vf_t tmp7  = jpeg_vf_add(z11, z13);
+    tmp11           = jpeg_vf_mul(jpeg_vf_sub(z11, z13), jpeg_vf_set(1.414213562f));
+
+    jpeg_vf_t z5    = jpeg_vf_mul(jpeg_vf_add(z10, z12), jpeg_vf_set(1.847759065f));
+    tmp10           = jpeg_vf_sub(jpeg_vf_mul(z12, jpeg_vf_set( 1.082392200f)), z5);
+    tmp12           = jpeg_vf_add(jpeg_vf_mul(z10, jpeg_vf_set(-2.613125930f)), z5);
+
+    jpeg_vf_t tmp6  = jpeg_vf_sub(tmp12, tmp7);
+    jpeg_vf_t tmp5  = jpeg_vf_sub(tmp11, tmp6);
+    jpeg_vf_t tmp4  = jpeg_vf_add(tmp10, tmp5);
+
+    ws[0][vdx]      = jpeg_vf_add(tmp0, tmp7);
+    ws[7][vdx]      = jpeg_vf_sub(tmp0, tmp7);
+    ws[1][vdx]      = jpeg_vf_add(tmp1, tmp6);
+    ws[6][vdx]      = jpeg_vf_sub(tmp1, tmp6);
+    ws[2][vdx]      = jpeg_vf_add(tmp2, tmp5);
+    ws[5][vdx]      = jpeg_vf_sub(tmp2, tmp5);
+    ws[4][vdx]      = jpeg_vf_add(tmp3, tmp4);
+    ws[3][vdx]      = jpeg_vf_sub(tmp3, tmp4);
 }
 
+//-------------------------------------------------------------
+// jpeg_idct_float()
+//
+// Description:
+//
+// Separable single precision floating point AAN inverse DCT
+// for an 8x8 block of de-quantised coefficients. The AAN
+// prescaling (and final divide by 8) is applied on loading
+// the coefficients, then a 1D iDCT is done down the columns,
+// the block transposed, a 1D iDCT done down the (original)
+// rows, and the block transposed back for rounding and
+// clipping. Blocks with only a DC coefficient are short-cut.
+// Vectorised with SSE or AVX when available.
+//
+// Parameters:
+//      data:  pointer to 8x8 block of 16 bit coefficients for transformation
+//
+// Return value:
+//    None.
+//
+
+void jfif_idct::jpeg_idct_float(jpeg_8x8_block_t data)
+{
+    jpeg_vf_t ws[DCTSIZE][DCTSIZE/JPEG_VF_LANES];
+
+    int16_t *coef = &data[0][0];
+    int      ac   = 0;
+
+    // Check for a DC only block, where all outputs are the same
+    for (int idx = 1; idx < DCTSIZE2; idx++)
+    {
+        ac |= coef[idx];
+    }
+
+    if (!ac)
+    {
+        float   dc  = (float)coef[0] * aan_float_scales[0] + 128.0f;
+        int16_t val = (int16_t)floorf(JPEG_CLIP(dc) + 0.5f);
+
+        for (int idx = 0; idx < DCTSIZE2; idx++)
+        {
+            coef[idx] = val;
+        }
+
+        return;
+    }
+
+    // Load and prescale
+    for (int row = 0; row < DCTSIZE; row++)
+    {
+        for (int vdx = 0; vdx < DCTSIZE/JPEG_VF_LANES; vdx++)
+        {
+            int offset   = row*DCTSIZE + vdx*JPEG_VF_LANES;
+            ws[row][vdx] = jpeg_vf_mul(jpeg_vf_load(&coef[offset]), jpeg_vf_load_scale(&aan_float_scales[offset]));
+        }
+    }
+
+    // iDCT down the columns
+    for (int vdx = 0; vdx < DCTSIZE/JPEG_VF_LANES; vdx++)
+    {
+        jpeg_idct_float_1d(ws, vdx);
+    }
+
+    jpeg_vf_transpose(ws);
+
+    // iDCT down the transposed rows
+    for (int vdx = 0; vdx < DCTSIZE/JPEG_VF_LANES; vdx++)
+    {
+        jpeg_idct_float_1d(ws, vdx);
+    }
+
+    jpeg_vf_transpose(ws);
+
+    // Round, level shift, clip and store
+    for (int row = 0; row < DCTSIZE; row++)
+    {
+        for (int vdx = 0; vdx < DCTSIZE/JPEG_VF_LANES; vdx++)
+        {
+            jpeg_vf_store(&coef[row*DCTSIZE + vdx*JPEG_VF_LANES], ws[row][vdx]);
+        }
+    }
+}
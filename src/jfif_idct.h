@@ -29,9 +29,27 @@
 #define _JFIF_IDCT_H_
 
 
-// iDCT base class for use in JFIF/JPEG decoding
+// iDCT base class for use in JFIF/JPEG decoding. All the iDCT
+// engines are compiled in, and selected by the decoder at run time
+// (see jfif_idct_policy.h)
 class jfif_idct {
 
+public:
+
+    // Pipelined fast integer iDCT implementation, reflecting h/w architecture
+    void jpeg_idct (jpeg_8x8_block_t data);
+
+    // Simple, but slow, integer iDCT
+    void jpeg_idct_slow (jpeg_8x8_block_t data);
+
+    // Separable single precision floating point AAN iDCT (SSE/AVX when available)
+    void jpeg_idct_float (jpeg_8x8_block_t data);
+
+    // Reduced size integer iDCTs, for 1/2 and 1/4 scale decoding, of a block's lowest
+    // frequencies to its top left 4x4 or 2x2 samples (coefficients optionally AAN prescaled)
+    void jpeg_idct_4x4 (jpeg_8x8_block_t data, bool aan_scaled);
+    void jpeg_idct_2x2 (jpeg_8x8_block_t data, bool aan_scaled);
+
 protected:
 
     // Constructor
@@ -39,12 +57,6 @@ protected:
     {
     };
 
-    // Pipelined fast integer iDCT implementation, reflecting h/w architecture
-    void jpeg_idct (jpeg_8x8_block_t data);
-
-    // Simple, but slow, iDCT
-    void jpeg_idct_slow (jpeg_8x8_block_t data);
-
     // iDCT descale (truncate) an integer result
     inline int jpeg_idescale (int x, int n) {
         return x >> n;
@@ -60,11 +72,17 @@ protected:
 
 private:
 
-    static const jpeg_dct_t C[JPEG_BLOCK_DIMENSION][JPEG_BLOCK_DIMENSION];
+    static const int   C_int  [JPEG_BLOCK_DIMENSION][JPEG_BLOCK_DIMENSION];
+
+    // AAN prescaling for the floating point iDCT, in natural (row major) order
+    static const float aan_float_scales[DCTSIZE2];
+
+    // Reduced iDCT multipliers, for plain ([0]) and AAN prescaled ([1]) coefficients
+    static const int   idct_4x4_mult[2][5];
+    static const int   idct_2x2_mult[2];
 
     void jpeg_idct_1d(int *data0, int *data1, int *data2, int *data3,
                       int *data4, int *data5, int *data6, int *data7);
-
 };
 
 #endif
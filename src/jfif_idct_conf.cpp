@@ -0,0 +1,1185 @@
+//=============================================================
+//
+// Copyright (c) 2026 Simon Southwell
+// All rights reserved.
+//
+// Date: 18th October 2026
+//
+// This file is part of JFIF.
+//
+// JFIF is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// JFIF is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JFIF. If not, see <http://www.gnu.org/licenses/>.
+//
+//=============================================================
+//
+// iDCT accuracy and throughput conformance harness (make
+// conformance). Each of the iDCT engines is driven through its
+// policy class (jfif_idct_policy.h), exactly as the decoder
+// does, with a unity quantisation table.
+//
+// Accuracy is measured with the IEEE 1180-1990 random block
+// test: blocks of random pixels in the ranges [-256, 255],
+// [-5, 5] and [-300, 300] (and their negations) are forward
+// transformed in double precision, rounded and clipped to give
+// the coefficients, and the engine's output compared with a
+// double precision reference iDCT. As the engines output level
+// shifted, clipped pixels (0 to 255), the reference is level
+// shifted and clipped to match.
+//
+// Throughput is measured in blocks/s for random coefficient
+// blocks, DC only blocks and sparse blocks (a few low frequency
+// coefficients, as typical of quantised image data).
+//
+// The decoder's handling of truncated input is also checked, on
+// a small baseline JPEG synthesised here (4:4:4, 4:2:0 and
+// monochrome) and cut short at points through its scan: the
+// MCUs of both the raw and bitmap outputs must match the complete image's decode up to the one the
+// input ended in, and be black after it.
+//
+// Results are output as JSON, to stdout by default.
+//
+//=============================================================
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+#include "jfif.h"
+#include "jfif_local.h"
+#include "jfif_idct_policy.h"
+#include "bitmap.h"
+
+#ifdef WIN32
+// MSVC doesn't have getopt, so declare hooks to bundled in version
+extern "C" int getopt(int nargc, char** nargv, char *ostr);
+extern "C" char *optarg;
+#else
+#include <getopt.h>
+#endif
+
+#define CONF_DEFAULT_BLOCKS     10000
+#define CONF_DEFAULT_SECONDS    0.25
+#define CONF_PERF_BLOCKS        4096
+#define CONF_NUM_RANGES         3
+
+// Truncated input test image (multiple of the largest MCU size), quantisation
+// value, and number of truncation points through the scan
+#define CONF_TRUNC_WIDTH        80
+#define CONF_TRUNC_HEIGHT       48
+#define CONF_TRUNC_QUANT        16
+#define CONF_TRUNC_CUTS         9
+#define CONF_NUM_TRUNC          3
+
+// IEEE 1180 accuracy limits
+#define CONF_MAX_PEAK_ERROR     1
+#define CONF_MAX_PIXEL_MSE      0.06
+#define CONF_MAX_OVERALL_MSE    0.02
+#define CONF_MAX_PIXEL_ME       0.015
+#define CONF_MAX_OVERALL_ME     0.0015
+
+// Results of one IEEE 1180 test run
+typedef struct {
+    int    lower;
+    int    upper;
+    int    sign;
+    int    peak_error;
+    double peak_pixel_mse;
+    double overall_mse;
+    double peak_pixel_me;
+    double overall_me;
+    bool   pass;
+} conf_accuracy_t;
+
+// Results for one engine
+typedef struct {
+    const char*     name;
+    int             mode;
+    conf_accuracy_t accuracy[CONF_NUM_RANGES*2];
+    bool            zero_pass;
+    bool            pass;
+    double          random_bps;
+    double          dc_bps;
+    double          sparse_bps;
+} conf_engine_t;
+
+// Results of the truncated input test, for one sampling
+typedef struct {
+    const char*     sampling;
+    int             components;
+    int             h_samp;                 // Luma sampling factors
+    int             v_samp;
+    int             cuts_decoded;           // Truncated decodes returning JPEG_NO_ERROR
+    bool            pass;
+} conf_trunc_t;
+
+static const int conf_ranges[CONF_NUM_RANGES][2] = {{256, 255}, {5, 5}, {300, 300}};
+static const int conf_zigzag[DCTSIZE2]           = JPEG_ZIGZAG_MAP;
+
+//-------------------------------------------------------------
+// The iDCT engine, with public construction
+
+class jfif_idct_conf : public jfif_idct {
+
+public:
+
+    jfif_idct_conf() : jfif_idct(0)
+    {
+    };
+};
+
+//-------------------------------------------------------------
+// conf_rand()
+//
+// Description:
+//
+// IEEE 1180 pseudo-random number generator, returning a value
+// in the range [-L, H]. The state is 32 bits, as the standard's
+// generator assumes a 32 bit long.
+//
+// Parameters:
+//      L:  magnitude of lower limit
+//      H:  upper limit
+//
+// Return value:
+//    Random value in range
+//
+
+static uint32_t conf_randx;
+
+static int conf_rand (int L, int H)
+{
+    conf_randx = conf_randx * 1103515245U + 12345U;
+
+    double x = (double)(conf_randx & 0x7ffffffe) / (double)0x7fffffff;
+
+    return (int)(x * (L + H + 1)) - L;
+}
+
+//-------------------------------------------------------------
+// conf_dct_ref() / conf_idct_ref()
+//
+// Description:
+//
+// Double precision reference forward and inverse DCTs, by
+// direct evaluation of the 2D transform equations.
+//
+// Parameters:
+//      in:   input 8x8 block
+//      out:  output 8x8 block
+//
+// Return value:
+//    None.
+//
+
+static double conf_cos[DCTSIZE][DCTSIZE];
+
+static void conf_init_cos (void)
+{
+    for (int x = 0; x < DCTSIZE; x++)
+    {
+        for (int u = 0; u < DCTSIZE; u++)
+        {
+            double cu = (u == 0) ? sqrt(0.5) : 1.0;
+            conf_cos[x][u] = cu * cos((2*x + 1) * u * M_PI / 16.0) / 2.0;
+        }
+    }
+}
+
+static void conf_dct_ref (const double in[DCTSIZE2], double out[DCTSIZE2])
+{
+    for (int v = 0; v < DCTSIZE; v++)
+    {
+        for (int u = 0; u < DCTSIZE; u++)
+        {
+            double sum = 0.0;
+
+            for (int y = 0; y < DCTSIZE; y++)
+            {
+                for (int x = 0; x < DCTSIZE; x++)
+                {
+                    sum += in[y*DCTSIZE + x] * conf_cos[y][v] * conf_cos[x][u];
+                }
+            }
+
+            out[v*DCTSIZE + u] = sum;
+        }
+    }
+}
+
+static void conf_idct_ref (const double in[DCTSIZE2], double out[DCTSIZE2])
+{
+    for (int y = 0; y < DCTSIZE; y++)
+    {
+        for (int x = 0; x < DCTSIZE; x++)
+        {
+            double sum = 0.0;
+
+            for (int v = 0; v < DCTSIZE; v++)
+            {
+                for (int u = 0; u < DCTSIZE; u++)
+                {
+                    sum += in[v*DCTSIZE + u] * conf_cos[y][v] * conf_cos[x][u];
+                }
+            }
+
+            out[y*DCTSIZE + x] = sum;
+        }
+    }
+}
+
+static inline int conf_clip (double val, int lo, int hi)
+{
+    int ival = (int)floor(val + 0.5);
+
+    return (ival < lo) ? lo : (ival > hi) ? hi : ival;
+}
+
+//-------------------------------------------------------------
+// conf_run_idct()
+//
+// Description:
+//
+// Runs a block of (natural order) coefficients through the
+// policy's de-quantisation, with a unity quantisation table
+// prescaled as for the decoder, and then the policy's iDCT.
+//
+// Parameters:
+//      engine: iDCT engine
+//      coef:   input coefficients
+//      out:    output pixels (level shifted, 0 to 255)
+//
+// Return value:
+//    None.
+//
+
+template <typename POLICY> static void conf_run_idct (jfif_idct &engine, const int coef[DCTSIZE2], int out[DCTSIZE2])
+{
+    int16_t blk[DCTSIZE][DCTSIZE];
+
+    for (int idx = 0; idx < DCTSIZE2; idx++)
+    {
+        int q = POLICY::dqt_prescale(1, conf_zigzag[idx]);
+
+        blk[idx/DCTSIZE][idx%DCTSIZE] = JPEG_CLIP16(POLICY::dequantise(coef[idx], q));
+    }
+
+    POLICY::idct(engine, blk);
+
+    for (int idx = 0; idx < DCTSIZE2; idx++)
+    {
+        out[idx] = blk[idx/DCTSIZE][idx%DCTSIZE];
+    }
+}
+
+//-------------------------------------------------------------
+// conf_accuracy()
+//
+// Description:
+//
+// Runs one IEEE 1180 test, for pixel range [-L, H] and the
+// given sign, over num_blocks random blocks.
+//
+// Parameters:
+//      engine:     iDCT engine
+//      L, H:       pixel range
+//      sign:       1 or -1, applied to the random pixels
+//      num_blocks: number of blocks to test
+//      res:        returned results
+//
+// Return value:
+//    None.
+//
+
+template <typename POLICY> static void conf_accuracy (jfif_idct &engine, int L, int H, int sign, int num_blocks, conf_accuracy_t &res)
+{
+    double pixels[DCTSIZE2], dct[DCTSIZE2], ref[DCTSIZE2];
+    int    coef[DCTSIZE2], out[DCTSIZE2];
+
+    double sum_err[DCTSIZE2] = {};
+    double sum_sq [DCTSIZE2] = {};
+
+    res.lower      = -L;
+    res.upper      = H;
+    res.sign       = sign;
+    res.peak_error = 0;
+
+    conf_randx = 1;
+
+    for (int blk = 0; blk < num_blocks; blk++)
+    {
+        for (int idx = 0; idx < DCTSIZE2; idx++)
+        {
+            pixels[idx] = sign * conf_rand(L, H);
+        }
+
+        // Forward DCT, rounded and clipped to 12 bits
+        conf_dct_ref(pixels, dct);
+
+        for (int idx = 0; idx < DCTSIZE2; idx++)
+        {
+            coef[idx] = conf_clip(dct[idx], -2048, 2047);
+            dct[idx]  = coef[idx];
+        }
+
+        // Reference iDCT from the quantised coefficients
+        conf_idct_ref(dct, ref);
+
+        conf_run_idct<POLICY>(engine, coef, out);
+
+        for (int idx = 0; idx < DCTSIZE2; idx++)
+        {
+            int r   = conf_clip(conf_clip(ref[idx], -256, 255) + 128, 0, 255);
+            int err = out[idx] - r;
+
+            sum_err[idx] += err;
+            sum_sq[idx]  += err * err;
+
+            if (abs(err) > res.peak_error)
+            {
+                res.peak_error = abs(err);
+            }
+        }
+    }
+
+    res.peak_pixel_mse = 0.0;
+    res.peak_pixel_me  = 0.0;
+    res.overall_mse    = 0.0;
+    res.overall_me     = 0.0;
+
+    for (int idx = 0; idx < DCTSIZE2; idx++)
+    {
+        double mse = sum_sq[idx]  / num_blocks;
+        double me  = sum_err[idx] / num_blocks;
+
+        res.peak_pixel_mse = fmax(res.peak_pixel_mse, mse);
+        res.peak_pixel_me  = fmax(res.peak_pixel_me, fabs(me));
+        res.overall_mse   += sum_sq[idx];
+        res.overall_me    += sum_err[idx];
+    }
+
+    res.overall_mse /= (double)num_blocks * DCTSIZE2;
+    res.overall_me  /= (double)num_blocks * DCTSIZE2;
+
+    res.pass = res.peak_error          <= CONF_MAX_PEAK_ERROR   &&
+               res.peak_pixel_mse      <= CONF_MAX_PIXEL_MSE    &&
+               res.overall_mse         <= CONF_MAX_OVERALL_MSE  &&
+               res.peak_pixel_me       <= CONF_MAX_PIXEL_ME     &&
+               fabs(res.overall_me)    <= CONF_MAX_OVERALL_ME;
+}
+
+//-------------------------------------------------------------
+// conf_throughput()
+//
+// Description:
+//
+// Measures the blocks/s throughput of an engine's iDCT over a
+// set of de-quantised coefficient blocks. Each block is copied
+// to a working block before transformation (as the decoder
+// fills a fresh MCU block), and the copy included in the time.
+//
+// Parameters:
+//      engine:  iDCT engine
+//      blocks:  CONF_PERF_BLOCKS coefficient blocks
+//      seconds: minimum measurement time
+//
+// Return value:
+//    Blocks per second
+//
+
+static volatile int conf_sink;
+
+template <typename POLICY> static double conf_throughput (jfif_idct &engine, const int16_t (*blocks)[DCTSIZE2], double seconds)
+{
+    typedef std::chrono::steady_clock clk;
+
+    int16_t blk[DCTSIZE][DCTSIZE];
+    int     check  = 0;
+    long    count  = 0;
+    double  elapsed;
+
+    clk::time_point start = clk::now();
+
+    do
+    {
+        for (int bdx = 0; bdx < CONF_PERF_BLOCKS; bdx++)
+        {
+            memcpy(blk, blocks[bdx], sizeof(blk));
+            POLICY::idct(engine, blk);
+            check += blk[bdx & 7][(bdx >> 3) & 7];
+        }
+
+        count  += CONF_PERF_BLOCKS;
+        elapsed = std::chrono::duration<double>(clk::now() - start).count();
+
+    } while (elapsed < seconds);
+
+    conf_sink = check;
+
+    return (double)count / elapsed;
+}
+
+//-------------------------------------------------------------
+// conf_engine()
+//
+// Description:
+//
+// Runs all the accuracy and throughput tests on a single engine
+//
+// Parameters:
+//      res:        returned results (name and mode already set)
+//      num_blocks: number of blocks per accuracy test
+//      seconds:    minimum time for each throughput measurement
+//
+// Return value:
+//    None.
+//
+
+template <typename POLICY> static void conf_engine (conf_engine_t &res, int num_blocks, double seconds)
+{
+    jfif_idct_conf engine;
+
+    static int16_t random_blks[CONF_PERF_BLOCKS][DCTSIZE2];
+    static int16_t dc_blks    [CONF_PERF_BLOCKS][DCTSIZE2];
+    static int16_t sparse_blks[CONF_PERF_BLOCKS][DCTSIZE2];
+
+    int coef[DCTSIZE2] = {};
+    int out [DCTSIZE2];
+
+    // IEEE 1180 tests, for each range, positive then negated
+    res.pass = true;
+
+    for (int rdx = 0; rdx < CONF_NUM_RANGES; rdx++)
+    {
+        for (int sdx = 0; sdx < 2; sdx++)
+        {
+            conf_accuracy_t &acc = res.accuracy[rdx*2 + sdx];
+
+            conf_accuracy<POLICY>(engine, conf_ranges[rdx][0], conf_ranges[rdx][1], sdx ? -1 : 1, num_blocks, acc);
+
+            res.pass &= acc.pass;
+        }
+    }
+
+    // All zero input must give all zero (i.e. level shifted 128) output
+    conf_run_idct<POLICY>(engine, coef, out);
+
+    res.zero_pass = true;
+
+    for (int idx = 0; idx < DCTSIZE2; idx++)
+    {
+        res.zero_pass &= (out[idx] == 128);
+    }
+
+    res.pass &= res.zero_pass;
+
+    // Throughput test blocks, de-quantised as for the decoder
+    conf_randx = 1;
+
+    for (int bdx = 0; bdx < CONF_PERF_BLOCKS; bdx++)
+    {
+        memset(sparse_blks[bdx], 0, sizeof(sparse_blks[bdx]));
+        memset(dc_blks[bdx],     0, sizeof(dc_blks[bdx]));
+
+        for (int idx = 0; idx < DCTSIZE2; idx++)
+        {
+            random_blks[bdx][idx] = POLICY::dequantise(conf_rand(256, 255), POLICY::dqt_prescale(1, conf_zigzag[idx]));
+        }
+
+        dc_blks[bdx][0] = POLICY::dequantise(conf_rand(1024, 1023), POLICY::dqt_prescale(1, 0));
+
+        // DC plus a few of the first 10 (zigzag order) AC coefficients
+        sparse_blks[bdx][0] = dc_blks[bdx][0];
+
+        for (int zdx = 1; zdx < 10; zdx++)
+        {
+            if (conf_rand(0, 2) == 0)
+            {
+                int idx = 0;
+
+                while (conf_zigzag[idx] != zdx)
+                {
+                    idx++;
+                }
+
+                sparse_blks[bdx][idx] = POLICY::dequantise(conf_rand(64, 64), POLICY::dqt_prescale(1, zdx));
+            }
+        }
+    }
+
+    res.random_bps = conf_throughput<POLICY>(engine, random_blks, seconds);
+    res.dc_bps     = conf_throughput<POLICY>(engine, dc_blks,     seconds);
+    res.sparse_bps = conf_throughput<POLICY>(engine, sparse_blks, seconds);
+}
+
+//-------------------------------------------------------------
+// Baseline JPEG encoding, for the truncated input test, with the
+// example luminance Huffman tables of ITU.T81 Annex K (K.3), used
+// for all the components.
+
+static const uint8_t conf_dc_bits[16]  = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t conf_dc_vals[12]  = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t conf_ac_bits[16]  = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t conf_ac_vals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// Huffman code table (code and size for each value), and entropy coded output state
+typedef struct {
+    uint16_t code[256];
+    uint8_t  size[256];
+} conf_huff_t;
+
+typedef struct {
+    std::vector<uint8_t> data;
+    uint32_t             bits;
+    int                  nbits;
+} conf_bitstream_t;
+
+//-------------------------------------------------------------
+// conf_huff_init()
+//
+// Description:
+//
+// Generates the code for each value of a Huffman table from its
+// code counts (BITS) and values (HUFFVAL), as ITU.T81 Annex C.
+//
+// Parameters:
+//      bits: number of codes of each length (1 to 16)
+//      vals: values, in code order
+//      huff: code table to fill
+//
+// Return value:
+//    None.
+//
+
+static void conf_huff_init (const uint8_t bits[16], const uint8_t *vals, conf_huff_t &huff)
+{
+    int code = 0;
+    int vdx  = 0;
+
+    for (int len = 1; len <= 16; len++)
+    {
+        for (int idx = 0; idx < bits[len-1]; idx++)
+        {
+            huff.code[vals[vdx]] = code++;
+            huff.size[vals[vdx]] = len;
+            vdx++;
+        }
+
+        code <<= 1;
+    }
+}
+
+//-------------------------------------------------------------
+// conf_put_bits()
+//
+// Description:
+//
+// Adds a value's bits to the entropy coded data, most
+// significant first, stuffing a zero byte after any 0xff byte.
+//
+// Parameters:
+//      bs:    entropy coded output
+//      value: bits to add (in the least significant bits)
+//      size:  number of bits (0 to 16)
+//
+// Return value:
+//    None.
+//
+
+static void conf_put_bits (conf_bitstream_t &bs, uint32_t value, int size)
+{
+    bs.bits   = (bs.bits << size) | (value & ((1U << size) - 1));
+    bs.nbits += size;
+
+    while (bs.nbits >= 8)
+    {
+        uint8_t byte = (bs.bits >> (bs.nbits - 8)) & 0xff;
+
+        bs.data.push_back(byte);
+
+        if (byte == 0xff)
+        {
+            bs.data.push_back(0);
+        }
+
+        bs.nbits -= 8;
+    }
+}
+
+//-------------------------------------------------------------
+// conf_encode_block()
+//
+// Description:
+//
+// Forward transforms, quantises and entropy codes an 8x8 block
+// of samples, as ITU.T81 Annex F.1.2.
+//
+// Parameters:
+//      bs:      entropy coded output
+//      samples: block of samples (0 to 255)
+//      pred:    component's DC prediction, updated
+//      dc:      DC Huffman table
+//      ac:      AC Huffman table
+//
+// Return value:
+//    None.
+//
+
+static void conf_encode_block (conf_bitstream_t &bs, const int samples[DCTSIZE2], int &pred, const conf_huff_t &dc,
+                               const conf_huff_t &ac)
+{
+    double in[DCTSIZE2], out[DCTSIZE2];
+    int    zz[DCTSIZE2];
+
+    for (int idx = 0; idx < DCTSIZE2; idx++)
+    {
+        in[idx] = samples[idx] - 128.0;
+    }
+
+    conf_dct_ref(in, out);
+
+    for (int idx = 0; idx < DCTSIZE2; idx++)
+    {
+        zz[conf_zigzag[idx]] = (int)floor(out[idx] / CONF_TRUNC_QUANT + 0.5);
+    }
+
+    // Value's category (bit length of its magnitude), with the value coded as
+    // its low bits, less one if negative
+    int diff = zz[0] - pred;
+    int cat  = 0;
+
+    pred = zz[0];
+
+    while ((abs(diff) >> cat) != 0)
+    {
+        cat++;
+    }
+
+    conf_put_bits(bs, dc.code[cat], dc.size[cat]);
+    conf_put_bits(bs, (diff < 0) ? diff - 1 : diff, cat);
+
+    int run = 0;
+
+    for (int zdx = 1; zdx < DCTSIZE2; zdx++)
+    {
+        if (zz[zdx] == 0)
+        {
+            run++;
+            continue;
+        }
+
+        // Runs of more than 15 zeros coded as ZRL (16 zeros)
+        for (; run > 15; run -= 16)
+        {
+            conf_put_bits(bs, ac.code[0xf0], ac.size[0xf0]);
+        }
+
+        for (cat = 0; (abs(zz[zdx]) >> cat) != 0; cat++)
+            ;
+
+        conf_put_bits(bs, ac.code[(run << 4) | cat], ac.size[(run << 4) | cat]);
+        conf_put_bits(bs, (zz[zdx] < 0) ? zz[zdx] - 1 : zz[zdx], cat);
+
+        run = 0;
+    }
+
+    // End of block for trailing zeros
+    if (run)
+    {
+        conf_put_bits(bs, ac.code[0], ac.size[0]);
+    }
+}
+
+//-------------------------------------------------------------
+// conf_put_marker()
+//
+// Description:
+//
+// Adds a (16 bit) marker to an encoded JPEG
+//
+// Parameters:
+//      jpeg: encoded JPEG
+//      mkr:  marker (JPEG_MKR_xxx)
+//
+// Return value:
+//    None.
+//
+
+static void conf_put_marker (std::vector<uint8_t> &jpeg, int mkr)
+{
+    jpeg.push_back(mkr >> 8);
+    jpeg.push_back(mkr & 0xff);
+}
+
+//-------------------------------------------------------------
+// conf_encode_jpeg()
+//
+// Description:
+//
+// Encodes a baseline JPEG of CONF_TRUNC_WIDTH by CONF_TRUNC_HEIGHT
+// random samples, with a single scan of all the components, and
+// chroma (if any) sub-sampled by the luma sampling factors (each
+// chroma sample taken from the first of the luma samples it
+// covers). The image dimensions are a multiple of the MCU size.
+//
+// Parameters:
+//      trunc:      sampling to encode
+//      jpeg:       encoded JPEG
+//      scan_start: offset of the scan's entropy coded data
+//
+// Return value:
+//    None.
+//
+
+static void conf_encode_jpeg (const conf_trunc_t &trunc, std::vector<uint8_t> &jpeg, long &scan_start)
+{
+    static int  image[JPEG_NUM_RGB_COLOURS][CONF_TRUNC_HEIGHT][CONF_TRUNC_WIDTH];
+
+    conf_huff_t dc, ac;
+    int         Ns = trunc.components;
+    int         Hi = trunc.h_samp;
+    int         Vi = trunc.v_samp;
+
+    conf_huff_init(conf_dc_bits, conf_dc_vals, dc);
+    conf_huff_init(conf_ac_bits, conf_ac_vals, ac);
+
+    conf_randx = 1;
+
+    for (int cdx = 0; cdx < Ns; cdx++)
+    {
+        for (int y = 0; y < CONF_TRUNC_HEIGHT; y++)
+        {
+            for (int x = 0; x < CONF_TRUNC_WIDTH; x++)
+            {
+                image[cdx][y][x] = conf_rand(0, 255);
+            }
+        }
+    }
+
+    // Headers: SOI, DQT, SOF0, DHT (DC and AC tables) and SOS
+    jpeg.clear();
+
+    conf_put_marker(jpeg, JPEG_MKR_SOI);
+    conf_put_marker(jpeg, JPEG_MKR_DQT);
+
+    jpeg.insert(jpeg.end(), {0, 2 + 1 + DCTSIZE2, 0});
+    jpeg.insert(jpeg.end(), DCTSIZE2, CONF_TRUNC_QUANT);
+
+    conf_put_marker(jpeg, JPEG_MKR_SOF0);
+
+    jpeg.insert(jpeg.end(), {0, (uint8_t)(8 + 3*Ns), 8, 0, CONF_TRUNC_HEIGHT, 0, CONF_TRUNC_WIDTH,
+                             (uint8_t)Ns});
+
+    for (int cdx = 0; cdx < Ns; cdx++)
+    {
+        jpeg.insert(jpeg.end(), {(uint8_t)(cdx + 1), (uint8_t)(cdx ? 0x11 : (Hi << 4) | Vi), 0});
+    }
+
+    for (int tc = 0; tc < 2; tc++)
+    {
+        const uint8_t *bits = tc ? conf_ac_bits : conf_dc_bits;
+        const uint8_t *vals = tc ? conf_ac_vals : conf_dc_vals;
+        int            nval = tc ? sizeof(conf_ac_vals) : sizeof(conf_dc_vals);
+
+        conf_put_marker(jpeg, JPEG_MKR_DHT);
+
+        jpeg.insert(jpeg.end(), {(uint8_t)((2 + 1 + 16 + nval) >> 8), (uint8_t)(2 + 1 + 16 + nval),
+                                 (uint8_t)(tc << 4)});
+        jpeg.insert(jpeg.end(), bits, bits + 16);
+        jpeg.insert(jpeg.end(), vals, vals + nval);
+    }
+
+    conf_put_marker(jpeg, JPEG_MKR_SOS);
+
+    jpeg.insert(jpeg.end(), {0, (uint8_t)(6 + 2*Ns), (uint8_t)Ns});
+
+    for (int cdx = 0; cdx < Ns; cdx++)
+    {
+        jpeg.insert(jpeg.end(), {(uint8_t)(cdx + 1), 0});
+    }
+
+    jpeg.insert(jpeg.end(), {0, DCTSIZE2-1, 0});
+
+    scan_start = (long)jpeg.size();
+
+    // Entropy coded MCUs
+    conf_bitstream_t bs = {std::vector<uint8_t>(), 0, 0};
+    int              pred[JPEG_NUM_RGB_COLOURS] = {};
+    int              blk[DCTSIZE2];
+
+    for (int my = 0; my < CONF_TRUNC_HEIGHT; my += Vi*DCTSIZE)
+    {
+        for (int mx = 0; mx < CONF_TRUNC_WIDTH; mx += Hi*DCTSIZE)
+        {
+            for (int cdx = 0; cdx < Ns; cdx++)
+            {
+                int sh = cdx ? Hi : 1;
+                int sv = cdx ? Vi : 1;
+
+                for (int by = 0; by < (cdx ? 1 : Vi); by++)
+                {
+                    for (int bx = 0; bx < (cdx ? 1 : Hi); bx++)
+                    {
+                        for (int idx = 0; idx < DCTSIZE2; idx++)
+                        {
+                            int y = my + (by*DCTSIZE + idx/DCTSIZE)*sv;
+                            int x = mx + (bx*DCTSIZE + idx%DCTSIZE)*sh;
+
+                            blk[idx] = image[cdx][y][x];
+                        }
+
+                        conf_encode_block(bs, blk, pred[cdx], dc, ac);
+                    }
+                }
+            }
+        }
+    }
+
+    // Pad the last byte with 1s, and end with EOI
+    conf_put_bits(bs, 0x7f, 7);
+
+    jpeg.insert(jpeg.end(), bs.data.begin(), bs.data.end());
+
+    conf_put_marker(jpeg, JPEG_MKR_EOI);
+}
+
+//-------------------------------------------------------------
+// conf_trunc_match()
+//
+// Description:
+//
+// Compares a truncated decode's image with the full decode's,
+// MCU by MCU in scan order. The MCUs must match up to the one
+// the input ended in (which may be partially decoded), with all
+// the MCUs after it black.
+//
+// Parameters:
+//      full:      full decode's image (first pixel of top row)
+//      cut:       truncated decode's image (first pixel of top row)
+//      stride:    bytes from one row to the next (negative if bottom-up)
+//      mcu_w:     MCU width, in pixels
+//      mcu_h:     MCU height, in pixels
+//
+// Return value:
+//    true if the truncated image matched, else false.
+//
+
+static bool conf_trunc_match (const uint8_t *full, const uint8_t *cut, long stride, int mcu_w, int mcu_h)
+{
+    bool pass  = true;
+    bool ended = false;
+
+    for (int my = 0; my < CONF_TRUNC_HEIGHT; my += mcu_h)
+    {
+        for (int mx = 0; mx < CONF_TRUNC_WIDTH; mx += mcu_w)
+        {
+            bool same = true, zero = true;
+
+            for (int y = my; y < my + mcu_h; y++)
+            {
+                const uint8_t *crow = &cut[y*stride + mx*JPEG_NUM_RGB_COLOURS];
+                const uint8_t *frow = &full[y*stride + mx*JPEG_NUM_RGB_COLOURS];
+
+                for (int idx = 0; idx < mcu_w*JPEG_NUM_RGB_COLOURS; idx++)
+                {
+                    same &= crow[idx] == frow[idx];
+                    zero &= crow[idx] == 0;
+                }
+            }
+
+            // The first MCU not matching is the one the input ended in, which
+            // may be partially decoded, with every MCU after it black
+            if (!ended && !same)
+            {
+                ended = true;
+            }
+            else if (ended)
+            {
+                pass &= zero;
+            }
+        }
+    }
+
+    return pass && ended;
+}
+
+//-------------------------------------------------------------
+// conf_bmp_top_row()
+//
+// Description:
+//
+// Finds the top row of a decoded bottom-up 24 bit bitmap
+//
+// Parameters:
+//      bmp:       bitmap, including header
+//
+// Return value:
+//    Pointer to the first pixel of the bitmap's top row.
+//
+
+static const uint8_t* conf_bmp_top_row (const uint8_t *bmp)
+{
+    // bfOffBits, little endian
+    uint32_t offset = bmp[10] | (bmp[11] << 8) | (bmp[12] << 16) | ((uint32_t)bmp[13] << 24);
+
+    return &bmp[offset + (long)(CONF_TRUNC_HEIGHT-1)*BMP_WIDTH_TO_PADDED_BYTES(CONF_TRUNC_WIDTH)];
+}
+
+//-------------------------------------------------------------
+// conf_truncated()
+//
+// Description:
+//
+// Decodes a synthesised JPEG in full, and then cut short at
+// CONF_TRUNC_CUTS points through its scan (with no EOI marker),
+// as an input of the cut length. Each truncated decode's raw and
+// bitmap outputs must match the full decode's, as checked by
+// conf_trunc_match().
+//
+// Parameters:
+//      res: sampling to test, and results
+//
+// Return value:
+//    None.
+//
+
+static void conf_truncated (conf_trunc_t &res)
+{
+    std::vector<uint8_t> jpeg;
+    long                 scan_start;
+    jpeg_decode_opts_t   opts;
+    uint8_t             *full     = NULL;
+    uint8_t             *full_bmp = NULL;
+
+    conf_encode_jpeg(res, jpeg, scan_start);
+
+    // Raw RGB and bitmap output, with nearest neighbour upsampling so MCUs are independent
+    jpeg_default_opts_c(&opts);
+    opts.output_flags  = JPEG_OUTPUT_BMP | JPEG_OUTPUT_RAW;
+    opts.pixel_format  = JPEG_PIXFMT_RGB24;
+    opts.upsample_mode = JPEG_UPSAMPLE_NEAREST;
+
+    res.cuts_decoded = 0;
+    res.pass         = jpeg_process_jfif_len_c(&jpeg[0], (long)jpeg.size(), &full_bmp, &full, &opts, 0) == JPEG_NO_ERROR;
+
+    int  mcu_w      = res.h_samp*DCTSIZE;
+    int  mcu_h      = res.v_samp*DCTSIZE;
+    long stride     = (long)CONF_TRUNC_WIDTH*JPEG_NUM_RGB_COLOURS;
+    long bmp_stride = -(long)BMP_WIDTH_TO_PADDED_BYTES(CONF_TRUNC_WIDTH);
+
+    for (int cut = 1; res.pass && cut <= CONF_TRUNC_CUTS; cut++)
+    {
+        long     len = scan_start + (long)(jpeg.size() - 2 - scan_start)*cut/(CONF_TRUNC_CUTS + 1);
+        uint8_t *raw = NULL;
+        uint8_t *bmp = NULL;
+
+        if (jpeg_process_jfif_len_c(&jpeg[0], len, &bmp, &raw, &opts, 0) == JPEG_NO_ERROR)
+        {
+            res.cuts_decoded++;
+
+            res.pass &= conf_trunc_match(full, raw, stride, mcu_w, mcu_h);
+            res.pass &= conf_trunc_match(conf_bmp_top_row(full_bmp), conf_bmp_top_row(bmp), bmp_stride, mcu_w, mcu_h);
+        }
+
+        jpeg_free_c(raw);
+        jpeg_free_c(bmp);
+    }
+
+    res.pass &= res.cuts_decoded == CONF_TRUNC_CUTS;
+
+    jpeg_free_c(full);
+    jpeg_free_c(full_bmp);
+}
+
+//-------------------------------------------------------------
+// conf_print_json()
+//
+// Description:
+//
+// Outputs the results as JSON
+//
+// Parameters:
+//      fp:          output file pointer
+//      res:         array of engine results
+//      num_engines: number of engines in res
+//      num_blocks:  number of blocks per accuracy test
+//      trunc:       array of truncated input results
+//      num_trunc:   number of samplings in trunc
+//
+// Return value:
+//    None.
+//
+
+static void conf_print_json (FILE *fp, const conf_engine_t *res, int num_engines, int num_blocks,
+                             const conf_trunc_t *trunc, int num_trunc)
+{
+    const char *simd =
+#if defined(JPEG_SIMD_AVX)
+                       "avx";
+#elif defined(JPEG_SIMD_SSE2)
+                       "sse2";
+#else
+                       "none";
+#endif
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"test\": \"IEEE 1180-1990\",\n");
+    fprintf(fp, "  \"blocks_per_test\": %d,\n", num_blocks);
+    fprintf(fp, "  \"simd\": \"%s\",\n", simd);
+    fprintf(fp, "  \"engines\": [\n");
+
+    for (int edx = 0; edx < num_engines; edx++)
+    {
+        const conf_engine_t &e = res[edx];
+
+        fprintf(fp, "    {\n");
+        fprintf(fp, "      \"name\": \"%s\",\n", e.name);
+        fprintf(fp, "      \"mode\": %d,\n", e.mode);
+        fprintf(fp, "      \"ieee1180_pass\": %s,\n", e.pass ? "true" : "false");
+        fprintf(fp, "      \"zero_input_pass\": %s,\n", e.zero_pass ? "true" : "false");
+        fprintf(fp, "      \"accuracy\": [\n");
+
+        for (int adx = 0; adx < CONF_NUM_RANGES*2; adx++)
+        {
+            const conf_accuracy_t &a = e.accuracy[adx];
+
+            fprintf(fp, "        {\"lower\": %d, \"upper\": %d, \"sign\": %d, \"peak_error\": %d, "
+                        "\"peak_pixel_mse\": %.6f, \"overall_mse\": %.6f, "
+                        "\"peak_pixel_mean_error\": %.6f, \"overall_mean_error\": %.6f, \"pass\": %s}%s\n",
+                        a.lower, a.upper, a.sign, a.peak_error,
+                        a.peak_pixel_mse, a.overall_mse, a.peak_pixel_me, a.overall_me,
+                        a.pass ? "true" : "false", (adx == CONF_NUM_RANGES*2-1) ? "" : ",");
+        }
+
+        fprintf(fp, "      ],\n");
+        fprintf(fp, "      \"blocks_per_second\": {\"random\": %.0f, \"dc_only\": %.0f, \"sparse\": %.0f}\n",
+                    e.random_bps, e.dc_bps, e.sparse_bps);
+        fprintf(fp, "    }%s\n", (edx == num_engines-1) ? "" : ",");
+    }
+
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"truncated_input\": [\n");
+
+    for (int tdx = 0; tdx < num_trunc; tdx++)
+    {
+        fprintf(fp, "    {\"sampling\": \"%s\", \"cuts\": %d, \"cuts_decoded\": %d, \"pass\": %s}%s\n",
+                    trunc[tdx].sampling, CONF_TRUNC_CUTS, trunc[tdx].cuts_decoded, trunc[tdx].pass ? "true" : "false",
+                    (tdx == num_trunc-1) ? "" : ",");
+    }
+
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+}
+
+//-------------------------------------------------------------
+// main()
+//
+// Usage: jfif_idct_conf [-h] [-n <blocks>] [-t <seconds>] [-o <filename>]
+//
+
+int main (int argc, char **argv)
+{
+    int    num_blocks = CONF_DEFAULT_BLOCKS;
+    double seconds    = CONF_DEFAULT_SECONDS;
+    char*  ofname     = NULL;
+    FILE*  ofp        = stdout;
+    int    option;
+
+    // Results filled in by conf_engine()
+    conf_engine_t res[3] = {
+        {"fast",  JPEG_IDCT_FAST_INT, {}, false, false, 0.0, 0.0, 0.0},
+        {"slow",  JPEG_IDCT_SLOW_INT, {}, false, false, 0.0, 0.0, 0.0},
+        {"float", JPEG_IDCT_FLOAT,    {}, false, false, 0.0, 0.0, 0.0}
+    };
+
+    // Results filled in by conf_truncated()
+    conf_trunc_t trunc[CONF_NUM_TRUNC] = {
+        {"4:4:4", 3, 1, 1, 0, false},
+        {"4:2:0", 3, 2, 2, 0, false},
+        {"mono",  1, 1, 1, 0, false}
+    };
+
+    while ((option = getopt(argc, argv, (char *)"hn:t:o:")) != EOF)
+    {
+        switch(option)
+        {
+        case 'n':
+            num_blocks = (int)strtol(optarg, NULL, 0);
+            break;
+
+        case 't':
+            seconds = strtod(optarg, NULL);
+            break;
+
+        case 'o':
+            ofname = optarg;
+            break;
+
+        case 'h':
+        case '?':
+            fprintf(stderr, "Usage: jfif_idct_conf [-h] [-n <blocks>] [-t <seconds>] [-o <filename>]\n"
+                            "    -h display help message\n"
+                            "    -n number of blocks per accuracy test (default %d)\n"
+                            "    -t minimum time in seconds per throughput measurement (default %.2f)\n"
+                            "    -o output JSON filename (default stdout)\n",
+                            CONF_DEFAULT_BLOCKS, CONF_DEFAULT_SECONDS);
+            return JPEG_USER_INPUT_ERROR;
+        }
+    }
+
+    if (num_blocks <= 0 || seconds <= 0.0)
+    {
+        fprintf(stderr, "ERROR: number of blocks and measurement time must be positive\n");
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    if (ofname != NULL && (ofp = fopen(ofname, "w")) == NULL)
+    {
+        fprintf(stderr, "ERROR: could not open %s for writing\n", ofname);
+        return JPEG_FILE_ERROR;
+    }
+
+    conf_init_cos();
+
+    conf_engine<jfif_fast_int_idct_policy>(res[0], num_blocks, seconds);
+    conf_engine<jfif_slow_int_idct_policy>(res[1], num_blocks, seconds);
+    conf_engine<jfif_float_idct_policy>   (res[2], num_blocks, seconds);
+
+    for (int tdx = 0; tdx < CONF_NUM_TRUNC; tdx++)
+    {
+        conf_truncated(trunc[tdx]);
+    }
+
+    conf_print_json(ofp, res, 3, num_blocks, trunc, CONF_NUM_TRUNC);
+
+    if (ofp != stdout)
+    {
+        fclose(ofp);
+    }
+
+    return JPEG_NO_ERROR;
+}
@@ -0,0 +1,181 @@
+//=============================================================
+//
+// Copyright (c) 2026 Simon Southwell
+// All rights reserved.
+//
+// Date: 18th October 2026
+//
+// This file is part of JFIF.
+//
+// JFIF is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// JFIF is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JFIF. If not, see <http://www.gnu.org/licenses/>.
+//
+//=============================================================
+//
+// iDCT engine policy classes. Each policy bundles together an
+// iDCT implementation (from the jfif_idct base class), the
+// matching de-quantisation table prescaling and de-quantisation,
+// and the matching YCbCr to RGB colour conversion. The decoder's
+// scan processing methods are templated on a policy, with one
+// instantiation for each policy compiled into the library, and
+// the engine selected at run time (JPEG_IDCT_xxx in jfif.h).
+//
+//=============================================================
+
+#include <cmath>
+
+#include "jfif_local.h"
+#include "jfif_idct.h"
+#include "jfif_colour.h"
+
+#ifndef _JFIF_IDCT_POLICY_H_
+#define _JFIF_IDCT_POLICY_H_
+
+//-------------------------------------------------------------
+// Fixed point colour conversion, common to the integer engines
+// (vectorised, in jfif_colour.cpp)
+
+class jfif_int_ycc_policy {
+
+public:
+
+    static inline void ycc_to_rgb_row (const int16_t *Y, const int16_t *Cb, const int16_t *Cr,
+                                       uint8_t *r, uint8_t *g, uint8_t *b, int n)
+    {
+        jpeg_ycc_to_rgb_row(Y, Cb, Cr, r, g, b, n);
+    };
+};
+
+//-------------------------------------------------------------
+// Fast integer iDCT engine (JPEG_IDCT_FAST_INT). The AAN iDCT
+// prescaling is folded into the quantisation tables, and the
+// de-quantised values partially descaled.
+
+class jfif_fast_int_idct_policy : public jfif_int_ycc_policy {
+
+public:
+
+    static const int aanscales[DCTSIZE2];
+
+    // Prescale a quantisation value at (zigzag) index zdx
+    static inline int dqt_prescale (int q, int zdx)
+    {
+        return (q * aanscales[zdx]) >> PRE_DESCALE_BITS;
+    };
+
+    // De-quantise an amplitude with a (prescaled) quantisation value
+    static inline int dequantise (int amplitude, int q)
+    {
+        return (amplitude * q) >> (SCALE_BITS-PRE_DESCALE_BITS);
+    };
+
+    static inline void idct (jfif_idct &engine, jpeg_8x8_block_t data)
+    {
+        engine.jpeg_idct(data);
+    };
+
+    // Reduced size (bs by bs, for bs of 4 or 2) iDCT, when decoding at
+    // 1/2 or 1/4 scale
+    static inline void idct_reduced (jfif_idct &engine, jpeg_8x8_block_t data, int bs)
+    {
+        if (bs == 4)
+            engine.jpeg_idct_4x4(data, true);
+        else
+            engine.jpeg_idct_2x2(data, true);
+    };
+};
+
+//-------------------------------------------------------------
+// Slow integer iDCT engine (JPEG_IDCT_SLOW_INT)
+
+class jfif_slow_int_idct_policy : public jfif_int_ycc_policy {
+
+public:
+
+    static inline int dqt_prescale (int q, int /* zdx */)
+    {
+        return q;
+    };
+
+    static inline int dequantise (int amplitude, int q)
+    {
+        return amplitude * q;
+    };
+
+    static inline void idct (jfif_idct &engine, jpeg_8x8_block_t data)
+    {
+        engine.jpeg_idct_slow(data);
+    };
+
+    // Reduced size (bs by bs, for bs of 4 or 2) iDCT, when decoding at
+    // 1/2 or 1/4 scale
+    static inline void idct_reduced (jfif_idct &engine, jpeg_8x8_block_t data, int bs)
+    {
+        if (bs == 4)
+            engine.jpeg_idct_4x4(data, false);
+        else
+            engine.jpeg_idct_2x2(data, false);
+    };
+};
+
+//-------------------------------------------------------------
+// Floating point iDCT engine (JPEG_IDCT_FLOAT), with single
+// precision floating point colour conversion
+
+class jfif_float_idct_policy {
+
+public:
+
+    static inline int dqt_prescale (int q, int /* zdx */)
+    {
+        return q;
+    };
+
+    static inline int dequantise (int amplitude, int q)
+    {
+        return amplitude * q;
+    };
+
+    static inline void idct (jfif_idct &engine, jpeg_8x8_block_t data)
+    {
+        engine.jpeg_idct_float(data);
+    };
+
+    // Reduced size (bs by bs, for bs of 4 or 2) iDCT, when decoding at
+    // 1/2 or 1/4 scale (there is no reduced float iDCT, so the integer
+    // kernels are used on the plain coefficients)
+    static inline void idct_reduced (jfif_idct &engine, jpeg_8x8_block_t data, int bs)
+    {
+        if (bs == 4)
+            engine.jpeg_idct_4x4(data, false);
+        else
+            engine.jpeg_idct_2x2(data, false);
+    };
+
+    static inline void ycc_to_rgb_row (const int16_t *Y, const int16_t *Cb, const int16_t *Cr,
+                                       uint8_t *r, uint8_t *g, uint8_t *b, int n)
+    {
+        for (int idx = 0; idx < n; idx++)
+        {
+            float y  = (float)Y[idx];
+            float cb = (float)(Cb[idx]-128);
+            float cr = (float)(Cr[idx]-128);
+
+            r[idx] = JPEG_CLIP((int)floorf(y + (float)JPEG_RGB_FLT_Kr1 * cr + 0.5f));
+            g[idx] = JPEG_CLIP((int)floorf(y - (float)JPEG_RGB_FLT_Kg1 * cb - (float)JPEG_RGB_FLT_Kg2 * cr + 0.5f));
+            b[idx] = JPEG_CLIP((int)floorf(y + (float)JPEG_RGB_FLT_Kb1 * cb + 0.5f));
+        }
+    };
+};
+
+#endif
@@ -43,22 +43,22 @@
 // JPEG_DEBUG_MODE:             Enables verbose debug output to
 //                              stdout during execution.
 //
-// JPEG_DCT_INTEGER:            Makes the iDCT one of two integer
-//                              based algorithms (see below). When
-//                              undefined, iDCT is floating point based.
-//
-// JPEG_FAST_INT_IDCT:          Compiles the fast (less accurate) integer
-//                              iDCT. JPEG_DCT_INTEGER is forced to be
-//                              defined if this is defined.
-//
 // JPEG_IGNORE_SOS_TAIL_ERRORS: Suppresses errors associated with
 //                              missing EOI markers.
 //
-// JPEG_LIMITED_SUB_SAMPLING:   Turns off support for vertical
-//                              sub-sampling.
+// JPEG_LIMITED_SUB_SAMPLING:   Turns off support for chroma
+//                              sub-sampling (4:4:4 only).
 //
 // JPEG_NO_WARNINGS:            Suppresses output of warnings
 //
+// JPEG_NO_SIMD:                Disables use of SSE/AVX intrinsics,
+//                              even when the target supports them.
+//
+// JPEG_HW_MODEL:               Instruments the fast integer iDCT
+//                              with the hardware pipeline model
+//                              (jfif_hwmodel.h). Used for the
+//                              jfif_hwmodel program only.
+//
 //=============================================================
 
 #ifndef _JFIF_LOCAL_H_
@@ -72,14 +72,30 @@
 
 #include "jfif.h"
 
-// Undefine before including jpeg_dct_cos.h to have
-// integer based DCT (or define in makefile)
-//#define JPEG_DCT_INTEGER
-
-// Use fast integer iDCT.
-//#define JPEG_FAST_INT_IDCT
+// Select the SIMD instruction set extensions from the compiler's target
+// (e.g. -mavx2 or -march=native in the makefile's ARCHOPTS). SSE2 is
+// always available on x86-64.
+#if !defined(JPEG_NO_SIMD)
+# if defined(__AVX2__)
+#  define JPEG_SIMD_AVX2
+# endif
+# if defined(__AVX__)
+#  define JPEG_SIMD_AVX
+# endif
+# if defined(__SSSE3__)
+#  define JPEG_SIMD_SSSE3
+# endif
+# if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define JPEG_SIMD_SSE2
+# endif
+# if defined(__F16C__)
+#  define JPEG_SIMD_F16C
+# endif
+#endif
 
-//#include "jpeg_dct_cos.h"
+#if defined(JPEG_SIMD_AVX) || defined(JPEG_SIMD_SSE2)
+#include <immintrin.h>
+#endif
 
 // Uncomment (or add to makefile) for compiling test code
 //#define JPEG_TEST_MODE
@@ -98,13 +114,8 @@
 // Uncomment (or add to makefile) to suppress warnings (not recommended)
 //#define JPEG_NO_WARNINGS
 
-// If JPEG_FAST_INT_IDCT defined, then ensure that JPEG_DCT_INTEGER
-// is also defined
-#ifdef  JPEG_FAST_INT_IDCT
-#ifndef JPEG_DCT_INTEGER
-#define JPEG_DCT_INTEGER
-#endif
-#endif
+// Uncomment (or add to makefile) to disable SSE/AVX code
+//#define JPEG_NO_SIMD
 
 #define JPEG_ZIGZAG_MAP   {         \
      0,  1,  5,  6, 14, 15, 27, 28, \
@@ -130,6 +141,7 @@
 
 #define JPEG_MAG_ADJUST_POS {0,  1,  2,  4,   8,  16,  32,   64,  128,  256,   512,  1024}
 #define JPEG_MAG_ADJUST_NEG {0, -1, -3, -7, -15, -31, -63, -127, -255, -511, -1023, -2047}
+#define JPEG_MAG_MAX_SIZE   11
 
 // Precomputed values scaled up by 14 bits, and inverse zigzagged
 #define JPEG_SCALING_INIT { \
@@ -147,7 +159,6 @@
 
 #define INPUT_FILENAME                  "test.jpg"
 #define OUTPUT_FILENAME                 "test.bmp"
-#define DEFAULT_BUFSIZE                 4096
 
 // JPEG segment definitions
 #define JPEG_MARKER_MASK                0xff00
@@ -231,9 +242,10 @@
 #define JPEG_DQT_TABLE_SIZE             (JPEG_DQT_ELEMENTS+1)
 #define JPEG_MCU_ELEMENTS               64
 #define JPEG_BLOCK_DIMENSION            8
-#define JPEG_MAX_MCU_BLOCKS             6
+#define JPEG_MAX_MCU_BLOCKS             10
 #define JPEG_MAX_QUANT_TABLES           4
 
+#define JPEG_SOF_CI_OFFSET              8
 #define JPEG_SOS_NS_OFFSET              2
 #define JPEG_SOS_CI_OFFSET              3
 #define JPEG_SOS_TAIL_SIZE              3
@@ -243,6 +255,7 @@
 #define JPEG_APP14_ADOBE_STR            "Adobe"
 #define JPEG_APP14_ADOBE_STR_LEN        5
 #define JPEG_APP14_COLOUR_SPACE_OFFSET  13
+#define JPEG_APP14_YCCK                 2
 
 #define JPEG_DQT_OFFSET                 2
 #define JPEG_DRI_OFFSET                 2
@@ -262,30 +275,51 @@
 
 #define JPEG_NUM_COLOUR_SCANS           3
 #define JPEG_NUM_RGB_COLOURS            3
+#define JPEG_NUM_CMYK_COLOURS           4
 
-#define JPEG_JFIF_STR                   "JFIF"
-#define JPEG_JFXX_STR                   "JFXX"
+// Neutral (zero colour difference) chroma value
+#define JPEG_CHROMA_NEUTRAL             128
 
-#ifdef JPEG_DCT_INTEGER
+// Maximum bytes per pixel of the packed pixel formats (JPEG_PIXFMT_xxx)
+#define JPEG_MAX_PIXEL_BYTES            4
 
-  #define JPEG_RGB_BITS                 10
-  #define JPEG_RGB_SCALE                (1 << JPEG_RGB_BITS)
-  #define JPEG_RGB_ROUND_MASK           (1 << (JPEG_RGB_BITS)-1)
-  #define JPEG_RGB_Kr1                  1436
-  #define JPEG_RGB_Kg1                  352
-  #define JPEG_RGB_Kg2                  731
-  #define JPEG_RGB_Kb1                  1815
+// Largest image dimension (of the frame header's 16 bit X and Y)
+#define JPEG_MAX_DIMENSION              65535
 
-#else
+// 8 bit grayscale bitmap palette entries (of 4 bytes), and row width padded to 32 bits
+#define JPEG_BMP_GRAY_LEVELS            256
+#define JPEG_BMP_GRAY_PALETTE_SIZE      (JPEG_BMP_GRAY_LEVELS*4)
+#define JPEG_BMP_GRAY_PADDED_BYTES(_x)  (((_x) + 3) & ~3)
 
-  #define JPEG_RGB_Kr1                  1.402
-  #define JPEG_RGB_Kg1                  0.34414
-  #define JPEG_RGB_Kg2                  0.71414
-  #define JPEG_RGB_Kb1                  1.772
+#define JPEG_JFIF_STR                   "JFIF"
+#define JPEG_JFXX_STR                   "JFXX"
 
-#endif
+// Shortest APP0 segment, of its length bytes and identifier
+#define JPEG_APP0_MIN_LENGTH            6
+
+// Fixed point colour conversion constants (integer iDCT engines)
+#define JPEG_RGB_BITS                   10
+#define JPEG_RGB_SCALE                  (1 << JPEG_RGB_BITS)
+#define JPEG_RGB_ROUND_MASK             (1 << (JPEG_RGB_BITS)-1)
+#define JPEG_RGB_ROUND                  (1 << (JPEG_RGB_BITS-1))
+#define JPEG_RGB_Kr1                    1436
+#define JPEG_RGB_Kg1                    352
+#define JPEG_RGB_Kg2                    731
+#define JPEG_RGB_Kb1                    1815
+
+// Fixed point RGB to luma constants (RGB coded data to gray)
+#define JPEG_GRAY_Kr                    306
+#define JPEG_GRAY_Kg                    601
+#define JPEG_GRAY_Kb                    117
+
+// Floating point colour conversion constants (floating point iDCT engine)
+#define JPEG_RGB_FLT_Kr1                1.402
+#define JPEG_RGB_FLT_Kg1                0.34414
+#define JPEG_RGB_FLT_Kg2                0.71414
+#define JPEG_RGB_FLT_Kb1                1.772
 
 #define JPEG_CLIP(_a)                   (((_a) < 0) ? 0 : ((_a) > 255) ? 255 : (_a))
+#define JPEG_CLIP16(_a)                 (((_a) < INT16_MIN) ? INT16_MIN : ((_a) > INT16_MAX) ? INT16_MAX : (_a))
 #define JPEG_ROUND(_a)                  ((int)floor((_a)+0.5))
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
@@ -430,14 +464,110 @@ typedef struct {
     int  amplitude;                             // unadjusted amplitude (if not EOB or ZRL)
 } rle_amplitude_t, *rle_amplitude_pt;
 
-typedef int (* jpeg_8x8_block_t)   [JPEG_BLOCK_DIMENSION];
-typedef int (* jpeg_nx8x8_block_t) [JPEG_BLOCK_DIMENSION]  [JPEG_BLOCK_DIMENSION];
-typedef int (* jpeg_rgb_block_t)   [JPEG_BLOCK_DIMENSION*2][JPEG_BLOCK_DIMENSION*2];
+// Coefficient blocks are 16 bit, from de-quantisation through to iDCT output
+typedef int16_t (* jpeg_8x8_block_t)   [JPEG_BLOCK_DIMENSION];
+typedef int16_t (* jpeg_nx8x8_block_t) [JPEG_BLOCK_DIMENSION]  [JPEG_BLOCK_DIMENSION];
+// Number of band buffer sets (double buffered for vertical triangle upsampling)
+#define JPEG_BAND_SETS                  2
 
-#ifdef JPEG_DCT_INTEGER
-typedef int    jpeg_dct_t;
-#else
-typedef double jpeg_dct_t;
-#endif
+// Padding either side of each band row, and above and below, for upsampling
+// edge context
+#define JPEG_BAND_PAD_COLS              8
+#define JPEG_BAND_PAD_ROWS              1
+
+// Dimension of d pixels when decoded with an iDCT block size of bs (8, 4, 2 or 1)
+#define JPEG_SCALED_DIM(_d, _bs)        (((_d)*(_bs) + JPEG_BLOCK_DIMENSION-1) / JPEG_BLOCK_DIMENSION)
+
+// Resampling weights are fixed point, with each output sample's weights summing to 1
+#define JPEG_RESIZE_BITS                14
+#define JPEG_RESIZE_ONE                 (1 << JPEG_RESIZE_BITS)
+
+// Weight of a fraction (num/den) of an output sample's coverage, rounded
+#define JPEG_RESIZE_WEIGHT(_num, _den)  ((int)((((int64_t)(_num) << JPEG_RESIZE_BITS) + (_den)/2) / (_den)))
+
+// Resampler state, when resizing on decode. Each output sample is the area
+// weighted average of the source samples it covers, resampled horizontally
+// as each source row is converted, and accumulated vertically until all the
+// source rows an output row covers have been seen.
+typedef struct {
+    int       in_w;                             // Source size (the output rectangle, at the iDCT scale)
+    int       in_h;
+    int       out_w;                            // Target size
+    int       out_h;
+    int       taps;                             // Source samples per output sample, horizontally
+    int      *x_start;                          // Each output sample's first source sample
+    int16_t  *x_weight;                         // and the weights of its taps
+    uint16_t *h_row[JPEG_NUM_RGB_COLOURS];      // Horizontally resampled row (8.8 fixed point)
+    uint32_t *acc[JPEG_NUM_RGB_COLOURS];        // Vertical accumulators of the output row
+    uint8_t  *out[JPEG_NUM_RGB_COLOURS];        // Completed output row
+    int       in_row;                           // Next source row
+    int       out_row;                          // Output row being accumulated
+} jpeg_resize_t;
+
+// An MCU row (band) of decoded component samples, and the row buffers
+// for upsampling and colour conversion. Component plane pointers are
+// to row 0, column 0, with ptr[-1] and ptr[-stride] valid context.
+typedef struct {
+    int      Hi;                                // Luma sampling factors (MCU is bs*Hi by bs*Vi pixels)
+    int      Vi;
+    int      bs;                                // Block size decoded (8, or 4, 2 or 1 when resizing)
+    int      Ns;                                // Number of components (1, 3, or 4 for CMYK/YCCK)
+    bool     is_RGB;                            // 3 component data is JPEG RGB data (4 component, CMYK not YCCK)
+    bool     k_luma;                            // 4 component K sampled as luma (else as chroma)
+    int      c_planes;                          // Number of chroma sampled components (0, 2, or 3 with chroma sampled K)
+    int      upsample_mode;                     // Chroma upsampling (JPEG_UPSAMPLE_xxx)
+    bool     delayed;                           // Band output delayed by one band for vertical context
+    int      X;                                 // Band width (from MCU mcu_x0) and image height, in pixels
+    int      Y;
+    int      c_width;                           // Chroma band width and image height, in samples
+    int      c_height;
+    int      y_stride;                          // Row strides of luma and chroma planes, in samples
+    int      c_stride;
+    int      set;                               // Current band buffer set
+    int      rows_out;                          // Number of output rows so far
+
+    // Range of MCUs decoded (covering the crop, plus upsampling context)
+    int      mcu_x0;
+    int      mcu_x1;
+    int      mcu_y0;
+    int      mcu_y1;
+
+    // Output rectangle, with X offset relative to band column 0, and Y in the image
+    // (at the decoded scale), and the output size (different only when resizing)
+    int      out_x;
+    int      out_y;
+    int      in_w;
+    int      in_h;
+    int      out_w;
+    int      out_h;
+    int      max_rows;                          // Most output rows from a band
+    jpeg_resize_t *rs;                          // Resampler, when resizing (else NULL)
+    int16_t *comp[JPEG_BAND_SETS][JPEG_SOS_MAX_NS];
+    int16_t *c_up[JPEG_SOS_MAX_NS-1];           // Upsampled chroma (and chroma sampled K) rows
+    uint8_t *rgb[JPEG_NUM_RGB_COLOURS];         // Colour converted rows
+    uint8_t *cmyk[JPEG_NUM_CMYK_COLOURS];       // C, M, Y and K rows of 4 component data (C, M, Y only for CMYK output)
+
+    // Output targets (NULL when not selected)
+    uint8_t *bmp_data;                          // Bitmap pixel data
+    uint8_t *raw;                               // Raw buffer (or band buffer, for a band sink)
+    int      pixel_format;                      // Raw and sink pixel format (JPEG_PIXFMT_xxx)
+    int      raw_stride;                        // Bytes between raw rows (luma rows for planar YUV)
+    int      raw_y0;                            // First output row, and number of rows, held in raw
+    int      raw_rows;
+    bool     need_rgb;                          // Targets need colour converted RGB rows
+    jpeg_row_sink_t sink;                       // Caller's row sink, and its context
+    void    *sink_ctx;
+    jpeg_band_sink_t band_sink;                 // Caller's band sink
+    jpeg_band_sink_t bmp_sink;                  // Caller's bitmap sink (bmp_data is then a band buffer)
+    int      bmp_y0;                            // First output row held in a bitmap band buffer
+    int      bmp_bits;                          // Bitmap bits per pixel (24, or 8 for grayscale)
+    int      bmp_stride;                        // Bytes between bitmap rows
+    uint8_t *tensor;                            // Tensor (JPEG_OUTPUT_TENSOR)
+    int      tensor_type;                       // Tensor element type and layout (JPEG_TENSOR_xxx)
+    int      tensor_layout;
+    const float *tensor_scale;                  // Tensor per channel normalisation
+    const float *tensor_offset;
+    uint8_t *row;                               // Row for the sink, when no raw buffer (or planar YUV)
+} jpeg_band_t;
 
 #endif
@@ -24,6 +24,22 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include "jfif.h"
 #include "jfif_local.h"
@@ -39,7 +55,8 @@
 // the JPEG routine to decode the data. Default input filename
 // is "test.jpg", but a -i option can be used to override this.
 // Output is to another file (test.bmp by default), configurable
-// with -o option.
+// with -o option. With -b, many input files are decoded, on a
+// pool of worker threads, to bitmaps in an output directory.
 //
 
 #ifdef WIN32
@@ -50,18 +67,865 @@ extern char *optarg;
 #include <getopt.h>
 #endif
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+// Input file data, either mapped or read into a buffer
+typedef struct {
+    uint8_t *data;
+    long     size;
+    int      mapped;
+} input_file_t;
+
+// -------------------------------------------------------------
+// Get the whole of an input file into memory. The file is mapped,
+// for sequential access, and decoded in place with no copying,
+// with the decoder's reads checked against the file's size (so a
+// truncated file is safe to map). If mapping isn't available, the
+// file is read with a single fstat() sized read. Returns a
+// JPEG_*_ERROR status.
+//
+static int read_input (const char *fname, input_file_t *in)
+{
+    struct stat st;
+    long        rlen, len;
+    int         fd;
+
+    in->data   = NULL;
+    in->mapped = 0;
+
+    if ((fd = open(fname, O_RDONLY | O_BINARY)) < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "ERROR: could not open %s for reading\n", fname);
+        return JPEG_FILE_ERROR;
+    }
+
+    if ((in->size = (long)st.st_size) == 0)
+    {
+        fprintf(stderr, "ERROR: %s is empty\n", fname);
+        close(fd);
+        return JPEG_FORMAT_ERROR;
+    }
+
+#ifndef WIN32
+    {
+        void *map = mmap(NULL, (size_t)in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map != MAP_FAILED)
+        {
+            madvise(map, (size_t)in->size, MADV_SEQUENTIAL);
+
+            in->data   = (uint8_t *)map;
+            in->mapped = 1;
+            close(fd);
+            return JPEG_NO_ERROR;
+        }
+    }
+#endif
+
+    if ((in->data = (uint8_t *)malloc(in->size)) == NULL)
+    {
+        fprintf(stderr, "ERROR: memory allocation failed\n");
+        close(fd);
+        return JPEG_MEMORY_ERROR;
+    }
+
+    // A read may return less than asked for, so carry on to the end of the file
+    for (len = 0; len < in->size; len += rlen)
+    {
+        if ((rlen = (long)read(fd, in->data + len, (size_t)(in->size - len))) <= 0)
+        {
+            if (rlen < 0 && errno == EINTR)
+            {
+                rlen = 0;
+                continue;
+            }
+
+            fprintf(stderr, "ERROR: failed reading from %s\n", fname);
+            free(in->data);
+            in->data = NULL;
+            close(fd);
+            return JPEG_FILE_ERROR;
+        }
+    }
+
+    close(fd);
+
+    return JPEG_NO_ERROR;
+}
+
+// -------------------------------------------------------------
+// Release an input file's data
+//
+static void release_input (input_file_t *in)
+{
+#ifndef WIN32
+    if (in->mapped)
+    {
+        munmap(in->data, (size_t)in->size);
+    }
+    else
+#endif
+    {
+        free(in->data);
+    }
+
+    in->data = NULL;
+}
+
+// Output file state, for the bitmap sink (and raw file)
+typedef struct {
+    int    fd;
+    long   offset;                              // File offset of the first (top) row
+    int    X;                                   // Row width in pixels
+    long   row_bytes;                           // Bytes per row, padded to 32 bits
+    int    seekable;                            // Regular file, written at offsets (else written in order)
+    long   pos;                                 // Bytes written so far, when not seekable
+    int    created;                             // Created by this run, so may be removed on an error
+    int    error;
+    long   bytes;                               // Bytes written, and the time taken, in seconds
+    double secs;
+} out_file_t;
+
+// -------------------------------------------------------------
+// Current time in seconds, for the timing output
+//
+static double time_now (void)
+{
+#ifdef WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// -------------------------------------------------------------
+// Write a block of data to a file at the given offset, without
+// using (or moving) the file position, so that blocks may be
+// written in any order, and from more than one thread, with no
+// locking. Returns non-zero on an error.
+//
+static int write_at (int fd, const uint8_t *data, size_t len, long offset)
+{
+    while (len > 0)
+    {
+#ifdef WIN32
+        // No pwrite(), so seek and write (from a single thread only)
+        long wlen = (_lseek(fd, offset, SEEK_SET) == offset) ? _write(fd, data, (unsigned)len) : -1;
+#else
+        long wlen = pwrite(fd, data, len, (off_t)offset);
+#endif
+        if (wlen < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (wlen <= 0)
+        {
+            return 1;
+        }
+
+        data   += wlen;
+        len    -= wlen;
+        offset += wlen;
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------
+// Write a block of data at a file's current position, for files
+// that can't be written at an offset (pipes and devices).
+// Returns non-zero on an error.
+//
+static int write_all (int fd, const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        long wlen = (long)write(fd, data, len);
+
+        if (wlen < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (wlen <= 0)
+        {
+            return 1;
+        }
+
+        data += wlen;
+        len  -= wlen;
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------
+// Open an output file for writing, noting whether it was created
+// by this run, and so may be removed on an error (an existing
+// file, device or link is never removed), and whether it's a
+// regular file, which is written at offsets, or not (a pipe or
+// device), which is written in order. Returns non-zero if the
+// file couldn't be opened.
+//
+static int open_output (const char *fname, out_file_t *out)
+{
+    struct stat st;
+
+    out->created = 1;
+
+    if ((out->fd = open(fname, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0666)) < 0 && errno == EEXIST)
+    {
+        out->created = 0;
+        out->fd      = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    }
+
+    if (out->fd < 0)
+    {
+        return 1;
+    }
+
+    out->error    = fstat(out->fd, &st) != 0;
+    out->seekable = !out->error && S_ISREG(st.st_mode);
+    out->pos      = 0;
+
+    return 0;
+}
+
+// -------------------------------------------------------------
+// Write a block of data to an output file at the given offset,
+// with a single write (unless interrupted), updating the file's
+// error state, and its byte count and time spent writing. A file
+// that isn't seekable must be given its blocks in order.
+//
+static void write_out (out_file_t *out, const uint8_t *data, size_t len, long offset)
+{
+    double start = time_now();
+
+    if (!out->error)
+    {
+        if (out->seekable)
+        {
+            out->error = write_at(out->fd, data, len, offset);
+        }
+        else
+        {
+            out->error = offset != out->pos || write_all(out->fd, data, len);
+            out->pos  += (long)len;
+        }
+    }
+
+    out->bytes += (long)len;
+    out->secs  += time_now() - start;
+}
+
+// -------------------------------------------------------------
+// Bitmap sink, writing each band of (top-down) bitmap rows to
+// its place in the output file, at an offset precomputed from
+// the band's first row and the padded row size. No band depends
+// on another having been written, so bands may be flushed in
+// any order to a regular file (and are written in order to any
+// other output).
+//
+static void write_bmp_band (void *sink_ctx, int y, int rows, const uint8_t *data, int stride, int X)
+{
+    out_file_t *bmp_file = (out_file_t *)sink_ctx;
+
+    // Rows not of the width the file was sized for are not written to it
+    if (X != bmp_file->X || stride != bmp_file->row_bytes)
+    {
+        bmp_file->error = 1;
+    }
+
+    write_out(bmp_file, data, (size_t)rows * stride, bmp_file->offset + y * bmp_file->row_bytes);
+}
+
+
+// Per image decode state, and results
+typedef struct {
+    input_file_t input;
+    out_file_t   bmp_file;                      // Bitmap output file (the decoder's bitmap sink context)
+    uint8_t     *databuf;                       // Raw output, when selected
+    int          X, Y;                          // Output image size
+    double       read_secs;                     // Read time, and decode time (less writing), in seconds
+    double       decode_secs;
+} image_t;
+
+// -------------------------------------------------------------
+// Decode a JFIF/JPEG file to a bitmap file, with a decoder whose
+// bitmap sink context is the image's bitmap file state. The
+// bitmap is streamed to the output file as it is decoded, and
+// removed on an error, if this run created it. Returns a
+// JPEG_*_ERROR status.
+//
+static int decode_file (jpeg_decoder_t *decoder, const jpeg_decode_opts_t *opts, const char *ifname, const char *ofname,
+                        image_t *img, int debug_enable)
+{
+    out_file_t *bmp_file = &img->bmp_file;
+    uint8_t     bmp_hdr[JPEG_BITMAP_MAX_HDR_SIZE];
+    int         status, components, bmp_bits;
+    long        hdr_size;
+    double      start;
+
+    // Only read for JPEG_DEBUG_MODE builds
+    (void)debug_enable;
+
+    memset(bmp_file, 0, sizeof(out_file_t));
+    img->databuf = NULL;
+
+    // Get the input file's data, mapped where possible
+    start = time_now();
+
+    if ((status = read_input(ifname, &img->input)) != JPEG_NO_ERROR)
+    {
+        return status;
+    }
+
+    img->read_secs = time_now() - start;
+
+#ifdef JPEG_DEBUG_MODE
+    if (debug_enable & JPEG_DEBUG_MAIN_EN)
+    {
+        printf("%s %ld bytes\n", img->input.mapped ? "Mapped" : "Read", img->input.size);
+    }
+#endif
+
+    // Output image size, from the header (or the crop, or resize)
+    if ((status = jpeg_decoder_output_size_c(decoder, img->input.data, img->input.size, &img->X, &img->Y, &components)))
+    {
+        release_input(&img->input);
+        return status;
+    }
+
+    // Top-down bitmap header, checking the bitmap's size fits it, before any output is created
+    bmp_bits            = (opts->bitmap_gray && components == 1) ? 8 : 24;
+
+    if ((hdr_size = jpeg_bitmap_header_c(bmp_hdr, img->X, img->Y, bmp_bits, true)) == 0)
+    {
+        release_input(&img->input);
+        return JPEG_UNSUPPORTED_ERROR;
+    }
+
+    // Open file for writing bitmap data
+    if (open_output(ofname, bmp_file))
+    {
+        fprintf(stderr, "ERROR: could not open %s for writing\n", ofname);
+        release_input(&img->input);
+        return JPEG_FILE_ERROR;
+    }
+
+#ifdef JPEG_DEBUG_MODE
+    if (debug_enable & JPEG_DEBUG_MAIN_EN)
+    {
+        printf("main(): writing data to output file\n");
+    }
+#endif
+
+    // Write the bitmap header, with each band of rows following at its own
+    // offset, as decoded
+    bmp_file->offset    = hdr_size;
+    bmp_file->X         = img->X;
+    bmp_file->row_bytes = (bmp_bits == 8) ? JPEG_BMP_GRAY_PADDED_BYTES(img->X) : BMP_WIDTH_TO_PADDED_BYTES(img->X);
+
+    write_out(bmp_file, bmp_hdr, hdr_size, 0);
+
+#ifndef WIN32
+    // Size a regular file up front, so bands written out of order don't each extend it
+    if (bmp_file->seekable && !bmp_file->error)
+    {
+        bmp_file->error = ftruncate(bmp_file->fd, (off_t)(hdr_size + bmp_file->row_bytes * img->Y)) != 0;
+    }
+#endif
+
+    // Decode jpeg input buffer, writing the bitmap, and returning any raw data location into databuf.
+    // The bitmap is written as it is decoded, so the write time is taken out of the decode time.
+    start            = time_now();
+    status           = jpeg_decoder_process_c(decoder, img->input.data, img->input.size, NULL, &img->databuf);
+    img->decode_secs = time_now() - start - bmp_file->secs;
+
+    // Input data is finished with
+    release_input(&img->input);
+
+    // Ensure data is written to disk before any display window
+    if (close(bmp_file->fd) || bmp_file->error)
+    {
+        fprintf(stderr, "ERROR: failed writing to %s\n", ofname);
+        status = status ? status : JPEG_FILE_ERROR;
+    }
+
+    // No partial bitmap left on an error, where this run created it
+    if (status && bmp_file->created)
+    {
+        remove(ofname);
+    }
+
+    return status;
+}
+
+// Growable list of input file names
+typedef struct {
+    char **names;
+    int    n;
+    int    size;
+} file_list_t;
+
+// -------------------------------------------------------------
+// Add a copy of a file name to a list. Returns a JPEG_*_ERROR
+// status.
+//
+static int add_file (file_list_t *list, const char *name)
+{
+    if (list->n == list->size)
+    {
+        int    size  = list->size ? list->size * 2 : 64;
+        char **names = (char **)realloc(list->names, size * sizeof(char *));
+
+        if (names == NULL)
+        {
+            fprintf(stderr, "ERROR: memory allocation failed\n");
+            return JPEG_MEMORY_ERROR;
+        }
+
+        list->names = names;
+        list->size  = size;
+    }
+
+    if ((list->names[list->n] = (char *)malloc(strlen(name) + 1)) == NULL)
+    {
+        fprintf(stderr, "ERROR: memory allocation failed\n");
+        return JPEG_MEMORY_ERROR;
+    }
+
+    strcpy(list->names[list->n++], name);
+
+    return JPEG_NO_ERROR;
+}
+
+// -------------------------------------------------------------
+// True if a file name has a JPEG extension (.jpg, .jpeg or
+// .jfif, in any case)
+//
+static int is_jpeg_name (const char *name)
+{
+    static const char *exts[] = {".jpg", ".jpeg", ".jfif"};
+    const char        *ext    = strrchr(name, '.');
+
+    for (int edx = 0; ext != NULL && edx < (int)(sizeof(exts) / sizeof(exts[0])); edx++)
+    {
+        int cdx;
+
+        for (cdx = 0; ext[cdx] && tolower((unsigned char)ext[cdx]) == exts[edx][cdx]; cdx++)
+            ;
+
+        if (ext[cdx] == 0 && exts[edx][cdx] == 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int compare_names (const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// -------------------------------------------------------------
+// Add batch input files to a list, from a command line argument.
+// This is a file, a directory (for all its JPEG files, in name
+// order) or, when starting with @, a manifest file listing one
+// input file per line (with blank lines, and lines starting #,
+// ignored). Returns a JPEG_*_ERROR status.
+//
+static int add_inputs (file_list_t *list, const char *arg)
+{
+    struct stat st;
+    int         status = JPEG_NO_ERROR;
+
+    if (arg[0] == '@')
+    {
+        FILE *fp;
+        char  line[4096];
+
+        if ((fp = fopen(arg + 1, "r")) == NULL)
+        {
+            fprintf(stderr, "ERROR: could not open manifest %s for reading\n", arg + 1);
+            return JPEG_FILE_ERROR;
+        }
+
+        while (status == JPEG_NO_ERROR && fgets(line, sizeof(line), fp) != NULL)
+        {
+            size_t len = strlen(line);
+
+            while (len > 0 && isspace((unsigned char)line[len - 1]))
+            {
+                line[--len] = 0;
+            }
+
+            if (len > 0 && line[0] != '#')
+            {
+                status = add_file(list, line);
+            }
+        }
+
+        fclose(fp);
+    }
+    else if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        DIR           *dir;
+        struct dirent *entry;
+        int            first = list->n;
+        char           path[4096];
+
+        if ((dir = opendir(arg)) == NULL)
+        {
+            fprintf(stderr, "ERROR: could not open directory %s\n", arg);
+            return JPEG_FILE_ERROR;
+        }
+
+        while (status == JPEG_NO_ERROR && (entry = readdir(dir)) != NULL)
+        {
+            if (is_jpeg_name(entry->d_name) && snprintf(path, sizeof(path), "%s/%s", arg, entry->d_name) < (int)sizeof(path))
+            {
+                status = add_file(list, path);
+            }
+        }
+
+        closedir(dir);
+
+        qsort(list->names + first, list->n - first, sizeof(char *), compare_names);
+    }
+    else
+    {
+        status = add_file(list, arg);
+    }
+
+    return status;
+}
+
+// -------------------------------------------------------------
+// Batch output file name for an input file, from a template, with
+// %s replaced by the input's base name (without its directory or
+// extension), or else a directory, for the base name with a .bmp
+// extension. Returns an allocated name, or NULL on an error.
+//
+static char *output_name (const char *out, const char *ifname)
+{
+    const char *base  = ifname;
+    const char *subst = strstr(out, "%s");
+    const char *ext;
+    char       *name;
+    int         base_len;
+
+    for (const char *cptr = ifname; *cptr; cptr++)
+    {
+        if (*cptr == '/' || *cptr == '\\')
+        {
+            base = cptr + 1;
+        }
+    }
+
+    ext      = strrchr(base, '.');
+    base_len = (ext != NULL && ext != base) ? (int)(ext - base) : (int)strlen(base);
+
+    // Room for the base name, with a separator and .bmp extension
+    if ((name = (char *)malloc(strlen(out) + base_len + 6)) != NULL)
+    {
+        if (subst != NULL)
+        {
+            sprintf(name, "%.*s%.*s%s", (int)(subst - out), out, base_len, base, subst + 2);
+        }
+        else
+        {
+            sprintf(name, "%s/%.*s.bmp", out, base_len, base);
+        }
+    }
+
+    return name;
+}
+
+// -------------------------------------------------------------
+// Free an allocated array of allocated names (any of which may be
+// NULL)
+//
+static void free_names (char **names, int n)
+{
+    if (names != NULL)
+    {
+        for (int idx = 0; idx < n; idx++)
+        {
+            free(names[idx]);
+        }
+    }
+
+    free(names);
+}
+
+// -------------------------------------------------------------
+// Get the batch output file name of each input file, checking no
+// two inputs (such as files of the same name in different
+// directories) would be decoded to the same output, and that no
+// output overwrites its input. On success, outs is an allocated
+// array of allocated names, to be freed with free_names().
+// Returns a JPEG_*_ERROR status.
+//
+static int output_names (const char *out, char **files, int n, char ***outs)
+{
+    char **sorted;
+    int    status = JPEG_NO_ERROR;
+
+    if ((*outs = (char **)calloc(n, sizeof(char *))) == NULL || (sorted = (char **)malloc(n * sizeof(char *))) == NULL)
+    {
+        fprintf(stderr, "ERROR: memory allocation failed\n");
+        free(*outs);
+        return JPEG_MEMORY_ERROR;
+    }
+
+    for (int idx = 0; idx < n && status == JPEG_NO_ERROR; idx++)
+    {
+        if (((*outs)[idx] = output_name(out, files[idx])) == NULL)
+        {
+            fprintf(stderr, "ERROR: memory allocation failed\n");
+            status = JPEG_MEMORY_ERROR;
+        }
+        else if (!strcmp((*outs)[idx], files[idx]))
+        {
+            fprintf(stderr, "ERROR: input and output filenames identical (%s)\n", files[idx]);
+            status = JPEG_USER_INPUT_ERROR;
+        }
+
+        sorted[idx] = (*outs)[idx];
+    }
+
+    // Any duplicates are adjacent once sorted
+    if (status == JPEG_NO_ERROR)
+    {
+        qsort(sorted, n, sizeof(char *), compare_names);
+
+        for (int idx = 1; idx < n && status == JPEG_NO_ERROR; idx++)
+        {
+            if (!strcmp(sorted[idx-1], sorted[idx]))
+            {
+                int first = -1;
+
+                for (int jdx = 0; jdx < n; jdx++)
+                {
+                    if (!strcmp((*outs)[jdx], sorted[idx]))
+                    {
+                        if (first < 0)
+                        {
+                            first = jdx;
+                        }
+                        else
+                        {
+                            fprintf(stderr, "ERROR: %s and %s would both be decoded to %s\n", files[first], files[jdx], sorted[idx]);
+                            break;
+                        }
+                    }
+                }
+
+                status = JPEG_USER_INPUT_ERROR;
+            }
+        }
+    }
+
+    free(sorted);
+
+    if (status != JPEG_NO_ERROR)
+    {
+        free_names(*outs, n);
+        *outs = NULL;
+    }
+
+    return status;
+}
+
+// Batch of input files, decoded by a pool of worker threads
+typedef struct {
+    char                    **files;            // Input files, and their output files, and their number
+    char                    **outs;
+    int                       n;
+    const jpeg_decode_opts_t *opts;             // Decode options (for every file)
+    int                       debug_enable;
+    pthread_mutex_t           lock;             // Guards next
+    int                       next;             // Next file to be taken by a worker
+} batch_t;
+
+// Batch worker thread state, and its totals
+typedef struct {
+    batch_t  *batch;
+    pthread_t thread;
+    int       status;                           // First failing file's status
+    int       images;                           // Files decoded, and their input and output bytes
+    long      in_bytes;
+    long      out_bytes;
+} batch_worker_t;
+
+// -------------------------------------------------------------
+// Batch worker thread, decoding files of a batch, taking the
+// next file not yet started until none are left. The worker's
+// decoder is set up once, and reused for each file.
+//
+static void *batch_worker (void *arg)
+{
+    batch_worker_t    *worker = (batch_worker_t *)arg;
+    batch_t           *batch  = worker->batch;
+    jpeg_decode_opts_t opts   = *batch->opts;
+    jpeg_decoder_t    *decoder;
+    image_t            img;
+    int                idx, status;
+
+    // The decoder's bitmap sink writes to this worker's current file
+    opts.sink_ctx = &img.bmp_file;
+
+    if ((worker->status = jpeg_decoder_create_c(&decoder, &opts, batch->debug_enable)) != JPEG_NO_ERROR)
+    {
+        return NULL;
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->lock);
+        idx = batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+
+        if (idx >= batch->n)
+        {
+            break;
+        }
+
+        status = decode_file(decoder, &opts, batch->files[idx], batch->outs[idx], &img, batch->debug_enable);
+
+        if (status == JPEG_NO_ERROR)
+        {
+            worker->images++;
+            worker->in_bytes  += img.input.size;
+            worker->out_bytes += img.bmp_file.bytes;
+        }
+        else
+        {
+            fprintf(stderr, "ERROR: failed to decode %s (status %d)\n", batch->files[idx], status);
+            worker->status = worker->status ? worker->status : status;
+        }
+    }
+
+    jpeg_decoder_free_c(decoder);
+
+    return NULL;
+}
+
+// -------------------------------------------------------------
+// Decode a batch of files to bitmaps, on a pool of worker threads
+// (the calling thread being one of them), printing the aggregate
+// images/s and MB/s read and written at the end. Returns the
+// first failing file's status, or JPEG_NO_ERROR.
+//
+static int decode_batch (file_list_t *list, const char *out, const jpeg_decode_opts_t *opts, int threads, int debug_enable)
+{
+    batch_t         batch;
+    batch_worker_t *workers;
+    int             images = 0, status = JPEG_NO_ERROR;
+    long            in_bytes = 0, out_bytes = 0;
+    double          start, secs;
+
+    // One worker per core by default, but no more than there are files
+    if (threads <= 0)
+    {
+#ifdef WIN32
+        const char *cores = getenv("NUMBER_OF_PROCESSORS");
+
+        threads = (cores != NULL) ? atoi(cores) : 1;
+#else
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    }
+
+    threads = (threads > list->n) ? list->n : threads;
+    threads = (threads < 1) ? 1 : threads;
+
+    // Every output is named before any is written, to catch clashes
+    if ((status = output_names(out, list->names, list->n, &batch.outs)))
+    {
+        return status;
+    }
+
+    if ((workers = (batch_worker_t *)calloc(threads, sizeof(batch_worker_t))) == NULL)
+    {
+        fprintf(stderr, "ERROR: memory allocation failed\n");
+        free_names(batch.outs, list->n);
+        return JPEG_MEMORY_ERROR;
+    }
+
+    batch.files        = list->names;
+    batch.n            = list->n;
+    batch.opts         = opts;
+    batch.debug_enable = debug_enable;
+    batch.next         = 0;
+    pthread_mutex_init(&batch.lock, NULL);
+
+    start = time_now();
+
+    for (int tdx = 0; tdx < threads; tdx++)
+    {
+        workers[tdx].batch = &batch;
+
+        // Carry on with fewer workers if a thread can't be started
+        if (tdx > 0 && pthread_create(&workers[tdx].thread, NULL, batch_worker, &workers[tdx]) != 0)
+        {
+            threads = tdx;
+        }
+    }
+
+    batch_worker(&workers[0]);
+
+    for (int tdx = 0; tdx < threads; tdx++)
+    {
+        if (tdx > 0)
+        {
+            pthread_join(workers[tdx].thread, NULL);
+        }
+
+        images    += workers[tdx].images;
+        in_bytes  += workers[tdx].in_bytes;
+        out_bytes += workers[tdx].out_bytes;
+        status     = status ? status : workers[tdx].status;
+    }
+
+    secs = time_now() - start;
+
+    pthread_mutex_destroy(&batch.lock);
+    free_names(batch.outs, list->n);
+    free(workers);
+
+    printf("Decoded %d of %d images, with %d worker%s, in %.3f s\n", images, list->n, threads, (threads > 1) ? "s" : "", secs);
+    printf("%.1f images/s, %.1f MB/s read, %.1f MB/s written\n", (secs > 0) ? images / secs : 0.0,
+           (secs > 0) ? in_bytes / secs / 1e6 : 0.0, (secs > 0) ? out_bytes / secs / 1e6 : 0.0);
+
+    return status;
+}
+
 
 int main (int argc, char **argv)
 {
-    FILE     *ifp, *ofp;
-    char*    ibuf;
-    uint8_t* obuf;
-    uint8_t* databuf;
-    int      c, current_bufsize = 4096, idx, status, fsize, bytewidth, height;
-    char*    ifname = INPUT_FILENAME;
-    char*    ofname = OUTPUT_FILENAME;
-    bmhdr_t* bmp_hdr;
+    jpeg_decoder_t *decoder = NULL;
+    image_t  img;
+    int      status;
+    char*    ifname = NULL;
+    char*    ofname = NULL;
+    char*    rfname = NULL;
+    out_file_t raw_file = {0};
+    int      timing = 0;
+    int      batch = 0;
+    int      threads = 0;
     int      debug_enable = 0;
+    jpeg_decode_opts_t opts;
 
 #ifndef JPEG_NO_GRAPHICS
     int      display_RGB = FALSE;
@@ -70,13 +934,16 @@ int main (int argc, char **argv)
     // Link to getopts
 
     int  option;
-    char option_str[20];
+    char option_str[32];
+
+    // Default decode options
+    jpeg_default_opts_c(&opts);
 
     // Process the command line options
 #ifdef JPEG_NO_GRAPHICS
-    sprintf(option_str, "%s", "hi:o:D:");
+    sprintf(option_str, "%s", "hbgti:o:m:u:f:r:c:s:j:D:");
 #else
-    sprintf(option_str, "%s", "hdi:o:D:");
+    sprintf(option_str, "%s", "hdbgti:o:m:u:f:r:c:s:j:D:");
 #endif
     while ((option = getopt(argc, argv, option_str)) != EOF)
     {
@@ -89,6 +956,124 @@ int main (int argc, char **argv)
         case 'o':
             ofname = optarg;
             break;
+
+        case 'm':
+            if (!strcmp(optarg, "fast"))
+            {
+                opts.idct_mode = JPEG_IDCT_FAST_INT;
+            }
+            else if (!strcmp(optarg, "slow"))
+            {
+                opts.idct_mode = JPEG_IDCT_SLOW_INT;
+            }
+            else if (!strcmp(optarg, "float"))
+            {
+                opts.idct_mode = JPEG_IDCT_FLOAT;
+            }
+            else
+            {
+                fprintf(stderr, "ERROR: unrecognised iDCT mode \"%s\" (fast, slow or float)\n", optarg);
+                return JPEG_USER_INPUT_ERROR;
+            }
+            break;
+
+        case 'u':
+            if (!strcmp(optarg, "nearest"))
+            {
+                opts.upsample_mode = JPEG_UPSAMPLE_NEAREST;
+            }
+            else if (!strcmp(optarg, "triangle"))
+            {
+                opts.upsample_mode = JPEG_UPSAMPLE_TRIANGLE;
+            }
+            else
+            {
+                fprintf(stderr, "ERROR: unrecognised upsampling mode \"%s\" (nearest or triangle)\n", optarg);
+                return JPEG_USER_INPUT_ERROR;
+            }
+            break;
+
+        case 'f':
+            if (!strcmp(optarg, "rgb24"))
+            {
+                opts.pixel_format = JPEG_PIXFMT_RGB24;
+            }
+            else if (!strcmp(optarg, "rgba"))
+            {
+                opts.pixel_format = JPEG_PIXFMT_RGBA32;
+            }
+            else if (!strcmp(optarg, "bgra"))
+            {
+                opts.pixel_format = JPEG_PIXFMT_BGRA32;
+            }
+            else if (!strcmp(optarg, "rgb565"))
+            {
+                opts.pixel_format = JPEG_PIXFMT_RGB565;
+            }
+            else if (!strcmp(optarg, "gray"))
+            {
+                opts.pixel_format = JPEG_PIXFMT_GRAY8;
+            }
+            else if (!strcmp(optarg, "i420"))
+            {
+                opts.pixel_format = JPEG_PIXFMT_I420;
+            }
+            else if (!strcmp(optarg, "nv12"))
+            {
+                opts.pixel_format = JPEG_PIXFMT_NV12;
+            }
+            else if (!strcmp(optarg, "cmyk"))
+            {
+                opts.pixel_format = JPEG_PIXFMT_CMYK;
+            }
+            else
+            {
+                fprintf(stderr, "ERROR: unrecognised pixel format \"%s\" (rgb24, rgba, bgra, rgb565, gray, i420, nv12 or cmyk)\n", optarg);
+                return JPEG_USER_INPUT_ERROR;
+            }
+            break;
+
+        case 'r':
+            rfname = optarg;
+            break;
+
+        case 'g':
+            opts.bitmap_gray = true;
+            break;
+
+        case 't':
+            timing = 1;
+            break;
+
+        case 'b':
+            batch = 1;
+            break;
+
+        case 'j':
+            if (sscanf(optarg, "%d", &threads) != 1 || threads < 0)
+            {
+                fprintf(stderr, "ERROR: bad number of worker threads \"%s\"\n", optarg);
+                return JPEG_USER_INPUT_ERROR;
+            }
+            break;
+
+        case 'c':
+            if (sscanf(optarg, "%d,%d,%d,%d", &opts.crop_x, &opts.crop_y, &opts.crop_width, &opts.crop_height) != 4 ||
+                opts.crop_width <= 0 || opts.crop_height <= 0)
+            {
+                fprintf(stderr, "ERROR: bad crop \"%s\" (x,y,width,height)\n", optarg);
+                return JPEG_USER_INPUT_ERROR;
+            }
+            break;
+
+        case 's':
+            if (sscanf(optarg, "%dx%d", &opts.resize_width, &opts.resize_height) != 2 ||
+                opts.resize_width < 0 || opts.resize_height < 0 || (opts.resize_width | opts.resize_height) == 0)
+            {
+                fprintf(stderr, "ERROR: bad size \"%s\" (widthxheight, 0 to keep aspect ratio)\n", optarg);
+                return JPEG_USER_INPUT_ERROR;
+            }
+            break;
 #ifndef JPEG_NO_GRAPHICS
         case 'd':
             display_RGB = TRUE;
@@ -103,7 +1088,9 @@ int main (int argc, char **argv)
 
         case 'h':
         case '?':
-            fprintf(stderr, "Usage: jfif [-h] [-i <filename>] [-o <filename>]"
+            fprintf(stderr, "Usage: jfif [-h] [-i <filename>] [-o <filename>] [-m fast|slow|float] [-u nearest|triangle]"
+                            " [-f <format>] [-r <filename>] [-c x,y,w,h] [-s wxh] [-g] [-t]"
+                            " [-b [-j <threads>] [<input> ...]]"
 #ifndef JPEG_NO_GRAPHICS
                                              " [-d]"
 #endif
@@ -117,7 +1104,19 @@ int main (int argc, char **argv)
                             "    -d display generated bitmap file's image in a window\n"
 #endif
                             "    -i define input filename (default test.jpg)\n"
-                            "    -o define output filename (default test.bmp)\n"
+                            "    -o define output filename (default test.bmp), or with -b an output directory,\n"
+                            "       or a name template with %%s for each input's base name (default .)\n"
+                            "    -m select iDCT engine: fast, slow or float (default fast)\n"
+                            "    -u select chroma upsampling: nearest or triangle (default nearest)\n"
+                            "    -f select raw output pixel format: rgb24, rgba, bgra, rgb565, gray, i420, nv12 or cmyk (default rgb24)\n"
+                            "    -r define raw output filename (default none)\n"
+                            "    -c decode only a crop rectangle of the image (default whole image)\n"
+                            "    -s resize the image (or crop) on decode, 0 for either keeping aspect ratio (default none)\n"
+                            "    -g write monochrome images as 8 bit grayscale bitmaps (default 24 bit)\n"
+                            "    -t print read, decode and write times, and write throughput\n"
+                            "    -b batch decode the inputs (files, directories of .jpg files, or @manifest files\n"
+                            "       listing one file per line) following the options, and any -i file, to bitmaps\n"
+                            "    -j number of batch worker threads (default one per core)\n"
 #ifdef JPEG_DEBUG_MODE
                             "    -D specify debug enable value  (default off)\n"
 #endif
@@ -128,94 +1127,141 @@ int main (int argc, char **argv)
         }
     }
 
-    // Check user input validity
-    if ((status = strcmp(ifname, ofname)) == 0)
-    {
-        fprintf(stderr, "ERROR: input and output filenames identical\n");
-        return JPEG_USER_INPUT_ERROR;
-    }
-
-    // Open file input file for reading
-    if ((ifp = fopen(ifname, "rb")) == NULL)
+    // The bitmap is streamed to the output file, a band at a time, as it is
+    // decoded, so the raw buffer is only needed if writing the raw data, or
+    // displaying from it
+    opts.output_flags = JPEG_OUTPUT_BMP_BAND | ((rfname != NULL) ? JPEG_OUTPUT_RAW : 0);
+    opts.bmp_sink     = write_bmp_band;
+    opts.sink_ctx     = &img.bmp_file;
+#if !defined(JPEG_NO_GRAPHICS) && !defined(JPEG_DISPLAY_BMP)
+    if (display_RGB)
     {
-        fprintf(stderr, "ERROR: could not open %s for reading\n", ifname);
-        return JPEG_FILE_ERROR;
+        opts.output_flags |= JPEG_OUTPUT_RAW;
     }
+#endif
 
-    // Create a buffer for input data
-    if ((ibuf =(char *) malloc(current_bufsize)) == NULL)
+    // Batch mode decodes all the inputs to bitmaps, with each bitmap's name
+    // from the output directory or template
+    if (batch)
     {
-        fprintf(stderr, "ERROR: memory allocation failed\n");
-        return JPEG_MEMORY_ERROR;
-    }
+        file_list_t list = {NULL, 0, 0};
 
-    // Read data from file into a buffer
-    idx = 0;
-    while((c = getc(ifp)) != EOF)
-    {
-        ibuf[idx++] = c;
+        if (rfname != NULL || timing
+#ifndef JPEG_NO_GRAPHICS
+            || display_RGB
+#endif
+           )
+        {
+            fprintf(stderr, "ERROR: -r, -t and -d not supported with -b\n");
+            return JPEG_USER_INPUT_ERROR;
+        }
 
-        if (idx == current_bufsize)
+        if (ifname != NULL && (status = add_inputs(&list, ifname)))
         {
-            current_bufsize += DEFAULT_BUFSIZE;
+            return status;
+        }
 
-            if ((ibuf = (char *)realloc(ibuf, current_bufsize)) == NULL)
+        for (int adx = optind; adx < argc; adx++)
+        {
+            if ((status = add_inputs(&list, argv[adx])))
             {
-                fprintf(stderr, "ERROR: memory re-allocation failed\n");
-                return JPEG_MEMORY_ERROR;
+                return status;
             }
         }
+
+        if (list.n == 0)
+        {
+            fprintf(stderr, "ERROR: no input files for batch decode\n");
+            return JPEG_USER_INPUT_ERROR;
+        }
+
+        status = decode_batch(&list, (ofname != NULL) ? ofname : ".", &opts, threads, debug_enable);
+
+        for (int idx = 0; idx < list.n; idx++)
+        {
+            free(list.names[idx]);
+        }
+
+        free(list.names);
+
+        return status;
     }
 
-    // Input file is finished with
-    fclose(ifp);
+    ifname = (ifname != NULL) ? ifname : INPUT_FILENAME;
+    ofname = (ofname != NULL) ? ofname : OUTPUT_FILENAME;
 
-#ifdef JPEG_DEBUG_MODE
-    if (debug_enable & JPEG_DEBUG_MAIN_EN)
+    // Check user input validity
+    if ((status = strcmp(ifname, ofname)) == 0)
     {
-        printf("Read %d bytes\n", idx);
+        fprintf(stderr, "ERROR: input and output filenames identical\n");
+        return JPEG_USER_INPUT_ERROR;
     }
-#endif
 
-    // Decode jpeg input buffer, and return bitmap data location into obuf
-    if (status = jpeg_process_jfif_c((uint8_t *)ibuf, &obuf, &databuf, debug_enable))
+    if (rfname != NULL && (!strcmp(ifname, rfname) || !strcmp(ofname, rfname)))
     {
-        return status;
+        fprintf(stderr, "ERROR: raw output filename same as input or output\n");
+        return JPEG_USER_INPUT_ERROR;
     }
 
-    // Map bitmap header over data buffer (to extract info)
-    bmp_hdr    = (bmhdr_t *)obuf;
-
-    // Extract total number of bytes in bitmap
-    fsize      = BMP_SWPEND32(bmp_hdr->f.bfSize);
+#if !defined(JPEG_NO_GRAPHICS) && !defined(JPEG_DISPLAY_BMP)
+    // Display is from the raw buffer, so must be RGB
+    if (display_RGB && opts.pixel_format != JPEG_PIXFMT_RGB24)
+    {
+        fprintf(stderr, "ERROR: -d only supported with rgb24 pixel format\n");
+        return JPEG_USER_INPUT_ERROR;
+    }
+#endif
 
-    // Width in bytes, padded to 32-bit boundary
-    bytewidth  = BMP_WIDTH_TO_PADDED_BYTES(BMP_SWPEND32(bmp_hdr->i.biWidth));
-    height     = BMP_SWPEND32(bmp_hdr->i.biHeight);
+    // Decode the input file to the bitmap file, and any raw data into databuf
+    img.databuf = NULL;
 
-    // Open file for writing bitmap data
-    if ((ofp = fopen(ofname, "wb")) == NULL)
+    if ((status = jpeg_decoder_create_c(&decoder, &opts, debug_enable)) ||
+        (status = decode_file(decoder, &opts, ifname, ofname, &img, debug_enable)))
     {
-        fprintf(stderr, "ERROR: could not open %s for writing\n", ofname);
-        return(JPEG_FILE_ERROR);
+        jpeg_free_c(img.databuf);
+        jpeg_decoder_free_c(decoder);
+        return status;
     }
 
-#ifdef JPEG_DEBUG_MODE
-    if (debug_enable & JPEG_DEBUG_MAIN_EN)
+    // Write raw data in the selected pixel format, if requested, in one write
+    if (rfname != NULL)
     {
-        printf("main(): writing data to output file\n");
+        if (open_output(rfname, &raw_file))
+        {
+            fprintf(stderr, "ERROR: could not open %s for writing\n", rfname);
+            jpeg_free_c(img.databuf);
+            jpeg_decoder_free_c(decoder);
+            return(JPEG_FILE_ERROR);
+        }
+
+        // Written from the start, in order, with write(), so any output (such as a pipe) will do
+        raw_file.seekable = 0;
+
+        write_out(&raw_file, img.databuf, jpeg_raw_size_c(opts.pixel_format, img.X, img.Y), 0);
+
+        if (close(raw_file.fd) || raw_file.error)
+        {
+            fprintf(stderr, "ERROR: failed writing to %s\n", rfname);
+            if (raw_file.created)
+            {
+                remove(rfname);
+            }
+            jpeg_free_c(img.databuf);
+            jpeg_decoder_free_c(decoder);
+            return JPEG_FILE_ERROR;
+        }
     }
-#endif
 
-    // write bitmap to file
-    for (idx = 0; idx < fsize; idx++)
+    if (timing)
     {
-        fputc(obuf[idx], ofp);
-    }
+        double write_secs  = img.bmp_file.secs + raw_file.secs;
+        long   write_bytes = img.bmp_file.bytes + raw_file.bytes;
 
-    // Ensure data is written to disk before any display window
-    fflush(ofp);
-    fclose(ofp);
+        printf("Read   %ld bytes (%s) in %.3f ms\n", img.input.size, img.input.mapped ? "mapped" : "read", img.read_secs * 1e3);
+        printf("Decode %dx%d in %.3f ms\n", img.X, img.Y, img.decode_secs * 1e3);
+        printf("Write  %ld bytes in %.3f ms (%.1f MB/s)\n", write_bytes, write_secs * 1e3,
+               (write_secs > 0) ? write_bytes / write_secs / 1e6 : 0.0);
+    }
 
 #ifndef JPEG_NO_GRAPHICS
 
@@ -223,13 +1269,16 @@ int main (int argc, char **argv)
     if (display_RGB)
     {
 # ifdef JPEG_DISPLAY_BMP
-        jpeg_display_bmp_file (argc, argv, (unsigned char*)ofname, BMP_SWPEND32(bmp_hdr->i.biWidth), BMP_SWPEND32(bmp_hdr->i.biHeight));
+        jpeg_display_bmp_file (argc, argv, (unsigned char*)ofname, img.X, img.Y);
 # else
-        jpeg_display_img_data (argc, argv, databuf, BMP_SWPEND32(bmp_hdr->i.biWidth), BMP_SWPEND32(bmp_hdr->i.biHeight));
+        jpeg_display_img_data (argc, argv, img.databuf, img.X, img.Y);
 # endif
     }
 #endif
 
+    jpeg_free_c(img.databuf);
+    jpeg_decoder_free_c(decoder);
+
     // Completed successfully
     return JPEG_NO_ERROR;
 }
@@ -0,0 +1,480 @@
+//=============================================================
+//
+// Copyright (c) 2026 Simon Southwell
+// All rights reserved.
+//
+// Date: 18th October 2026
+//
+// This file is part of JFIF.
+//
+// JFIF is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// JFIF is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JFIF. If not, see <http://www.gnu.org/licenses/>.
+//
+//=============================================================
+//
+// Incremental decoding of an image as its data arrives, in
+// chunks pushed by the caller (e.g. as read from a socket or
+// pipe). The decode runs on its own thread, from the first
+// chunk, and suspends whenever it runs out of data, resuming
+// with its state intact when the next chunk is pushed, so that
+// decoding overlaps the transfer. Rows are output to any sinks
+// as they complete. The data is gathered in a buffer of the
+// largest input size expected, allocated up front, so the
+// decoder's pointers into it stay valid as it fills.
+//
+//=============================================================
+
+#include <cstring>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <iostream>
+
+#include "jfif_class.h"
+
+struct jpeg_stream
+{
+    jfif                    decoder;
+    jpeg_decode_opts_t      opts;               // Decode options (for the output size)
+    int                     debug_enable;
+
+    uint8_t                *ibuf;               // Input buffer, of max_size bytes plus a terminating EOI marker
+    long                    max_size;
+    long                    size;               // Bytes of input pushed so far
+
+    std::mutex              lock;               // Guards the state below, shared with the decode thread
+    std::condition_variable cond;
+    long                    avail;              // Bytes of input available to the decode
+    bool                    ended;              // Input ended (no more to be pushed)
+    bool                    header;             // Header (up to the start of the scan data) arrived
+    bool                    done;               // Decode completed, with its status
+    int                     status;
+
+    uint8_t                *obuf;               // Decoded bitmap and raw buffers, if selected
+    uint8_t                *rawbuf;
+
+    std::thread             thread;
+
+    jpeg_stream(int debug_enable_in) :
+        decoder(debug_enable_in), debug_enable(debug_enable_in), ibuf(NULL), max_size(0), size(0),
+        avail(0), ended(false), header(false), done(false), status(JPEG_NO_ERROR), obuf(NULL), rawbuf(NULL) {}
+};
+
+//-------------------------------------------------------------
+// jpeg_stream_wait()
+//
+// Description:
+//
+// Input wait function for the stream's decoder, suspending the
+// decode until n bytes of input from ptr have arrived, or the
+// input has ended.
+//
+// Parameters:
+//    ctx:      pointer to the stream
+//    ptr:      pointer into the input buffer
+//    n:        number of bytes needed from ptr
+//
+// Return value:
+//    Pointer to the end of the available input
+//
+
+static const uint8_t *jpeg_stream_wait (void *ctx, const uint8_t *ptr, int n)
+{
+    jpeg_stream_t               *stream = (jpeg_stream_t *)ctx;
+    std::unique_lock<std::mutex> guard(stream->lock);
+
+    while (!stream->ended && ptr + n > stream->ibuf + stream->avail)
+    {
+        stream->cond.wait(guard);
+    }
+
+    return stream->ibuf + stream->avail;
+}
+
+//-------------------------------------------------------------
+// jpeg_stream_decode()
+//
+// Description:
+//
+// Stream decode thread. Waits for the whole of the header (up to
+// the end of the SOS segment), as its segments arrive, then
+// decodes the image, waiting on jpeg_stream_wait() as the scan
+// data arrives.
+//
+// Parameters:
+//    stream:   pointer to the stream
+//
+// Return value:
+//    None
+//
+
+static void jpeg_stream_decode (jpeg_stream_t *stream)
+{
+    const uint8_t *ibuf     = stream->ibuf;
+    long           pos      = 0;
+    bool           complete = true;
+    int            status   = JPEG_NO_ERROR;
+
+    // Walk the header's marker segments as they arrive. Anything unexpected is left for
+    // the decode to report.
+    while ((complete = jpeg_stream_wait(stream, ibuf + pos, 4) >= ibuf + pos + 4))
+    {
+        int marker = (ibuf[pos] << 8) | ibuf[pos+1];
+
+        if (marker == JPEG_MKR_SOI)
+        {
+            pos += 2;
+            continue;
+        }
+
+        if (ibuf[pos] != JPEG_MARKER_BYTE || marker == JPEG_MKR_EOI || (marker & 0xfff8) == JPEG_MKR_RST0)
+        {
+            break;
+        }
+
+        long next = pos + 2 + ((ibuf[pos+2] << 8) | ibuf[pos+3]);
+
+        if (!(complete = jpeg_stream_wait(stream, ibuf + pos, (int)(next - pos)) >= ibuf + next) ||
+            marker == JPEG_MKR_SOS)
+        {
+            break;
+        }
+
+        pos = next;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(stream->lock);
+
+        stream->header = true;
+    }
+
+    stream->cond.notify_all();
+
+    if (!complete)
+    {
+        std::cerr << "ERROR: jpeg_stream_decode(): input ended within the header" << std::endl;
+        status = JPEG_FORMAT_ERROR;
+    }
+    else
+    {
+        status = stream->decoder.jpeg_process_jfif(stream->ibuf, &stream->obuf, &stream->rawbuf);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(stream->lock);
+
+        stream->status = status;
+        stream->done   = true;
+    }
+
+    stream->cond.notify_all();
+}
+
+//-------------------------------------------------------------
+// jpeg_stream_end()
+//
+// Description:
+//
+// Ends a stream's input, terminating it with an EOI marker (in
+// case it was truncated), and waits for the decode to complete.
+//
+// Parameters:
+//    stream:   pointer to the stream
+//
+// Return value:
+//    None
+//
+
+static void jpeg_stream_end (jpeg_stream_t *stream)
+{
+    if (!stream->thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(stream->lock);
+
+        stream->ibuf[stream->size]     = JPEG_MARKER_BYTE;
+        stream->ibuf[stream->size + 1] = JPEG_MKR_EOI & 0xff;
+        stream->avail                  = stream->size + 2;
+        stream->ended                  = true;
+    }
+
+    stream->cond.notify_all();
+    stream->thread.join();
+}
+
+//-------------------------------------------------------------
+// jpeg_stream_create_c()
+//
+// Description:
+//
+// Creates a stream, for decoding an image incrementally as its
+// data is pushed with jpeg_stream_push_c(), up to max_size bytes.
+// The decode thread is started, and waits for the data. The
+// input buffer is allocated up front, but, on most systems, only
+// takes memory as it is filled.
+//
+// Parameters:
+//    stream:       pointer to the returned stream (NULL on an error)
+//    opts:         pointer to decode options (NULL for defaults)
+//    max_size:     largest input size, in bytes
+//    debug_enable: Debug control (when compiled with JPEG_DEBUG_MODE)
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, JPEG_USER_INPUT_ERROR
+//    for invalid options or size, or JPEG_MEMORY_ERROR if the buffer
+//    can't be allocated, or the decode thread started.
+//
+
+extern "C" int jpeg_stream_create_c (jpeg_stream_t **stream, const jpeg_decode_opts_t *opts, long max_size, int debug_enable)
+{
+    int status = JPEG_NO_ERROR;
+
+    *stream = NULL;
+
+    if (max_size <= 0)
+    {
+        std::cerr << "ERROR: jpeg_stream_create_c(): invalid maximum input size (" << std::dec << max_size << ")" << std::endl;
+        return JPEG_USER_INPUT_ERROR;
+    }
+
+    try
+    {
+        *stream = new jpeg_stream(debug_enable);
+        (*stream)->ibuf = new uint8_t[max_size + 2];
+    }
+    catch(std::bad_alloc& ba)
+    {
+        std::cerr << "ERROR: jpeg_stream_create_c(): memory allocation error: " << ba.what() << std::endl;
+        delete *stream;
+        *stream = NULL;
+        return JPEG_MEMORY_ERROR;
+    }
+
+    if (opts != NULL)
+    {
+        (*stream)->opts = *opts;
+    }
+    else
+    {
+        jpeg_default_opts_c(&(*stream)->opts);
+    }
+
+    if ((status = (*stream)->decoder.jpeg_set_opts(&(*stream)->opts)))
+    {
+        jpeg_stream_free_c(*stream);
+        *stream = NULL;
+        return status;
+    }
+
+    (*stream)->max_size = max_size;
+    (*stream)->decoder.jpeg_set_input_wait(jpeg_stream_wait, *stream);
+
+    try
+    {
+        (*stream)->thread = std::thread(jpeg_stream_decode, *stream);
+    }
+    catch(std::system_error& se)
+    {
+        std::cerr << "ERROR: jpeg_stream_create_c(): could not start decode thread: " << se.what() << std::endl;
+        jpeg_stream_free_c(*stream);
+        *stream = NULL;
+        return JPEG_MEMORY_ERROR;
+    }
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_stream_push_c()
+//
+// Description:
+//
+// Pushes the next chunk of a stream's input, resuming the decode
+// if it was waiting for data. The chunk is copied, so its buffer
+// may be reused once this returns.
+//
+// Parameters:
+//    stream:   pointer to the stream
+//    data:     pointer to the chunk of data
+//    len:      number of bytes in the chunk
+//
+// Return value:
+//    Returns JPEG_NO_ERROR, or the decode's status if it has already
+//    failed. JPEG_USER_INPUT_ERROR returned if the input has ended, or
+//    would exceed the stream's maximum size.
+//
+
+extern "C" int jpeg_stream_push_c (jpeg_stream_t *stream, const uint8_t *data, long len)
+{
+    {
+        std::lock_guard<std::mutex> guard(stream->lock);
+
+        if (stream->done && stream->status != JPEG_NO_ERROR)
+        {
+            return stream->status;
+        }
+
+        if (stream->ended || len < 0 || len > stream->max_size - stream->size)
+        {
+            std::cerr << "ERROR: jpeg_stream_push_c(): input ended, or more than the maximum size ("
+                      << std::dec << stream->max_size << " bytes)" << std::endl;
+            return JPEG_USER_INPUT_ERROR;
+        }
+    }
+
+    // Only the data beyond avail is written, which the decode doesn't read until
+    // avail is updated
+    memcpy(stream->ibuf + stream->size, data, len);
+    stream->size += len;
+
+    {
+        std::lock_guard<std::mutex> guard(stream->lock);
+
+        stream->avail = stream->size;
+    }
+
+    stream->cond.notify_all();
+
+    return JPEG_NO_ERROR;
+}
+
+//-------------------------------------------------------------
+// jpeg_stream_output_size_c()
+//
+// Description:
+//
+// Waits for a stream's header to arrive, and returns the output
+// dimensions of the image (after any crop and resize in the
+// options), and its number of components, e.g. for setting up the
+// outputs that the decode's sinks write to. The decode doesn't
+// output any rows until the header has arrived. As this blocks,
+// it must be called from a thread other than the one pushing the
+// data, or once the header has been pushed.
+//
+// Parameters:
+//    stream:       pointer to the stream
+//    X:            pointer to the returned output width
+//    Y:            pointer to the returned output height
+//    components:   pointer to the returned number of components
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR
+//    on unexpected data or markers, or the input ending in the header.
+//
+
+extern "C" int jpeg_stream_output_size_c (jpeg_stream_t *stream, int *X, int *Y, int *components)
+{
+    long avail;
+
+    {
+        std::unique_lock<std::mutex> guard(stream->lock);
+
+        while (!stream->header)
+        {
+            stream->cond.wait(guard);
+        }
+
+        if (stream->done && stream->status != JPEG_NO_ERROR)
+        {
+            return stream->status;
+        }
+
+        avail = stream->avail;
+    }
+
+    // A separate decoder reads the header, bounded by the input arrived so far, as the
+    // stream's own is decoding
+    jfif decoder(stream->debug_enable);
+    int  status;
+
+    if ((status = decoder.jpeg_set_opts(&stream->opts)) ||
+        (status = decoder.jpeg_get_size(stream->ibuf, X, Y, components, avail)))
+    {
+        return status;
+    }
+
+    return decoder.jpeg_get_output_size(stream->ibuf, X, Y, avail);
+}
+
+//-------------------------------------------------------------
+// jpeg_stream_finish_c()
+//
+// Description:
+//
+// Ends a stream's input, and waits for its decode to complete.
+// Input ending before the EOI marker is decoded as if truncated,
+// with any rows not decoded output as black.
+//
+// Parameters:
+//    stream:   pointer to the stream
+//    obuf:     pointer to a buffer pointer, updated to point to bitmap output
+//    rawbuf:   pointer to a buffer pointer, updated to point to raw output
+//
+// Return value:
+//    Returns JPEG_NO_ERROR on successful completion, or JPEG_FORMAT_ERROR on
+//    unexpected data or markers.
+//
+
+extern "C" int jpeg_stream_finish_c (jpeg_stream_t *stream, uint8_t **obuf, uint8_t **rawbuf)
+{
+    jpeg_stream_end(stream);
+
+    // Ownership of the outputs passes to the caller
+    if (obuf != NULL)
+    {
+        *obuf = stream->obuf;
+        stream->obuf = NULL;
+    }
+
+    if (rawbuf != NULL)
+    {
+        *rawbuf = stream->rawbuf;
+        stream->rawbuf = NULL;
+    }
+
+    return stream->status;
+}
+
+//-------------------------------------------------------------
+// jpeg_stream_free_c()
+//
+// Description:
+//
+// Frees a stream created by jpeg_stream_create_c(), ending its
+// input, and waiting for its decode, if not already finished. Any
+// outputs not returned by jpeg_stream_finish_c() are freed.
+//
+// Parameters:
+//    stream:   stream to free (may be NULL)
+//
+// Return value:
+//    None
+//
+
+extern "C" void jpeg_stream_free_c (jpeg_stream_t *stream)
+{
+    if (stream != NULL)
+    {
+        jpeg_stream_end(stream);
+
+        delete [] stream->obuf;
+        delete [] stream->rawbuf;
+        delete [] stream->ibuf;
+        delete stream;
+    }
+}
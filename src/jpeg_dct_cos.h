@@ -26,10 +26,10 @@
 #define _JPEG_DCT_COS_
 
 //-------------------------------------------------------------
-// The following definitions are for the floating point/slow
-// integer based iDCT functions
-
-#ifndef JPEG_DCT_INTEGER
+// The following definitions are for the floating point and
+// slow integer based iDCT functions. Both sets of constants
+// are always defined, as the iDCT engine is selected at run
+// time.
 
 #define POSNUM0  0.3535533905932737     /* 1/sqrt(8) */
 #define POSNUM1  0.4903926402016152     /* 0.5 * cos (1/8 * 90 deg) */
@@ -40,21 +40,17 @@
 #define POSNUM6  0.1913417161825449     /* 0.5 * cos (6/8 * 90 deg) */
 #define POSNUM7  0.0975451610080642     /* 0.5 * cos (7/8 * 90 deg) */
 
-#else
-
 // Fixed point u0.9 bits (i.e. round (512 * num))
 #define JPEG_DCT_INT_SCALE      9
 
-#define POSNUM0                 181
-#define POSNUM1                 251
-#define POSNUM2                 237
-#define POSNUM3                 213
-#define POSNUM4                 181
-#define POSNUM5                 142
-#define POSNUM6                  98
-#define POSNUM7                  50
-
-#endif
+#define POSINT0                 181
+#define POSINT1                 251
+#define POSINT2                 237
+#define POSINT3                 213
+#define POSINT4                 181
+#define POSINT5                 142
+#define POSINT6                  98
+#define POSINT7                  50
 
 #define NEGNUM0 (-1 * POSNUM0)          /* -1/sqrt(8) */
 #define NEGNUM1 (-1 * POSNUM1)          /* 0.5 * cos (7/8 * 90 deg + 90 deg) */
@@ -65,6 +61,15 @@
 #define NEGNUM6 (-1 * POSNUM6)          /* 0.5 * cos (2/8 * 90 deg + 90 deg) */
 #define NEGNUM7 (-1 * POSNUM7)          /* 0.5 * cos (1/8 * 90 deg + 90 deg) */
 
+#define NEGINT0 (-1 * POSINT0)
+#define NEGINT1 (-1 * POSINT1)
+#define NEGINT2 (-1 * POSINT2)
+#define NEGINT3 (-1 * POSINT3)
+#define NEGINT4 (-1 * POSINT4)
+#define NEGINT5 (-1 * POSINT5)
+#define NEGINT6 (-1 * POSINT6)
+#define NEGINT7 (-1 * POSINT7)
+
 /*
    0   0   0   0   0   0   0    0
    1   3   5   7  -7  -5  -3   -1
@@ -77,17 +82,22 @@
 */
 
 
-#define JPEG_DCT_C_INIT {\
-    {POSNUM0, POSNUM0, POSNUM0, POSNUM0, POSNUM0, POSNUM0, POSNUM0, POSNUM0},\
-    {POSNUM1, POSNUM3, POSNUM5, POSNUM7, NEGNUM7, NEGNUM5, NEGNUM3, NEGNUM1},\
-    {POSNUM2, POSNUM6, NEGNUM6, NEGNUM2, NEGNUM2, NEGNUM6, POSNUM6, POSNUM2},\
-    {POSNUM3, NEGNUM7, NEGNUM1, NEGNUM5, POSNUM5, POSNUM1, POSNUM7, NEGNUM3},\
-    {POSNUM4, NEGNUM4, NEGNUM4, POSNUM4, POSNUM4, NEGNUM4, NEGNUM4, POSNUM4},\
-    {POSNUM5, NEGNUM1, POSNUM7, POSNUM3, NEGNUM3, NEGNUM7, POSNUM1, NEGNUM5},\
-    {POSNUM6, NEGNUM2, POSNUM2, NEGNUM6, NEGNUM6, POSNUM2, NEGNUM2, POSNUM6},\
-    {POSNUM7, NEGNUM5, POSNUM3, NEGNUM1, POSNUM1, NEGNUM3, POSNUM5, NEGNUM7},\
+// Cosine matrix, constructed from a positive (_P) and negative (_N)
+// constant set (e.g. POSNUM/NEGNUM or POSINT/NEGINT)
+#define JPEG_DCT_C_TABLE(_P, _N) {\
+    {_P##0, _P##0, _P##0, _P##0, _P##0, _P##0, _P##0, _P##0},\
+    {_P##1, _P##3, _P##5, _P##7, _N##7, _N##5, _N##3, _N##1},\
+    {_P##2, _P##6, _N##6, _N##2, _N##2, _N##6, _P##6, _P##2},\
+    {_P##3, _N##7, _N##1, _N##5, _P##5, _P##1, _P##7, _N##3},\
+    {_P##4, _N##4, _N##4, _P##4, _P##4, _N##4, _N##4, _P##4},\
+    {_P##5, _N##1, _P##7, _P##3, _N##3, _N##7, _P##1, _N##5},\
+    {_P##6, _N##2, _P##2, _N##6, _N##6, _P##2, _N##2, _P##6},\
+    {_P##7, _N##5, _P##3, _N##1, _P##1, _N##3, _P##5, _N##7},\
 }
 
+#define JPEG_DCT_C_INIT         JPEG_DCT_C_TABLE(POSNUM, NEGNUM)
+#define JPEG_DCT_C_INT_INIT     JPEG_DCT_C_TABLE(POSINT, NEGINT)
+
 //-------------------------------------------------------------
 // The following definitions are for the fast integer based
 // iDCT functions
@@ -107,5 +117,44 @@
 #define FIX_2_613125930         ((int)  669)            /* FIX(2.613125930) */
 #define FIX_NEG_2_613125930     ((int)  -669)           /* FIX(-2.613125930) */
 
+//-------------------------------------------------------------
+// AAN prescaling for the single precision floating point iDCT,
+// in natural order. Entry [r][c] is aan[r]*aan[c]/8, where
+// aan[0] = 1 and aan[k] = cos(k*pi/16) * sqrt(2), with the final
+// divide by 8 of the 2D iDCT folded in.
+
+#define JPEG_FLOAT_SCALING_INIT {\
+    0.125000000f, 0.173379981f, 0.163320371f, 0.146984450f, 0.125000000f, 0.098211870f, 0.067649513f, 0.034487422f,\
+    0.173379981f, 0.240484942f, 0.226531862f, 0.203873289f, 0.173379981f, 0.136223777f, 0.093832569f, 0.047835429f,\
+    0.163320371f, 0.226531862f, 0.213388348f, 0.192044439f, 0.163320371f, 0.128319992f, 0.088388348f, 0.045059989f,\
+    0.146984450f, 0.203873289f, 0.192044439f, 0.172835429f, 0.146984450f, 0.115484942f, 0.079547411f, 0.040552919f,\
+    0.125000000f, 0.173379981f, 0.163320371f, 0.146984450f, 0.125000000f, 0.098211870f, 0.067649513f, 0.034487422f,\
+    0.098211870f, 0.136223777f, 0.128319992f, 0.115484942f, 0.098211870f, 0.077164571f, 0.053151881f, 0.027096594f,\
+    0.067649513f, 0.093832569f, 0.088388348f, 0.079547411f, 0.067649513f, 0.053151881f, 0.036611652f, 0.018664459f,\
+    0.034487422f, 0.047835429f, 0.045059989f, 0.040552919f, 0.034487422f, 0.027096594f, 0.018664459f, 0.009515058f,\
+}
+
+//-------------------------------------------------------------
+// The following definitions are for the reduced size (4x4 and
+// 2x2) integer iDCTs, used when decoding at 1/2 and 1/4 scale.
+// Each transforms the lowest 4x4 (or 2x2) frequencies of a block,
+// with an N point 1D iDCT, scaled by 2*sqrt(2) as the 8 point one
+// is, so the output has the same final descale. The multipliers
+// are of the odd (and, for 4x4, the F2) terms, both for plain
+// de-quantised coefficients, and for the fast integer engine's
+// AAN prescaled ones, with the prescaling divided out. With 10
+// bit constants, no intermediate result can exceed 32 bits.
+
+#define RED_CONST_BITS          10
+#define RED_PASS_BITS           2
+
+// 4 point multipliers: F2, then F1 and F3 for outputs 0 and 3, and F1 and F3 for outputs 1 and 2
+#define JPEG_IDCT_4X4_INIT      {1024, 1338,  554,  554, 1338}   /* 1, sqrt(2)*cos(pi/8), sqrt(2)*cos(3pi/8), ... */
+#define JPEG_IDCT_4X4_AAN_INIT  { 784,  965,  471,  400, 1138}   /* The same, over aan[2], aan[1], aan[3], aan[1], aan[3] */
+
+// 2 point multipliers of F1
+#define JPEG_IDCT_2X2_MULT      1024                             /* 1 */
+#define JPEG_IDCT_2X2_AAN_MULT  738                              /* 1/aan[1] */
+
 #endif
 